@@ -15,9 +15,13 @@
  *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#ifndef RFC2440_H
+#define RFC2440_H
+
 #include <stdint.h>
 
 #define SALT_SIZE       (8u)
+#define ARGON2_SALT_SIZE (16u)
 
 /* S2K structures */
 
@@ -26,7 +30,8 @@ enum string_to_key
     SimpleS2K,
     SaltedS2K,
     ReservedS2K,
-    IteratedSaltedS2K
+    IteratedSaltedS2K,
+    Argon2S2K
 };
 struct salted_s2k
 {
@@ -59,6 +64,7 @@ enum old_packet_len
 #define PKT_LEN_TWO_MAX (8383u)
 #define PKT_LEN_LEADING (255u)
 #define PKT_LEN_FIVE_MAX (UINT16_T_MAX)
+#define PKT_LEN_INDETERMINATE (UINT32_MAX)
 
 #define PKT_LEN_PT      (224u)
 #define PKT_LEN_PT_MASK (0x1f)
@@ -85,7 +91,9 @@ enum packet_tags
     PktNone2,
     PktUserAttribute,
     PktSymEncIntegrityProtData,
-    PktMDC
+    PktMDC,
+    PktAEADEncData,
+    PktPadding
 };
 
 /***************************************************************************/
@@ -110,6 +118,7 @@ enum packet_tags
 
 #define SIG_VERSION_3_BAS (19u)
 #define SIG_VERSION_4_BAS (10u)
+#define SIG_VERSION_6_BAS (15u)
 #define SIG_SUBPACKET_LEN (2u)
 
 struct sig_subpacket
@@ -127,6 +136,7 @@ enum sub_packet_tags
     SubPktSigCreation = 2,
     SubPktSigExpiration,
     SubPktExportable,
+    SubPktTrust,
     SubPktRegex,
     SubPktRevocable,
     SubPktKeyExpiration = 9,
@@ -146,37 +156,53 @@ enum sub_packet_tags
     SubPktRevokeReason,
     SubPktFeatures,
     SubPktSigTarget,
-    SubPktSigEmbedded
+    SubPktSigEmbedded,
+    SubPktIssuerFingerprint,
+    SubPktPrefAEAD,
+    SubPktIntendedRecipient,
+    SubPktAttestedCerts = 37,
+    SubPktKeyBlock,
+    SubPktPrefAEADCiphersuites
 };
 
-#define SUB_PKT_NUM_TAGS (32u)
+#define SUB_PKT_NUM_TAGS (40u)
 #define SUB_PKT_CRITICAL (0x80)
-uint8_t sub_pkt_fixed_len[SUB_PKT_NUM_TAGS] =
+static const uint8_t sub_pkt_fixed_len[SUB_PKT_NUM_TAGS] =
 {
     0, 0,
-    4, 4, 1, 0, 1,
-    0, 0, 
+    4, 4, 1, 2, 0, 1,
+    0, 
     4, 0, 0, 22,
     0, 0, 0,
     8,
     0, 0, 0,
-    8, 0, 0, 0, 1, 0, 0, 0, 1, 0, 2, 0
+    0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0
 };
-uint8_t sub_pkt_variable[SUB_PKT_NUM_TAGS] =
+static const uint8_t sub_pkt_variable[SUB_PKT_NUM_TAGS] =
 {
     0, 0,
-    0, 0, 0, 1, 0,
-    0, 0, 
+    0, 0, 0, 0, 1, 0,
+    0, 
     0, 1, 1, 0,
     0, 0, 0,
     0,
     0, 0, 0,
-    1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1
+    1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 0, 1, 1, 1
 };
 					
 #define SUB_PKT_LEN_SIG_CREATION        (4u)
 #define SUB_PKT_LEN_SIG_EXPIRATION      (4u)
 
+/***************************************************************************/
+/* Key definitions                                                         */
+/***************************************************************************/
+
+#define KEY_VERSION_3_BAS (8u)
+#define KEY_VERSION_4_BAS (6u)
+#define KEY_VERSION_6_BAS (10u)
+
 /***************************************************************************/
 /* Other definitions                                                       */
 /***************************************************************************/
@@ -188,10 +214,15 @@ enum pub_key_tags
     PKAlgSignOnly,
     PKAlgElGamal = 16,
     PKAlgDSA,
-    PKAlgECCRsv,
-    PKAlgECDSARsv,
+    PKAlgECDH,
+    PKAlgECDSA,
     PKAlgReserved,
-    PKAlgDHRsv
+    PKAlgDHRsv,
+    PKAlgEdDSALegacy,
+    PKAlgX25519 = 25,
+    PKAlgX448,
+    PKAlgEd25519,
+    PKAlgEd448
 };
 
 enum sym_key_tags
@@ -204,7 +235,17 @@ enum sym_key_tags
     SKAlgAES128 = 7,
     SKAlgAES192,
     SKAlgAES256,
-    SKAlgTwofish256
+    SKAlgTwofish256,
+    SKAlgCamellia128,
+    SKAlgCamellia192,
+    SKAlgCamellia256
+};
+
+enum aead_tags
+{
+    AEADAlgEAX = 1,
+    AEADAlgOCB,
+    AEADAlgGCM
 };
 
 enum compression_tags
@@ -223,5 +264,9 @@ enum hash_tags
     HashAlgSHA256 = 8,
     HashAlgSHA384,
     HashAlgSHA512,
-    HashAlgSHA224
+    HashAlgSHA224,
+    HashAlgSHA3_256,
+    HashAlgSHA3_512 = 14
 };
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "grab.h"
+#include "armor.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+static const char armor_end[]    = "-----END PGP ";
+static const char armor_dashes[] = "-----";
+
+/***************************************************************************/
+/*                                                                         */
+/* What --carve and --mail share: the report text each holds back until    */
+/* the stripes or files before it have been printed, and the reading of    */
+/* ASCII armor.                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+/***************************************************************************/
+/*                                                                         */
+/* report_emit                                                             */
+/* INPUTS: report - the report this goes into                              */
+/*         format - printf format and arguments                            */
+/* RETURN: none                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+extern void report_emit (struct armor_report *report, const char *format, ...)
+{
+va_list args;
+char   *grown;
+size_t  size;
+int     n;
+
+    for (;;)
+    {
+        va_start (args, format);
+        n = vsnprintf (report->text + report->len, report->size - report->len, format, args);
+        va_end (args);
+        if (n < 0)
+        {
+            report->failed = TRUE;
+            return;
+        }
+        if ((size_t)n < report->size - report->len) break;
+        size  = report->size ? (report->size * 2u) : 4096u;
+        while (size < report->len + (size_t)n + 1u) size *= 2u;
+        grown = realloc (report->text, size);
+        if (grown == NULL)
+        {
+            report->failed = TRUE;
+            return;
+        }
+        report->text = grown;
+        report->size = size;
+    }
+    report->len += (size_t)n;
+}
+
+extern void report_hex (struct armor_report *report, const uint8_t *data, uint32_t len)
+{
+uint32_t i;
+
+    for (i = 0u; i < len; i++)
+    {
+        report_emit (report, "%02X", data[i]);
+    }
+}
+
+extern void report_date (struct armor_report *report, uint32_t when)
+{
+time_t    t = (time_t)when;
+struct tm tm;
+char      date[16];
+
+    gmtime_r (&t, &tm);
+    strftime (date, sizeof(date), "%Y-%m-%d", &tm);
+    report_emit (report, "%s", date);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* base64_value                                                            */
+/* INPUTS: c - an armor character                                          */
+/* RETURN: its six bit value, or 64 if it is not a base64 digit            */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t base64_value (uint8_t c)
+{
+    if ((c >= 'A') && (c <= 'Z')) return (uint8_t)(c - 'A');
+    if ((c >= 'a') && (c <= 'z')) return (uint8_t)(c - 'a' + 26);
+    if ((c >= '0') && (c <= '9')) return (uint8_t)(c - '0' + 52);
+    if (c == '+') return 62u;
+    if (c == '/') return 63u;
+    return 64u;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* base64_decode                                                           */
+/* INPUTS: p - start of base64 text                                        */
+/*         end - its end                                                   */
+/*         buf - buffer for the decoded octets, grown as needed            */
+/* RETURN: number of octets decoded, or zero if memory ran out             */
+/*                                                                         */
+/* Line breaks, padding and anything else that is not a base64 digit are   */
+/* passed over.                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+extern size_t base64_decode (const uint8_t *p, const uint8_t *end, struct grab_buffer *buf)
+{
+size_t   got = 0u;
+size_t   need;
+uint32_t acc = 0u;
+uint32_t bits = 0u;
+uint8_t *grown;
+uint8_t  val;
+
+    need = (size_t)(end - p) / 4u * 3u + 3u;
+    if (need > ARMOR_MAX) return 0u;
+    if (need > buf->size)
+    {
+        grown = realloc (buf->data, need);
+        if (grown == NULL) return 0u;
+        buf->data = grown;
+        buf->size = (uint32_t)need;
+    }
+    for (; p < end; p++)
+    {
+        val = base64_value (*p);
+        if (val > 63u) continue;
+        acc   = (acc << 6) | val;
+        bits += 6u;
+        if (bits < 8u) continue;
+        bits -= 8u;
+        buf->data[got++] = (uint8_t)(acc >> bits);
+    }
+    return got;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* armor_read                                                              */
+/* INPUTS: p - a BEGIN line                                                */
+/*         end - end of the text it is in                                  */
+/*         buf - buffer for the decoded data                               */
+/* OUTPUT: block - its label, where it ends and how much was decoded       */
+/* RETURN: FALSE if the BEGIN line is not one                              */
+/*                                                                         */
+/* The label is up to 64 printable characters closed by five dashes and    */
+/* the end of the line. The armor headers end at the first empty line,     */
+/* and the data at the CRC line, or at the END line if there is no CRC.    */
+/* The armor runs to the end of the END line, and no further than          */
+/* ARMOR_MAX octets. Clear signed text is not read; its block ends with    */
+/* the BEGIN line, and its signature has armor of its own.                 */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t armor_read (const uint8_t *p, const uint8_t *end, struct grab_buffer *buf,
+                           struct armor_block *block)
+{
+const uint8_t *label;
+const uint8_t *close;
+const uint8_t *line;
+const uint8_t *at;
+const uint8_t *data = NULL;
+const uint8_t *stop = NULL;
+
+    if ((size_t)(end - p) > ARMOR_MAX) end = p + ARMOR_MAX;
+    label = p + ARMOR_BEGIN_LEN;
+    close = memmem (label, (size_t)(end - label), armor_dashes, sizeof(armor_dashes) - 1u);
+    if ((close == NULL) || (close - label > 64)) return FALSE;
+    for (at = label; at < close; at++)
+    {
+        if ((*at < ' ') || (*at > '~')) return FALSE;
+    }
+    line = close + sizeof(armor_dashes) - 1u;
+    if ((line < end) && (*line == '\r')) line++;
+    if ((line >= end) || (*line != '\n')) return FALSE;
+    line++;
+
+    block->label        = label;
+    block->label_len    = (uint32_t)(close - label);
+    block->clear_signed = (block->label_len == 14u) && !memcmp (label, "SIGNED MESSAGE", 14u);
+    block->got          = 0u;
+    if (block->clear_signed)
+    {
+        block->end = line;
+        return TRUE;
+    }
+
+    /* walk the lines: headers, an empty line, then the data */
+    while (line < end)
+    {
+        at = memchr (line, '\n', (size_t)(end - line));
+        at = at ? at + 1 : end;
+        if (((size_t)(end - line) >= sizeof(armor_end) - 1u) &&
+                !memcmp (line, armor_end, sizeof(armor_end) - 1u))
+        {
+            if (stop == NULL) stop = line;
+            line = at;
+            break;
+        }
+        if (data && !stop && (*line == '='))
+        {
+            stop = line;
+        }
+        else if (!data && ((*line == '\n') || ((*line == '\r') && (line + 1 < end) &&
+                                               (line[1] == '\n'))))
+        {
+            data = line;
+        }
+        line = at;
+    }
+    block->end = line;
+    if (data != NULL) block->got = base64_decode (data, stop ? stop : line, buf);
+    return TRUE;
+}
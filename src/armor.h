@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARMOR_H
+#define ARMOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "grab.h"
+
+#define ARMOR_BEGIN     "-----BEGIN PGP "
+#define ARMOR_BEGIN_LEN (sizeof(ARMOR_BEGIN) - 1u)
+#define ARMOR_MAX       ((size_t)1u << 26)
+
+/* Report text held until it can be printed in order */
+
+struct armor_report
+{
+    char           *text;
+    size_t          len;
+    size_t          size;
+    uint8_t         failed;
+};
+
+/* One piece of armor, as read by armor_read */
+
+struct armor_block
+{
+    const uint8_t  *label;
+    uint32_t        label_len;
+    uint8_t         clear_signed;
+    const uint8_t  *end;
+    size_t          got;
+};
+
+extern void    report_emit (struct armor_report *report, const char *format, ...);
+extern void    report_hex (struct armor_report *report, const uint8_t *data, uint32_t len);
+extern void    report_date (struct armor_report *report, uint32_t when);
+extern size_t  base64_decode (const uint8_t *p, const uint8_t *end, struct grab_buffer *buf);
+extern uint8_t armor_read (const uint8_t *p, const uint8_t *end, struct grab_buffer *buf,
+                           struct armor_block *block);
+
+#endif
@@ -0,0 +1,884 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "digest.h"
+#include "resync.h"
+#include "armor.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/* Each thread takes a stripe at a time, working through it in blocks */
+/* small enough to stay in cache for the armor pass over them.        */
+
+#define CARVE_STRIPE    ((uint64_t)1u << 26)
+#define CARVE_BLOCK     ((uint64_t)1u << 18)
+#define CARVE_UID_SHOWN (64u)
+#define CARVE_TO_SHOWN  (4u)
+
+/* A wrapped session key, with its IV and tag, is never more than this */
+
+#define CARVE_SKESK_MAX (128u)
+
+/* Earliest creation time believed: PGP 1.0 was released in June 1991 */
+
+#define CARVE_EPOCH     (675993600ul)
+#define CARVE_FUTURE    (10ul * 366ul * 86400ul)
+
+/***************************************************************************/
+/*                                                                         */
+/* The image is mapped and cut into stripes, which the threads take in     */
+/* turn. In each stripe every octet which could open a key, signature or   */
+/* session key packet is tried as the start of a run of packets; the run   */
+/* is followed header by header for as long as each packet decodes, and is */
+/* kept if a signature in it decoded in full, or a session key was         */
+/* followed by encrypted data. A run that carries on past the end of its   */
+/* stripe is followed to its end, and the same run found part way through  */
+/* by the next stripe is dropped when the stripes are printed, in order.   */
+/* ASCII armor is found by its BEGIN line and decoded, and the runs in it  */
+/* are reported the same way.                                              */
+/*                                                                         */
+/***************************************************************************/
+
+struct carve_hit
+{
+    uint64_t        offset;
+    uint64_t        end;
+    size_t          text;
+    size_t          text_len;
+};
+
+struct carve_stripe
+{
+    uint64_t        start;
+    uint64_t        end;
+    struct carve_hit *hit;
+    size_t          hits;
+    size_t          hit_size;
+    struct armor_report report;
+    uint8_t         done;
+};
+
+struct carve_job
+{
+    const uint8_t  *base;
+    uint64_t        size;
+    uint32_t        now;
+    struct carve_stripe *stripe;
+    uint32_t        stripes;
+    uint32_t        next;
+    pthread_mutex_t lock;
+    pthread_cond_t  finished;
+};
+
+/* What a run of packets turned out to hold */
+
+struct carve_run
+{
+    uint8_t         first;
+    uint32_t        packets;
+    uint32_t        keys;
+    uint32_t        subkeys;
+    uint32_t        uids;
+    uint32_t        sigs;
+    uint32_t        pkesks;
+    uint32_t        skesks;
+    uint32_t        one_pass;
+    uint64_t        data;
+    uint8_t         encrypted;
+    struct pgp_key  key;
+    uint8_t         keyid[PKT_KEYID_LEN];
+    uint8_t         fpr[PKT_MAX_FPR];
+    uint8_t         fpr_len;
+    const uint8_t  *uid;
+    uint32_t        uid_len;
+    struct pgp_sig  sig;
+    uint8_t         to[CARVE_TO_SHOWN][PKT_KEYID_LEN];
+};
+
+/***************************************************************************/
+/*                                                                         */
+/* starts_run                                                              */
+/* INPUTS: val - a candidate first header octet                            */
+/* RETURN: TRUE for a public key encrypted or symmetric key encrypted      */
+/*         session key, signature, one pass signature, public or secret   */
+/*         key packet, which is everything a key block, certificate,      */
+/*         detached signature or message can open with                     */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t starts_run (uint8_t val)
+{
+uint8_t tag;
+
+    if (!(val & PKT_INDICATED)) return FALSE;
+    if (val & PKT_FORMAT_NEW)
+    {
+        tag = val & PKT_NEW_PACKET;
+    }
+    else
+    {
+        if ((val & PKT_OLD_LENGTH) == OldPartial) return FALSE;
+        tag = (val & PKT_OLD_PACKET) >> PKT_OLD_PKT_SHF;
+    }
+    return ((tag >= PktPKESKP) && (tag <= PktPublicKey));
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* next_start                                                              */
+/* INPUTS: p - where to start looking                                      */
+/*         end - where to stop                                             */
+/* RETURN: the first octet at or after p that starts_run, or end           */
+/*                                                                         */
+/* Those octets are 0x84 to 0x9a in the old format and 0xc1 to 0xc6 in    */
+/* the new, two ranges SSE2 tests 16 octets at a time; flipping the top    */
+/* bit first lets the signed compares do unsigned ranges. Each of these    */
+/* packets opens with a version from 2 to 6, which comes 2, 3, 5 or 6      */
+/* octets on depending on the length encoding, so candidates without one  */
+/* of those in any of the four places are dropped in the same pass.       */
+/*                                                                         */
+/***************************************************************************/
+
+static const uint8_t *next_start (const uint8_t *p, const uint8_t *end)
+{
+#ifdef __SSE2__
+const __m128i flip   = _mm_set1_epi8 ((char)0x80);
+const __m128i old_lo = _mm_set1_epi8 (0x84 - 0x80 - 1);
+const __m128i old_hi = _mm_set1_epi8 (0x9a - 0x80 + 1);
+const __m128i new_lo = _mm_set1_epi8 (0xc1 - 0x80 - 1);
+const __m128i new_hi = _mm_set1_epi8 (0xc6 - 0x80 + 1);
+const __m128i ver_lo = _mm_set1_epi8 (2 - 1);
+const __m128i ver_hi = _mm_set1_epi8 (6 + 1);
+__m128i  block, hits, ver;
+uint32_t mask;
+
+#define VERSION_AT(n) _mm_and_si128 ( \
+            _mm_cmpgt_epi8 (_mm_loadu_si128 ((const __m128i *)(p + (n))), ver_lo), \
+            _mm_cmplt_epi8 (_mm_loadu_si128 ((const __m128i *)(p + (n))), ver_hi))
+
+    while (end - p >= 16 + 6)
+    {
+        block = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *)p), flip);
+        hits  = _mm_or_si128 (
+                    _mm_and_si128 (_mm_cmpgt_epi8 (block, old_lo),
+                                   _mm_cmplt_epi8 (block, old_hi)),
+                    _mm_and_si128 (_mm_cmpgt_epi8 (block, new_lo),
+                                   _mm_cmplt_epi8 (block, new_hi)));
+        mask  = (uint32_t)_mm_movemask_epi8 (hits);
+        if (mask)
+        {
+            ver   = _mm_or_si128 (_mm_or_si128 (VERSION_AT (2), VERSION_AT (3)),
+                                  _mm_or_si128 (VERSION_AT (5), VERSION_AT (6)));
+            mask &= (uint32_t)_mm_movemask_epi8 (ver);
+        }
+        while (mask)
+        {
+            if (starts_run (p[__builtin_ctz (mask)])) return p + __builtin_ctz (mask);
+            mask &= mask - 1u;
+        }
+        p += 16;
+    }
+#undef VERSION_AT
+#endif
+    while ((p < end) && !starts_run (*p)) p++;
+    return p;
+}
+
+static uint8_t believable_time (uint32_t when, uint32_t now)
+{
+    return ((when >= CARVE_EPOCH) && (when <= now + CARVE_FUTURE));
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* mpi_end                                                                 */
+/* INPUTS: p - an MPI                                                      */
+/*         avail - octets available at p                                   */
+/* RETURN: octets it takes, or zero if it overruns or its bit count is     */
+/*         not exactly that of its leading octet, which cannot be zero    */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t mpi_end (const uint8_t *p, uint32_t avail)
+{
+uint32_t bits;
+uint32_t len;
+
+    if (avail < 3u) return 0u;
+    bits = ((uint32_t)p[0] << 8) | p[1];
+    len  = (bits + 7u) / 8u;
+    if ((len == 0u) || (len > avail - 2u) || (p[2] == 0u)) return 0u;
+    if ((32u - (uint32_t)__builtin_clz (p[2])) != bits - (len - 1u) * 8u) return 0u;
+    return len + 2u;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* fields_fit                                                              */
+/* INPUTS: alg - the public key algorithm                                  */
+/*         material - where the fields were read from                      */
+/*         len - length of the material                                    */
+/*         field - the fields                                              */
+/*         count - how many                                                */
+/*         exact - TRUE if the fields must use up the material             */
+/* RETURN: TRUE if every MPI has the bit count of its leading octet, which */
+/*         is not zero                                                     */
+/*                                                                         */
+/* Algorithms from X25519 on use fixed size native fields, not MPIs, as do */
+/* the KDF parameters which end an ECDH key.                               */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t fields_fit (uint8_t alg, const uint8_t *material, uint32_t len,
+                           const struct pgp_field *field, uint8_t count, uint8_t exact)
+{
+uint8_t mpis;
+uint8_t i;
+
+    if (count == 0u) return FALSE;
+    mpis = (alg == PKAlgECDH) ? (uint8_t)(count - 1u) : count;
+    for (i = 0u; (alg < PKAlgX25519) && (i < mpis); i++)
+    {
+        if ((field[i].len == 0u) || (field[i].data[0] == 0u) ||
+                ((32u - (uint32_t)__builtin_clz (field[i].data[0])) !=
+                 field[i].bits - (field[i].len - 1u) * 8u))
+        {
+            return FALSE;
+        }
+    }
+    return (!exact || (field[count - 1u].data + field[count - 1u].len == material + len));
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* pkesk_fits                                                              */
+/* INPUTS: pkesk - decoded session key packet                              */
+/* RETURN: TRUE if its material is exactly what its algorithm calls for    */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t pkesk_fits (const struct pgp_pkesk *pkesk)
+{
+const uint8_t *p = pkesk->material;
+uint32_t avail = pkesk->material_len;
+uint32_t used;
+
+    switch (pkesk->pk_alg)
+    {
+        case PKAlgEncryptAndSign:
+        case PKAlgEncryptOnly:
+            return (mpi_end (p, avail) == avail);
+        case PKAlgElGamal:
+            used = mpi_end (p, avail);
+            return (used && (mpi_end (p + used, avail - used) == avail - used));
+        case PKAlgECDH:
+            used = mpi_end (p, avail);
+            return (used && (used < avail) && (p[used] + 1u == avail - used));
+        case PKAlgX25519:
+            return ((avail > 33u) && (p[32] + 33u == avail));
+        case PKAlgX448:
+            return ((avail > 57u) && (p[56] + 57u == avail));
+        default:
+            return FALSE;
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* carve_packet                                                            */
+/* INPUTS: tag - the packet type                                           */
+/*         body - its whole body                                           */
+/*         len - length of the body                                        */
+/*         now - the current time                                          */
+/*         run - what the run holds so far                                 */
+/* RETURN: TRUE if the packet decodes, and is added to the run             */
+/*                                                                         */
+/* Keys and signatures must decode right through their key or signature    */
+/* material and carry a believable creation time.                          */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t carve_packet (uint8_t tag, const uint8_t *body, uint32_t len,
+                             uint32_t now, struct carve_run *run)
+{
+struct pgp_field  field[PKT_MAX_FIELDS];
+struct pgp_key    key;
+struct pgp_sig    sig;
+struct pgp_pkesk  pkesk;
+struct pgp_skesk  skesk;
+struct pgp_one_pass ops;
+uint8_t count;
+
+    switch (tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            if (!decode_public_key (body, len, &key) ||
+                    !key_fields (&key, field, &count) ||
+                    !fields_fit (key.algorithm, key.material, key.material_len,
+                                 field, count, FALSE) ||
+                    !believable_time (key.created, now))
+            {
+                return FALSE;
+            }
+            if ((tag == PktPublicKey) || (tag == PktSecretKey))
+            {
+                if (run->keys++ == 0u)
+                {
+                    run->key = key;
+                    key_fingerprint (body, len, run->fpr, &run->fpr_len, run->keyid);
+                }
+            }
+            else
+            {
+                run->subkeys++;
+            }
+            break;
+        case PktSignature:
+            if (!decode_signature (body, len, &sig) ||
+                    !sig_fields (&sig, field, &count) ||
+                    !fields_fit (sig.pk_alg, sig.material, sig.material_len,
+                                 field, count, TRUE) ||
+                    !believable_time (sig.created, now))
+            {
+                return FALSE;
+            }
+            if (run->sigs++ == 0u) run->sig = sig;
+            break;
+        case PktPKESKP:
+            if (!decode_pkesk (body, len, &pkesk) || !pkesk_fits (&pkesk)) return FALSE;
+            if ((run->pkesks < CARVE_TO_SHOWN) && (pkesk.recipient_len >= PKT_KEYID_LEN))
+            {
+                /* v4 key IDs are the tail of the fingerprint, v6 the head */
+                memcpy (run->to[run->pkesks], (pkesk.key_version == 4u) ?
+                        pkesk.recipient + pkesk.recipient_len - PKT_KEYID_LEN :
+                        pkesk.recipient, PKT_KEYID_LEN);
+            }
+            run->pkesks++;
+            break;
+        case PktSKESKP:
+            if (!decode_skesk (body, len, &skesk) ||
+                    (skesk.sym_alg < SKAlgIDEA) || (skesk.sym_alg > SKAlgCamellia256) ||
+                    (skesk.rest_len > CARVE_SKESK_MAX))
+            {
+                return FALSE;
+            }
+            run->skesks++;
+            break;
+        case PktOnePassSignature:
+            if (!decode_one_pass (body, len, &ops)) return FALSE;
+            run->one_pass++;
+            break;
+        case PktUserID:
+            if (run->uids++ == 0u)
+            {
+                run->uid     = body;
+                run->uid_len = len;
+            }
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* carve_run                                                               */
+/* INPUTS: p - candidate start of a run of packets                         */
+/*         avail - octets from p to the end of the image                   */
+/*         now - the current time                                          */
+/* RETURN: length of the run, or zero if there is nothing believable at p  */
+/* OUTPUT: run - what it holds                                             */
+/*                                                                         */
+/* A run stops before the next primary key, so each key block is reported  */
+/* on its own. Every key block worth having carries at least one self     */
+/* signature, so a key on its own is not believed.                         */
+/*                                                                         */
+/***************************************************************************/
+
+static uint64_t carve_run (const uint8_t *p, uint64_t avail, uint32_t now,
+                           struct carve_run *run)
+{
+struct resync_head head;
+uint64_t pos = 0u;
+size_t   end;
+
+    memset (run, 0, sizeof(*run));
+    while (pos < avail)
+    {
+        if (resync_parse (p + pos, avail - pos, TRUE, &head) != HeadGood) break;
+        if (!resync_body_end (p + pos, avail - pos, &head, &end)) break;
+        if (run->packets == 0u)
+        {
+            run->first = head.tag;
+        }
+        else if ((head.tag == PktPublicKey) || (head.tag == PktSecretKey))
+        {
+            break;
+        }
+        if (head.partial || is_stream (head.tag))
+        {
+            if (!run->pkesks && !run->skesks && !run->one_pass) break;
+            if ((head.tag == PktSymmetricEncData) || (head.tag == PktAEADEncData) ||
+                    (head.tag == PktSymEncIntegrityProtData))
+            {
+                run->encrypted = TRUE;
+            }
+            if (head.tag != PktLiteral) run->data += end - head.head;
+        }
+        else if (!carve_packet (head.tag, p + pos + head.head, head.len, now, run))
+        {
+            break;
+        }
+        run->packets++;
+        pos += end;
+    }
+    if (run->sigs || ((run->pkesks || run->skesks) && run->encrypted))
+    {
+        return pos;
+    }
+    return 0u;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* describe                                                                */
+/* INPUTS: stripe - where the report goes                                  */
+/*         prefix - put before the line                                    */
+/*         offset - where the run starts                                   */
+/*         len - its length                                                */
+/*         run - what it holds                                             */
+/* RETURN: none                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+static void describe (struct carve_stripe *stripe, const char *prefix, uint64_t offset,
+                      uint64_t len, const struct carve_run *run)
+{
+struct armor_report *out = &stripe->report;
+uint32_t i;
+uint32_t shown;
+
+    report_emit (out, "%s%" PRIu64 " %" PRIu64 " ", prefix, offset, len);
+    if (run->keys)
+    {
+        report_emit (out, "%s key v%u alg %u %u bits ",
+                   (run->first == PktSecretKey) ? "secret" : "public",
+                   run->key.version, run->key.algorithm, run->key.bits);
+        report_hex (out, run->fpr, run->fpr_len);
+        report_emit (out, " created ");
+        report_date (out, run->key.created);
+        report_emit (out, ", %u user IDs, %u subkeys, %u signatures",
+                   run->uids, run->subkeys, run->sigs);
+        if (run->uids)
+        {
+            shown = (run->uid_len > CARVE_UID_SHOWN) ? CARVE_UID_SHOWN : run->uid_len;
+            report_emit (out, ": %.*s", (int)shown, (const char *)run->uid);
+        }
+    }
+    else if (run->pkesks || run->skesks || run->one_pass)
+    {
+        report_emit (out, "message, %u public key and %u passphrase session keys",
+                   run->pkesks, run->skesks);
+        shown = (run->pkesks > CARVE_TO_SHOWN) ? CARVE_TO_SHOWN : run->pkesks;
+        for (i = 0u; i < shown; i++)
+        {
+            report_emit (out, i ? " " : " to ");
+            report_hex (out, run->to[i], PKT_KEYID_LEN);
+        }
+        report_emit (out, ", %" PRIu64 " bytes of data, %u signatures", run->data,
+                   run->sigs + run->one_pass);
+    }
+    else
+    {
+        report_emit (out, "%u signatures, the first v%u type 0x%02x", run->sigs,
+                   run->sig.version, run->sig.type);
+        if (run->sig.has_issuer)
+        {
+            report_emit (out, " by ");
+            report_hex (out, run->sig.issuer, PKT_KEYID_LEN);
+        }
+        report_emit (out, " made ");
+        report_date (out, run->sig.created);
+    }
+    report_emit (out, "\n");
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* record                                                                  */
+/* INPUTS: stripe - the stripe it was found in                             */
+/*         offset - where the find starts                                  */
+/*         end - where it ends                                             */
+/*         text - where its report starts in the stripe's text             */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* The report runs from text to whatever has been emitted since.           */
+/*                                                                         */
+/***************************************************************************/
+
+static void record (struct carve_stripe *stripe, uint64_t offset, uint64_t end,
+                    size_t text)
+{
+struct carve_hit *grown;
+size_t size;
+
+    if (stripe->hits == stripe->hit_size)
+    {
+        size  = stripe->hit_size ? (stripe->hit_size * 2u) : 64u;
+        grown = realloc (stripe->hit, size * sizeof(*grown));
+        if (grown == NULL)
+        {
+            stripe->report.failed = TRUE;
+            return;
+        }
+        stripe->hit      = grown;
+        stripe->hit_size = size;
+    }
+    stripe->hit[stripe->hits].offset   = offset;
+    stripe->hit[stripe->hits].end      = end;
+    stripe->hit[stripe->hits].text     = text;
+    stripe->hit[stripe->hits].text_len = stripe->report.len - text;
+    stripe->hits++;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* carve_armor                                                             */
+/* INPUTS: job - the image                                                 */
+/*         stripe - where the report goes                                  */
+/*         offset - where a BEGIN line was found                           */
+/*         buf - buffer for the decoded data                               */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* The armor is read by armor_read, and the runs in its data are listed    */
+/* after it. Clear signed text is only reported as far as the next BEGIN   */
+/* line.                                                                   */
+/*                                                                         */
+/***************************************************************************/
+
+static void carve_armor (const struct carve_job *job, struct carve_stripe *stripe,
+                         uint64_t offset, struct grab_buffer *buf)
+{
+struct armor_block block;
+struct carve_run run;
+const uint8_t *p;
+const uint8_t *end;
+const uint8_t *at;
+uint64_t avail;
+uint64_t found;
+size_t   text;
+
+    text  = stripe->report.len;
+    p     = job->base + offset;
+    avail = job->size - offset;
+    if (avail > ARMOR_MAX) avail = ARMOR_MAX;
+    end   = p + avail;
+    if (!armor_read (p, end, buf, &block)) return;
+
+    if (block.clear_signed)
+    {
+        /* the text runs to the signature armor, which is found on its own */
+        at    = memmem (block.end, (size_t)(end - block.end), ARMOR_BEGIN, ARMOR_BEGIN_LEN);
+        found = at ? (uint64_t)(at - p) : avail;
+        report_emit (&stripe->report, "%" PRIu64 " %" PRIu64 " armor %.*s\n", offset, found,
+                     (int)block.label_len, (const char *)block.label);
+        record (stripe, offset, offset + found, text);
+        return;
+    }
+
+    report_emit (&stripe->report, "%" PRIu64 " %" PRIu64 " armor %.*s, %zu bytes decoded\n",
+                 offset, (uint64_t)(block.end - p), (int)block.label_len,
+                 (const char *)block.label, block.got);
+
+    p   = buf->data;
+    end = p + block.got;
+    for (at = next_start (p, end); at < end; at = next_start (at, end))
+    {
+        found = carve_run (at, (uint64_t)(end - at), job->now, &run);
+        if (!found)
+        {
+            at++;
+            continue;
+        }
+        describe (stripe, "  +", (uint64_t)(at - p), found, &run);
+        at += found;
+    }
+    record (stripe, offset, (uint64_t)(block.end - job->base), text);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* carve_stripe                                                            */
+/* INPUTS: job - the image                                                 */
+/*         stripe - the part of it to search                               */
+/*         buf - buffer for decoded armor                                  */
+/* RETURN: none                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+static void carve_stripe (const struct carve_job *job, struct carve_stripe *stripe,
+                          struct grab_buffer *buf)
+{
+struct carve_run run;
+const uint8_t *p;
+const uint8_t *q;
+const uint8_t *stop;
+uint64_t block;
+uint64_t limit;
+uint64_t found;
+uint64_t skip = stripe->start;
+size_t   text;
+
+    for (block = stripe->start; block < stripe->end; block += CARVE_BLOCK)
+    {
+        limit = block + CARVE_BLOCK;
+        if (limit > stripe->end) limit = stripe->end;
+        stop = job->base + limit;
+        for (p = next_start (job->base + ((skip > block) ? skip : block), stop);
+                 p < stop; p = next_start (p, stop))
+        {
+            found = carve_run (p, job->size - (uint64_t)(p - job->base), job->now, &run);
+            if (!found)
+            {
+                p++;
+                continue;
+            }
+            text = stripe->report.len;
+            describe (stripe, "", (uint64_t)(p - job->base), found, &run);
+            record (stripe, (uint64_t)(p - job->base), (uint64_t)(p - job->base) + found,
+                    text);
+            if (stripe->report.failed) return;
+            p   += found;
+            skip = (uint64_t)(p - job->base);
+            if (p > stop) break;
+        }
+
+        /* a BEGIN line starting in this block may run on past it */
+        q    = job->base + block;
+        stop = job->base + ((limit + ARMOR_BEGIN_LEN - 1u < job->size) ?
+                            limit + ARMOR_BEGIN_LEN - 1u : job->size);
+        while ((q = memmem (q, (size_t)(stop - q), ARMOR_BEGIN, ARMOR_BEGIN_LEN)) != NULL)
+        {
+            carve_armor (job, stripe, (uint64_t)(q - job->base), buf);
+            if (stripe->report.failed) return;
+            q++;
+        }
+        madvise ((void *)((uintptr_t)(job->base + block) & ~(uintptr_t)4095u),
+                 (size_t)(limit - block), MADV_DONTNEED);
+    }
+}
+
+static void *carve_worker (void *arg)
+{
+struct carve_job  *job = arg;
+struct grab_buffer buf = { NULL, 0ul };
+uint32_t index;
+
+    for (;;)
+    {
+        pthread_mutex_lock (&job->lock);
+        index = job->next;
+        if (index < job->stripes) job->next++;
+        pthread_mutex_unlock (&job->lock);
+        if (index >= job->stripes) break;
+
+        carve_stripe (job, &job->stripe[index], &buf);
+
+        pthread_mutex_lock (&job->lock);
+        job->stripe[index].done = TRUE;
+        pthread_cond_broadcast (&job->finished);
+        pthread_mutex_unlock (&job->lock);
+    }
+    grab_release (&buf);
+    return NULL;
+}
+
+static int by_offset (const void *a, const void *b)
+{
+const struct carve_hit *x = a;
+const struct carve_hit *y = b;
+
+    if (x->offset != y->offset) return (x->offset < y->offset) ? -1 : 1;
+    return (x->end > y->end) ? -1 : (x->end < y->end);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* report                                                                  */
+/* INPUTS: stripe - a finished stripe                                      */
+/*         pCovered - end of the last find printed                         */
+/* RETURN: number of finds printed                                         */
+/*                                                                         */
+/* Armor is found after the runs of each block, so the finds are put back  */
+/* in order first. A run which starts inside one already printed is its    */
+/* tail, found by a stripe which began part way through it.                */
+/*                                                                         */
+/***************************************************************************/
+
+static uint64_t report (struct carve_stripe *stripe, uint64_t *pCovered)
+{
+struct carve_hit *hit;
+size_t   i;
+uint64_t printed = 0u;
+
+    if (stripe->hits) qsort (stripe->hit, stripe->hits, sizeof(*stripe->hit), by_offset);
+    for (i = 0u; i < stripe->hits; i++)
+    {
+        hit = &stripe->hit[i];
+        if (hit->offset < *pCovered) continue;
+        fwrite (stripe->report.text + hit->text, 1u, hit->text_len, stdout);
+        *pCovered = hit->end;
+        printed++;
+    }
+    return printed;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* carve_image                                                             */
+/* INPUTS: name - the image to search, which must be a regular file or     */
+/*                block device that can be mapped                          */
+/*         threads - worker threads                                        */
+/* RETURN: 0 if anything was found, 1 if nothing, 2 on trouble             */
+/*                                                                         */
+/* Each find is printed as its offset and length in octets and what it     */
+/* holds. The runs found within decoded armor follow it, indented and     */
+/* with offsets into the decoded data.                                     */
+/*                                                                         */
+/***************************************************************************/
+
+extern int carve_image (const char *name, uint32_t threads)
+{
+struct carve_job job;
+struct stat st;
+pthread_t *thread = NULL;
+uint64_t covered = 0u;
+uint64_t printed = 0u;
+uint64_t size;
+uint32_t started = 0u;
+uint32_t i;
+void    *map = MAP_FAILED;
+int      fd;
+int      status = 2;
+
+    memset (&job, 0, sizeof(job));
+    fd = open (name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        return (2u);
+    }
+    size = 0u;
+    if (!fstat (fd, &st))
+    {
+        size = S_ISBLK (st.st_mode) ? (uint64_t)lseek (fd, 0, SEEK_END) :
+                                      (uint64_t)st.st_size;
+    }
+    if (size == 0u)
+    {
+        fprintf (stderr, "%s: empty or cannot be mapped\n", name);
+        goto done;
+    }
+    map = mmap (NULL, (size_t)size, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        fprintf (stderr, "%s: cannot be mapped\n", name);
+        goto done;
+    }
+    madvise (map, (size_t)size, MADV_SEQUENTIAL);
+
+    job.base    = map;
+    job.size    = size;
+    job.now     = (uint32_t)time (NULL);
+    job.stripes = (uint32_t)((size + CARVE_STRIPE - 1u) / CARVE_STRIPE);
+    job.stripe  = calloc (job.stripes, sizeof(*job.stripe));
+    if (threads < 1u) threads = 1u;
+    if (threads > job.stripes) threads = job.stripes;
+    thread = calloc (threads, sizeof(*thread));
+    if ((job.stripe == NULL) || (thread == NULL)) goto done;
+    for (i = 0u; i < job.stripes; i++)
+    {
+        job.stripe[i].start = (uint64_t)i * CARVE_STRIPE;
+        job.stripe[i].end   = job.stripe[i].start + CARVE_STRIPE;
+        if (job.stripe[i].end > size) job.stripe[i].end = size;
+    }
+    pthread_mutex_init (&job.lock, NULL);
+    pthread_cond_init (&job.finished, NULL);
+    for (started = 0u; started < threads; started++)
+    {
+        if (pthread_create (&thread[started], NULL, carve_worker, &job)) break;
+    }
+    if (started == 0u) carve_worker (&job);
+
+    /* print the stripes in order as they finish */
+    status = 0;
+    for (i = 0u; i < job.stripes; i++)
+    {
+        pthread_mutex_lock (&job.lock);
+        while (!job.stripe[i].done) pthread_cond_wait (&job.finished, &job.lock);
+        pthread_mutex_unlock (&job.lock);
+        if (job.stripe[i].report.failed) status = 2;
+        printed += report (&job.stripe[i], &covered);
+        free (job.stripe[i].report.text);
+        free (job.stripe[i].hit);
+        job.stripe[i].report.text = NULL;
+        job.stripe[i].hit  = NULL;
+    }
+    for (i = 0u; i < started; i++)
+    {
+        pthread_join (thread[i], NULL);
+    }
+    pthread_cond_destroy (&job.finished);
+    pthread_mutex_destroy (&job.lock);
+    fflush (stdout);
+    if (!status && !printed) status = 1;
+
+done:
+    free (thread);
+    free (job.stripe);
+    if (map != MAP_FAILED) munmap (map, (size_t)size);
+    close (fd);
+    return status;
+}
@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/***************************************************************************/
+/*                                                                         */
+/* Column chunked file, all integers little endian:                        */
+/*                                                                         */
+/*   header  "PGPCOLS" 0x00, u32 version (1), u32 reserved                 */
+/*   chunk   u32 table, u32 rows, u32 columns, u32 reserved,               */
+/*           then per column u32 id, u32 width, u64 length,                */
+/*           then the column data in the same order, each padded with     */
+/*           zeros to a multiple of 8 octets                               */
+/*   end     a chunk with table 0 and no rows or columns                   */
+/*                                                                         */
+/* width is the octets per row, or 0 for the variable length text of the   */
+/* user ID dictionary. Rows of each table are numbered from 0 across all   */
+/* its chunks. The tables and columns are listed in the README.            */
+/*                                                                         */
+/***************************************************************************/
+
+#define COLUMNS_MAGIC   "PGPCOLS"
+#define COLUMNS_VERSION (1u)
+#define COLUMNS_BATCH   (65536u)
+#define MAX_COLUMNS     (10u)
+#define DICT_EMPTY      (UINT32_MAX)
+
+enum column_table
+{
+    TableEnd,
+    TableKeys,
+    TableSignatures,
+    TableUserIDText,
+    TableUserIDs
+};
+
+enum sig_target
+{
+    TargetKey,
+    TargetUserID,
+    TargetAttribute,
+    TargetSubkey
+};
+
+struct column
+{
+    uint32_t        id;
+    uint32_t        width;
+    uint8_t        *data;
+    size_t          len;
+    size_t          size;
+};
+
+struct table
+{
+    uint32_t        id;
+    uint32_t        count;
+    uint32_t        rows;
+    struct column   col[MAX_COLUMNS];
+};
+
+/* A key row, held until its key block ends so the expiry is known */
+
+struct key_row
+{
+    uint8_t         fpr[PKT_MAX_FPR];
+    uint8_t         fpr_len;
+    uint8_t         version;
+    uint8_t         algorithm;
+    uint16_t        bits;
+    uint32_t        created;
+    uint32_t        expires;
+    uint32_t        expiry_from;
+};
+
+/* Open addressed hash of the user ID texts seen so far */
+
+struct dict_slot
+{
+    uint32_t        id;
+    uint32_t        hash;
+    uint64_t        offset;
+    uint32_t        len;
+};
+
+struct columns_ctx
+{
+    FILE           *out;
+    uint8_t         failed;
+    struct table    keys;
+    struct table    sigs;
+    struct table    text;
+    struct table    uids;
+    uint64_t        key_rows;
+    struct key_row *pending;
+    uint32_t        pending_count;
+    uint32_t        pending_size;
+    uint32_t        current;
+    enum sig_target target;
+    struct dict_slot *slot;
+    uint32_t        slots;
+    uint32_t        dict_count;
+    uint8_t        *strings;
+    uint64_t        strings_len;
+    uint64_t        strings_size;
+    uint32_t        text_written;
+};
+
+static void table_init (struct table *table, uint32_t id, const uint32_t *width,
+                        uint32_t count)
+{
+uint32_t i;
+
+    memset (table, 0, sizeof(*table));
+    table->id    = id;
+    table->count = count;
+    for (i = 0u; i < count; i++)
+    {
+        table->col[i].id    = i + 1u;
+        table->col[i].width = width[i];
+    }
+}
+
+static uint8_t put (struct column *col, const void *value, size_t len)
+{
+uint8_t *grown;
+size_t   size;
+
+    if (col->len + len > col->size)
+    {
+        size = col->size ? col->size : (col->width ? col->width : 1u) * COLUMNS_BATCH;
+        while (size < col->len + len) size *= 2u;
+        grown = realloc (col->data, size);
+        if (grown == NULL) return FALSE;
+        col->data = grown;
+        col->size = size;
+    }
+    memcpy (col->data + col->len, value, len);
+    col->len += len;
+    return TRUE;
+}
+
+static void le (uint8_t *p, uint64_t value, uint32_t len)
+{
+uint32_t i;
+
+    for (i = 0u; i < len; i++)
+    {
+        p[i] = (uint8_t)(value >> (8u * i));
+    }
+}
+
+static uint8_t put_int (struct column *col, uint64_t value)
+{
+uint8_t octets[8];
+
+    le (octets, value, col->width);
+    return put (col, octets, col->width);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* flush_table                                                             */
+/* INPUTS: ctx - the columns context                                       */
+/*         table - the table whose batch is written out as one chunk       */
+/* RETURN: TRUE if written                                                 */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t flush_table (struct columns_ctx *ctx, struct table *table)
+{
+static const uint8_t zero[8];
+uint8_t  head[16];
+uint32_t i;
+size_t   pad;
+
+    if (!table->rows && (table->id != TableEnd)) return TRUE;
+    le (head, table->id, 4u);
+    le (head + 4, table->rows, 4u);
+    le (head + 8, table->count, 4u);
+    le (head + 12, 0u, 4u);
+    if (fwrite (head, 1u, 16u, ctx->out) != 16u) return FALSE;
+    for (i = 0u; i < table->count; i++)
+    {
+        le (head, table->col[i].id, 4u);
+        le (head + 4, table->col[i].width, 4u);
+        le (head + 8, table->col[i].len, 8u);
+        if (fwrite (head, 1u, 16u, ctx->out) != 16u) return FALSE;
+    }
+    for (i = 0u; i < table->count; i++)
+    {
+        pad = (8u - (table->col[i].len & 7u)) & 7u;
+        if ((fwrite (table->col[i].data, 1u, table->col[i].len, ctx->out) !=
+                     table->col[i].len) ||
+                (fwrite (zero, 1u, pad, ctx->out) != pad))
+        {
+            return FALSE;
+        }
+        table->col[i].len = 0u;
+    }
+    table->rows = 0u;
+    return TRUE;
+}
+
+static uint8_t row_done (struct columns_ctx *ctx, struct table *table)
+{
+    table->rows++;
+    if (table->rows < COLUMNS_BATCH) return TRUE;
+    if ((table == &ctx->uids) && !flush_table (ctx, &ctx->text)) return FALSE;
+    return flush_table (ctx, table);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* dict_id                                                                 */
+/* INPUTS: ctx - the columns context                                       */
+/*         text - user ID                                                  */
+/*         len - its length                                                */
+/* RETURN: the dictionary id of the text, or DICT_EMPTY if out of memory   */
+/*                                                                         */
+/* A text seen for the first time is given the next id and added to the    */
+/* dictionary table, which is always written before the user IDs that      */
+/* refer to it.                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t dict_hash (const uint8_t *text, uint32_t len)
+{
+uint32_t hash = 2166136261u;
+uint32_t i;
+
+    for (i = 0u; i < len; i++)
+    {
+        hash = (hash ^ text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint8_t dict_grow (struct columns_ctx *ctx)
+{
+struct dict_slot *slot;
+uint32_t slots, i, j;
+
+    slots = ctx->slots ? ctx->slots * 2u : 4096u;
+    slot  = malloc (slots * sizeof(*slot));
+    if (slot == NULL) return FALSE;
+    for (i = 0u; i < slots; i++)
+    {
+        slot[i].id = DICT_EMPTY;
+    }
+    for (i = 0u; i < ctx->slots; i++)
+    {
+        if (ctx->slot[i].id == DICT_EMPTY) continue;
+        for (j = ctx->slot[i].hash & (slots - 1u); slot[j].id != DICT_EMPTY;
+                 j = (j + 1u) & (slots - 1u));
+        slot[j] = ctx->slot[i];
+    }
+    free (ctx->slot);
+    ctx->slot  = slot;
+    ctx->slots = slots;
+    return TRUE;
+}
+
+static uint32_t dict_id (struct columns_ctx *ctx, const uint8_t *text, uint32_t len)
+{
+struct dict_slot *slot;
+uint8_t  *grown;
+uint64_t  size;
+uint32_t  hash, j;
+uint8_t   end[4];
+
+    if ((ctx->dict_count + 1u) * 2u > ctx->slots && !dict_grow (ctx)) return DICT_EMPTY;
+    hash = dict_hash (text, len);
+    for (j = hash & (ctx->slots - 1u); ctx->slot[j].id != DICT_EMPTY;
+             j = (j + 1u) & (ctx->slots - 1u))
+    {
+        slot = &ctx->slot[j];
+        if ((slot->hash == hash) && (slot->len == len) &&
+                !memcmp (ctx->strings + slot->offset, text, len))
+        {
+            return slot->id;
+        }
+    }
+
+    if (ctx->strings_len + len > ctx->strings_size)
+    {
+        size = ctx->strings_size ? ctx->strings_size : (1u << 20);
+        while (size < ctx->strings_len + len) size *= 2u;
+        grown = realloc (ctx->strings, size);
+        if (grown == NULL) return DICT_EMPTY;
+        ctx->strings      = grown;
+        ctx->strings_size = size;
+    }
+    memcpy (ctx->strings + ctx->strings_len, text, len);
+    slot         = &ctx->slot[j];
+    slot->id     = ctx->dict_count++;
+    slot->hash   = hash;
+    slot->offset = ctx->strings_len;
+    slot->len    = len;
+    ctx->strings_len += len;
+
+    /* end offsets are relative to the chunk's own text column */
+    le (end, ctx->text.col[1].len + len, 4u);
+    if (!put (&ctx->text.col[0], end, 4u) || !put (&ctx->text.col[1], text, len))
+    {
+        return DICT_EMPTY;
+    }
+    if (!row_done (ctx, &ctx->text)) return DICT_EMPTY;
+    return slot->id;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* flush_keys                                                              */
+/* INPUTS: ctx - the columns context                                       */
+/* RETURN: TRUE if the held key rows were added                            */
+/*                                                                         */
+/* The primary is row key_rows, its subkeys the rows after it, matching    */
+/* the key column the block's signatures and user IDs were given.          */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t flush_keys (struct columns_ctx *ctx)
+{
+const struct key_row *row;
+uint64_t primary = ctx->key_rows;
+uint32_t i;
+
+    for (i = 0u; i < ctx->pending_count; i++)
+    {
+        row = &ctx->pending[i];
+        if (!put (&ctx->keys.col[0], row->fpr, PKT_MAX_FPR) ||
+                !put_int (&ctx->keys.col[1], row->fpr_len) ||
+                !put_int (&ctx->keys.col[2], row->version) ||
+                !put_int (&ctx->keys.col[3], row->algorithm) ||
+                !put_int (&ctx->keys.col[4], row->bits) ||
+                !put_int (&ctx->keys.col[5], row->created) ||
+                !put_int (&ctx->keys.col[6], row->expires) ||
+                !put_int (&ctx->keys.col[7], primary) ||
+                !row_done (ctx, &ctx->keys))
+        {
+            return FALSE;
+        }
+        ctx->key_rows++;
+    }
+    ctx->pending_count = 0u;
+    return TRUE;
+}
+
+static uint8_t hold_key (struct columns_ctx *ctx, const struct keyring_packet *pkt)
+{
+struct key_row *row;
+struct pgp_key  key;
+uint8_t         keyid[PKT_KEYID_LEN];
+
+    if (ctx->pending_count == ctx->pending_size)
+    {
+        ctx->pending_size = ctx->pending_size ? ctx->pending_size * 2u : 16u;
+        row = realloc (ctx->pending, ctx->pending_size * sizeof(*row));
+        if (row == NULL) return FALSE;
+        ctx->pending = row;
+    }
+    row = &ctx->pending[ctx->pending_count];
+    memset (row, 0, sizeof(*row));
+    if (decode_public_key (pkt->body, pkt->len, &key))
+    {
+        row->version   = key.version;
+        row->algorithm = key.algorithm;
+        row->bits      = key.bits;
+        row->created   = key.created;
+        row->expires   = key_own_expiry (&key);
+        key_fingerprint (pkt->body, pkt->len, row->fpr, &row->fpr_len, keyid);
+    }
+    ctx->current = ctx->pending_count++;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* add_signature                                                           */
+/* INPUTS: ctx - the columns context                                       */
+/*         block - the key block being walked                              */
+/*         pkt - the signature packet                                      */
+/* RETURN: FALSE if out of memory                                          */
+/*                                                                         */
+/* A self signature's key expiration applies to the primary key, or for a  */
+/* subkey binding to the subkey; the latest such signature wins.           */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t add_signature (struct columns_ctx *ctx, const struct keyring_block *block,
+                              const struct keyring_packet *pkt)
+{
+struct pgp_sig  sig;
+struct key_row *row = NULL;
+
+    if (!decode_signature (pkt->body, pkt->len, &sig)) return TRUE;
+    if (ctx->pending_count && sig.has_issuer &&
+            !memcmp (sig.issuer, block->keyid, PKT_KEYID_LEN))
+    {
+        if (((ctx->target == TargetUserID) || (ctx->target == TargetKey)) &&
+                (sig.type != SIG_REVOKE_KEY) && (sig.type != SIG_REVOKE_CERT))
+        {
+            row = &ctx->pending[0];
+        }
+        else if ((ctx->target == TargetSubkey) && (sig.type == SIG_SUBKEY_BIND))
+        {
+            row = &ctx->pending[ctx->current];
+        }
+    }
+    if (row != NULL)
+    {
+        self_sig_expiry (&sig, row->created, &row->expiry_from, &row->expires);
+    }
+
+    if (!put_int (&ctx->sigs.col[0], ctx->key_rows) ||
+            !put (&ctx->sigs.col[1], sig.issuer, PKT_KEYID_LEN) ||
+            !put_int (&ctx->sigs.col[2], sig.type) ||
+            !put_int (&ctx->sigs.col[3], sig.version) ||
+            !put_int (&ctx->sigs.col[4], sig.pk_alg) ||
+            !put_int (&ctx->sigs.col[5], sig.hash_alg) ||
+            !put_int (&ctx->sigs.col[6], sig.created) ||
+            !put_int (&ctx->sigs.col[7], sig.expires ? sig.created + sig.expires : 0u) ||
+            !put_int (&ctx->sigs.col[8], ctx->target))
+    {
+        return FALSE;
+    }
+    return row_done (ctx, &ctx->sigs);
+}
+
+static uint8_t columns_collect (void *ctx_in, const struct keyring_block *block,
+                                const struct keyring_packet *pkt)
+{
+struct columns_ctx *ctx = ctx_in;
+uint32_t id;
+
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            if (!flush_keys (ctx) || !hold_key (ctx, pkt)) goto fail;
+            ctx->target = TargetKey;
+            break;
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            if (!ctx->pending_count) break;
+            if (!hold_key (ctx, pkt)) goto fail;
+            ctx->target = TargetSubkey;
+            break;
+        case PktUserAttribute:
+            ctx->target = TargetAttribute;
+            break;
+        case PktUserID:
+            ctx->target = TargetUserID;
+            if (!ctx->pending_count) break;
+            id = dict_id (ctx, pkt->body, pkt->len);
+            if ((id == DICT_EMPTY) ||
+                    !put_int (&ctx->uids.col[0], ctx->key_rows) ||
+                    !put_int (&ctx->uids.col[1], id) ||
+                    !row_done (ctx, &ctx->uids))
+            {
+                goto fail;
+            }
+            break;
+        case PktSignature:
+            if (ctx->pending_count && !add_signature (ctx, block, pkt)) goto fail;
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+
+fail:
+    ctx->failed = TRUE;
+    return FALSE;
+}
+
+static void table_free (struct table *table)
+{
+uint32_t i;
+
+    for (i = 0u; i < table->count; i++)
+    {
+        free (table->col[i].data);
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* columns_export                                                          */
+/* INPUTS: name - keyring to read, or "-" for standard input               */
+/*         out_name - column file to write                                 */
+/* RETURN: 0 on success, 1 on failure                                      */
+/*                                                                         */
+/***************************************************************************/
+
+extern int columns_export (const char *name, const char *out_name)
+{
+static const uint32_t key_width[]  = { PKT_MAX_FPR, 1u, 1u, 1u, 2u, 4u, 4u, 8u };
+static const uint32_t sig_width[]  = { 8u, PKT_KEYID_LEN, 1u, 1u, 1u, 1u, 4u, 4u, 1u };
+static const uint32_t text_width[] = { 4u, 0u };
+static const uint32_t uid_width[]  = { 8u, 4u };
+struct columns_ctx ctx;
+struct table       end;
+struct source     *src;
+uint8_t            head[16];
+uint8_t            ok = FALSE;
+
+    memset (&ctx, 0, sizeof(ctx));
+    table_init (&ctx.keys, TableKeys, key_width, 8u);
+    table_init (&ctx.sigs, TableSignatures, sig_width, 9u);
+    table_init (&ctx.text, TableUserIDText, text_width, 2u);
+    table_init (&ctx.uids, TableUserIDs, uid_width, 2u);
+    table_init (&end, TableEnd, NULL, 0u);
+
+    src     = source_open (name);
+    ctx.out = fopen (out_name, "wb");
+    if ((src == NULL) || (ctx.out == NULL))
+    {
+        fprintf (stderr, "%s: cannot open\n", (src == NULL) ? name : out_name);
+        goto done;
+    }
+    memcpy (head, COLUMNS_MAGIC, 8u);
+    le (head + 8, COLUMNS_VERSION, 4u);
+    le (head + 12, 0u, 4u);
+    if (fwrite (head, 1u, 16u, ctx.out) != 16u) goto done;
+
+    if (!keyring_walk (src, 0u, columns_collect, &ctx) && !ctx.failed)
+    {
+        fprintf (stderr, "%s: malformed packet, rest of file ignored\n", name);
+    }
+    ok = !ctx.failed && flush_keys (&ctx) &&
+         flush_table (&ctx, &ctx.keys) && flush_table (&ctx, &ctx.sigs) &&
+         flush_table (&ctx, &ctx.text) && flush_table (&ctx, &ctx.uids) &&
+         flush_table (&ctx, &end) && !fflush (ctx.out);
+    if (ok)
+    {
+        fprintf (stderr, "%llu keys, %u distinct user IDs\n",
+                 (unsigned long long)ctx.key_rows, ctx.dict_count);
+    }
+
+done:
+    if (ctx.out && fclose (ctx.out)) ok = FALSE;
+    source_close (src);
+    table_free (&ctx.keys);
+    table_free (&ctx.sigs);
+    table_free (&ctx.text);
+    table_free (&ctx.uids);
+    free (ctx.pending);
+    free (ctx.slot);
+    free (ctx.strings);
+    return ok ? 0 : 1;
+}
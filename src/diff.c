@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+#include "extsort.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+#define DIFF_SAME       (0)
+#define DIFF_CHANGED    (1)
+#define DIFF_TROUBLE    (2)
+
+/***************************************************************************/
+/*                                                                         */
+/* One record per key, user ID, attribute, subkey and signature. The sort  */
+/* key is everything up to the offset: the primary fingerprint, the kind   */
+/* of component and its content digest. The offset lets a delta be read   */
+/* back from its file for display.                                         */
+/*                                                                         */
+/***************************************************************************/
+
+enum diff_kind
+{
+    DiffKey,
+    DiffUserID,
+    DiffAttribute,
+    DiffSubkey,
+    DiffSignature
+};
+
+struct diff_record
+{
+    uint8_t         primary[PKT_MAX_FPR];
+    uint8_t         fpr_len;
+    uint8_t         kind;
+    uint8_t         sig_type;
+    uint8_t         reserved;
+    uint8_t         digest[DIGEST_LEN];
+    uint64_t        offset;
+};
+
+#define DIFF_KEY_LEN    (offsetof(struct diff_record, offset))
+
+static int compare_records (const void *a, const void *b)
+{
+    return memcmp (a, b, DIFF_KEY_LEN);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* diff_collect                                                            */
+/* INPUTS: ctx - the sort the records are added to                         */
+/*         block - the key block being walked                              */
+/*         pkt - the packet                                                */
+/* RETURN: FALSE if the record could not be stored                         */
+/*                                                                         */
+/* Secret keys and subkeys are recorded as their public counterparts; a    */
+/* primary key is identified by its fingerprint alone.                     */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t diff_collect (void *ctx, const struct keyring_block *block,
+                             const struct keyring_packet *pkt)
+{
+struct diff_record record;
+
+    if (!block->valid) return TRUE;
+    memset (&record, 0, sizeof(record));
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            record.kind = DiffKey;
+            break;
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            record.kind = DiffSubkey;
+            memcpy (record.digest, pkt->digest, DIGEST_LEN);
+            break;
+        case PktUserID:
+            record.kind = DiffUserID;
+            memcpy (record.digest, pkt->digest, DIGEST_LEN);
+            break;
+        case PktUserAttribute:
+            record.kind = DiffAttribute;
+            memcpy (record.digest, pkt->digest, DIGEST_LEN);
+            break;
+        case PktSignature:
+            if (pkt->len < 3u) return TRUE;
+            record.kind     = DiffSignature;
+            record.sig_type = (pkt->body[0] < 4u) ? pkt->body[2] : pkt->body[1];
+            memcpy (record.digest, pkt->digest, DIGEST_LEN);
+            break;
+        default:
+            return TRUE;
+    }
+    memcpy (record.primary, block->fpr, block->fpr_len);
+    record.fpr_len = block->fpr_len;
+    record.offset  = (uint64_t)pkt->offset;
+    return extsort_add ((struct extsort *)ctx, &record);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* build_set                                                               */
+/* INPUTS: src - open keyring                                              */
+/*         memory - bytes of records held in memory at once                */
+/* RETURN: the sorted component set of the keyring, or NULL if failed      */
+/*                                                                         */
+/***************************************************************************/
+
+static struct extsort *build_set (struct source *src, size_t memory)
+{
+struct extsort *sort;
+
+    sort = extsort_open (sizeof(struct diff_record), memory, compare_records);
+    if (sort == NULL) return NULL;
+    if (!keyring_walk (src, KEYRING_DIGESTS, diff_collect, sort) ||
+            !extsort_finish (sort))
+    {
+        extsort_close (sort);
+        return NULL;
+    }
+    return sort;
+}
+
+static void print_hex (const uint8_t *buf, uint32_t len)
+{
+uint32_t i;
+
+    for (i = 0ul; i < len; i++)
+    {
+        printf ("%02X", buf[i]);
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* report                                                                  */
+/* INPUTS: sign - '+' for a component only in NEW, '-' only in OLD         */
+/*         src - the keyring the component came from                       */
+/*         record - the component                                          */
+/*         buf - buffer for reading the packet back                        */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* Print one delta line: kind, primary fingerprint and a short summary of  */
+/* the packet itself.                                                      */
+/*                                                                         */
+/***************************************************************************/
+
+static void report (char sign, struct source *src, const struct diff_record *record,
+                    struct grab_buffer *buf)
+{
+enum packet_tags tag;
+struct pgp_key   key;
+struct pgp_sig   sig;
+uint8_t          fpr[PKT_MAX_FPR];
+uint8_t          keyid[PKT_KEYID_LEN];
+uint8_t          fpr_len;
+uint32_t         len = 0ul;
+const char      *label;
+
+    switch (record->kind)
+    {
+        case DiffKey:
+            label = "key";
+            break;
+        case DiffUserID:
+            label = "uid";
+            break;
+        case DiffAttribute:
+            label = "uat";
+            break;
+        case DiffSubkey:
+            label = "sub";
+            break;
+        default:
+            label = ((record->sig_type == SIG_REVOKE_KEY) ||
+                     (record->sig_type == SIG_REVOKE_SUBKEY) ||
+                     (record->sig_type == SIG_REVOKE_CERT)) ? "rev" : "sig";
+            break;
+    }
+    printf ("%c%s ", sign, label);
+    print_hex (record->primary, record->fpr_len);
+
+    if (!keyring_read_at (src, (off_t)record->offset, buf, &tag, &len))
+    {
+        printf ("\n");
+        return;
+    }
+    switch (record->kind)
+    {
+        case DiffKey:
+            if (decode_public_key (buf->data, len, &key))
+            {
+                printf (" v%d alg %d %d bits", key.version, key.algorithm, key.bits);
+            }
+            break;
+        case DiffUserID:
+            printf (" %.*s", (int)len, buf->data);
+            break;
+        case DiffSubkey:
+            if (key_fingerprint (buf->data, len, fpr, &fpr_len, keyid))
+            {
+                printf (" ");
+                print_hex (fpr, fpr_len);
+            }
+            break;
+        case DiffSignature:
+            if (decode_signature (buf->data, len, &sig))
+            {
+                printf (" type %02x", sig.type);
+                if (sig.has_issuer)
+                {
+                    printf (" by ");
+                    print_hex (sig.issuer, PKT_KEYID_LEN);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    printf ("\n");
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* diff_keyrings                                                           */
+/* INPUTS: old_name - the earlier snapshot                                 */
+/*         new_name - the later snapshot                                   */
+/*         memory - bytes of sort records held in memory for each file     */
+/* RETURN: 0 if the keyrings hold the same components, 1 if they differ,   */
+/*         2 on trouble, as diff(1)                                        */
+/*                                                                         */
+/* Each keyring is reduced to a sorted set of component records, spilling  */
+/* to disk as needed, and the two sets are merged in a single pass. Only   */
+/* the deltas are read back and printed.                                   */
+/*                                                                         */
+/***************************************************************************/
+
+extern int diff_keyrings (const char *old_name, const char *new_name, size_t memory)
+{
+struct source      *old_src;
+struct source      *new_src;
+struct extsort     *old_set = NULL;
+struct extsort     *new_set = NULL;
+struct grab_buffer  buf = { NULL, 0ul };
+struct diff_record  old_rec, new_rec, last;
+uint8_t             have_old, have_new;
+int                 order;
+int                 status = DIFF_TROUBLE;
+
+    old_src = source_open (old_name);
+    new_src = source_open (new_name);
+    if ((old_src == NULL) || (new_src == NULL)) goto done;
+    if (!old_src->seekable || !new_src->seekable)
+    {
+        fprintf (stderr, "--diff reads changed packets back, so needs regular files\n");
+        goto done;
+    }
+
+    old_set = build_set (old_src, memory);
+    if (old_set == NULL) goto done;
+    new_set = build_set (new_src, memory);
+    if (new_set == NULL) goto done;
+
+    status   = DIFF_SAME;
+    have_old = extsort_next (old_set, &old_rec);
+    have_new = extsort_next (new_set, &new_rec);
+    while (have_old || have_new)
+    {
+        if (!have_old)       order =  1;
+        else if (!have_new)  order = -1;
+        else                 order = compare_records (&old_rec, &new_rec);
+
+        if (order < 0)
+        {
+            report ('-', old_src, &old_rec, &buf);
+            status = DIFF_CHANGED;
+        }
+        else if (order > 0)
+        {
+            report ('+', new_src, &new_rec, &buf);
+            status = DIFF_CHANGED;
+        }
+
+        /* step past the current record, and any duplicates of it */
+        if (order <= 0)
+        {
+            last = old_rec;
+            while ((have_old = extsort_next (old_set, &old_rec)) &&
+                   !compare_records (&old_rec, &last));
+        }
+        if (order >= 0)
+        {
+            last = new_rec;
+            while ((have_new = extsort_next (new_set, &new_rec)) &&
+                   !compare_records (&new_rec, &last));
+        }
+    }
+
+done:
+    grab_release (&buf);
+    extsort_close (old_set);
+    extsort_close (new_set);
+    source_close (old_src);
+    source_close (new_src);
+    return status;
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <gcrypt.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "digest.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+#define FPR_V3_LEN      (16u)
+#define FPR_V4_LEN      (20u)
+#define FPR_V6_LEN      (32u)
+#define FPR_V4_PREFIX   (0x99)
+#define FPR_V5_PREFIX   (0x9a)
+#define FPR_V6_PREFIX   (0x9b)
+
+/***************************************************************************/
+/*                                                                         */
+/* digest_init                                                             */
+/* INPUTS: none                                                            */
+/* RETURN: TRUE if libgcrypt is usable                                     */
+/*                                                                         */
+/* Must be called once before any of the digest functions. We only hash    */
+/* public data, so the secure memory pool is not wanted.                   */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t digest_init (void)
+{
+    if (!gcry_check_version (GCRYPT_VERSION)) return FALSE;
+    gcry_control (GCRYCTL_DISABLE_SECMEM, 0);
+    gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* key_fingerprint                                                         */
+/* INPUTS: body - public or secret key packet body                         */
+/*         len - length of the body                                        */
+/* RETURN: TRUE if the key could be fingerprinted                          */
+/* OUTPUT: fpr - the fingerprint, up to PKT_MAX_FPR octets                 */
+/*         pFprLen - its length                                            */
+/*         keyid - the 64 bit key ID                                       */
+/*                                                                         */
+/* v3 keys: MD5 of the RSA modulus and exponent, key ID from the modulus.  */
+/* v4 keys: SHA-1 over 0x99, a two octet length and the public part, key   */
+/* ID from the tail. v5 and v6 keys: SHA-256 over 0x9a or 0x9b, a four     */
+/* octet length and the public part, key ID from the head.                 */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t key_fingerprint (const uint8_t *body, uint32_t len, uint8_t *fpr,
+                                uint8_t *pFprLen, uint8_t *keyid)
+{
+struct pgp_key   key;
+struct pgp_field field[PKT_MAX_FIELDS];
+gcry_buffer_t    iov[2];
+uint8_t          head[5];
+uint32_t         public_len;
+uint8_t          count;
+
+    if (!decode_public_key (body, len, &key)) return FALSE;
+    memset (iov, 0, sizeof(iov));
+
+    if (key.version < 4u)
+    {
+        if (!key_fields (&key, field, &count) || (count < 2u) ||
+                (field[0].len < PKT_KEYID_LEN))
+        {
+            return FALSE;
+        }
+        iov[0].data = (void *)field[0].data;
+        iov[0].len  = field[0].len;
+        iov[1].data = (void *)field[1].data;
+        iov[1].len  = field[1].len;
+        gcry_md_hash_buffers (GCRY_MD_MD5, 0, fpr, iov, 2);
+        memcpy (keyid, field[0].data + field[0].len - PKT_KEYID_LEN, PKT_KEYID_LEN);
+        *pFprLen = FPR_V3_LEN;
+        return TRUE;
+    }
+
+    public_len = key_public_len (body, &key);
+    if (!public_len) return FALSE;
+    iov[1].data = (void *)body;
+    iov[1].len  = public_len;
+    if (key.version == 4u)
+    {
+        head[0] = FPR_V4_PREFIX;
+        head[1] = (uint8_t)(public_len >> 8);
+        head[2] = (uint8_t)public_len;
+        iov[0].data = head;
+        iov[0].len  = 3u;
+        gcry_md_hash_buffers (GCRY_MD_SHA1, 0, fpr, iov, 2);
+        memcpy (keyid, fpr + FPR_V4_LEN - PKT_KEYID_LEN, PKT_KEYID_LEN);
+        *pFprLen = FPR_V4_LEN;
+        return TRUE;
+    }
+    head[0] = (key.version == 5u) ? FPR_V5_PREFIX : FPR_V6_PREFIX;
+    head[1] = (uint8_t)(public_len >> 24);
+    head[2] = (uint8_t)(public_len >> 16);
+    head[3] = (uint8_t)(public_len >> 8);
+    head[4] = (uint8_t)public_len;
+    iov[0].data = head;
+    iov[0].len  = 5u;
+    gcry_md_hash_buffers (GCRY_MD_SHA256, 0, fpr, iov, 2);
+    memcpy (keyid, fpr, PKT_KEYID_LEN);
+    *pFprLen = FPR_V6_LEN;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* content_digest                                                          */
+/* INPUTS: prefix - octets hashed ahead of the body, may be NULL           */
+/*         prefix_len - length of the prefix                               */
+/*         body - packet body                                              */
+/*         len - length of the body                                        */
+/* OUTPUT: digest - DIGEST_LEN octets identifying the content              */
+/*                                                                         */
+/***************************************************************************/
+
+extern void content_digest (const uint8_t *prefix, uint32_t prefix_len,
+                            const uint8_t *body, uint32_t len, uint8_t *digest)
+{
+gcry_buffer_t iov[2];
+
+    if (prefix == NULL)
+    {
+        gcry_md_hash_buffer (GCRY_MD_SHA1, digest, body, len);
+        return;
+    }
+    memset (iov, 0, sizeof(iov));
+    iov[0].data = (void *)prefix;
+    iov[0].len  = prefix_len;
+    iov[1].data = (void *)body;
+    iov[1].len  = len;
+    gcry_md_hash_buffers (GCRY_MD_SHA1, 0, digest, iov, 2);
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stdint.h>
+
+#include "packet.h"
+
+/* Content digests used to tell packets apart, SHA-1 sized */
+
+#define DIGEST_LEN      (20u)
+
+extern uint8_t digest_init (void);
+extern uint8_t key_fingerprint (const uint8_t *body, uint32_t len, uint8_t *fpr,
+                                uint8_t *pFprLen, uint8_t *keyid);
+extern void    content_digest (const uint8_t *prefix, uint32_t prefix_len,
+                               const uint8_t *body, uint32_t len, uint8_t *digest);
+
+#endif
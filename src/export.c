@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/sendfile.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+#include "export.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+#define COPY_CHUNK      ((size_t)1u << 30)
+#define PREAD_CHUNK     ((size_t)1u << 20)
+
+/***************************************************************************/
+/*                                                                         */
+/* Packets are never rewritten, only chosen. The kept packets are gathered */
+/* into runs of adjacent byte ranges of the input, each copied to the     */
+/* output by the kernel once the run is broken by a dropped packet. The    */
+/* walk reads the keys and signatures it must look at; attribute bodies    */
+/* are stepped over unread when they are being dropped.                    */
+/*                                                                         */
+/***************************************************************************/
+
+enum copy_method
+{
+    CopyRange,
+    CopySendfile,
+    CopyPread
+};
+
+struct export_key
+{
+    uint8_t         id[PKT_MAX_FPR];
+    uint8_t         len;
+};
+
+struct export_ctx
+{
+    uint8_t         flags;
+    struct export_key *keys;
+    uint32_t        key_count;
+    int             in;
+    int             out;
+    enum copy_method method;
+    off_t           run_start;
+    off_t           run_end;
+    uint8_t         keep_block;
+    uint8_t         drop_component;
+    uint8_t         failed;
+    uint64_t        kept;
+    uint64_t        dropped;
+};
+
+/***************************************************************************/
+/*                                                                         */
+/* copy_range                                                              */
+/* INPUTS: export - the export context                                     */
+/*         offset - start of the range in the input                        */
+/*         len - its length                                                */
+/* RETURN: TRUE if the whole range was written                             */
+/*                                                                         */
+/* copy_file_range first; if the kernel or the file systems will not do it */
+/* (output a pipe, or on another file system) sendfile, and failing that  */
+/* pread and write. Whichever works is kept for the rest of the export.    */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t copy_range (struct export_ctx *export, off_t offset, off_t len)
+{
+static uint8_t buffer[PREAD_CHUNK];
+ssize_t done;
+size_t  chunk;
+
+    while (len > 0)
+    {
+        chunk = ((size_t)len > COPY_CHUNK) ? COPY_CHUNK : (size_t)len;
+        switch (export->method)
+        {
+            case CopyRange:
+                done = copy_file_range (export->in, &offset, export->out, NULL, chunk, 0u);
+                if ((done < 0) && ((errno == EXDEV) || (errno == EINVAL) ||
+                                   (errno == ENOSYS) || (errno == EOPNOTSUPP) ||
+                                   (errno == EBADF)))
+                {
+                    export->method = CopySendfile;
+                    continue;
+                }
+                break;
+            case CopySendfile:
+                done = sendfile (export->out, export->in, &offset, chunk);
+                if ((done < 0) && ((errno == EINVAL) || (errno == ENOSYS)))
+                {
+                    export->method = CopyPread;
+                    continue;
+                }
+                break;
+            default:
+                if (chunk > PREAD_CHUNK) chunk = PREAD_CHUNK;
+                done = pread (export->in, buffer, chunk, offset);
+                if ((done > 0) && (write (export->out, buffer, (size_t)done) != done))
+                {
+                    done = -1;
+                }
+                if (done > 0) offset += done;
+                break;
+        }
+        if ((done < 0) && (errno == EINTR)) continue;
+        if (done <= 0) return FALSE;
+        len -= done;
+    }
+    return TRUE;
+}
+
+static uint8_t flush_run (struct export_ctx *export)
+{
+    if (export->run_end > export->run_start)
+    {
+        if (!copy_range (export, export->run_start, export->run_end - export->run_start))
+        {
+            return FALSE;
+        }
+    }
+    export->run_start = export->run_end = 0;
+    return TRUE;
+}
+
+static uint8_t selected (const struct export_ctx *export, const struct keyring_block *block)
+{
+uint32_t i;
+
+    if (!export->key_count) return TRUE;
+    if (!block->valid) return FALSE;
+    for (i = 0u; i < export->key_count; i++)
+    {
+        if ((export->keys[i].len == PKT_KEYID_LEN) &&
+                !memcmp (export->keys[i].id, block->keyid, PKT_KEYID_LEN))
+        {
+            return TRUE;
+        }
+        if ((export->keys[i].len == block->fpr_len) &&
+                !memcmp (export->keys[i].id, block->fpr, block->fpr_len))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* export_filter                                                           */
+/* INPUTS: ctx - the export context                                        */
+/*         block - the key block being walked                              */
+/*         pkt - the packet                                                */
+/* RETURN: FALSE to stop the walk when the output cannot be written        */
+/*                                                                         */
+/* A dropped attribute takes its signatures with it. Third party           */
+/* certifications are those over a user ID or attribute by any key but    */
+/* the block's own primary; signatures without an issuer are kept.         */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t export_filter (void *ctx, const struct keyring_block *block,
+                              const struct keyring_packet *pkt)
+{
+struct export_ctx *export = ctx;
+struct pgp_sig     sig;
+uint8_t            keep = TRUE;
+
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            export->keep_block     = selected (export, block);
+            export->drop_component = FALSE;
+            break;
+        case PktUserAttribute:
+            export->drop_component = (export->flags & EXPORT_NO_ATTRIBUTES) ? TRUE : FALSE;
+            break;
+        case PktUserID:
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            export->drop_component = FALSE;
+            break;
+        case PktSignature:
+            if (!(export->flags & EXPORT_NO_THIRD_PARTY) ||
+                    !decode_signature (pkt->body, pkt->len, &sig) || !sig.has_issuer)
+            {
+                break;
+            }
+            if ((((sig.type >= SIG_CERT_GENERIC) && (sig.type <= SIG_CERT_POSITIVE)) ||
+                    (sig.type == SIG_REVOKE_CERT)) &&
+                    memcmp (sig.issuer, block->keyid, PKT_KEYID_LEN))
+            {
+                keep = FALSE;
+            }
+            break;
+        default:
+            break;
+    }
+    if (!export->keep_block || export->drop_component) keep = FALSE;
+
+    if (!keep)
+    {
+        export->dropped++;
+        return TRUE;
+    }
+    export->kept++;
+    if (pkt->offset != export->run_end)
+    {
+        if (!flush_run (export))
+        {
+            export->failed = TRUE;
+            return FALSE;
+        }
+        export->run_start = pkt->offset;
+    }
+    export->run_end = pkt->end;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* export_keyring                                                          */
+/* INPUTS: name - keyring to read, a regular file                          */
+/*         out_name - keyring to write, or NULL for stdout                 */
+/*         flags - EXPORT_NO_ATTRIBUTES, EXPORT_NO_THIRD_PARTY             */
+/*         keys - key IDs or fingerprints of the blocks wanted, in hex     */
+/*         key_count - number of keys, zero for every block                */
+/* RETURN: 0 on success, 1 on failure                                      */
+/*                                                                         */
+/***************************************************************************/
+
+extern int export_keyring (const char *name, const char *out_name, uint8_t flags,
+                           char **keys, uint32_t key_count)
+{
+struct export_ctx export;
+struct source    *src = NULL;
+uint32_t          i;
+uint8_t           ok = FALSE;
+
+    memset (&export, 0, sizeof(export));
+    export.flags      = flags;
+    export.key_count  = key_count;
+    export.out        = -1;
+    export.keep_block = !key_count;
+    export.keys      = calloc (key_count + 1u, sizeof(*export.keys));
+    if (export.keys == NULL) goto done;
+    for (i = 0u; i < key_count; i++)
+    {
+        if (!parse_key_id (keys[i], export.keys[i].id, &export.keys[i].len))
+        {
+            fprintf (stderr, "%s: not a key ID or fingerprint\n", keys[i]);
+            goto done;
+        }
+    }
+
+    src = source_open (name);
+    if (src == NULL)
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        goto done;
+    }
+    if (!src->seekable)
+    {
+        fprintf (stderr, "--export copies packets by offset, so needs a regular file\n");
+        goto done;
+    }
+    export.in  = src->fd;
+    export.out = out_name ? open (out_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)
+                          : STDOUT_FILENO;
+    if (export.out < 0)
+    {
+        fprintf (stderr, "%s: cannot create\n", out_name);
+        goto done;
+    }
+
+    if (!keyring_walk (src, (flags & EXPORT_NO_ATTRIBUTES) ? KEYRING_SKIP_ATTRIBUTES : 0u,
+                       export_filter, &export) && !export.failed)
+    {
+        fprintf (stderr, "%s: malformed packet, rest of file ignored\n", name);
+    }
+    ok = !export.failed && flush_run (&export);
+    fprintf (stderr, "%llu packets kept, %llu dropped\n",
+             (unsigned long long)export.kept, (unsigned long long)export.dropped);
+
+done:
+    if (out_name && (export.out >= 0)) close (export.out);
+    source_close (src);
+    free (export.keys);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extsort.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+#define RUN_BUFFER      (1ul << 18)
+#define RUN_TEMPLATE    "/pgpscan.XXXXXX"
+
+struct extsort
+{
+    size_t          record_size;
+    size_t          capacity;
+    size_t          used;
+    size_t          next;
+    uint8_t        *records;
+    extsort_cmp     compare;
+    uint64_t        count;
+
+    FILE          **runs;
+    uint32_t        num_runs;
+    uint32_t       *heap;
+    uint32_t        heap_len;
+    uint8_t        *heads;
+};
+
+/***************************************************************************/
+/*                                                                         */
+/* open_run                                                                */
+/* INPUTS: none                                                            */
+/* RETURN: anonymous temporary file in $TMPDIR, or NULL if failed          */
+/*                                                                         */
+/***************************************************************************/
+
+static FILE *open_run (void)
+{
+const char *dir;
+char *path;
+FILE *run = NULL;
+int   fd;
+
+    dir = getenv ("TMPDIR");
+    if ((dir == NULL) || !*dir) dir = "/tmp";
+    path = malloc (strlen (dir) + sizeof(RUN_TEMPLATE));
+    if (path == NULL) return NULL;
+    strcpy (path, dir);
+    strcat (path, RUN_TEMPLATE);
+    fd = mkstemp (path);
+    if (fd >= 0)
+    {
+        unlink (path);
+        run = fdopen (fd, "w+b");
+        if (run == NULL) close (fd);
+    }
+    free (path);
+    return run;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* spill_run                                                               */
+/* INPUTS: sort - the sort                                                 */
+/* RETURN: TRUE if the records in memory were written out as a new run     */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t spill_run (struct extsort *sort)
+{
+FILE **grown;
+FILE  *run;
+
+    if (!sort->used) return TRUE;
+    qsort (sort->records, sort->used, sort->record_size, sort->compare);
+    grown = realloc (sort->runs, (sort->num_runs + 1u) * sizeof(FILE *));
+    if (grown == NULL) return FALSE;
+    sort->runs = grown;
+    run = open_run ();
+    if (run == NULL) return FALSE;
+    sort->runs[sort->num_runs++] = run;
+    if (fwrite (sort->records, sort->record_size, sort->used, run) != sort->used)
+    {
+        return FALSE;
+    }
+    sort->used = 0u;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* extsort_open                                                            */
+/* INPUTS: record_size - size of every record                              */
+/*         memory - bytes of records held before a run is spilled          */
+/*         compare - qsort style ordering of two records                   */
+/* RETURN: the new sort, or NULL if failed                                 */
+/*                                                                         */
+/***************************************************************************/
+
+extern struct extsort *extsort_open (size_t record_size, size_t memory,
+                                     extsort_cmp compare)
+{
+struct extsort *sort;
+
+    sort = calloc (1u, sizeof(*sort));
+    if (sort == NULL) return NULL;
+    sort->record_size = record_size;
+    sort->capacity    = memory / record_size;
+    if (sort->capacity < 2u) sort->capacity = 2u;
+    sort->compare     = compare;
+    sort->records     = malloc (sort->capacity * record_size);
+    if (sort->records == NULL)
+    {
+        free (sort);
+        return NULL;
+    }
+    return sort;
+}
+
+extern uint8_t extsort_add (struct extsort *sort, const void *record)
+{
+    if ((sort->used == sort->capacity) && !spill_run (sort)) return FALSE;
+    memcpy (sort->records + sort->used * sort->record_size, record,
+            sort->record_size);
+    sort->used++;
+    sort->count++;
+    return TRUE;
+}
+
+extern uint64_t extsort_count (const struct extsort *sort)
+{
+    return sort->count;
+}
+
+static uint8_t *head_of (struct extsort *sort, uint32_t run)
+{
+    return sort->heads + (size_t)run * sort->record_size;
+}
+
+static void sift_down (struct extsort *sort, uint32_t i)
+{
+uint32_t child;
+uint32_t swap;
+
+    for (;;)
+    {
+        child = 2u * i + 1u;
+        if (child >= sort->heap_len) break;
+        if ((child + 1u < sort->heap_len) &&
+                (sort->compare (head_of (sort, sort->heap[child + 1u]),
+                                head_of (sort, sort->heap[child])) < 0))
+        {
+            child++;
+        }
+        if (sort->compare (head_of (sort, sort->heap[child]),
+                           head_of (sort, sort->heap[i])) >= 0)
+        {
+            break;
+        }
+        swap               = sort->heap[i];
+        sort->heap[i]      = sort->heap[child];
+        sort->heap[child]  = swap;
+        i = child;
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* extsort_finish                                                          */
+/* INPUTS: sort - the sort, once every record has been added               */
+/* RETURN: TRUE if the sort is ready for extsort_next                      */
+/*                                                                         */
+/* If nothing was ever spilled the records are simply sorted in memory.    */
+/* Otherwise the last records are spilled too, the memory is given back    */
+/* and a heap is primed with the first record of every run.                */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t extsort_finish (struct extsort *sort)
+{
+uint32_t i;
+int32_t  j;
+
+    if (!sort->num_runs)
+    {
+        qsort (sort->records, sort->used, sort->record_size, sort->compare);
+        sort->next = 0u;
+        return TRUE;
+    }
+    if (!spill_run (sort)) return FALSE;
+    free (sort->records);
+    sort->records = NULL;
+
+    sort->heap  = malloc (sort->num_runs * sizeof(uint32_t));
+    sort->heads = malloc (sort->num_runs * sort->record_size);
+    if ((sort->heap == NULL) || (sort->heads == NULL)) return FALSE;
+    sort->heap_len = 0u;
+    for (i = 0u; i < sort->num_runs; i++)
+    {
+        if (fflush (sort->runs[i]) || fseeko (sort->runs[i], 0, SEEK_SET))
+        {
+            return FALSE;
+        }
+        setvbuf (sort->runs[i], NULL, _IOFBF, RUN_BUFFER);
+        if (fread (head_of (sort, i), sort->record_size, 1u, sort->runs[i]) == 1u)
+        {
+            sort->heap[sort->heap_len++] = i;
+        }
+    }
+    for (j = (int32_t)sort->heap_len / 2 - 1; j >= 0; j--)
+    {
+        sift_down (sort, (uint32_t)j);
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* extsort_next                                                            */
+/* INPUTS: sort - a finished sort                                          */
+/* RETURN: TRUE if a record was returned, FALSE once all are exhausted     */
+/* OUTPUT: record - the next record in order                               */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t extsort_next (struct extsort *sort, void *record)
+{
+uint32_t run;
+
+    if (!sort->num_runs)
+    {
+        if (sort->next >= sort->used) return FALSE;
+        memcpy (record, sort->records + sort->next * sort->record_size,
+                sort->record_size);
+        sort->next++;
+        return TRUE;
+    }
+    if (!sort->heap_len) return FALSE;
+    run = sort->heap[0];
+    memcpy (record, head_of (sort, run), sort->record_size);
+    if (fread (head_of (sort, run), sort->record_size, 1u, sort->runs[run]) != 1u)
+    {
+        sort->heap[0] = sort->heap[--sort->heap_len];
+    }
+    sift_down (sort, 0u);
+    return TRUE;
+}
+
+extern void extsort_close (struct extsort *sort)
+{
+uint32_t i;
+
+    if (sort == NULL) return;
+    for (i = 0u; i < sort->num_runs; i++)
+    {
+        fclose (sort->runs[i]);
+    }
+    free (sort->runs);
+    free (sort->heap);
+    free (sort->heads);
+    free (sort->records);
+    free (sort);
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/***************************************************************************/
+/* External merge sort of fixed size records                               */
+/*                                                                         */
+/* Records are collected in memory up to a limit, then sorted and spilled  */
+/* to a temporary run file. Once every record has been added the runs are  */
+/* merged back in order through a heap, reading each run sequentially.    */
+/***************************************************************************/
+
+typedef int (*extsort_cmp) (const void *a, const void *b);
+
+struct extsort;
+
+extern struct extsort *extsort_open (size_t record_size, size_t memory,
+                                     extsort_cmp compare);
+extern uint8_t extsort_add (struct extsort *sort, const void *record);
+extern uint8_t extsort_finish (struct extsort *sort);
+extern uint8_t extsort_next (struct extsort *sort, void *record);
+extern uint64_t extsort_count (const struct extsort *sort);
+extern void    extsort_close (struct extsort *sort);
+
+#endif
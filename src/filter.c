@@ -0,0 +1,718 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+#include "filter.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/***************************************************************************/
+/*                                                                         */
+/* Filter file, all integers little endian:                                */
+/*                                                                         */
+/*   header  "PGPFILT" 0x00, u32 version (1), u32 filters (2)              */
+/*   filters per filter u64 offset, u64 blocks, u64 items, u32 probes,     */
+/*           u32 zero                                                      */
+/*   blocks  from offset, 64 octet blocks of 512 bits each                 */
+/*                                                                         */
+/* An ID, the 8 octets of a key ID or the whole of a fingerprint, is       */
+/* hashed to 64 bits with FNV-1a and a final mix. The top 32 bits pick the */
+/* block, as (h >> 32) * blocks >> 32. For the probes, h has 0x9e3779b9   */
+/* 7f4a7c15 added and is mixed again, and each of its low seven 9 bit      */
+/* fields in turn, from the bottom, names a bit of the block; every seven  */
+/* probes the mixed value is put through the same again. Bit n of a block */
+/* bit n mod 8 of octet n / 8. The first filter holds the IDs of every     */
+/* key and subkey, the second those of each key revoked by itself or a     */
+/* designated revoker and of each subkey revoked by its primary key.       */
+/*                                                                         */
+/***************************************************************************/
+
+#define FILTER_MAGIC    "PGPFILT"
+#define FILTER_VERSION  (1u)
+#define FILTER_HEAD     (16u)
+#define FILTER_ENTRY    (32u)
+#define FILTER_BLOCK    (64u)
+#define FILTER_ALIGN    (64u)
+#define FILTER_MAX_PROBES (16u)
+#define FILTER_PER_MIX  (7u)
+#define FILTER_REMIX    (0x9e3779b97f4a7c15ull)
+
+struct filter_items
+{
+    uint64_t       *hash;
+    uint64_t        count;
+    uint64_t        size;
+};
+
+/* A signature's issuer, by key ID or whole fingerprint, or a revoker */
+
+struct filter_id
+{
+    uint8_t         id[PKT_MAX_FPR];
+    uint8_t         len;
+};
+
+struct filter_ids
+{
+    struct filter_id *id;
+    uint32_t        count;
+    uint32_t        size;
+};
+
+struct filter_ctx
+{
+    struct filter_items set[FILTER_SETS];
+    uint8_t         key_fpr[PKT_MAX_FPR];
+    uint8_t         key_fpr_len;
+    uint8_t         key_keyid[PKT_KEYID_LEN];
+    uint8_t         have_key;
+    uint8_t         key_revoked;
+    struct filter_ids pending;
+    struct filter_ids revoker;
+    uint8_t         subkey_fpr[PKT_MAX_FPR];
+    uint8_t         subkey_fpr_len;
+    uint8_t         subkey_keyid[PKT_KEYID_LEN];
+    uint8_t         have_subkey;
+    uint8_t         failed;
+};
+
+static uint64_t mix (uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t id_hash (const uint8_t *id, uint32_t len)
+{
+uint64_t hash = 14695981039346656037ull;
+uint32_t i;
+
+    for (i = 0u; i < len; i++)
+    {
+        hash = (hash ^ id[i]) * 1099511628211ull;
+    }
+    return mix (hash);
+}
+
+static void le (uint8_t *p, uint64_t value, uint32_t len)
+{
+uint32_t i;
+
+    for (i = 0u; i < len; i++)
+    {
+        p[i] = (uint8_t)(value >> (8u * i));
+    }
+}
+
+static uint64_t get_le (const uint8_t *p, uint32_t len)
+{
+uint64_t value = 0u;
+
+    while (len--)
+    {
+        value = (value << 8) | p[len];
+    }
+    return value;
+}
+
+static uint64_t block_of (uint64_t hash, uint64_t blocks)
+{
+    return (uint64_t)(((unsigned __int128)(hash >> 32) * blocks) >> 32);
+}
+
+/* Bit of the block for probe i, nine bits of hash at a time */
+
+static uint32_t probe_bit (uint64_t *pSeed, uint64_t *pBits, uint32_t i)
+{
+uint32_t bit;
+
+    if (!(i % FILTER_PER_MIX))
+    {
+        *pSeed = mix (*pSeed + FILTER_REMIX);
+        *pBits = *pSeed;
+    }
+    bit     = (uint32_t)*pBits & 511u;
+    *pBits >>= 9;
+    return bit;
+}
+
+static void set_bits (uint8_t *block, uint64_t hash, uint32_t probes)
+{
+uint64_t bits = 0u;
+uint32_t bit;
+uint32_t i;
+
+    for (i = 0u; i < probes; i++)
+    {
+        bit = probe_bit (&hash, &bits, i);
+        block[bit >> 3] |= (uint8_t)(1u << (bit & 7u));
+    }
+}
+
+static uint8_t test_bits (const uint8_t *block, uint64_t hash, uint32_t probes)
+{
+uint64_t bits = 0u;
+uint32_t bit;
+uint32_t i;
+
+    for (i = 0u; i < probes; i++)
+    {
+        bit = probe_bit (&hash, &bits, i);
+        if (!(block[bit >> 3] & (1u << (bit & 7u)))) return FALSE;
+    }
+    return TRUE;
+}
+
+static uint8_t add_id (struct filter_ctx *ctx, uint32_t set, const uint8_t *id,
+                       uint32_t len)
+{
+struct filter_items *items = &ctx->set[set];
+uint64_t *grown;
+
+    if (items->count == items->size)
+    {
+        items->size = items->size ? items->size * 2u : 65536u;
+        grown = realloc (items->hash, items->size * sizeof(*grown));
+        if (grown == NULL)
+        {
+            ctx->failed = TRUE;
+            return FALSE;
+        }
+        items->hash = grown;
+    }
+    items->hash[items->count++] = id_hash (id, len);
+    return TRUE;
+}
+
+static uint8_t add_key (struct filter_ctx *ctx, uint32_t set, const uint8_t *keyid,
+                        const uint8_t *fpr, uint8_t fpr_len)
+{
+    return add_id (ctx, set, keyid, PKT_KEYID_LEN) && add_id (ctx, set, fpr, fpr_len);
+}
+
+static uint8_t add_issuer (struct filter_ctx *ctx, struct filter_ids *ids,
+                           const uint8_t *id, uint32_t len)
+{
+struct filter_id *grown;
+
+    if (len > PKT_MAX_FPR) return TRUE;
+    if (ids->count == ids->size)
+    {
+        ids->size = ids->size ? ids->size * 2u : 16u;
+        grown = realloc (ids->id, ids->size * sizeof(*grown));
+        if (grown == NULL)
+        {
+            ctx->failed = TRUE;
+            return FALSE;
+        }
+        ids->id = grown;
+    }
+    memcpy (ids->id[ids->count].id, id, len);
+    ids->id[ids->count++].len = (uint8_t)len;
+    return TRUE;
+}
+
+/* Whether the primary key of the block made the signature */
+
+static uint8_t by_key (const struct filter_ctx *ctx, const struct pgp_sig *sig)
+{
+    if (!sig->has_issuer || memcmp (sig->issuer, ctx->key_keyid, PKT_KEYID_LEN))
+    {
+        return FALSE;
+    }
+    return (sig->issuer_fpr == NULL) ||
+           ((sig->issuer_fpr_len == ctx->key_fpr_len) &&
+            !memcmp (sig->issuer_fpr, ctx->key_fpr, ctx->key_fpr_len));
+}
+
+/* Whether an issuer is a revoker; v4 key IDs are the tail of the
+   fingerprint, v6 the head */
+
+static uint8_t is_revoker (const struct filter_id *issuer, const struct filter_id *revoker)
+{
+    if (issuer->len == PKT_KEYID_LEN)
+    {
+        return !memcmp (issuer->id, revoker->id + ((revoker->len == 20u) ? 12u : 0u),
+                        PKT_KEYID_LEN);
+    }
+    return (issuer->len == revoker->len) && !memcmp (issuer->id, revoker->id, issuer->len);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* block_end                                                               */
+/* INPUTS: ctx - the IDs gathered so far                                   */
+/* RETURN: FALSE if out of memory                                          */
+/*                                                                         */
+/* Revocations of the primary key by other keys are held until the whole  */
+/* block has been seen, as the self signatures naming its designated      */
+/* revokers usually come after them; any by a designated revoker counts.   */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t block_end (struct filter_ctx *ctx)
+{
+uint32_t i;
+uint32_t j;
+uint8_t  ok = TRUE;
+
+    for (i = 0u; ctx->have_key && !ctx->key_revoked && (i < ctx->pending.count); i++)
+    {
+        for (j = 0u; j < ctx->revoker.count; j++)
+        {
+            if (!is_revoker (&ctx->pending.id[i], &ctx->revoker.id[j])) continue;
+            ctx->key_revoked = TRUE;
+            ok = add_key (ctx, FILTER_REVOKED, ctx->key_keyid, ctx->key_fpr,
+                          ctx->key_fpr_len);
+            break;
+        }
+    }
+    ctx->pending.count = 0u;
+    ctx->revoker.count = 0u;
+    ctx->have_key      = FALSE;
+    return ok;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* key_signature                                                           */
+/* INPUTS: ctx - the IDs gathered so far                                   */
+/*         sig - a signature over the primary key or one of its user IDs   */
+/* RETURN: FALSE if out of memory                                          */
+/*                                                                         */
+/* The key's own self signatures name its designated revokers; its own    */
+/* revocation counts at once, one by another key only if that key turns    */
+/* out to be one of them.                                                  */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t key_signature (struct filter_ctx *ctx, const struct pgp_sig *sig)
+{
+struct pgp_subpacket sub;
+uint32_t offset = 0ul;
+
+    if (!ctx->have_key) return TRUE;
+    if (sig->type == SIG_REVOKE_KEY)
+    {
+        if (by_key (ctx, sig))
+        {
+            if (ctx->key_revoked) return TRUE;
+            ctx->key_revoked = TRUE;
+            return add_key (ctx, FILTER_REVOKED, ctx->key_keyid, ctx->key_fpr,
+                            ctx->key_fpr_len);
+        }
+        if (sig->issuer_fpr != NULL)
+        {
+            return add_issuer (ctx, &ctx->pending, sig->issuer_fpr, sig->issuer_fpr_len);
+        }
+        if (sig->has_issuer)
+        {
+            return add_issuer (ctx, &ctx->pending, sig->issuer, PKT_KEYID_LEN);
+        }
+        return TRUE;
+    }
+    if (((sig->type == SIG_DIRECT) ||
+         ((sig->type >= SIG_CERT_GENERIC) && (sig->type <= SIG_CERT_POSITIVE))) &&
+            by_key (ctx, sig))
+    {
+        /* class, algorithm, then the revoker's fingerprint */
+        while (next_subpacket (sig->hashed, sig->hashed_len, &offset, &sub))
+        {
+            if ((sub.type != SubPktRevocationKey) || (sub.len < 2u + 20u)) continue;
+            if (!add_issuer (ctx, &ctx->revoker, sub.data + 2, sub.len - 2u)) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* filter_collect                                                          */
+/* INPUTS: ctx - the IDs gathered so far                                   */
+/*         block - the key block being walked                              */
+/*         pkt - the packet                                                */
+/* RETURN: FALSE if out of memory                                          */
+/*                                                                         */
+/* A key revocation counts if it sits over the key and was issued by the   */
+/* key itself or by one of its designated revokers, a subkey revocation   */
+/* if it sits over the subkey and was issued by the primary key. Issuers  */
+/* are taken from the signature as it stands; whether it verifies is left */
+/* to --verify.                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t filter_collect (void *ctx_in, const struct keyring_block *block,
+                               const struct keyring_packet *pkt)
+{
+struct filter_ctx *ctx = ctx_in;
+struct pgp_sig     sig;
+
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            ctx->have_subkey = FALSE;
+            if (!block_end (ctx)) return FALSE;
+            ctx->have_key    = block->valid;
+            ctx->key_revoked = FALSE;
+            if (block->valid)
+            {
+                memcpy (ctx->key_fpr, block->fpr, block->fpr_len);
+                memcpy (ctx->key_keyid, block->keyid, PKT_KEYID_LEN);
+                ctx->key_fpr_len = block->fpr_len;
+                return add_key (ctx, FILTER_KNOWN, block->keyid, block->fpr,
+                                block->fpr_len);
+            }
+            break;
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            ctx->have_subkey = key_fingerprint (pkt->body, pkt->len, ctx->subkey_fpr,
+                                                &ctx->subkey_fpr_len, ctx->subkey_keyid);
+            if (ctx->have_subkey)
+            {
+                return add_key (ctx, FILTER_KNOWN, ctx->subkey_keyid, ctx->subkey_fpr,
+                                ctx->subkey_fpr_len);
+            }
+            break;
+        case PktSignature:
+            if (!decode_signature (pkt->body, pkt->len, &sig)) break;
+            if ((sig.type == SIG_REVOKE_KEY) && (block->component != PktPublicKey)) break;
+            if ((block->component == PktPublicKey) || (block->component == PktUserID))
+            {
+                return key_signature (ctx, &sig);
+            }
+            if ((sig.type == SIG_REVOKE_SUBKEY) && ctx->have_subkey && by_key (ctx, &sig) &&
+                    ((block->component == PktPublicSubkey) ||
+                     (block->component == PktSecretSubkey)))
+            {
+                return add_key (ctx, FILTER_REVOKED, ctx->subkey_keyid, ctx->subkey_fpr,
+                                ctx->subkey_fpr_len);
+            }
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* parse_rate                                                              */
+/* INPUTS: text - false positive rate wanted, such as 0.001 or 1/1000      */
+/* RETURN: the bits of filter to spend per ID, or 0 if not understood      */
+/* OUTPUT: pProbes - probes per ID                                         */
+/*                                                                         */
+/* A plain Bloom filter needs 1.44 log2(1/p) bits per ID; blocking costs   */
+/* a little more, made up with two bits and a quarter of log2(1/p). The    */
+/* probes are ln 2 times the bits per ID.                                  */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t parse_rate (const char *text, uint32_t *pProbes)
+{
+double   rate;
+double   over;
+char    *end;
+uint32_t halvings = 0u;
+uint32_t bits;
+
+    rate = strtod (text, &end);
+    if ((*end == '/') && (rate > 0.0))
+    {
+        over = strtod (end + 1, &end);
+        if (over <= 0.0) return 0u;
+        rate /= over;
+    }
+    if (*end || !(rate > 0.0) || !(rate < 1.0)) return 0u;
+    for (; (rate < 1.0) && (halvings < 40u); rate *= 2.0)
+    {
+        halvings++;
+    }
+    bits     = (halvings * 144u + 99u) / 100u + halvings / 4u + 2u;
+    *pProbes = (bits * 69u + 50u) / 100u;
+    if (*pProbes < 1u) *pProbes = 1u;
+    if (*pProbes > FILTER_MAX_PROBES) *pProbes = FILTER_MAX_PROBES;
+    return bits;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* filter_build                                                            */
+/* INPUTS: name - keyring to read, or "-" for standard input               */
+/*         out_name - filter file to write                                 */
+/*         rate - false positive rate wanted, or NULL for 1/1000           */
+/* RETURN: 0 on success, 1 on failure                                      */
+/*                                                                         */
+/***************************************************************************/
+
+extern int filter_build (const char *name, const char *out_name, const char *rate)
+{
+struct filter_ctx ctx;
+struct source    *src = NULL;
+FILE             *out = NULL;
+uint8_t           head[FILTER_HEAD + FILTER_SETS * FILTER_ENTRY];
+uint8_t          *bits[FILTER_SETS] = { NULL, NULL };
+uint64_t          blocks[FILTER_SETS];
+uint64_t          at;
+uint64_t          i;
+uint32_t          per_id;
+uint32_t          probes = 1u;
+uint32_t          set;
+uint8_t           ok = FALSE;
+
+    memset (&ctx, 0, sizeof(ctx));
+    per_id = parse_rate (rate ? rate : "0.001", &probes);
+    if (!per_id)
+    {
+        fprintf (stderr, "%s: not a false positive rate between 0 and 1\n", rate);
+        return 1;
+    }
+    src = source_open (name);
+    if (src == NULL)
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        return 1;
+    }
+    if (!keyring_walk (src, KEYRING_SKIP_ATTRIBUTES, filter_collect, &ctx) && !ctx.failed)
+    {
+        fprintf (stderr, "%s: malformed packet, rest of file ignored\n", name);
+    }
+    if (!ctx.failed) block_end (&ctx);
+    if (ctx.failed) goto done;
+
+    for (set = 0u; set < FILTER_SETS; set++)
+    {
+        blocks[set] = (ctx.set[set].count * per_id + FILTER_BLOCK * 8u - 1u) /
+                      (FILTER_BLOCK * 8u);
+        if (!blocks[set]) blocks[set] = 1u;
+        bits[set] = calloc (blocks[set], FILTER_BLOCK);
+        if (bits[set] == NULL) goto done;
+        for (i = 0u; i < ctx.set[set].count; i++)
+        {
+            set_bits (bits[set] + block_of (ctx.set[set].hash[i], blocks[set]) *
+                      FILTER_BLOCK, ctx.set[set].hash[i], probes);
+        }
+    }
+
+    out = fopen (out_name, "wb");
+    if (out == NULL)
+    {
+        fprintf (stderr, "%s: cannot open\n", out_name);
+        goto done;
+    }
+    memset (head, 0, sizeof(head));
+    memcpy (head, FILTER_MAGIC, 8u);
+    le (head + 8, FILTER_VERSION, 4u);
+    le (head + 12, FILTER_SETS, 4u);
+    at = (sizeof(head) + FILTER_ALIGN - 1u) / FILTER_ALIGN * FILTER_ALIGN;
+    for (set = 0u; set < FILTER_SETS; set++)
+    {
+        le (head + FILTER_HEAD + set * FILTER_ENTRY, at, 8u);
+        le (head + FILTER_HEAD + set * FILTER_ENTRY + 8u, blocks[set], 8u);
+        le (head + FILTER_HEAD + set * FILTER_ENTRY + 16u, ctx.set[set].count, 8u);
+        le (head + FILTER_HEAD + set * FILTER_ENTRY + 24u, probes, 4u);
+        at += blocks[set] * FILTER_BLOCK;
+    }
+    if (fwrite (head, 1u, sizeof(head), out) != sizeof(head)) goto done;
+    memset (head, 0, sizeof(head));
+    at = (sizeof(head) + FILTER_ALIGN - 1u) / FILTER_ALIGN * FILTER_ALIGN - sizeof(head);
+    if (fwrite (head, 1u, at, out) != at) goto done;
+    for (set = 0u; set < FILTER_SETS; set++)
+    {
+        if (fwrite (bits[set], FILTER_BLOCK, blocks[set], out) != blocks[set]) goto done;
+    }
+    ok = !fflush (out);
+    if (ok)
+    {
+        fprintf (stderr, "%llu IDs, %llu revoked, %u bits and %u probes each\n",
+                 (unsigned long long)ctx.set[FILTER_KNOWN].count,
+                 (unsigned long long)ctx.set[FILTER_REVOKED].count, per_id, probes);
+    }
+
+done:
+    if (out && fclose (out)) ok = FALSE;
+    source_close (src);
+    for (set = 0u; set < FILTER_SETS; set++)
+    {
+        free (ctx.set[set].hash);
+        free (bits[set]);
+    }
+    free (ctx.pending.id);
+    free (ctx.revoker.id);
+    return ok ? 0 : 1;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* filter_open                                                             */
+/* INPUTS: name - file written by filter_build                             */
+/* RETURN: the mapped filters, or NULL if the file is not one              */
+/*                                                                         */
+/***************************************************************************/
+
+extern struct filter *filter_open (const char *name)
+{
+struct filter *filter;
+struct stat    st;
+void          *map;
+uint64_t       offset;
+uint64_t       blocks;
+uint32_t       set;
+int            fd;
+
+    fd = open (name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    if (fstat (fd, &st) || (st.st_size < FILTER_ALIGN))
+    {
+        close (fd);
+        return NULL;
+    }
+    map = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    filter = calloc (1u, sizeof(*filter));
+    if ((map == MAP_FAILED) || (filter == NULL)) goto fail;
+    filter->fd   = fd;
+    filter->map  = map;
+    filter->size = (size_t)st.st_size;
+    if (memcmp (map, FILTER_MAGIC, 8u) ||
+            (get_le (filter->map + 8, 4u) != FILTER_VERSION) ||
+            (get_le (filter->map + 12, 4u) != FILTER_SETS))
+    {
+        goto fail;
+    }
+    for (set = 0u; set < FILTER_SETS; set++)
+    {
+        offset = get_le (filter->map + FILTER_HEAD + set * FILTER_ENTRY, 8u);
+        blocks = get_le (filter->map + FILTER_HEAD + set * FILTER_ENTRY + 8u, 8u);
+        filter->set[set].probes = (uint32_t)get_le (filter->map + FILTER_HEAD +
+                                                    set * FILTER_ENTRY + 24u, 4u);
+        if (!blocks || (offset > filter->size) ||
+                (blocks > (filter->size - offset) / FILTER_BLOCK) ||
+                (filter->set[set].probes > FILTER_MAX_PROBES))
+        {
+            goto fail;
+        }
+        filter->set[set].bits   = filter->map + offset;
+        filter->set[set].blocks = blocks;
+    }
+    return filter;
+
+fail:
+    if (map != MAP_FAILED) munmap (map, (size_t)st.st_size);
+    free (filter);
+    close (fd);
+    return NULL;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* filter_check                                                            */
+/* INPUTS: filter - the mapped filters                                     */
+/*         set - FILTER_KNOWN or FILTER_REVOKED                            */
+/*         id - key ID (8 octets) or fingerprint                           */
+/*         len - its length                                                */
+/* RETURN: FALSE if the ID is certainly not in the set                     */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t filter_check (const struct filter *filter, uint32_t set,
+                             const uint8_t *id, uint32_t len)
+{
+const struct filter_set *fs = &filter->set[set];
+uint64_t hash;
+
+    hash = id_hash (id, len);
+    return test_bits (fs->bits + block_of (hash, fs->blocks) * FILTER_BLOCK, hash,
+                      fs->probes);
+}
+
+extern void filter_close (struct filter *filter)
+{
+    if (filter == NULL) return;
+    munmap ((void *)filter->map, filter->size);
+    close (filter->fd);
+    free (filter);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* filter_query                                                            */
+/* INPUTS: name - file written by filter_build                             */
+/*         ids - key IDs or fingerprints in hex, optionally 0x prefixed    */
+/*         count - how many                                                */
+/* RETURN: 0 if every ID was unknown, 1 if any was known, 2 on trouble     */
+/*                                                                         */
+/* Prints each ID with unknown, known or revoked; known and revoked may    */
+/* be false positives, unknown never is wrong.                             */
+/*                                                                         */
+/***************************************************************************/
+
+extern int filter_query (const char *name, char **ids, uint32_t count)
+{
+struct filter *filter;
+uint8_t        id[PKT_MAX_FPR];
+uint8_t        len;
+uint32_t       n;
+int            rc = 0;
+
+    filter = filter_open (name);
+    if (filter == NULL)
+    {
+        fprintf (stderr, "%s: not a filter file\n", name);
+        return 2;
+    }
+    for (n = 0u; n < count; n++)
+    {
+        if (!parse_key_id (ids[n], id, &len))
+        {
+            fprintf (stderr, "%s: not a key ID or fingerprint\n", ids[n]);
+            rc = 2;
+            break;
+        }
+        if (!filter_check (filter, FILTER_KNOWN, id, (uint32_t)len))
+        {
+            printf ("%s unknown\n", ids[n]);
+            continue;
+        }
+        printf ("%s %s\n", ids[n],
+                filter_check (filter, FILTER_REVOKED, id, (uint32_t)len) ? "revoked" : "known");
+        rc = 1;
+    }
+    filter_close (filter);
+    return rc;
+}
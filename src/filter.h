@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/***************************************************************************/
+/* Key ID filters                                                          */
+/*                                                                         */
+/* Two blocked Bloom filters in one small file, one holding every key ID   */
+/* and fingerprint of a keyring and one those of its revoked keys. Every   */
+/* probe for an ID falls in the same 64 octet block, one cache line, so a  */
+/* check costs one memory access however low the false positive rate.     */
+/* An ID that is there is always reported; one that is not is reported    */
+/* at about the rate the filter was built for.                             */
+/***************************************************************************/
+
+#define FILTER_KNOWN    (0u)
+#define FILTER_REVOKED  (1u)
+#define FILTER_SETS     (2u)
+
+struct filter_set
+{
+    const uint8_t  *bits;
+    uint64_t        blocks;
+    uint32_t        probes;
+};
+
+struct filter
+{
+    int             fd;
+    const uint8_t  *map;
+    size_t          size;
+    struct filter_set set[FILTER_SETS];
+};
+
+extern int      filter_build (const char *name, const char *out_name, const char *rate);
+extern struct filter *filter_open (const char *name);
+extern uint8_t  filter_check (const struct filter *filter, uint32_t set,
+                              const uint8_t *id, uint32_t len);
+extern void     filter_close (struct filter *filter);
+extern int      filter_query (const char *name, char **ids, uint32_t count);
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "source.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+#define FOLLOW_EVENTS   (IN_MODIFY | IN_CLOSE_WRITE | \
+                         IN_DELETE_SELF | IN_MOVE_SELF | IN_ATTRIB)
+#define FOLLOW_GONE     (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)
+#define EVENT_BUF_SIZE  (4096u)
+
+/***************************************************************************/
+/*                                                                         */
+/* follow_open                                                             */
+/* INPUTS: filename - the file being followed                              */
+/* RETURN: inotify descriptor, or -1 if failed                             */
+/*                                                                         */
+/* Create an inotify instance watching the file for appended data, and     */
+/* for it being removed or renamed away from underneath us.                */
+/*                                                                         */
+/***************************************************************************/
+
+extern int follow_open (const char *filename)
+{
+int notify;
+
+    notify = inotify_init1 (IN_CLOEXEC);
+    if (notify < 0) return -1;
+    if (inotify_add_watch (notify, filename, FOLLOW_EVENTS) < 0)
+    {
+        close (notify);
+        return -1;
+    }
+    return notify;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* follow_complete                                                         */
+/* INPUTS: src - the file being followed                                   */
+/*         length - the bytes still expected for the current packet        */
+/* RETURN: TRUE if the whole packet is already on disk                     */
+/*                                                                         */
+/* Called straight after the packet header has been grabbed. A header cut  */
+/* short by end of file shows up as the source EOF indicator, otherwise    */
+/* the body is complete once the file has grown to cover it.               */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t follow_complete (struct source *src, uint32_t length)
+{
+struct stat st;
+
+    if (src->eof || src->error) return FALSE;
+    if (fstat (src->fd, &st)) return FALSE;
+    return ((st.st_size - source_tell (src)) >= (off_t)length);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* follow_wait                                                             */
+/* INPUTS: notify - inotify descriptor from follow_open                    */
+/*         src - the file being followed                                   */
+/*         position - offset of the first byte not yet parsed              */
+/* RETURN: TRUE to carry on parsing, FALSE once the file has gone          */
+/*                                                                         */
+/* Rewind the source to the start of the incomplete packet and sleep in    */
+/* read() until the writer touches the file again. Only the few header    */
+/* bytes of the held packet are ever read twice. As we hold the file open */
+/* its deletion only shows as IN_ATTRIB on the last link going, the inode  */
+/* (and IN_DELETE_SELF) lingering until we close it.                       */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t follow_wait (int notify, struct source *src, off_t position)
+{
+uint8_t events[EVENT_BUF_SIZE];
+const struct inotify_event *event;
+ssize_t got;
+ssize_t offset;
+struct stat st;
+uint8_t alive;
+
+    if (!source_seek (src, position)) return FALSE;
+
+    got = read (notify, events, sizeof(events));
+    if (got <= 0) return FALSE;
+
+    alive = TRUE;
+    for (offset = 0; offset < got;
+             offset += sizeof(struct inotify_event) + event->len)
+    {
+        event = (const struct inotify_event *)(events + offset);
+        if (event->mask & FOLLOW_GONE) alive = FALSE;
+        if ((event->mask & IN_ATTRIB) &&
+                (fstat (src->fd, &st) || (st.st_nlink == 0u))) alive = FALSE;
+    }
+    return alive;
+}
+
+extern void follow_close (int notify)
+{
+    if (notify >= 0) close (notify);
+}
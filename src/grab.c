@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <byteswap.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "grab.h"
+#include "source.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+#define MAXIMUM_BODY    (1ul << 26)
+
+/********************************************************************************/
+/*                                                                              */
+/* grab_new_s_pkt_head                                                          */
+/* INPUTS: src - pgp packet input                                               */
+/*         mainPkt - whether this is a packet or a sub-packet                   */
+/* RETURN: number of bytes to transferred                                       */
+/* OUTPUT: pPartial - whether this a partial packet or not                      */
+/*         pLength - the length of the packet                                   */
+/*                                                                              */
+/* Grab the new packet header or sub-packet header, and the return the length   */
+/* of the the rest of the packet to be expected.                                */
+/*                                                                              */
+/********************************************************************************/
+  
+extern uint8_t grab_new_s_pkt_head (struct source *src, uint8_t mainPkt, uint8_t *pPartial, uint32_t *pLength)
+{
+uint8_t val;
+uint8_t first;
+uint8_t transferred;
+uint32_t length;
+
+    *pPartial   = FALSE;
+    transferred = source_read (src, &val, sizeof(uint8_t));
+    if (transferred != sizeof(uint8_t)) return transferred;
+    length = val;
+    if ((val > PKT_LEN_ONE_MAX) &&
+             (val < (mainPkt ? PKT_LEN_PT : PKT_LEN_LEADING)))
+    {
+        first        = val;
+        transferred += source_read (src, &val, sizeof(uint8_t));
+        if (transferred != sizeof(uint8_t)*2) return transferred;
+        length =   first - (PKT_LEN_ONE_MAX + 1);
+        length <<= 8;
+        length +=  val;
+        length +=  PKT_LEN_ONE_MAX + 1;
+    }
+    else if (val == PKT_LEN_LEADING)
+    {
+        transferred += source_read (src, &length, sizeof(uint32_t));
+        if (transferred != sizeof(uint8_t)+sizeof(uint32_t))
+        {
+            return transferred;
+        }
+//        bswap_32 (length);
+        length = __bswap_constant_32 (length);
+    }
+    else if ((val >= PKT_LEN_PT) && mainPkt) 
+    {
+        /* this could be replaced with the macro */
+        length    = (1ul << (val & PKT_LEN_PT_MASK));
+        *pPartial = TRUE;
+    }
+    *pLength = length;
+    return transferred;
+}
+
+/********************************************************************************/
+/*                                                                              */
+/* grab_packet_head                                                             */
+/* INPUTS: src - pgp packet input                                               */
+/* RETURN: number of bytes to transferred                                       */
+/* OUTPUT: pTag - the tag of the packet                                         */
+/*         pPartial - whether this packet is incomplete/partial                 */
+/*         pLength - the length of the packet (NB may be partial)               */
+/*                                                                              */
+/* Grab the packet header and return the tag, partial indicator and length of   */
+/* the remaining packet                                                         */
+/*                                                                              */
+/********************************************************************************/
+
+extern uint8_t grab_packet_head (struct source *src, uint8_t *pTag, uint8_t *pPartial, uint32_t *pLength)
+{
+uint8_t val;
+uint8_t transferred = 0u;
+uint16_t old_length;
+uint32_t length;
+enum old_packet_len op_len;
+
+    *pTag     = 0u;
+    *pPartial = FALSE;
+    *pLength  = (0ul);
+    transferred += source_read (src, pTag, sizeof(uint8_t));
+    if (transferred != sizeof(uint8_t)) return transferred;
+    if (!(*pTag & PKT_INDICATED))
+    {
+        *pTag = PktReserved;
+        return (sizeof(uint8_t));
+    }
+    if (*pTag & PKT_FORMAT_NEW)
+    {
+        transferred  = grab_new_s_pkt_head (src, TRUE, pPartial, pLength) + 1; 
+        *pTag       &= PKT_NEW_PACKET;
+    }
+    else
+    {
+        op_len = (*pTag & PKT_OLD_LENGTH);
+        switch (op_len)
+        {
+            case OldOneOctet:
+                transferred += source_read (src, &val, sizeof(uint8_t));
+                if (transferred != sizeof(uint8_t)*2) return transferred;
+                length = val;
+                break;
+            case OldTwoOctet:
+                transferred += source_read (src, &old_length, sizeof(uint16_t));
+                if (transferred != sizeof(uint8_t)+sizeof(uint16_t))
+                {
+                    return transferred;
+                }
+//                bswap_16 (old_length);
+                old_length = __bswap_constant_16 (old_length);
+                length = old_length;
+                break;
+            case OldFourOctet:
+                transferred += source_read (src, &length, sizeof(uint32_t));
+                if (transferred != sizeof(uint8_t)+sizeof(uint32_t))
+                {
+                    return transferred;
+                }
+//                bswap_32 (length);
+                length = __bswap_constant_32 (length);
+                break;
+            case OldPartial:
+                /* indeterminate length, the packet runs to end of file */
+                length = PKT_LEN_INDETERMINATE;
+                break;
+            default:
+                break;
+        }
+        *pTag &=  PKT_OLD_PACKET;
+        *pTag >>= PKT_OLD_PKT_SHF;
+        *pLength = length;
+    }    
+    return transferred;
+}
+
+/********************************************************************************/
+/*                                                                              */
+/* grab_body                                                                    */
+/* INPUTS: src - pgp packet input positioned after the packet header            */
+/*         length - length of the body, or of its first partial chunk           */
+/*         partial - whether further partial body chunks follow                 */
+/*         buf - buffer to hold the body, grown as needed                       */
+/* RETURN: TRUE if the whole body was read                                      */
+/* OUTPUT: pTotal - total length of the body now held in buf                    */
+/*                                                                              */
+/* Read the whole packet body into memory, joining partial body chunks, so the  */
+/* decoders can work on it in place.                                            */
+/*                                                                              */
+/********************************************************************************/
+
+extern uint8_t grab_body (struct source *src, uint32_t length, uint8_t partial,
+                          struct grab_buffer *buf, uint32_t *pTotal)
+{
+uint32_t total = 0ul;
+uint8_t *grown;
+
+    for (;;)
+    {
+        if ((length > MAXIMUM_BODY) || (total + length > MAXIMUM_BODY))
+        {
+            return FALSE;
+        }
+        if (total + length > buf->size)
+        {
+            grown = realloc (buf->data, total + length);
+            if (grown == NULL) return FALSE;
+            buf->data = grown;
+            buf->size = total + length;
+        }
+        if (source_read (src, buf->data + total, length) != length) return FALSE;
+        total += length;
+        if (!partial) break;
+        if (!grab_new_s_pkt_head (src, TRUE, &partial, &length)) return FALSE;
+    }
+    *pTotal = total;
+    return TRUE;
+}
+
+/********************************************************************************/
+/*                                                                              */
+/* skip_body                                                                    */
+/* INPUTS: src - pgp packet input positioned within the packet body             */
+/*         length - bytes left of the current chunk                             */
+/*         partial - whether further partial body chunks follow                 */
+/* RETURN: TRUE if the end of the body was reached                              */
+/*                                                                              */
+/* Step over the bulk data packets without holding them in memory.              */
+/*                                                                              */
+/********************************************************************************/
+
+extern uint8_t skip_body (struct source *src, uint32_t length, uint8_t partial)
+{
+    if (length == PKT_LEN_INDETERMINATE)
+    {
+        return source_skip_rest (src);
+    }
+    for (;;)
+    {
+        if (!source_skip (src, length)) return FALSE;
+        if (!partial) break;
+        if (!grab_new_s_pkt_head (src, TRUE, &partial, &length)) return FALSE;
+    }
+    return TRUE;
+}
+
+/* Bulk data packets, which are stepped over rather than held in memory */
+
+extern uint8_t is_stream (enum packet_tags tagged)
+{
+    return ((tagged == PktCompressedData) || (tagged == PktSymmetricEncData) ||
+            (tagged == PktLiteral) || (tagged == PktSymEncIntegrityProtData) ||
+            (tagged == PktAEADEncData));
+}
+
+extern void grab_release (struct grab_buffer *buf)
+{
+    free (buf->data);
+    buf->data = NULL;
+    buf->size = 0ul;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAB_H
+#define GRAB_H
+
+#include <stdint.h>
+
+#include "2440.h"
+#include "source.h"
+
+/* Caller owned buffer that packet bodies are grabbed into */
+
+struct grab_buffer
+{
+    uint8_t        *data;
+    uint32_t        size;
+};
+
+extern uint8_t grab_new_s_pkt_head (struct source *src, uint8_t mainPkt,
+                                    uint8_t *pPartial, uint32_t *pLength);
+extern uint8_t grab_packet_head (struct source *src, uint8_t *pTag, uint8_t *pPartial,
+                                 uint32_t *pLength);
+extern uint8_t grab_body (struct source *src, uint32_t length, uint8_t partial,
+                          struct grab_buffer *buf, uint32_t *pTotal);
+extern uint8_t skip_body (struct source *src, uint32_t length, uint8_t partial);
+extern uint8_t is_stream (enum packet_tags tagged);
+extern void    grab_release (struct grab_buffer *buf);
+
+#endif
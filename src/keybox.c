@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "packet.h"
+#include "keybox.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/***************************************************************************/
+/*                                                                         */
+/* Blob layout, all integers big endian, offsets from the blob's start:    */
+/*                                                                         */
+/*   u32 blob length, u8 type, u8 version, u16 flags                       */
+/*   header blob:  "KBXf", then reserved and timestamps                    */
+/*   OpenPGP blob: u32 key block offset, u32 key block length,             */
+/*                 u16 keys, u16 key info size, then per key               */
+/*                   version 1: 20 octets fingerprint, u32 key ID offset,  */
+/*                              u16 flags, u16 reserved                    */
+/*                   version 2: 32 octets fingerprint, u16 flags (0x80     */
+/*                              if all 32 are used, else the first 20),    */
+/*                              u16 reserved, 20 octets keygrip            */
+/*                 u16 serial number length, serial number,                */
+/*                 u16 user IDs, u16 user ID info size, then per user ID   */
+/*                   u32 offset, u32 length, u16 flags, u8 validity, u8    */
+/*                 and signature and trust information not read here       */
+/*                                                                         */
+/***************************************************************************/
+
+#define KEYBOX_MAGIC    "KBXf"
+#define BLOB_HEAD       (20u)
+#define KEY_INFO_V1     (28u)
+#define KEY_INFO_V2     (56u)
+#define UID_INFO        (12u)
+#define KEY_FPR32       (0x0080u)
+
+static uint32_t be32 (const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t be16 (const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* keybox_open                                                             */
+/* INPUTS: name - file to open                                             */
+/* RETURN: the mapped keybox, or NULL if it is not a keybox                */
+/*                                                                         */
+/* Quiet when the file is not a keybox, so any file can be tried.          */
+/*                                                                         */
+/***************************************************************************/
+
+extern struct keybox *keybox_open (const char *name)
+{
+struct keybox *kbx;
+struct stat    st;
+uint8_t        head[12];
+void          *map;
+int            fd;
+
+    fd = open (name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    if (fstat (fd, &st) || !S_ISREG (st.st_mode) ||
+            (pread (fd, head, sizeof(head), 0) != (ssize_t)sizeof(head)) ||
+            (head[4] != KEYBOX_HEADER) || memcmp (head + 8, KEYBOX_MAGIC, 4u) ||
+            (be32 (head) < sizeof(head)) || (be32 (head) > (uint64_t)st.st_size))
+    {
+        close (fd);
+        return NULL;
+    }
+    kbx = calloc (1u, sizeof(*kbx));
+    map = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if ((kbx == NULL) || (map == MAP_FAILED))
+    {
+        if (map != MAP_FAILED) munmap (map, (size_t)st.st_size);
+        free (kbx);
+        close (fd);
+        return NULL;
+    }
+    kbx->fd   = fd;
+    kbx->map  = map;
+    kbx->size = (size_t)st.st_size;
+    return kbx;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* keybox_next                                                             */
+/* INPUTS: kbx - the keybox                                                */
+/*         pOffset - offset of the blob to read, 0 to start at the header  */
+/* RETURN: TRUE if a blob was read, FALSE at the end or on a damaged blob  */
+/*         (the two told apart by *pOffset having reached kbx->size)       */
+/* OUTPUT: pOffset - offset of the blob after it                           */
+/*         blob - the blob; the tables are only filled in for OpenPGP     */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t keybox_next (const struct keybox *kbx, size_t *pOffset,
+                            struct keybox_blob *blob)
+{
+const uint8_t *p;
+size_t   left;
+size_t   at;
+
+    memset (blob, 0, sizeof(*blob));
+    if (*pOffset + 6u > kbx->size) return FALSE;
+    p         = kbx->map + *pOffset;
+    left      = kbx->size - *pOffset;
+    blob->len = be32 (p);
+    if ((blob->len < 6u) || (blob->len > left)) return FALSE;
+    blob->offset  = *pOffset;
+    blob->type    = p[4];
+    blob->version = p[5];
+    if (blob->type == KEYBOX_OPENPGP)
+    {
+        if (blob->len < BLOB_HEAD) return FALSE;
+        blob->flags        = be16 (p + 6);
+        blob->keyblock     = be32 (p + 8);
+        blob->keyblock_len = be32 (p + 12);
+        blob->keys         = be16 (p + 16);
+        blob->key_size     = be16 (p + 18);
+        blob->key          = p + BLOB_HEAD;
+        if ((blob->keyblock > blob->len) ||
+                (blob->keyblock_len > blob->len - blob->keyblock) ||
+                (blob->key_size < ((blob->version < 2u) ? KEY_INFO_V1 : KEY_INFO_V2)))
+        {
+            return FALSE;
+        }
+        at = BLOB_HEAD + (size_t)blob->keys * blob->key_size;
+        if (at + 2u > blob->len) return FALSE;
+        at += 2u + be16 (p + at);
+        if (at + 4u > blob->len) return FALSE;
+        blob->uids     = be16 (p + at);
+        blob->uid_size = be16 (p + at + 2u);
+        blob->uid      = p + at + 4u;
+        if ((blob->uids && (blob->uid_size < 8u)) ||
+                (at + 4u + (size_t)blob->uids * blob->uid_size > blob->len))
+        {
+            return FALSE;
+        }
+        blob->keyblock += blob->offset;
+    }
+    *pOffset += blob->len;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* keybox_key                                                              */
+/* INPUTS: kbx - the keybox                                                */
+/*         blob - an OpenPGP blob                                          */
+/*         n - which key, 0 for the primary                                */
+/* RETURN: TRUE if the key is there                                        */
+/* OUTPUT: fpr - its fingerprint                                           */
+/*         pFprLen - 20 or 32                                              */
+/*         keyid - its key ID                                              */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t keybox_key (const struct keybox *kbx, const struct keybox_blob *blob,
+                           uint16_t n, uint8_t *fpr, uint8_t *pFprLen, uint8_t *keyid)
+{
+const uint8_t *info;
+uint32_t       at;
+
+    if (n >= blob->keys) return FALSE;
+    info = blob->key + (size_t)n * blob->key_size;
+    if (blob->version < 2u)
+    {
+        *pFprLen = 20u;
+        memcpy (fpr, info, 20u);
+        at = be32 (info + 20);
+        if (at && (at <= blob->len - PKT_KEYID_LEN))
+        {
+            memcpy (keyid, kbx->map + blob->offset + at, PKT_KEYID_LEN);
+        }
+        else
+        {
+            memcpy (keyid, info + 20u - PKT_KEYID_LEN, PKT_KEYID_LEN);
+        }
+        return TRUE;
+    }
+    if (be16 (info + 32) & KEY_FPR32)
+    {
+        *pFprLen = 32u;
+        memcpy (fpr, info, 32u);
+        memcpy (keyid, info, PKT_KEYID_LEN);
+    }
+    else
+    {
+        *pFprLen = 20u;
+        memcpy (fpr, info, 20u);
+        memcpy (keyid, info + 20u - PKT_KEYID_LEN, PKT_KEYID_LEN);
+    }
+    return TRUE;
+}
+
+extern uint8_t keybox_uid (const struct keybox *kbx, const struct keybox_blob *blob,
+                           uint16_t n, const uint8_t **pText, uint32_t *pLen)
+{
+const uint8_t *info;
+uint32_t       at;
+uint32_t       len;
+
+    if (n >= blob->uids) return FALSE;
+    info = blob->uid + (size_t)n * blob->uid_size;
+    at   = be32 (info);
+    len  = be32 (info + 4);
+    if ((at > blob->len) || (len > blob->len - at)) return FALSE;
+    *pText = kbx->map + blob->offset + at;
+    *pLen  = len;
+    return TRUE;
+}
+
+/* Whether any key in the blob has this key ID or fingerprint */
+
+extern uint8_t keybox_has_key (const struct keybox *kbx, const struct keybox_blob *blob,
+                               const uint8_t *id, uint8_t len)
+{
+uint8_t  fpr[PKT_MAX_FPR];
+uint8_t  fpr_len;
+uint8_t  keyid[PKT_KEYID_LEN];
+uint16_t n;
+
+    for (n = 0u; n < blob->keys; n++)
+    {
+        if (!keybox_key (kbx, blob, n, fpr, &fpr_len, keyid)) break;
+        if ((len == PKT_KEYID_LEN) && !memcmp (keyid, id, PKT_KEYID_LEN)) return TRUE;
+        if ((len == fpr_len) && !memcmp (fpr, id, len)) return TRUE;
+    }
+    return FALSE;
+}
+
+static uint8_t lower (uint8_t c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+/* Whether any user ID in the blob contains the text, ASCII case ignored */
+
+extern uint8_t keybox_has_uid (const struct keybox *kbx, const struct keybox_blob *blob,
+                               const char *text)
+{
+const uint8_t *uid;
+uint32_t len;
+uint32_t want = (uint32_t)strlen (text);
+uint32_t i;
+uint32_t j;
+uint16_t n;
+
+    for (n = 0u; n < blob->uids; n++)
+    {
+        if (!keybox_uid (kbx, blob, n, &uid, &len) || (len < want)) continue;
+        for (i = 0u; i + want <= len; i++)
+        {
+            for (j = 0u; j < want; j++)
+            {
+                if (lower (uid[i + j]) != lower ((uint8_t)text[j])) break;
+            }
+            if (j == want) return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+extern void keybox_close (struct keybox *kbx)
+{
+    if (kbx == NULL) return;
+    munmap ((void *)kbx->map, kbx->size);
+    close (kbx->fd);
+    free (kbx);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef KEYBOX_H
+#define KEYBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packet.h"
+
+/***************************************************************************/
+/* GnuPG keybox (pubring.kbx)                                              */
+/*                                                                         */
+/* A keybox is a run of blobs, the first a header. Each OpenPGP blob       */
+/* carries the key block as stored by gpg, along with tables giving the    */
+/* fingerprint of every key in it and where each user ID lies, so keys     */
+/* can be found and listed without parsing the key block at all.           */
+/***************************************************************************/
+
+#define KEYBOX_EMPTY    (0u)
+#define KEYBOX_HEADER   (1u)
+#define KEYBOX_OPENPGP  (2u)
+#define KEYBOX_X509     (3u)
+
+#define KEYBOX_SECRET   (0x0001u)
+
+struct keybox
+{
+    int             fd;
+    const uint8_t  *map;
+    size_t          size;
+};
+
+struct keybox_blob
+{
+    size_t          offset;
+    uint32_t        len;
+    uint8_t         type;
+    uint8_t         version;
+    uint16_t        flags;
+    size_t          keyblock;
+    uint32_t        keyblock_len;
+    uint16_t        keys;
+    uint16_t        key_size;
+    const uint8_t  *key;
+    uint16_t        uids;
+    uint16_t        uid_size;
+    const uint8_t  *uid;
+};
+
+extern struct keybox *keybox_open (const char *name);
+extern uint8_t keybox_next (const struct keybox *kbx, size_t *pOffset,
+                            struct keybox_blob *blob);
+extern uint8_t keybox_key (const struct keybox *kbx, const struct keybox_blob *blob,
+                           uint16_t n, uint8_t *fpr, uint8_t *pFprLen, uint8_t *keyid);
+extern uint8_t keybox_uid (const struct keybox *kbx, const struct keybox_blob *blob,
+                           uint16_t n, const uint8_t **pText, uint32_t *pLen);
+extern uint8_t keybox_has_key (const struct keybox *kbx, const struct keybox_blob *blob,
+                               const uint8_t *id, uint8_t len);
+extern uint8_t keybox_has_uid (const struct keybox *kbx, const struct keybox_blob *blob,
+                               const char *text);
+extern void    keybox_close (struct keybox *kbx);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/***************************************************************************/
+/*                                                                         */
+/* keyring_walk                                                            */
+/* INPUTS: src - pgp input containing key blocks                           */
+/*         flags - KEYRING_DIGESTS to have every packet's content digest   */
+/*                 worked out, KEYRING_SKIP_ATTRIBUTES to pass over user   */
+/*                 attribute bodies unread                                 */
+/*         fn - called for each packet, returns FALSE to stop the walk     */
+/*         ctx - passed through to fn                                      */
+/* RETURN: TRUE if the walk reached end of file or was stopped by fn,      */
+/*         FALSE on a malformed or truncated packet                        */
+/*                                                                         */
+/* User IDs, attributes and subkeys are digested on their own bodies;      */
+/* signatures on the digest of the component they follow and their own     */
+/* body, so the same signature over a different user ID is distinct.       */
+/* Bulk data packets, and attributes if asked, are skipped and handed on   */
+/* without a body.                                                         */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t keyring_walk (struct source *src, uint8_t flags, keyring_fn fn,
+                             void *ctx)
+{
+struct grab_buffer    buf = { NULL, 0ul };
+struct keyring_block  block;
+struct keyring_packet pkt;
+uint8_t  tag;
+uint8_t  partial;
+uint8_t  transferred;
+uint8_t  ok = FALSE;
+uint32_t length;
+
+    memset (&block, 0, sizeof(block));
+    for (;;)
+    {
+        memset (&pkt, 0, sizeof(pkt));
+        pkt.offset  = source_tell (src);
+        transferred = grab_packet_head (src, &tag, &partial, &length);
+        if (!transferred && src->eof)
+        {
+            ok = TRUE;
+            break;
+        }
+        if (src->eof || (tag == PktReserved)) break;
+
+        pkt.tag = tag;
+        if (is_stream (pkt.tag) ||
+                ((flags & KEYRING_SKIP_ATTRIBUTES) && (pkt.tag == PktUserAttribute)))
+        {
+            if (!skip_body (src, length, partial)) break;
+        }
+        else
+        {
+            if (!grab_body (src, length, partial, &buf, &pkt.len)) break;
+            pkt.body = buf.data;
+        }
+        pkt.end = source_tell (src);
+
+        switch (pkt.tag)
+        {
+            case PktPublicKey:
+            case PktSecretKey:
+                memset (&block, 0, sizeof(block));
+                block.valid     = key_fingerprint (pkt.body, pkt.len, block.fpr,
+                                                   &block.fpr_len, block.keyid);
+                block.version   = pkt.len ? pkt.body[0] : 0u;
+                block.offset    = pkt.offset;
+                block.component = PktPublicKey;
+                if (flags & KEYRING_DIGESTS)
+                {
+                    content_digest (NULL, 0ul, pkt.body, pkt.len, pkt.digest);
+                }
+                break;
+            case PktUserID:
+            case PktUserAttribute:
+            case PktPublicSubkey:
+            case PktSecretSubkey:
+                block.component = pkt.tag;
+                if (flags & KEYRING_DIGESTS)
+                {
+                    content_digest (NULL, 0ul, pkt.body, pkt.len, pkt.digest);
+                    memcpy (block.component_digest, pkt.digest, DIGEST_LEN);
+                }
+                break;
+            case PktSignature:
+                if (flags & KEYRING_DIGESTS)
+                {
+                    content_digest (block.component_digest, DIGEST_LEN,
+                                    pkt.body, pkt.len, pkt.digest);
+                }
+                break;
+            default:
+                break;
+        }
+        block.count++;
+        if (!fn (ctx, &block, &pkt))
+        {
+            ok = TRUE;
+            break;
+        }
+    }
+    grab_release (&buf);
+    return ok;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* keyring_read_at                                                         */
+/* INPUTS: src - pgp input, which must be a regular file                   */
+/*         offset - start of a packet header found by an earlier walk      */
+/*         buf - buffer for the body                                       */
+/* RETURN: TRUE if the packet was read back                                */
+/* OUTPUT: pTag - the packet type                                          */
+/*         pLen - the length of the body                                   */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t keyring_read_at (struct source *src, off_t offset,
+                                struct grab_buffer *buf, enum packet_tags *pTag,
+                                uint32_t *pLen)
+{
+uint8_t  tag;
+uint8_t  partial;
+uint32_t length;
+
+    if (!source_seek (src, offset)) return FALSE;
+    if (!grab_packet_head (src, &tag, &partial, &length) || src->eof) return FALSE;
+    if (is_stream (tag)) return FALSE;
+    *pTag = tag;
+    return grab_body (src, length, partial, buf, pLen);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYRING_H
+#define KEYRING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "digest.h"
+#include "grab.h"
+#include "source.h"
+
+/***************************************************************************/
+/* Key block walking                                                       */
+/*                                                                         */
+/* A key block is a primary key and every packet up to the next primary   */
+/* key. The walker hands each packet to a callback along with the block it */
+/* belongs to and the user ID, attribute or subkey it follows.             */
+/***************************************************************************/
+
+#define KEYRING_DIGESTS (1u)
+#define KEYRING_SKIP_ATTRIBUTES (2u)
+
+struct keyring_block
+{
+    uint8_t          valid;
+    uint8_t          version;
+    uint8_t          fpr[PKT_MAX_FPR];
+    uint8_t          fpr_len;
+    uint8_t          keyid[PKT_KEYID_LEN];
+    off_t            offset;
+    uint32_t         count;
+    enum packet_tags component;
+    uint8_t          component_digest[DIGEST_LEN];
+};
+
+struct keyring_packet
+{
+    enum packet_tags tag;
+    off_t            offset;
+    off_t            end;
+    const uint8_t   *body;
+    uint32_t         len;
+    uint8_t          digest[DIGEST_LEN];
+};
+
+typedef uint8_t (*keyring_fn) (void *ctx, const struct keyring_block *block,
+                               const struct keyring_packet *pkt);
+
+extern uint8_t keyring_walk (struct source *src, uint8_t flags, keyring_fn fn,
+                             void *ctx);
+extern uint8_t keyring_read_at (struct source *src, off_t offset,
+                                struct grab_buffer *buf, enum packet_tags *pTag,
+                                uint32_t *pLen);
+
+#endif
@@ -0,0 +1,757 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "digest.h"
+#include "push.h"
+#include "armor.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/* How far to look for the end of a header block, and for the END line */
+
+#define MAIL_HEADERS_MAX ((size_t)1u << 16)
+#define MAIL_ID_SHOWN   (128u)
+#define MAIL_UID_SHOWN  (64u)
+
+/***************************************************************************/
+/*                                                                         */
+/* Each file named, and each file in a directory named, however deep, is   */
+/* mapped and searched by one of the threads; a file opening with a        */
+/* "From " line is taken to be an mbox and cut into messages at each such  */
+/* line, and any other file to be a single message, as in a Maildir.       */
+/* Within a message only the lines opening with -, C, F or M (in either    */
+/* case) matter: armor BEGIN lines, MIME boundaries, the Content-Type,     */
+/* Content-Transfer-Encoding and Message-ID headers, and mbox From lines.  */
+/* Armor is decoded where it is found. A MIME part of an application/pgp-* */
+/* or application/octet-stream type sent in base64 is decoded at the      */
+/* boundary which ends it, and whatever armor or packets it holds is       */
+/* handled in turn. Decoded packets go through the push parser. The        */
+/* reports are held per file and printed in the order the files were      */
+/* named.                                                                  */
+/*                                                                         */
+/***************************************************************************/
+
+struct mail_file
+{
+    char           *name;
+    struct armor_report report;
+    uint64_t        finds;
+    uint8_t         done;
+};
+
+struct mail_job
+{
+    struct mail_file *file;
+    uint32_t        files;
+    uint32_t        file_size;
+    uint32_t        next;
+    pthread_mutex_t lock;
+    pthread_cond_t  finished;
+};
+
+/* A thread's place within the file it is searching */
+
+struct mail_scan
+{
+    struct mail_file *file;
+    const uint8_t  *base;
+    const uint8_t  *end;
+    uint8_t         mbox;
+    const uint8_t  *message;
+    const uint8_t  *headers_end;
+    const uint8_t  *id;
+    uint32_t        id_len;
+    const uint8_t  *part_body;
+    uint8_t         part_pgp;
+    uint8_t         part_base64;
+    uint8_t         packets;
+    struct grab_buffer decoded;
+    struct grab_buffer armor;
+};
+
+/* Each line of the report opens with the file, message offset and ID */
+
+static void emit_find (struct mail_scan *scan)
+{
+struct armor_report *out = &scan->file->report;
+
+    report_emit (out, "%s %" PRIu64 " ", scan->file->name,
+                 (uint64_t)(scan->message - scan->base));
+    if (scan->id_len)
+    {
+        report_emit (out, "%.*s ", (int)scan->id_len, (const char *)scan->id);
+    }
+    else
+    {
+        report_emit (out, "- ");
+    }
+    scan->file->finds++;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* next_mark                                                               */
+/* INPUTS: p - where to start looking                                      */
+/*         end - where to stop                                             */
+/* RETURN: the start of the first line after p opening with -, C, F or M   */
+/*         in either case, or end                                          */
+/*                                                                         */
+/* SSE2 finds the newlines 16 octets at a time, and only where there is    */
+/* one are the octets after them tested. Setting bit 5 folds the letters   */
+/* to lower case and leaves '-' alone, so four compares cover all six.     */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t is_mark (uint8_t c)
+{
+    c |= 0x20u;
+    return ((c == '-') || (c == 'c') || (c == 'f') || (c == 'm'));
+}
+
+static const uint8_t *next_mark (const uint8_t *p, const uint8_t *end)
+{
+#ifdef __SSE2__
+const __m128i newline = _mm_set1_epi8 ('\n');
+const __m128i fold    = _mm_set1_epi8 (0x20);
+const __m128i dash    = _mm_set1_epi8 ('-');
+const __m128i c_lower = _mm_set1_epi8 ('c');
+const __m128i f_lower = _mm_set1_epi8 ('f');
+const __m128i m_lower = _mm_set1_epi8 ('m');
+__m128i  next;
+uint32_t mask;
+
+    while (end - p >= 17)
+    {
+        mask = (uint32_t)_mm_movemask_epi8 (
+                   _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *)p), newline));
+        if (mask)
+        {
+            next  = _mm_or_si128 (_mm_loadu_si128 ((const __m128i *)(p + 1)), fold);
+            mask &= (uint32_t)_mm_movemask_epi8 (_mm_or_si128 (
+                        _mm_or_si128 (_mm_cmpeq_epi8 (next, dash),
+                                      _mm_cmpeq_epi8 (next, c_lower)),
+                        _mm_or_si128 (_mm_cmpeq_epi8 (next, f_lower),
+                                      _mm_cmpeq_epi8 (next, m_lower))));
+            if (mask) return p + __builtin_ctz (mask) + 1;
+        }
+        p += 16;
+    }
+#endif
+    for (; end - p >= 2; p++)
+    {
+        if ((*p == '\n') && is_mark (p[1])) return p + 1;
+    }
+    return end;
+}
+
+/* Whether the line at p opens with text, ASCII case ignored */
+
+static uint8_t opens_with (const uint8_t *p, const uint8_t *end, const char *text)
+{
+size_t len = strlen (text);
+
+    return (((size_t)(end - p) >= len) && !strncasecmp ((const char *)p, text, len));
+}
+
+/* The octet after the next newline at or after p, or end */
+
+static const uint8_t *line_after (const uint8_t *p, const uint8_t *end)
+{
+    p = memchr (p, '\n', (size_t)(end - p));
+    return p ? p + 1 : end;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* blank_line                                                              */
+/* INPUTS: p - somewhere in a header block                                 */
+/*         end - end of the file                                           */
+/* RETURN: the start of the line after the empty line ending the block,    */
+/*         or NULL if there is none within MAIL_HEADERS_MAX                */
+/*                                                                         */
+/***************************************************************************/
+
+static const uint8_t *blank_line (const uint8_t *p, const uint8_t *end)
+{
+const uint8_t *stop;
+
+    stop = ((size_t)(end - p) > MAIL_HEADERS_MAX) ? p + MAIL_HEADERS_MAX : end;
+    while ((p = memchr (p, '\n', (size_t)(stop - p))) != NULL)
+    {
+        p++;
+        if ((p < stop) && (*p == '\n')) return p + 1;
+        if ((p + 1 < stop) && (p[0] == '\r') && (p[1] == '\n')) return p + 2;
+    }
+    return NULL;
+}
+
+/* Value of the header on the line at p, with leading white space dropped */
+
+static const uint8_t *header_value (const uint8_t *p, const uint8_t *end)
+{
+    p = memchr (p, ':', (size_t)(end - p));
+    if (p == NULL) return end;
+    for (p++; (p < end) && ((*p == ' ') || (*p == '\t')); p++);
+    return p;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* mail_packet                                                             */
+/* INPUTS: ctx - the mail_scan                                             */
+/*         pkt - a packet from the push parser                             */
+/* RETURN: TRUE to carry on                                                */
+/*                                                                         */
+/* One line is reported for each recipient of a public key encrypted      */
+/* session key, each passphrase session key, each key, subkey and user ID */
+/* and each signature.                                                    */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t mail_packet (void *ctx, const struct push_packet *pkt)
+{
+struct mail_scan *scan = ctx;
+struct armor_report *out = &scan->file->report;
+struct pgp_pkesk  pkesk;
+struct pgp_sig    sig;
+uint8_t  fpr[PKT_MAX_FPR];
+uint8_t  keyid[PKT_KEYID_LEN];
+uint8_t  fpr_len;
+uint32_t shown;
+
+    scan->packets++;
+    if (is_stream (pkt->tag)) return TRUE;
+    switch (pkt->tag)
+    {
+        case PktPKESKP:
+            if (!decode_pkesk (pkt->data, pkt->len, &pkesk)) break;
+            emit_find (scan);
+            if (pkesk.recipient_len < PKT_KEYID_LEN)
+            {
+                report_emit (out, "to anonymous\n");
+                break;
+            }
+            /* v4 key IDs are the tail of the fingerprint, v6 the head */
+            report_emit (out, "to ");
+            report_hex (out, (pkesk.key_version == 4u) ?
+                        pkesk.recipient + pkesk.recipient_len - PKT_KEYID_LEN :
+                        pkesk.recipient, PKT_KEYID_LEN);
+            report_emit (out, "\n");
+            break;
+        case PktSKESKP:
+            emit_find (scan);
+            report_emit (out, "passphrase\n");
+            break;
+        case PktPublicKey:
+        case PktSecretKey:
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            if (!key_fingerprint (pkt->data, pkt->len, fpr, &fpr_len, keyid)) break;
+            emit_find (scan);
+            report_emit (out, ((pkt->tag == PktPublicKey) || (pkt->tag == PktSecretKey)) ?
+                         "key " : "subkey ");
+            report_hex (out, fpr, fpr_len);
+            report_emit (out, "\n");
+            break;
+        case PktUserID:
+            shown = (pkt->len > MAIL_UID_SHOWN) ? MAIL_UID_SHOWN : pkt->len;
+            emit_find (scan);
+            report_emit (out, "uid %.*s\n", (int)shown, (const char *)pkt->data);
+            break;
+        case PktSignature:
+            if (!decode_signature (pkt->data, pkt->len, &sig)) break;
+            emit_find (scan);
+            report_emit (out, "sig ");
+            if (sig.has_issuer)
+            {
+                report_hex (out, sig.issuer, PKT_KEYID_LEN);
+            }
+            else
+            {
+                report_emit (out, "-");
+            }
+            report_emit (out, " type 0x%02x made ", sig.type);
+            report_date (out, sig.created);
+            report_emit (out, "\n");
+            break;
+        default:
+            break;
+    }
+    return !out->failed;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* mail_packets                                                            */
+/* INPUTS: scan - the file being searched                                  */
+/*         data - decoded packets                                          */
+/*         len - their length                                              */
+/* RETURN: none                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+static void mail_packets (struct mail_scan *scan, const uint8_t *data, size_t len)
+{
+struct push_parser *parser;
+enum push_status status;
+
+    parser = push_new (mail_packet, scan);
+    if (parser == NULL)
+    {
+        scan->file->report.failed = TRUE;
+        return;
+    }
+    scan->packets = 0u;
+    status = push_feed (parser, data, len);
+    if (status == PushOK) status = push_finish (parser);
+    if (status == PushFailed)
+    {
+        emit_find (scan);
+        report_emit (&scan->file->report, "damaged after %u packets\n", scan->packets);
+    }
+    push_free (parser);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* mail_armor                                                              */
+/* INPUTS: scan - the file being searched                                  */
+/*         p - a BEGIN line                                                */
+/*         end - end of the text it is in                                  */
+/* RETURN: the newline ending the armor, where the search goes on from    */
+/*                                                                         */
+/* The armor is read by armor_read, and the packets in its data reported.  */
+/* Clear signed text is passed over; its signature has armor of its own.   */
+/* The search goes on from the newline, not past it, so that a BEGIN line  */
+/* straight after the END line is still found as a mark.                   */
+/*                                                                         */
+/***************************************************************************/
+
+static const uint8_t *mail_armor (struct mail_scan *scan, const uint8_t *p,
+                                  const uint8_t *end)
+{
+struct armor_block block;
+
+    if (!armor_read (p, end, &scan->armor, &block)) return line_after (p, end) - 1;
+    if (block.got) mail_packets (scan, scan->armor.data, block.got);
+    return block.end - 1;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* mail_part_end                                                           */
+/* INPUTS: scan - the file being searched                                  */
+/*         p - the boundary line or message end closing the current part   */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* A part worth decoding holds armor, or packets starting with a header    */
+/* octet; anything else, such as an attachment mislabelled as octet       */
+/* stream, is dropped once the first few octets show it.                   */
+/*                                                                         */
+/***************************************************************************/
+
+static void mail_part_end (struct mail_scan *scan, const uint8_t *p)
+{
+const uint8_t *text;
+const uint8_t *stop;
+size_t got;
+
+    if (scan->part_pgp && scan->part_base64 && scan->part_body && (scan->part_body < p))
+    {
+        got = base64_decode (scan->part_body, p, &scan->decoded);
+        for (text = scan->decoded.data, stop = text + got;
+                 (text < stop) && ((*text == ' ') || (*text == '\r') || (*text == '\n'));
+                 text++);
+        if (opens_with (text, stop, ARMOR_BEGIN))
+        {
+            while (text < stop)
+            {
+                text = mail_armor (scan, text, stop);
+                text = memmem (text, (size_t)(stop - text), ARMOR_BEGIN, ARMOR_BEGIN_LEN);
+                if (text == NULL) break;
+            }
+        }
+        else if ((text < stop) && (*text & PKT_INDICATED))
+        {
+            mail_packets (scan, text, (size_t)(stop - text));
+        }
+    }
+    scan->part_body   = NULL;
+    scan->part_pgp    = FALSE;
+    scan->part_base64 = FALSE;
+}
+
+/* Start a message at p, which is the start of the file or an mbox From line */
+
+static void mail_message (struct mail_scan *scan, const uint8_t *p)
+{
+    mail_part_end (scan, p);
+    scan->message     = p;
+    scan->headers_end = blank_line (p, scan->end);
+    if (scan->headers_end == NULL) scan->headers_end = scan->end;
+    scan->id          = NULL;
+    scan->id_len      = 0u;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* mail_line                                                               */
+/* INPUTS: scan - the file being searched                                  */
+/*         p - the start of a line opening with one of the marks           */
+/* RETURN: where the search goes on from                                   */
+/*                                                                         */
+/***************************************************************************/
+
+static const uint8_t *mail_line (struct mail_scan *scan, const uint8_t *p)
+{
+const uint8_t *end = scan->end;
+const uint8_t *value;
+const uint8_t *at;
+
+    if (scan->mbox && (p > scan->message) && ((size_t)(end - p) >= 5u) &&
+            !memcmp (p, "From ", 5u))
+    {
+        mail_message (scan, p);
+    }
+    else if (opens_with (p, end, ARMOR_BEGIN))
+    {
+        return mail_armor (scan, p, end);
+    }
+    else if (opens_with (p, end, "--"))
+    {
+        mail_part_end (scan, p);
+    }
+    else if (opens_with (p, end, "Message-ID:") && !scan->id && (p < scan->headers_end))
+    {
+        value = header_value (p, end);
+        for (at = value; (at < end) && (*at > ' ') && (at - value < MAIL_ID_SHOWN); at++);
+        scan->id     = value;
+        scan->id_len = (uint32_t)(at - value);
+    }
+    else if (opens_with (p, end, "Content-Type:"))
+    {
+        value = header_value (p, end);
+        if (opens_with (value, end, "application/pgp-") ||
+                opens_with (value, end, "application/octet-stream"))
+        {
+            scan->part_pgp = TRUE;
+            if (!scan->part_body) scan->part_body = blank_line (p, end);
+        }
+    }
+    else if (opens_with (p, end, "Content-Transfer-Encoding:"))
+    {
+        value = header_value (p, end);
+        if (opens_with (value, end, "base64"))
+        {
+            scan->part_base64 = TRUE;
+            if (!scan->part_body) scan->part_body = blank_line (p, end);
+        }
+    }
+    return p;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* mail_search                                                             */
+/* INPUTS: file - the file to search                                       */
+/*         scan - the thread's buffers                                     */
+/* RETURN: none                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+static void mail_search (struct mail_file *file, struct mail_scan *scan)
+{
+struct stat st;
+const uint8_t *p;
+void *map;
+int   fd;
+
+    fd = open (file->name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf (stderr, "%s: cannot open\n", file->name);
+        file->report.failed = TRUE;
+        return;
+    }
+    if (fstat (fd, &st) || !S_ISREG (st.st_mode) || (st.st_size == 0))
+    {
+        close (fd);
+        return;
+    }
+    map = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf (stderr, "%s: cannot be mapped\n", file->name);
+        file->report.failed = TRUE;
+        return;
+    }
+    madvise (map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    scan->file        = file;
+    scan->base        = map;
+    scan->end         = scan->base + st.st_size;
+    scan->mbox        = (st.st_size >= 5) && !memcmp (scan->base, "From ", 5u);
+    scan->part_body   = NULL;
+    scan->part_pgp    = FALSE;
+    scan->part_base64 = FALSE;
+    mail_message (scan, scan->base);
+
+    p = is_mark (*scan->base) ? scan->base : next_mark (scan->base, scan->end);
+    while ((p < scan->end) && !file->report.failed)
+    {
+        p = mail_line (scan, p);
+        p = next_mark (p, scan->end);
+    }
+    mail_part_end (scan, scan->end);
+    munmap (map, (size_t)st.st_size);
+}
+
+static void *mail_worker (void *arg)
+{
+struct mail_job  *job = arg;
+struct mail_scan  scan;
+uint32_t index;
+
+    memset (&scan, 0, sizeof(scan));
+    for (;;)
+    {
+        pthread_mutex_lock (&job->lock);
+        index = job->next;
+        if (index < job->files) job->next++;
+        pthread_mutex_unlock (&job->lock);
+        if (index >= job->files) break;
+
+        mail_search (&job->file[index], &scan);
+
+        pthread_mutex_lock (&job->lock);
+        job->file[index].done = TRUE;
+        pthread_cond_broadcast (&job->finished);
+        pthread_mutex_unlock (&job->lock);
+    }
+    grab_release (&scan.decoded);
+    grab_release (&scan.armor);
+    return NULL;
+}
+
+static int by_name (const void *a, const void *b)
+{
+    return strcmp (*(char * const *)a, *(char * const *)b);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* mail_add                                                                */
+/* INPUTS: job - the list of files                                         */
+/*         name - a file, or a directory to add every file under           */
+/* RETURN: FALSE if memory ran out                                         */
+/*                                                                         */
+/* A directory's entries are taken in name order, so the report is the     */
+/* same from run to run. The tmp directory of a Maildir holds messages    */
+/* still being delivered, and is passed over.                              */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t mail_add (struct mail_job *job, const char *name)
+{
+struct mail_file *grown;
+struct dirent *entry;
+struct stat st;
+DIR     *dir;
+char   **names = NULL;
+char   **more;
+char    *path;
+size_t   count = 0u;
+size_t   size = 0u;
+size_t   i;
+uint8_t  ok = TRUE;
+
+    if (stat (name, &st))
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        return TRUE;
+    }
+    if (!S_ISDIR (st.st_mode))
+    {
+        if (job->files == job->file_size)
+        {
+            size  = job->file_size ? (job->file_size * 2u) : 64u;
+            grown = realloc (job->file, size * sizeof(*grown));
+            if (grown == NULL) return FALSE;
+            job->file      = grown;
+            job->file_size = (uint32_t)size;
+        }
+        memset (&job->file[job->files], 0, sizeof(*job->file));
+        job->file[job->files].name = strdup (name);
+        if (job->file[job->files].name == NULL) return FALSE;
+        job->files++;
+        return TRUE;
+    }
+
+    dir = opendir (name);
+    if (dir == NULL)
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        return TRUE;
+    }
+    while ((entry = readdir (dir)) != NULL)
+    {
+        if (!strcmp (entry->d_name, ".") || !strcmp (entry->d_name, "..") ||
+                !strcmp (entry->d_name, "tmp"))
+        {
+            continue;
+        }
+        if (count == size)
+        {
+            size = size ? (size * 2u) : 64u;
+            more = realloc (names, size * sizeof(*more));
+            if (more == NULL)
+            {
+                ok = FALSE;
+                break;
+            }
+            names = more;
+        }
+        path = malloc (strlen (name) + strlen (entry->d_name) + 2u);
+        if (path == NULL)
+        {
+            ok = FALSE;
+            break;
+        }
+        sprintf (path, "%s/%s", name, entry->d_name);
+        names[count++] = path;
+    }
+    closedir (dir);
+    if (count) qsort (names, count, sizeof(*names), by_name);
+    for (i = 0u; i < count; i++)
+    {
+        if (ok) ok = mail_add (job, names[i]);
+        free (names[i]);
+    }
+    free (names);
+    return ok;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* mail_archives                                                           */
+/* INPUTS: names - mbox files, Maildir directories, or single messages     */
+/*         count - how many                                                */
+/*         threads - worker threads                                        */
+/* RETURN: 0 if anything was found, 1 if nothing, 2 on trouble             */
+/*                                                                         */
+/* Each find is printed as the file, the offset of its message in the      */
+/* file, the Message-ID (or - if there is none) and what was found:        */
+/*                                                                         */
+/*   to KEYID               a recipient of a public key encrypted message  */
+/*   to anonymous           a recipient whose key ID was left out          */
+/*   passphrase             a passphrase session key                       */
+/*   key FPR, subkey FPR    a key or subkey, such as an attached key       */
+/*   uid TEXT               a user ID of one                               */
+/*   sig KEYID type 0xNN made DATE                                         */
+/*                          a signature, with its issuer or - if none      */
+/*   damaged after N packets                                               */
+/*                                                                         */
+/***************************************************************************/
+
+extern int mail_archives (char **names, uint32_t count, uint32_t threads)
+{
+struct mail_job job;
+pthread_t *thread = NULL;
+uint64_t finds = 0u;
+uint32_t started = 0u;
+uint32_t i;
+int      status = 2;
+
+    memset (&job, 0, sizeof(job));
+    for (i = 0u; i < count; i++)
+    {
+        if (!mail_add (&job, names[i])) goto done;
+    }
+    if (job.files == 0u)
+    {
+        status = 1;
+        goto done;
+    }
+    if (threads < 1u) threads = 1u;
+    if (threads > job.files) threads = job.files;
+    thread = calloc (threads, sizeof(*thread));
+    if (thread == NULL) goto done;
+    pthread_mutex_init (&job.lock, NULL);
+    pthread_cond_init (&job.finished, NULL);
+    for (started = 0u; started < threads; started++)
+    {
+        if (pthread_create (&thread[started], NULL, mail_worker, &job)) break;
+    }
+    if (started == 0u) mail_worker (&job);
+
+    /* print the files in order as they finish */
+    status = 0;
+    for (i = 0u; i < job.files; i++)
+    {
+        pthread_mutex_lock (&job.lock);
+        while (!job.file[i].done) pthread_cond_wait (&job.finished, &job.lock);
+        pthread_mutex_unlock (&job.lock);
+        if (job.file[i].report.failed) status = 2;
+        fwrite (job.file[i].report.text, 1u, job.file[i].report.len, stdout);
+        finds += job.file[i].finds;
+        free (job.file[i].report.text);
+        job.file[i].report.text = NULL;
+    }
+    for (i = 0u; i < started; i++)
+    {
+        pthread_join (thread[i], NULL);
+    }
+    pthread_cond_destroy (&job.finished);
+    pthread_mutex_destroy (&job.lock);
+    fflush (stdout);
+    if (!status && !finds) status = 1;
+
+done:
+    for (i = 0u; i < job.files; i++)
+    {
+        free (job.file[i].name);
+    }
+    free (job.file);
+    free (thread);
+    return status;
+}
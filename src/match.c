@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+#include "pattern.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+#define NOTATION_HEAD   (8u)
+#define MATCH_CHUNK     ((size_t)1u << 16)
+
+/***************************************************************************/
+/*                                                                         */
+/* Where the packets of the current key block lie in the input is kept,   */
+/* as runs of adjacent packets, until the next primary key shows up; if    */
+/* any of its user IDs, signer user IDs or notations matched, the block's */
+/* packets are then copied out unchanged, as --export does.               */
+/*                                                                         */
+/***************************************************************************/
+
+struct match_run
+{
+    off_t           start;
+    off_t           end;
+};
+
+struct match_ctx
+{
+    const struct pattern_set *patterns;
+    int             in;
+    FILE           *out;
+    struct match_run *run;
+    size_t          runs;
+    size_t          run_size;
+    uint8_t         in_block;
+    uint8_t         matched;
+    uint8_t         failed;
+    uint64_t        blocks;
+    uint64_t        hits;
+};
+
+/* Copy the input from offset to end onto the output */
+
+static uint8_t copy_range (struct match_ctx *match, off_t offset, off_t end)
+{
+static uint8_t buffer[MATCH_CHUNK];
+ssize_t done;
+size_t  chunk;
+
+    while (offset < end)
+    {
+        chunk = ((uint64_t)(end - offset) > MATCH_CHUNK) ? MATCH_CHUNK : (size_t)(end - offset);
+        done  = pread (match->in, buffer, chunk, offset);
+        if (done <= 0) return FALSE;
+        if (fwrite (buffer, 1u, (size_t)done, match->out) != (size_t)done) return FALSE;
+        offset += done;
+    }
+    return TRUE;
+}
+
+static uint8_t flush_block (struct match_ctx *match)
+{
+size_t i;
+
+    if (match->in_block && match->matched)
+    {
+        match->hits++;
+        for (i = 0u; i < match->runs; i++)
+        {
+            if (!copy_range (match, match->run[i].start, match->run[i].end)) return FALSE;
+        }
+    }
+    match->runs    = 0u;
+    match->matched = FALSE;
+    return TRUE;
+}
+
+static uint8_t keep (struct match_ctx *match, const struct keyring_packet *pkt)
+{
+struct match_run *grown;
+size_t size;
+
+    if (match->runs && (match->run[match->runs - 1u].end == pkt->offset))
+    {
+        match->run[match->runs - 1u].end = pkt->end;
+        return TRUE;
+    }
+    if (match->runs == match->run_size)
+    {
+        size  = match->run_size ? (match->run_size * 2u) : 16u;
+        grown = realloc (match->run, size * sizeof(*grown));
+        if (grown == NULL) return FALSE;
+        match->run      = grown;
+        match->run_size = size;
+    }
+    match->run[match->runs].start = pkt->offset;
+    match->run[match->runs].end   = pkt->end;
+    match->runs++;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* sig_matches                                                             */
+/* INPUTS: patterns - the compiled patterns                                */
+/*         sig - a decoded signature                                       */
+/* RETURN: TRUE if its signer user ID or a notation matches                */
+/*                                                                         */
+/* Notations are searched over their name and value, past the flags and    */
+/* the two lengths.                                                        */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t sig_matches (const struct pattern_set *patterns, const struct pgp_sig *sig)
+{
+struct pgp_subpacket sub;
+const uint8_t *area[2];
+uint32_t       area_len[2];
+uint32_t       offset;
+uint8_t        a;
+
+    area[0] = sig->hashed;
+    area[1] = sig->unhashed;
+    area_len[0] = sig->hashed_len;
+    area_len[1] = sig->unhashed_len;
+    for (a = 0u; a < 2u; a++)
+    {
+        offset = 0ul;
+        while (next_subpacket (area[a], area_len[a], &offset, &sub))
+        {
+            if ((sub.type == SubPktSignerUserID) &&
+                    pattern_search (patterns, sub.data, sub.len))
+            {
+                return TRUE;
+            }
+            if ((sub.type == SubPktNotationData) && (sub.len > NOTATION_HEAD) &&
+                    pattern_search (patterns, sub.data + NOTATION_HEAD,
+                                    sub.len - NOTATION_HEAD))
+            {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* match_collect                                                           */
+/* INPUTS: ctx - the match context                                         */
+/*         block - the key block being walked                              */
+/*         pkt - the packet                                                */
+/* RETURN: FALSE to stop the walk on a write or memory failure             */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t match_collect (void *ctx, const struct keyring_block *block,
+                              const struct keyring_packet *pkt)
+{
+struct match_ctx *match = ctx;
+struct pgp_sig    sig;
+
+    (void)block;
+    if ((pkt->tag == PktPublicKey) || (pkt->tag == PktSecretKey))
+    {
+        if (!flush_block (match)) goto fail;
+        match->in_block = TRUE;
+        match->blocks++;
+    }
+    if (!match->in_block || (pkt->body == NULL)) return TRUE;
+    if (!keep (match, pkt)) goto fail;
+    if (match->matched) return TRUE;
+
+    switch (pkt->tag)
+    {
+        case PktUserID:
+            match->matched = pattern_search (match->patterns, pkt->body, pkt->len);
+            break;
+        case PktSignature:
+            if (decode_signature (pkt->body, pkt->len, &sig))
+            {
+                match->matched = sig_matches (match->patterns, &sig);
+            }
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+
+fail:
+    match->failed = TRUE;
+    return FALSE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* match_keyrings                                                          */
+/* INPUTS: pattern_file - patterns, one per line                           */
+/*         name - keyring to search, which must be a regular file          */
+/*         out_name - keyring to write, or NULL for stdout                 */
+/* RETURN: 0 if some key block matched, 1 if none did, 2 on failure        */
+/*                                                                         */
+/* One pass, with every user ID searched in place as it is parsed. The     */
+/* number of blocks matched is reported on stderr, keeping stdout for the  */
+/* keyring.                                                                */
+/*                                                                         */
+/***************************************************************************/
+
+extern int match_keyrings (const char *pattern_file, const char *name,
+                           const char *out_name)
+{
+struct match_ctx match;
+struct source   *src;
+int              status = 2;
+
+    memset (&match, 0, sizeof(match));
+    match.patterns = pattern_load (pattern_file);
+    if (match.patterns == NULL)
+    {
+        fprintf (stderr, "%s: no patterns could be loaded\n", pattern_file);
+        return status;
+    }
+    src = source_open (name);
+    if (src == NULL)
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        goto done;
+    }
+    if (!src->seekable)
+    {
+        fprintf (stderr, "--match-file copies key blocks by offset, so needs a regular file\n");
+        goto done;
+    }
+    match.in  = src->fd;
+    match.out = out_name ? fopen (out_name, "wb") : stdout;
+    if (match.out == NULL) goto done;
+
+    if (!keyring_walk (src, 0u, match_collect, &match) && !match.failed)
+    {
+        fprintf (stderr, "%s: malformed packet, rest of file ignored\n", name);
+    }
+    if (!match.failed && flush_block (&match) && !fflush (match.out))
+    {
+        fprintf (stderr, "%llu of %llu key blocks matched, using %u patterns\n",
+                 (unsigned long long)match.hits, (unsigned long long)match.blocks,
+                 match.patterns->count);
+        status = match.hits ? 0 : 1;
+    }
+
+done:
+    if (match.out && (match.out != stdout)) fclose (match.out);
+    source_close (src);
+    free (match.run);
+    pattern_free ((struct pattern_set *)match.patterns);
+    return status;
+}
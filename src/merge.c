@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+#include "extsort.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/***************************************************************************/
+/*                                                                         */
+/* One record per packet of every key block in every input. The sort key   */
+/* runs up to the file index: primary fingerprint, the component (the      */
+/* primary key itself, a user ID, attribute or subkey) and its digest,     */
+/* whether this is the component or one of its signatures, and the digest  */
+/* of the packet. Sorting brings every copy of a packet together and puts  */
+/* the key block in canonical order; the file index breaks ties so the     */
+/* copy from the earliest input is the one written.                        */
+/*                                                                         */
+/***************************************************************************/
+
+enum merge_component
+{
+    MergePrimary,
+    MergeUserID,
+    MergeAttribute,
+    MergeSubkey
+};
+
+enum merge_role
+{
+    MergeItself,
+    MergeSignature
+};
+
+struct merge_record
+{
+    uint8_t         primary[PKT_MAX_FPR];
+    uint8_t         fpr_len;
+    uint8_t         component;
+    uint8_t         reserved[2];
+    uint8_t         component_digest[DIGEST_LEN];
+    uint8_t         role;
+    uint8_t         unused[3];
+    uint8_t         digest[DIGEST_LEN];
+    uint32_t        file;
+    uint32_t        spare;
+    uint64_t        offset;
+};
+
+#define MERGE_KEY_LEN   (offsetof(struct merge_record, file))
+
+struct merge_input
+{
+    struct extsort *sort;
+    uint32_t        file;
+    uint8_t         component;
+    uint8_t         component_digest[DIGEST_LEN];
+};
+
+static int compare_records (const void *a, const void *b)
+{
+int order;
+
+    order = memcmp (a, b, MERGE_KEY_LEN);
+    if (order) return order;
+    return (((const struct merge_record *)a)->file >
+            ((const struct merge_record *)b)->file) ? 1 :
+           (((const struct merge_record *)a)->file <
+            ((const struct merge_record *)b)->file) ? -1 : 0;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* public_digest                                                           */
+/* INPUTS: body - key or subkey packet body                                */
+/*         len - length of the body                                        */
+/* OUTPUT: digest - digest of the public part only                         */
+/*                                                                         */
+/* So a secret key and its public key collapse into one.                   */
+/*                                                                         */
+/***************************************************************************/
+
+static void public_digest (const uint8_t *body, uint32_t len, uint8_t *digest)
+{
+struct pgp_key key;
+uint32_t       public_len;
+
+    public_len = 0ul;
+    if (decode_public_key (body, len, &key))
+    {
+        public_len = key_public_len (body, &key);
+    }
+    content_digest (NULL, 0ul, body, public_len ? public_len : len, digest);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* merge_collect                                                           */
+/* INPUTS: ctx - the merge input state                                     */
+/*         block - the key block being walked                              */
+/*         pkt - the packet                                                */
+/* RETURN: FALSE if the record could not be stored                         */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t merge_collect (void *ctx, const struct keyring_block *block,
+                              const struct keyring_packet *pkt)
+{
+struct merge_input  *input = ctx;
+struct merge_record  record;
+
+    if (!block->valid) return TRUE;
+    memset (&record, 0, sizeof(record));
+    record.role = MergeItself;
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            input->component = MergePrimary;
+            memset (input->component_digest, 0, DIGEST_LEN);
+            public_digest (pkt->body, pkt->len, record.digest);
+            break;
+        case PktUserID:
+        case PktUserAttribute:
+            input->component = (pkt->tag == PktUserID) ? MergeUserID : MergeAttribute;
+            content_digest (NULL, 0ul, pkt->body, pkt->len, input->component_digest);
+            memcpy (record.digest, input->component_digest, DIGEST_LEN);
+            break;
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            input->component = MergeSubkey;
+            public_digest (pkt->body, pkt->len, input->component_digest);
+            memcpy (record.digest, input->component_digest, DIGEST_LEN);
+            break;
+        case PktSignature:
+            record.role = MergeSignature;
+            content_digest (NULL, 0ul, pkt->body, pkt->len, record.digest);
+            break;
+        default:
+            return TRUE;
+    }
+    memcpy (record.primary, block->fpr, block->fpr_len);
+    record.fpr_len   = block->fpr_len;
+    record.component = input->component;
+    memcpy (record.component_digest, input->component_digest, DIGEST_LEN);
+    record.file      = input->file;
+    record.offset    = (uint64_t)pkt->offset;
+    return extsort_add (input->sort, &record);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* write_packet                                                            */
+/* INPUTS: out - output keyring                                            */
+/*         tag - packet type                                               */
+/*         body - packet body                                              */
+/*         len - length of the body                                        */
+/* RETURN: TRUE if written                                                 */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t write_packet (FILE *out, enum packet_tags tag, const uint8_t *body,
+                             uint32_t len)
+{
+uint8_t  head[PKT_MAX_HEADER];
+uint32_t head_len;
+
+    head_len = encode_header ((uint8_t)tag, len, head);
+    return (fwrite (head, 1u, head_len, out) == head_len) &&
+           (fwrite (body, 1u, len, out) == len);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* emit                                                                    */
+/* INPUTS: out - output keyring                                            */
+/*         in - the input the record came from                             */
+/*         record - the packet to copy                                     */
+/*         buf - buffer for reading the packet back                        */
+/* RETURN: TRUE if the packet was copied                                   */
+/*                                                                         */
+/* Secret keys and subkeys are written as public ones.                     */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t emit (FILE *out, struct source *in, const struct merge_record *record,
+                     struct grab_buffer *buf)
+{
+enum packet_tags tag;
+struct pgp_key   key;
+uint32_t         len;
+uint32_t         public_len;
+
+    if (!keyring_read_at (in, (off_t)record->offset, buf, &tag, &len)) return FALSE;
+    if ((tag == PktSecretKey) || (tag == PktSecretSubkey))
+    {
+        tag = (tag == PktSecretKey) ? PktPublicKey : PktPublicSubkey;
+        if (decode_public_key (buf->data, len, &key))
+        {
+            public_len = key_public_len (buf->data, &key);
+            if (public_len) len = public_len;
+        }
+    }
+    return write_packet (out, tag, buf->data, len);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* merge_keyrings                                                          */
+/* INPUTS: out_name - keyring to write, or NULL for stdout                 */
+/*         names - the input keyrings                                      */
+/*         count - number of inputs                                        */
+/*         memory - bytes of sort records held in memory                   */
+/* RETURN: 0 on success, 1 on failure                                      */
+/*                                                                         */
+/* Every packet of every input is recorded in one external sort, which     */
+/* groups the key blocks by primary fingerprint and brings duplicate user  */
+/* IDs, subkeys and signatures next to each other. A single pass over the  */
+/* sorted records then writes each distinct packet once, read back from   */
+/* whichever input it first appeared in.                                   */
+/*                                                                         */
+/***************************************************************************/
+
+extern int merge_keyrings (const char *out_name, char **names, uint32_t count,
+                           size_t memory)
+{
+struct source     **in;
+FILE               *out;
+struct merge_input  input;
+struct merge_record record, last;
+struct grab_buffer  buf = { NULL, 0ul };
+uint8_t             have_last = FALSE;
+uint8_t             ok = FALSE;
+uint32_t            i;
+
+    memset (&input, 0, sizeof(input));
+    in  = calloc (count, sizeof(struct source *));
+    out = out_name ? fopen (out_name, "wb") : stdout;
+    input.sort = extsort_open (sizeof(struct merge_record), memory, compare_records);
+    if ((in == NULL) || (out == NULL) || (input.sort == NULL)) goto done;
+
+    for (i = 0u; i < count; i++)
+    {
+        in[i] = source_open (names[i]);
+        if (in[i] == NULL)
+        {
+            fprintf (stderr, "%s: cannot open\n", names[i]);
+            goto done;
+        }
+        if (!in[i]->seekable)
+        {
+            fprintf (stderr, "%s: --merge reads packets back, so needs a regular file\n",
+                     names[i]);
+            goto done;
+        }
+        input.file = i;
+        if (!keyring_walk (in[i], 0u, merge_collect, &input))
+        {
+            fprintf (stderr, "%s: malformed packet, rest of file ignored\n", names[i]);
+        }
+    }
+    if (!extsort_finish (input.sort)) goto done;
+
+    ok = TRUE;
+    while (ok && extsort_next (input.sort, &record))
+    {
+        if (have_last && !memcmp (&record, &last, MERGE_KEY_LEN)) continue;
+        ok        = emit (out, in[record.file], &record, &buf);
+        last      = record;
+        have_last = TRUE;
+    }
+    if (fflush (out)) ok = FALSE;
+
+done:
+    grab_release (&buf);
+    extsort_close (input.sort);
+    if (in != NULL)
+    {
+        for (i = 0u; i < count; i++)
+        {
+            source_close (in[i]);
+        }
+        free (in);
+    }
+    if (out && (out != stdout)) fclose (out);
+    return ok ? 0 : 1;
+}
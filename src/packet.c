@@ -0,0 +1,913 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "2440.h"
+#include "packet.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/* Curve OIDs, as they appear after the one octet OID length */
+
+static const uint8_t oid_nistp256[]      = { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07 };
+static const uint8_t oid_nistp384[]      = { 0x2b, 0x81, 0x04, 0x00, 0x22 };
+static const uint8_t oid_nistp521[]      = { 0x2b, 0x81, 0x04, 0x00, 0x23 };
+static const uint8_t oid_secp256k1[]     = { 0x2b, 0x81, 0x04, 0x00, 0x0a };
+static const uint8_t oid_brainpool256[]  = { 0x2b, 0x24, 0x03, 0x03, 0x02, 0x08, 0x01, 0x01, 0x07 };
+static const uint8_t oid_brainpool384[]  = { 0x2b, 0x24, 0x03, 0x03, 0x02, 0x08, 0x01, 0x01, 0x0b };
+static const uint8_t oid_brainpool512[]  = { 0x2b, 0x24, 0x03, 0x03, 0x02, 0x08, 0x01, 0x01, 0x0d };
+static const uint8_t oid_ed25519[]       = { 0x2b, 0x06, 0x01, 0x04, 0x01, 0xda, 0x47, 0x0f, 0x01 };
+static const uint8_t oid_cv25519[]       = { 0x2b, 0x06, 0x01, 0x04, 0x01, 0x97, 0x55, 0x01, 0x05, 0x01 };
+static const uint8_t oid_ed448[]         = { 0x2b, 0x65, 0x71 };
+static const uint8_t oid_x448[]          = { 0x2b, 0x65, 0x6f };
+
+static const struct pgp_curve curves[] =
+{
+    { oid_nistp256,     sizeof(oid_nistp256),     "nistp256",        256u },
+    { oid_nistp384,     sizeof(oid_nistp384),     "nistp384",        384u },
+    { oid_nistp521,     sizeof(oid_nistp521),     "nistp521",        521u },
+    { oid_secp256k1,    sizeof(oid_secp256k1),    "secp256k1",       256u },
+    { oid_brainpool256, sizeof(oid_brainpool256), "brainpoolP256r1", 256u },
+    { oid_brainpool384, sizeof(oid_brainpool384), "brainpoolP384r1", 384u },
+    { oid_brainpool512, sizeof(oid_brainpool512), "brainpoolP512r1", 512u },
+    { oid_ed25519,      sizeof(oid_ed25519),      "ed25519",         255u },
+    { oid_cv25519,      sizeof(oid_cv25519),      "cv25519",         255u },
+    { oid_ed448,        sizeof(oid_ed448),        "ed448",           448u },
+    { oid_x448,         sizeof(oid_x448),         "x448",            448u }
+};
+
+#define NUM_CURVES      (sizeof(curves) / sizeof(curves[0]))
+
+static uint16_t read_be16 (const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+extern uint32_t read_be32 (const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8)  |  (uint32_t)p[3];
+}
+
+static const struct pgp_curve *find_curve (const uint8_t *oid, uint8_t oid_len)
+{
+uint8_t i;
+
+    for (i = 0u; i < NUM_CURVES; i++)
+    {
+        if ((curves[i].oid_len == oid_len) &&
+                !memcmp (curves[i].oid, oid, oid_len))
+        {
+            return &curves[i];
+        }
+    }
+    return NULL;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* native_size                                                             */
+/* INPUTS: algorithm - public key algorithm                                */
+/*         sig - whether the size of a signature is wanted                 */
+/* RETURN: fixed octet size of the native field, or zero for MPI based     */
+/*         algorithms                                                      */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t native_size (uint8_t algorithm, uint8_t sig)
+{
+    switch (algorithm)
+    {
+        case PKAlgX25519:
+            return 32u;
+        case PKAlgX448:
+            return 56u;
+        case PKAlgEd25519:
+            return sig ? 64u : 32u;
+        case PKAlgEd448:
+            return sig ? 114u : 57u;
+        default:
+            return 0u;
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* read_mpi                                                                */
+/* INPUTS: p - start of the MPI                                            */
+/*         avail - octets left in the packet                               */
+/* RETURN: octets taken by the MPI, or zero if it overruns the packet      */
+/* OUTPUT: field - the MPI's bit count and value                           */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t read_mpi (const uint8_t *p, uint32_t avail, struct pgp_field *field)
+{
+uint32_t len;
+
+    if (avail < sizeof(uint16_t)) return 0ul;
+    field->bits = read_be16 (p);
+    len = ((uint32_t)field->bits + 7ul) / 8ul;
+    if (len > avail - sizeof(uint16_t)) return 0ul;
+    field->data = p + sizeof(uint16_t);
+    field->len  = len;
+    return len + sizeof(uint16_t);
+}
+
+static uint32_t read_native (const uint8_t *p, uint32_t avail, uint32_t len,
+                             struct pgp_field *field)
+{
+    if (len > avail) return 0ul;
+    field->data = p;
+    field->len  = len;
+    field->bits = (uint16_t)(len * 8ul);
+    return len;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* decode_length                                                           */
+/* INPUTS: p - new format length octets                                    */
+/*         avail - octets available at p                                   */
+/* RETURN: number of length octets used, or zero if they overrun           */
+/* OUTPUT: pLength - the decoded length                                    */
+/*                                                                         */
+/* One, two and five octet lengths as used for subpackets.                 */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t decode_length (const uint8_t *p, uint32_t avail, uint32_t *pLength)
+{
+    if (avail < 1u) return 0u;
+    if (p[0] <= PKT_LEN_ONE_MAX)
+    {
+        *pLength = p[0];
+        return 1u;
+    }
+    if (p[0] < PKT_LEN_LEADING)
+    {
+        if (avail < 2u) return 0u;
+        *pLength = ((uint32_t)(p[0] - (PKT_LEN_ONE_MAX + 1u)) << 8) + p[1] +
+                   (PKT_LEN_ONE_MAX + 1u);
+        return 2u;
+    }
+    if (avail < 5u) return 0u;
+    *pLength = read_be32 (p + 1);
+    return 5u;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* decode_public_key                                                       */
+/* INPUTS: body - key packet body                                          */
+/*         len - length of the body                                        */
+/* RETURN: TRUE if the fixed part of the key was understood                */
+/* OUTPUT: key - version, algorithm, curve, size and public key material   */
+/*                                                                         */
+/* Version 5 and 6 keys carry a four octet count of the key material, so   */
+/* the material is located without looking inside it. For the older        */
+/* versions of secret keys the material runs on into the secret part;      */
+/* key_fields will find where it ends. The key size comes from the first   */
+/* MPI header or from the curve, both of which are at the start.           */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t decode_public_key (const uint8_t *body, uint32_t len, struct pgp_key *key)
+{
+uint32_t offset;
+
+    memset (key, 0, sizeof(*key));
+    if (len < KEY_VERSION_4_BAS) return FALSE;
+    key->version = body[0];
+    key->created = read_be32 (body + 1);
+    switch (key->version)
+    {
+        case 2u:
+        case 3u:
+            if (len < KEY_VERSION_3_BAS) return FALSE;
+            key->days_valid   = read_be16 (body + 5);
+            key->algorithm    = body[7];
+            offset            = KEY_VERSION_3_BAS;
+            key->material_len = len - offset;
+            break;
+        case 4u:
+            key->algorithm    = body[5];
+            offset            = KEY_VERSION_4_BAS;
+            key->material_len = len - offset;
+            break;
+        case 5u:
+        case 6u:
+            if (len < KEY_VERSION_6_BAS) return FALSE;
+            key->algorithm    = body[5];
+            key->material_len = read_be32 (body + 6);
+            offset            = KEY_VERSION_6_BAS;
+            if (key->material_len > len - offset) return FALSE;
+            break;
+        default:
+            return FALSE;
+    }
+    key->material = body + offset;
+
+    switch (key->algorithm)
+    {
+        case PKAlgEncryptAndSign:
+        case PKAlgEncryptOnly:
+        case PKAlgSignOnly:
+        case PKAlgElGamal:
+        case PKAlgDSA:
+            if (key->material_len >= sizeof(uint16_t))
+            {
+                key->bits = read_be16 (key->material);
+            }
+            break;
+        case PKAlgECDH:
+        case PKAlgECDSA:
+        case PKAlgEdDSALegacy:
+            if ((key->material_len < 1u) ||
+                    (key->material[0] >= key->material_len))
+            {
+                return FALSE;
+            }
+            key->oid_len = key->material[0];
+            key->oid     = key->material + 1;
+            key->curve   = find_curve (key->oid, key->oid_len);
+            key->bits    = key->curve ? key->curve->bits : 0u;
+            break;
+        case PKAlgX25519:
+        case PKAlgEd25519:
+            key->bits = 255u;
+            break;
+        case PKAlgX448:
+        case PKAlgEd448:
+            key->bits = 448u;
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* key_fields                                                              */
+/* INPUTS: key - decoded key                                               */
+/* RETURN: TRUE if the material holds every field the algorithm needs      */
+/* OUTPUT: field - MPIs or native fields of the public key                 */
+/*         pCount - number of fields                                       */
+/*                                                                         */
+/* The ECDH KDF parameters are returned as a final raw field.              */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t key_fields (const struct pgp_key *key, struct pgp_field *field, uint8_t *pCount)
+{
+const uint8_t *p;
+uint32_t avail, used;
+uint8_t  n, i;
+
+    *pCount = 0u;
+    p       = key->material;
+    avail   = key->material_len;
+    n       = 0u;
+    switch (key->algorithm)
+    {
+        case PKAlgEncryptAndSign:
+        case PKAlgEncryptOnly:
+        case PKAlgSignOnly:
+            n = 2u;
+            break;
+        case PKAlgElGamal:
+            n = 3u;
+            break;
+        case PKAlgDSA:
+            n = 4u;
+            break;
+        case PKAlgECDH:
+        case PKAlgECDSA:
+        case PKAlgEdDSALegacy:
+            p     += 1u + key->oid_len;
+            avail -= 1u + key->oid_len;
+            n      = 1u;
+            break;
+        default:
+            n = native_size (key->algorithm, FALSE);
+            if (!n) return FALSE;
+            if (!read_native (p, avail, n, &field[0])) return FALSE;
+            *pCount = 1u;
+            return TRUE;
+    }
+
+    for (i = 0u; i < n; i++)
+    {
+        used = read_mpi (p, avail, &field[i]);
+        if (!used) return FALSE;
+        p     += used;
+        avail -= used;
+    }
+    if (key->algorithm == PKAlgECDH)
+    {
+        if ((avail < 1u) || (p[0] >= avail)) return FALSE;
+        read_native (p + 1, avail - 1u, p[0], &field[n++]);
+    }
+    *pCount = n;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* key_public_len                                                          */
+/* INPUTS: body - key packet body                                          */
+/*         key - the key decoded from body                                 */
+/* RETURN: length of the public part of the body, or zero if the material  */
+/*         is malformed                                                    */
+/*                                                                         */
+/* This is the part covered by the fingerprint; for secret keys the        */
+/* secret material follows it.                                             */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint32_t key_public_len (const uint8_t *body, const struct pgp_key *key)
+{
+struct pgp_field field[PKT_MAX_FIELDS];
+uint8_t count;
+
+    if (key->version >= 5u)
+    {
+        return (uint32_t)(key->material - body) + key->material_len;
+    }
+    if (!key_fields (key, field, &count) || !count) return 0ul;
+    return (uint32_t)(field[count - 1u].data + field[count - 1u].len - body);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* sig_subpackets                                                          */
+/* INPUTS: area - subpacket area                                           */
+/*         len - length of the area                                        */
+/*         hashed - whether this is the hashed area                        */
+/* OUTPUT: sig - times and issuer filled from the subpackets               */
+/*                                                                         */
+/* Times only count when hashed; the issuer may sit in either area.        */
+/*                                                                         */
+/***************************************************************************/
+
+static void sig_subpackets (const uint8_t *area, uint32_t len, uint8_t hashed,
+                            struct pgp_sig *sig)
+{
+struct pgp_subpacket sub;
+uint32_t offset = 0ul;
+
+    while (next_subpacket (area, len, &offset, &sub))
+    {
+        switch (sub.type)
+        {
+            case SubPktSigCreation:
+                if (hashed && (sub.len == SUB_PKT_LEN_SIG_CREATION))
+                {
+                    sig->created = read_be32 (sub.data);
+                }
+                break;
+            case SubPktSigExpiration:
+                if (hashed && (sub.len == SUB_PKT_LEN_SIG_EXPIRATION))
+                {
+                    sig->expires = read_be32 (sub.data);
+                }
+                break;
+            case SubPktKeyExpiration:
+                if (hashed && (sub.len == SUB_PKT_LEN_SIG_EXPIRATION))
+                {
+                    sig->key_expires = read_be32 (sub.data);
+                }
+                break;
+            case SubPktIssuerKeyID:
+                if (sub.len == PKT_KEYID_LEN)
+                {
+                    memcpy (sig->issuer, sub.data, PKT_KEYID_LEN);
+                    sig->has_issuer = TRUE;
+                }
+                break;
+            case SubPktIssuerFingerprint:
+                if ((sub.len > 1u) && (sub.len - 1u <= PKT_MAX_FPR))
+                {
+                    sig->issuer_fpr     = sub.data + 1;
+                    sig->issuer_fpr_len = (uint8_t)(sub.len - 1u);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* decode_signature                                                        */
+/* INPUTS: body - signature packet body                                    */
+/*         len - length of the body                                        */
+/* RETURN: TRUE if the signature framing was understood                    */
+/* OUTPUT: sig - header fields, subpacket areas, hash prefix, salt and     */
+/*               the signature material                                    */
+/*                                                                         */
+/* Version 4 and 5 signatures have two octet subpacket area lengths,       */
+/* version 6 has four octet lengths followed by a salt. Either way the     */
+/* areas are stepped over without being parsed; only the handful of        */
+/* subpackets every mode wants are picked out afterwards.                  */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t decode_signature (const uint8_t *body, uint32_t len, struct pgp_sig *sig)
+{
+uint32_t offset;
+uint8_t  area_len;
+
+    memset (sig, 0, sizeof(*sig));
+    if (len < 1u) return FALSE;
+    sig->version = body[0];
+    switch (sig->version)
+    {
+        case 2u:
+        case 3u:
+            if ((len < SIG_VERSION_3_BAS) || (body[1] != 5u)) return FALSE;
+            sig->type     = body[2];
+            sig->created  = read_be32 (body + 3);
+            memcpy (sig->issuer, body + 7, PKT_KEYID_LEN);
+            sig->has_issuer = TRUE;
+            sig->pk_alg   = body[15];
+            sig->hash_alg = body[16];
+            sig->left16   = body + 17;
+            offset        = SIG_VERSION_3_BAS;
+            break;
+        case 4u:
+        case 5u:
+        case 6u:
+            area_len = (sig->version == 6u) ? sizeof(uint32_t) : sizeof(uint16_t);
+            if (len < SIG_VERSION_4_BAS) return FALSE;
+            sig->type     = body[1];
+            sig->pk_alg   = body[2];
+            sig->hash_alg = body[3];
+            offset        = 4ul;
+
+            if (len - offset < area_len) return FALSE;
+            sig->hashed_len = (area_len == sizeof(uint32_t)) ?
+                    read_be32 (body + offset) : read_be16 (body + offset);
+            offset += area_len;
+            if (sig->hashed_len > len - offset) return FALSE;
+            sig->hashed = body + offset;
+            offset += sig->hashed_len;
+
+            if (len - offset < area_len) return FALSE;
+            sig->unhashed_len = (area_len == sizeof(uint32_t)) ?
+                    read_be32 (body + offset) : read_be16 (body + offset);
+            offset += area_len;
+            if (sig->unhashed_len > len - offset) return FALSE;
+            sig->unhashed = body + offset;
+            offset += sig->unhashed_len;
+
+            if (len - offset < sizeof(uint16_t)) return FALSE;
+            sig->left16 = body + offset;
+            offset += sizeof(uint16_t);
+
+            if (sig->version == 6u)
+            {
+                if (len - offset < 1u) return FALSE;
+                sig->salt_len = body[offset++];
+                if (sig->salt_len > len - offset) return FALSE;
+                sig->salt = body + offset;
+                offset += sig->salt_len;
+            }
+            sig_subpackets (sig->hashed, sig->hashed_len, TRUE, sig);
+            sig_subpackets (sig->unhashed, sig->unhashed_len, FALSE, sig);
+            if (!sig->has_issuer && sig->issuer_fpr)
+            {
+                /* v4 key IDs are the tail of the fingerprint, v6 the head */
+                memcpy (sig->issuer, (sig->issuer_fpr_len == 20u) ?
+                        sig->issuer_fpr + 12 : sig->issuer_fpr, PKT_KEYID_LEN);
+                sig->has_issuer = TRUE;
+            }
+            break;
+        default:
+            return FALSE;
+    }
+    sig->material     = body + offset;
+    sig->material_len = len - offset;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* sig_fields                                                              */
+/* INPUTS: sig - decoded signature                                         */
+/* RETURN: TRUE if the material holds every field the algorithm needs      */
+/* OUTPUT: field - MPIs or native fields of the signature                  */
+/*         pCount - number of fields                                       */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t sig_fields (const struct pgp_sig *sig, struct pgp_field *field, uint8_t *pCount)
+{
+const uint8_t *p;
+uint32_t avail, used;
+uint8_t  n, i;
+
+    *pCount = 0u;
+    p       = sig->material;
+    avail   = sig->material_len;
+    switch (sig->pk_alg)
+    {
+        case PKAlgEncryptAndSign:
+        case PKAlgSignOnly:
+            n = 1u;
+            break;
+        case PKAlgElGamal:
+        case PKAlgReserved:
+        case PKAlgDSA:
+        case PKAlgECDSA:
+        case PKAlgEdDSALegacy:
+            n = 2u;
+            break;
+        default:
+            n = native_size (sig->pk_alg, TRUE);
+            if (!n) return FALSE;
+            if (!read_native (p, avail, n, &field[0])) return FALSE;
+            *pCount = 1u;
+            return TRUE;
+    }
+    for (i = 0u; i < n; i++)
+    {
+        used = read_mpi (p, avail, &field[i]);
+        if (!used) return FALSE;
+        p     += used;
+        avail -= used;
+    }
+    *pCount = n;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* next_subpacket                                                          */
+/* INPUTS: area - subpacket area                                           */
+/*         len - length of the area                                        */
+/*         pOffset - offset of the next subpacket, advanced on success     */
+/* RETURN: TRUE if another well formed subpacket was found                 */
+/* OUTPUT: sub - type, critical bit and body of the subpacket              */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t next_subpacket (const uint8_t *area, uint32_t len, uint32_t *pOffset,
+                               struct pgp_subpacket *sub)
+{
+uint32_t offset;
+uint32_t sub_len;
+uint8_t  used;
+
+    offset = *pOffset;
+    if (offset >= len) return FALSE;
+    used = decode_length (area + offset, len - offset, &sub_len);
+    if (!used || !sub_len) return FALSE;
+    offset += used;
+    if (sub_len > len - offset) return FALSE;
+
+    sub->type     = area[offset] & ~SUB_PKT_CRITICAL;
+    sub->critical = (area[offset] & SUB_PKT_CRITICAL) ? TRUE : FALSE;
+    sub->data     = area + offset + 1;
+    sub->len      = sub_len - 1u;
+    *pOffset      = offset + sub_len;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* decode_pkesk                                                            */
+/* INPUTS: body - public key encrypted session key packet body             */
+/*         len - length of the body                                        */
+/* RETURN: TRUE if the packet framing was understood                       */
+/* OUTPUT: pkesk - recipient key ID (v3) or fingerprint (v6), algorithm    */
+/*                 and the encrypted session key material                  */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t decode_pkesk (const uint8_t *body, uint32_t len, struct pgp_pkesk *pkesk)
+{
+uint32_t offset;
+uint8_t  n;
+
+    memset (pkesk, 0, sizeof(*pkesk));
+    if (len < 2u) return FALSE;
+    pkesk->version = body[0];
+    if (pkesk->version == 3u)
+    {
+        if (len < 2u + PKT_KEYID_LEN) return FALSE;
+        pkesk->recipient     = body + 1;
+        pkesk->recipient_len = PKT_KEYID_LEN;
+        offset = 1u + PKT_KEYID_LEN;
+    }
+    else if (pkesk->version == 6u)
+    {
+        n = body[1];
+        if ((uint32_t)n + 3u > len) return FALSE;
+        if (n)
+        {
+            pkesk->key_version   = body[2];
+            pkesk->recipient     = body + 3;
+            pkesk->recipient_len = n - 1u;
+        }
+        offset = 2u + n;
+    }
+    else
+    {
+        return FALSE;
+    }
+    pkesk->pk_alg       = body[offset++];
+    pkesk->material     = body + offset;
+    pkesk->material_len = len - offset;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* decode_s2k                                                              */
+/* INPUTS: p - string-to-key specifier                                     */
+/*         avail - octets available at p                                   */
+/* RETURN: octets taken by the specifier, or zero if unknown or truncated  */
+/* OUTPUT: s2k - the decoded specifier                                     */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t decode_s2k (const uint8_t *p, uint32_t avail, struct pgp_s2k *s2k)
+{
+uint32_t need;
+
+    memset (s2k, 0, sizeof(*s2k));
+    if (avail < 1u) return 0ul;
+    s2k->type = p[0];
+    switch (s2k->type)
+    {
+        case SimpleS2K:
+            need = 2u;
+            break;
+        case SaltedS2K:
+            need = 2u + SALT_SIZE;
+            break;
+        case IteratedSaltedS2K:
+            need = 3u + SALT_SIZE;
+            break;
+        case Argon2S2K:
+            need = 4u + ARGON2_SALT_SIZE;
+            break;
+        default:
+            return 0ul;
+    }
+    if (avail < need) return 0ul;
+    if (s2k->type == Argon2S2K)
+    {
+        s2k->salt        = p + 1;
+        s2k->salt_len    = ARGON2_SALT_SIZE;
+        s2k->passes      = p[1 + ARGON2_SALT_SIZE];
+        s2k->parallelism = p[2 + ARGON2_SALT_SIZE];
+        s2k->memory      = p[3 + ARGON2_SALT_SIZE];
+        return need;
+    }
+    s2k->hash_alg = p[1];
+    if (s2k->type != SimpleS2K)
+    {
+        s2k->salt     = p + 2;
+        s2k->salt_len = SALT_SIZE;
+    }
+    if (s2k->type == IteratedSaltedS2K)
+    {
+        s2k->count = p[2 + SALT_SIZE];
+    }
+    return need;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* decode_skesk                                                            */
+/* INPUTS: body - symmetric key encrypted session key packet body          */
+/*         len - length of the body                                        */
+/* RETURN: TRUE if the packet framing was understood                       */
+/* OUTPUT: skesk - algorithms, S2K specifier and the remaining IV and      */
+/*                 encrypted session key                                   */
+/*                                                                         */
+/* Version 6 prefixes both the fields and the S2K specifier with their     */
+/* lengths, so an unknown S2K type can still be stepped over.              */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t decode_skesk (const uint8_t *body, uint32_t len, struct pgp_skesk *skesk)
+{
+uint32_t offset;
+uint32_t used;
+
+    memset (skesk, 0, sizeof(*skesk));
+    if (len < 3u) return FALSE;
+    skesk->version = body[0];
+    switch (skesk->version)
+    {
+        case 4u:
+            skesk->sym_alg = body[1];
+            offset = 2ul;
+            used   = decode_s2k (body + offset, len - offset, &skesk->s2k);
+            if (!used) return FALSE;
+            offset += used;
+            break;
+        case 5u:
+            if (len < 4u) return FALSE;
+            skesk->sym_alg  = body[1];
+            skesk->aead_alg = body[2];
+            offset = 3ul;
+            used   = decode_s2k (body + offset, len - offset, &skesk->s2k);
+            if (!used) return FALSE;
+            offset += used;
+            break;
+        case 6u:
+            if (len < 5u) return FALSE;
+            skesk->sym_alg  = body[2];
+            skesk->aead_alg = body[3];
+            offset = 5ul;
+            if (body[4] > len - offset) return FALSE;
+            decode_s2k (body + offset, body[4], &skesk->s2k);
+            offset += body[4];
+            break;
+        default:
+            return FALSE;
+    }
+    skesk->rest     = body + offset;
+    skesk->rest_len = len - offset;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* decode_one_pass                                                         */
+/* INPUTS: body - one-pass signature packet body                           */
+/*         len - length of the body                                        */
+/* RETURN: TRUE if the packet framing was understood                       */
+/* OUTPUT: ops - signature type, algorithms and issuer key ID (v3) or      */
+/*               fingerprint (v6)                                          */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t decode_one_pass (const uint8_t *body, uint32_t len, struct pgp_one_pass *ops)
+{
+uint32_t offset;
+
+    memset (ops, 0, sizeof(*ops));
+    if (len < 5u) return FALSE;
+    ops->version  = body[0];
+    ops->type     = body[1];
+    ops->hash_alg = body[2];
+    ops->pk_alg   = body[3];
+    if (ops->version == 3u)
+    {
+        if (len < 5u + PKT_KEYID_LEN) return FALSE;
+        ops->issuer     = body + 4;
+        ops->issuer_len = PKT_KEYID_LEN;
+        ops->nested     = body[4 + PKT_KEYID_LEN];
+        return TRUE;
+    }
+    if (ops->version == 6u)
+    {
+        offset = 5u + body[4];
+        if (offset + PKT_MAX_FPR + 1u > len) return FALSE;
+        ops->issuer     = body + offset;
+        ops->issuer_len = PKT_MAX_FPR;
+        ops->nested     = body[offset + PKT_MAX_FPR];
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* encode_header                                                           */
+/* INPUTS: tag - packet type                                               */
+/*         len - length of the body                                        */
+/*         head - room for PKT_MAX_HEADER octets                           */
+/* RETURN: number of header octets written                                 */
+/*                                                                         */
+/* Always a new format header with the shortest definite length.           */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint32_t encode_header (uint8_t tag, uint32_t len, uint8_t *head)
+{
+    head[0] = PKT_INDICATED | PKT_FORMAT_NEW | tag;
+    if (len <= PKT_LEN_ONE_MAX)
+    {
+        head[1] = (uint8_t)len;
+        return 2u;
+    }
+    if (len <= PKT_LEN_TWO_MAX)
+    {
+        head[1] = (uint8_t)(((len - (PKT_LEN_ONE_MAX + 1u)) >> 8) + (PKT_LEN_ONE_MAX + 1u));
+        head[2] = (uint8_t)(len - (PKT_LEN_ONE_MAX + 1u));
+        return 3u;
+    }
+    head[1] = PKT_LEN_LEADING;
+    head[2] = (uint8_t)(len >> 24);
+    head[3] = (uint8_t)(len >> 16);
+    head[4] = (uint8_t)(len >> 8);
+    head[5] = (uint8_t)len;
+    return 6u;
+}
+
+static int hex_value (char c)
+{
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* parse_key_id                                                            */
+/* INPUTS: text - key ID or fingerprint in hex, optionally 0x prefixed     */
+/*         id - room for PKT_MAX_FPR octets                                */
+/* RETURN: TRUE if it is 16, 40 or 64 hex digits: a key ID, or a v4 or v6 */
+/*         fingerprint of 8, 20 or 32 octets                               */
+/* OUTPUT: pLen - how many octets                                          */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t parse_key_id (const char *text, uint8_t *id, uint8_t *pLen)
+{
+size_t len;
+size_t i;
+int    high;
+int    low;
+
+    if (!strncmp (text, "0x", 2u) || !strncmp (text, "0X", 2u)) text += 2;
+    len = strlen (text);
+    if ((len != 2u * PKT_KEYID_LEN) && (len != 40u) && (len != 2u * PKT_MAX_FPR))
+    {
+        return FALSE;
+    }
+    for (i = 0u; i < len / 2u; i++)
+    {
+        high = hex_value (text[2u * i]);
+        low  = hex_value (text[2u * i + 1u]);
+        if ((high < 0) || (low < 0)) return FALSE;
+        id[i] = (uint8_t)((high << 4) | low);
+    }
+    *pLen = (uint8_t)(len / 2u);
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* key_own_expiry                                                          */
+/* INPUTS: key - a decoded key                                             */
+/* RETURN: the expiry a v2 or v3 key carries in its own packet, 0 for none */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint32_t key_own_expiry (const struct pgp_key *key)
+{
+    return key->days_valid ? key->created + key->days_valid * 86400u : 0u;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* self_sig_expiry                                                         */
+/* INPUTS: sig - a self signature over a key or a subkey binding signature */
+/*         created - when the key was made                                 */
+/*         pFrom - creation time of the signature which last set pExpires  */
+/*         pExpires - the key's expiry so far, 0 for none                  */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* The latest signature decides. One of v4 or later sets the time from     */
+/* its key expiry subpacket, or no expiry without one; a v3 signature has  */
+/* no subpackets and leaves the expiry as it was, such as a v3 key's own.  */
+/*                                                                         */
+/***************************************************************************/
+
+extern void self_sig_expiry (const struct pgp_sig *sig, uint32_t created, uint32_t *pFrom,
+                             uint32_t *pExpires)
+{
+    if (sig->created < *pFrom) return;
+    *pFrom = sig->created;
+    if (sig->version < 4u) return;
+    *pExpires = sig->key_expires ? created + sig->key_expires : 0u;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <stdint.h>
+
+/***************************************************************************/
+/* Decoded packet bodies                                                   */
+/*                                                                         */
+/* The decoders work on a packet body already held in memory; every        */
+/* pointer below points back into that body, nothing is copied.            */
+/***************************************************************************/
+
+#define PKT_MAX_FIELDS  (4u)
+#define PKT_MAX_FPR     (32u)
+#define PKT_KEYID_LEN   (8u)
+#define PKT_MAX_SALT    (32u)
+#define PKT_MAX_HEADER  (6u)
+
+struct pgp_field
+{
+    const uint8_t  *data;
+    uint32_t        len;
+    uint16_t        bits;
+};
+
+struct pgp_curve
+{
+    const uint8_t  *oid;
+    uint8_t         oid_len;
+    const char     *name;
+    uint16_t        bits;
+};
+
+struct pgp_key
+{
+    uint8_t         version;
+    uint32_t        created;
+    uint16_t        days_valid;
+    uint8_t         algorithm;
+    const struct pgp_curve *curve;
+    const uint8_t  *oid;
+    uint8_t         oid_len;
+    const uint8_t  *material;
+    uint32_t        material_len;
+    uint16_t        bits;
+};
+
+struct pgp_sig
+{
+    uint8_t         version;
+    uint8_t         type;
+    uint8_t         pk_alg;
+    uint8_t         hash_alg;
+    const uint8_t  *hashed;
+    uint32_t        hashed_len;
+    const uint8_t  *unhashed;
+    uint32_t        unhashed_len;
+    const uint8_t  *left16;
+    const uint8_t  *salt;
+    uint8_t         salt_len;
+    const uint8_t  *material;
+    uint32_t        material_len;
+    uint32_t        created;
+    uint32_t        expires;
+    uint32_t        key_expires;
+    uint8_t         has_issuer;
+    uint8_t         issuer[PKT_KEYID_LEN];
+    uint8_t         issuer_fpr_len;
+    const uint8_t  *issuer_fpr;
+};
+
+struct pgp_subpacket
+{
+    uint8_t         type;
+    uint8_t         critical;
+    const uint8_t  *data;
+    uint32_t        len;
+};
+
+struct pgp_pkesk
+{
+    uint8_t         version;
+    uint8_t         pk_alg;
+    uint8_t         key_version;
+    const uint8_t  *recipient;
+    uint8_t         recipient_len;
+    const uint8_t  *material;
+    uint32_t        material_len;
+};
+
+struct pgp_s2k
+{
+    uint8_t         type;
+    uint8_t         hash_alg;
+    const uint8_t  *salt;
+    uint8_t         salt_len;
+    uint8_t         count;
+    uint8_t         passes;
+    uint8_t         parallelism;
+    uint8_t         memory;
+};
+
+struct pgp_skesk
+{
+    uint8_t         version;
+    uint8_t         sym_alg;
+    uint8_t         aead_alg;
+    struct pgp_s2k  s2k;
+    const uint8_t  *rest;
+    uint32_t        rest_len;
+};
+
+struct pgp_one_pass
+{
+    uint8_t         version;
+    uint8_t         type;
+    uint8_t         hash_alg;
+    uint8_t         pk_alg;
+    const uint8_t  *issuer;
+    uint8_t         issuer_len;
+    uint8_t         nested;
+};
+
+extern uint32_t read_be32 (const uint8_t *p);
+extern uint8_t  decode_length (const uint8_t *p, uint32_t avail, uint32_t *pLength);
+extern uint8_t  decode_public_key (const uint8_t *body, uint32_t len, struct pgp_key *key);
+extern uint8_t  key_fields (const struct pgp_key *key, struct pgp_field *field, uint8_t *pCount);
+extern uint32_t key_public_len (const uint8_t *body, const struct pgp_key *key);
+extern uint8_t  decode_signature (const uint8_t *body, uint32_t len, struct pgp_sig *sig);
+extern uint8_t  sig_fields (const struct pgp_sig *sig, struct pgp_field *field, uint8_t *pCount);
+extern uint8_t  next_subpacket (const uint8_t *area, uint32_t len, uint32_t *pOffset,
+                                struct pgp_subpacket *sub);
+extern uint8_t  decode_pkesk (const uint8_t *body, uint32_t len, struct pgp_pkesk *pkesk);
+extern uint8_t  decode_skesk (const uint8_t *body, uint32_t len, struct pgp_skesk *skesk);
+extern uint8_t  decode_one_pass (const uint8_t *body, uint32_t len, struct pgp_one_pass *ops);
+extern uint32_t encode_header (uint8_t tag, uint32_t len, uint8_t *head);
+extern uint8_t  parse_key_id (const char *text, uint8_t *id, uint8_t *pLen);
+extern uint32_t key_own_expiry (const struct pgp_key *key);
+extern void     self_sig_expiry (const struct pgp_sig *sig, uint32_t created,
+                                 uint32_t *pFrom, uint32_t *pExpires);
+
+#endif
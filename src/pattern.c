@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define PATTERN_SHUFTI
+#endif
+
+#include "pattern.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+#define NO_STATE        (UINT32_MAX)
+#define ROOT            (0u)
+
+/***************************************************************************/
+/*                                                                         */
+/* The automaton is a full DFA: next[state * classes + class] is always    */
+/* a state, so the search does one table lookup per byte and never        */
+/* follows failure links. Bytes are first mapped to classes, one per       */
+/* (case folded) byte that occurs in any pattern plus class 0 for every    */
+/* other byte, which keeps the table small for thousands of patterns.      */
+/* accept[] marks states where some pattern ends, directly or through a   */
+/* failure link.                                                           */
+/*                                                                         */
+/***************************************************************************/
+
+/***************************************************************************/
+/*                                                                         */
+/* read_patterns                                                           */
+/* INPUTS: filename - the pattern file                                     */
+/* OUTPUT: pLen - length of the text, not counting its final NUL           */
+/* RETURN: the whole file, or NULL if failed                               */
+/*                                                                         */
+/* The file is read once, so it may be a pipe or FIFO. Each line ending    */
+/* (and any carriage return before it) is overwritten with NUL, leaving    */
+/* the patterns as strings one after another; lines may be of any length. */
+/*                                                                         */
+/***************************************************************************/
+
+static char *read_patterns (const char *filename, size_t *pLen)
+{
+FILE   *fp;
+char   *text = NULL;
+char   *grown;
+char   *at;
+size_t  len = 0u;
+size_t  size = 0u;
+size_t  got;
+
+    fp = fopen (filename, "r");
+    if (fp == NULL) return NULL;
+    do
+    {
+        if (len + 1u >= size)
+        {
+            size  = size ? (size * 2u) : 4096u;
+            grown = realloc (text, size);
+            if (grown == NULL) goto fail;
+            text = grown;
+        }
+        got  = fread (text + len, 1u, size - len - 1u, fp);
+        len += got;
+    } while (got);
+    if (ferror (fp)) goto fail;
+    fclose (fp);
+
+    text[len] = '\0';
+    for (at = text; (at = memchr (at, '\n', (size_t)(text + len - at))) != NULL; at++)
+    {
+        *at = '\0';
+    }
+    for (at = text + len; at > text; at--)
+    {
+        if ((at[-1] == '\r') && !at[0]) at[-1] = '\0';
+    }
+    *pLen = len;
+    return text;
+
+fail:
+    fclose (fp);
+    free (text);
+    return NULL;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* build_trie                                                              */
+/* INPUTS: set - set with classes assigned and the table allocated         */
+/*         text - the patterns, as read by read_patterns                   */
+/*         len - length of the text                                        */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* Enter every pattern into the trie; missing edges are left as NO_STATE. */
+/*                                                                         */
+/***************************************************************************/
+
+static void build_trie (struct pattern_set *set, const char *text, size_t len)
+{
+const char *line;
+uint32_t state;
+uint32_t *edge;
+size_t   i;
+
+    set->states = 1u;
+    for (line = text; line < text + len; line += strlen (line) + 1u)
+    {
+        if (!line[0]) continue;
+        state = ROOT;
+        for (i = 0u; line[i]; i++)
+        {
+            edge = &set->next[state * set->classes + set->cls[(uint8_t)line[i]]];
+            if (*edge == NO_STATE) *edge = set->states++;
+            state = *edge;
+        }
+        set->accept[state] = TRUE;
+        set->count++;
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* complete                                                                */
+/* INPUTS: set - set holding the trie                                      */
+/* RETURN: FALSE if out of memory                                          */
+/*                                                                         */
+/* Breadth first over the trie: each missing edge is pointed where the     */
+/* state's failure link would go on the same class, and a state accepts    */
+/* if its failure state does.                                              */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t complete (struct pattern_set *set)
+{
+uint32_t *fail;
+uint32_t *queue;
+uint32_t  head = 0u, tail = 0u;
+uint32_t  state, c, target;
+uint32_t *row;
+
+    fail  = calloc (set->states, sizeof(*fail));
+    queue = calloc (set->states, sizeof(*queue));
+    if ((fail == NULL) || (queue == NULL))
+    {
+        free (fail);
+        free (queue);
+        return FALSE;
+    }
+    for (c = 0u; c < set->classes; c++)
+    {
+        target = set->next[c];
+        if (target == NO_STATE)
+        {
+            set->next[c] = ROOT;
+        }
+        else
+        {
+            fail[target]  = ROOT;
+            queue[tail++] = target;
+        }
+    }
+    while (head < tail)
+    {
+        state = queue[head++];
+        if (set->accept[fail[state]]) set->accept[state] = TRUE;
+        row = &set->next[state * set->classes];
+        for (c = 0u; c < set->classes; c++)
+        {
+            if (row[c] == NO_STATE)
+            {
+                row[c] = set->next[fail[state] * set->classes + c];
+            }
+            else
+            {
+                fail[row[c]]  = set->next[fail[state] * set->classes + c];
+                queue[tail++] = row[c];
+            }
+        }
+    }
+    free (fail);
+    free (queue);
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* pattern_load                                                            */
+/* INPUTS: filename - one pattern per line; empty lines are ignored        */
+/* RETURN: the compiled set, or NULL if failed                             */
+/*                                                                         */
+/* Two passes over the patterns: one to assign byte classes and size the  */
+/* trie, one to build it.                                                  */
+/*                                                                         */
+/***************************************************************************/
+
+extern struct pattern_set *pattern_load (const char *filename)
+{
+struct pattern_set *set;
+char    *text;
+char    *line;
+size_t   len;
+uint8_t  folded[256];
+size_t   total = 1u;
+size_t   i;
+uint32_t c, b;
+
+    text = read_patterns (filename, &len);
+    if (text == NULL) return NULL;
+    set = calloc (1u, sizeof(*set));
+    if (set == NULL)
+    {
+        free (text);
+        return NULL;
+    }
+
+    memset (folded, 0, sizeof(folded));
+    set->classes = 1u;
+    for (line = text; line < text + len; line += strlen (line) + 1u)
+    {
+        for (i = 0u; line[i]; i++)
+        {
+            b = (uint8_t)tolower ((uint8_t)line[i]);
+            if (!folded[b]) folded[b] = (uint8_t)set->classes++;
+            if (!i) set->first[b] = set->first[toupper (b)] = TRUE;
+        }
+        total += i;
+    }
+    for (b = 0u; b < 256u; b++)
+    {
+        set->cls[b] = folded[tolower (b)];
+    }
+    for (b = 0u; b < 256u; b++)
+    {
+        if (!set->first[b]) continue;
+        if (set->leads < PATTERN_LEADS) set->lead[set->leads] = (uint8_t)b;
+        set->leads++;
+        /* high nibbles h and h + 8 share a bucket */
+        set->lo_nibble[b & 0x0fu] |= (uint8_t)(1u << ((b >> 4) & 7u));
+        set->hi_nibble[b >> 4]     = (uint8_t)(1u << ((b >> 4) & 7u));
+    }
+#ifdef PATTERN_SHUFTI
+    set->shufti = (__builtin_cpu_supports ("ssse3") != 0);
+#endif
+
+    set->next   = malloc (total * set->classes * sizeof(*set->next));
+    set->accept = calloc (total, sizeof(*set->accept));
+    if ((set->next == NULL) || (set->accept == NULL)) goto fail;
+    for (c = 0u; c < total * set->classes; c++)
+    {
+        set->next[c] = NO_STATE;
+    }
+    build_trie (set, text, len);
+    if (!set->count || !complete (set)) goto fail;
+    free (text);
+    return set;
+
+fail:
+    free (text);
+    pattern_free (set);
+    return NULL;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* skip_to_lead                                                            */
+/* INPUTS: set - the compiled set                                          */
+/*         p - where to start looking                                      */
+/*         end - end of the text                                           */
+/* RETURN: the first byte at or after p that can start a pattern, or end   */
+/*                                                                         */
+/* Used while the automaton is at its root, where nothing else can move    */
+/* it. Where SSSE3 is available every first byte is tested for 16 octets  */
+/* at once by shufti_to_lead; otherwise, with only a few possible first    */
+/* bytes, SSE2 compares 16 octets against each.                            */
+/*                                                                         */
+/***************************************************************************/
+
+#ifdef PATTERN_SHUFTI
+
+/***************************************************************************/
+/*                                                                         */
+/* shufti_to_lead                                                          */
+/* INPUTS: set - the compiled set                                          */
+/*         p - where to start looking                                      */
+/*         end - end of the text                                           */
+/* RETURN: the first byte at or after p that can start a pattern, or end   */
+/*                                                                         */
+/* Each first byte sets the bit of its bucket (its high nibble mod 8) in   */
+/* lo_nibble at its low nibble and hi_nibble at its high nibble. Two       */
+/* PSHUFB lookups give both for 16 octets; an octet whose two lookups      */
+/* share a bit may start a pattern, and first[] settles it, since a byte   */
+/* with high nibble h + 8 can alias one with h.                            */
+/*                                                                         */
+/***************************************************************************/
+
+__attribute__ ((target ("ssse3")))
+static const uint8_t *shufti_to_lead (const struct pattern_set *set, const uint8_t *p,
+                                      const uint8_t *end)
+{
+__m128i  lo_table, hi_table, nibble, block, hits;
+uint32_t mask;
+
+    lo_table = _mm_loadu_si128 ((const __m128i *)set->lo_nibble);
+    hi_table = _mm_loadu_si128 ((const __m128i *)set->hi_nibble);
+    nibble   = _mm_set1_epi8 (0x0f);
+    while (end - p >= 16)
+    {
+        block = _mm_loadu_si128 ((const __m128i *)p);
+        hits  = _mm_and_si128 (
+                    _mm_shuffle_epi8 (lo_table, _mm_and_si128 (block, nibble)),
+                    _mm_shuffle_epi8 (hi_table,
+                                      _mm_and_si128 (_mm_srli_epi16 (block, 4), nibble)));
+        mask  = ~(uint32_t)_mm_movemask_epi8 (_mm_cmpeq_epi8 (hits, _mm_setzero_si128 ()))
+                & 0xffffu;
+        while (mask)
+        {
+            if (set->first[p[__builtin_ctz (mask)]]) return p + __builtin_ctz (mask);
+            mask &= mask - 1u;
+        }
+        p += 16;
+    }
+    while ((p < end) && !set->first[*p]) p++;
+    return p;
+}
+#endif
+
+static const uint8_t *skip_to_lead (const struct pattern_set *set, const uint8_t *p,
+                                    const uint8_t *end)
+{
+#ifdef PATTERN_SHUFTI
+    if (set->shufti) return shufti_to_lead (set, p, end);
+#endif
+#ifdef __SSE2__
+__m128i  block, hits, lead[PATTERN_LEADS];
+uint32_t i;
+int      mask;
+
+    if (set->leads <= PATTERN_LEADS)
+    {
+        for (i = 0u; i < set->leads; i++)
+        {
+            lead[i] = _mm_set1_epi8 ((char)set->lead[i]);
+        }
+        while (end - p >= 16)
+        {
+            block = _mm_loadu_si128 ((const __m128i *)p);
+            hits  = _mm_cmpeq_epi8 (block, lead[0]);
+            for (i = 1u; i < set->leads; i++)
+            {
+                hits = _mm_or_si128 (hits, _mm_cmpeq_epi8 (block, lead[i]));
+            }
+            mask = _mm_movemask_epi8 (hits);
+            if (mask) return p + __builtin_ctz ((unsigned int)mask);
+            p += 16;
+        }
+    }
+#endif
+    while ((p < end) && !set->first[*p]) p++;
+    return p;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* pattern_search                                                          */
+/* INPUTS: set - the compiled set                                          */
+/*         text - text to search, in place                                 */
+/*         len - its length                                                */
+/* RETURN: TRUE if any pattern occurs in the text                          */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t pattern_search (const struct pattern_set *set, const uint8_t *text,
+                               uint32_t len)
+{
+const uint8_t *p   = text;
+const uint8_t *end = text + len;
+uint32_t state = ROOT;
+
+    while (p < end)
+    {
+        if (state == ROOT)
+        {
+            p = skip_to_lead (set, p, end);
+            if (p == end) break;
+        }
+        state = set->next[state * set->classes + set->cls[*p++]];
+        if (set->accept[state]) return TRUE;
+    }
+    return FALSE;
+}
+
+extern void pattern_free (struct pattern_set *set)
+{
+    if (set == NULL) return;
+    free (set->next);
+    free (set->accept);
+    free (set);
+}
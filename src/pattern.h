@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdint.h>
+
+/***************************************************************************/
+/* Multi-pattern search                                                    */
+/*                                                                         */
+/* Every pattern is compiled into one Aho-Corasick automaton, so a text    */
+/* is searched in one pass however many patterns there are. Matching       */
+/* ignores ASCII case.                                                     */
+/***************************************************************************/
+
+#define PATTERN_LEADS   (4u)
+
+struct pattern_set
+{
+    uint8_t         cls[256];
+    uint32_t        classes;
+    uint32_t        states;
+    uint32_t       *next;
+    uint8_t        *accept;
+    uint8_t         first[256];
+    uint8_t         lead[PATTERN_LEADS];
+    uint8_t         leads;
+    uint8_t         lo_nibble[16];
+    uint8_t         hi_nibble[16];
+    uint8_t         shufti;
+    uint32_t        count;
+};
+
+extern struct pattern_set *pattern_load (const char *filename);
+extern uint8_t pattern_search (const struct pattern_set *set, const uint8_t *text,
+                               uint32_t len);
+extern void    pattern_free (struct pattern_set *set);
+
+#endif
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "grab.h"
+#include "push.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+#define MAXIMUM_BODY    (1ul << 26)
+
+/***************************************************************************/
+/*                                                                         */
+/* The parser is driven one state at a time. A header is taken an octet at */
+/* a time, so a piece may end anywhere in it; the body is taken in as much */
+/* of a run as the piece holds. A body sent in partial chunks goes back to */
+/* StateNewLen at the end of each chunk for the length of the next.        */
+/*                                                                         */
+/***************************************************************************/
+
+enum push_state
+{
+    StateTag,                   /* at a packet boundary */
+    StateOldLen,                /* in the length octets of an old header */
+    StateNewLen,                /* at the first length octet of a new header */
+    StateNewLenMore,            /* in the rest of a new format length */
+    StateBody,                  /* in a body, or one of its chunks */
+    StateStopped,
+    StateFailed
+};
+
+struct push_parser
+{
+    push_fn             fn;
+    void               *ctx;
+    enum push_state     state;
+    struct push_packet  pkt;
+    off_t               offset;
+    uint8_t             octets[4];
+    uint8_t             need;
+    uint8_t             have;
+    uint8_t             lead;
+    uint8_t             chunked;
+    uint8_t             partial;
+    uint8_t             to_end;
+    uint8_t             bulk;
+    uint32_t            left;
+    struct grab_buffer  buf;
+    uint32_t            held;
+};
+
+/***************************************************************************/
+/*                                                                         */
+/* push_new                                                                */
+/* INPUTS: fn - called with each packet, or each piece of a bulk data      */
+/*              packet, returns FALSE to stop the parser                   */
+/*         ctx - passed through to fn                                      */
+/* RETURN: a parser at the start of its input, or NULL                     */
+/*                                                                         */
+/***************************************************************************/
+
+extern struct push_parser *push_new (push_fn fn, void *ctx)
+{
+struct push_parser *parser;
+
+    parser = calloc (1u, sizeof(*parser));
+    if (parser == NULL) return NULL;
+    parser->fn    = fn;
+    parser->ctx   = ctx;
+    parser->state = StateTag;
+    return parser;
+}
+
+/* Hand a body, or a piece of one, to the callback */
+
+static void push_deliver (struct push_parser *parser, const uint8_t *data, uint32_t len,
+                          uint8_t last)
+{
+    parser->pkt.data = data;
+    parser->pkt.len  = len;
+    parser->pkt.last = last;
+    if (!parser->fn (parser->ctx, &parser->pkt))
+    {
+        parser->state = StateStopped;
+    }
+    parser->pkt.first = FALSE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* push_tag                                                                */
+/* INPUTS: parser - a parser at a packet boundary                          */
+/*         octet - the first octet of a packet header                      */
+/*                                                                         */
+/* Start a packet. An old format header names how many length octets       */
+/* follow, or that the body runs to the end of the input.                  */
+/*                                                                         */
+/***************************************************************************/
+
+static void push_tag (struct push_parser *parser, uint8_t octet)
+{
+    memset (&parser->pkt, 0, sizeof(parser->pkt));
+    parser->pkt.offset = parser->offset;
+    parser->pkt.first  = TRUE;
+    parser->chunked    = FALSE;
+    parser->partial    = FALSE;
+    parser->to_end     = FALSE;
+    parser->held       = 0ul;
+    parser->have       = 0u;
+    if (!(octet & PKT_INDICATED))
+    {
+        parser->state = StateFailed;
+        return;
+    }
+    if (octet & PKT_FORMAT_NEW)
+    {
+        parser->pkt.tag = octet & PKT_NEW_PACKET;
+        parser->state   = StateNewLen;
+    }
+    else
+    {
+        parser->pkt.tag = (octet & PKT_OLD_PACKET) >> PKT_OLD_PKT_SHF;
+        switch ((enum old_packet_len)(octet & PKT_OLD_LENGTH))
+        {
+            case OldOneOctet:
+                parser->need = 1u;
+                break;
+            case OldTwoOctet:
+                parser->need = 2u;
+                break;
+            case OldFourOctet:
+                parser->need = 4u;
+                break;
+            default:
+                parser->need = 0u;
+                break;
+        }
+        parser->state = StateOldLen;
+    }
+    parser->bulk = is_stream (parser->pkt.tag);
+    if (parser->need || (parser->state == StateNewLen)) return;
+
+    /* indeterminate length, the packet runs to the end of the input */
+    parser->to_end      = TRUE;
+    parser->chunked     = TRUE;
+    parser->pkt.length  = PKT_LEN_INDETERMINATE;
+    parser->state       = StateBody;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* push_length                                                             */
+/* INPUTS: parser - a parser which has just read a body length             */
+/*         length - the length of the body, or of this chunk of it         */
+/*         partial - whether further chunks follow                         */
+/*                                                                         */
+/***************************************************************************/
+
+static void push_length (struct push_parser *parser, uint32_t length, uint8_t partial)
+{
+    if (!parser->chunked)
+    {
+        parser->pkt.length  = length;
+        parser->pkt.partial = partial;
+        parser->chunked     = TRUE;
+    }
+    if (!parser->bulk && (length > MAXIMUM_BODY - parser->held))
+    {
+        parser->state = StateFailed;
+        return;
+    }
+    parser->left    = length;
+    parser->partial = partial;
+    parser->state   = StateBody;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* push_new_length                                                         */
+/* INPUTS: parser - a parser at the first length octet of a new format    */
+/*                  header, or of a further partial body chunk            */
+/*         octet - that octet                                              */
+/*                                                                         */
+/***************************************************************************/
+
+static void push_new_length (struct push_parser *parser, uint8_t octet)
+{
+    parser->lead = octet;
+    parser->have = 0u;
+    if (octet <= PKT_LEN_ONE_MAX)
+    {
+        push_length (parser, octet, FALSE);
+    }
+    else if (octet < PKT_LEN_PT)
+    {
+        parser->need  = 1u;
+        parser->state = StateNewLenMore;
+    }
+    else if (octet == PKT_LEN_LEADING)
+    {
+        parser->need  = 4u;
+        parser->state = StateNewLenMore;
+    }
+    else
+    {
+        push_length (parser, PKT_LEN_PT_CONVERT (octet), TRUE);
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* push_length_octet                                                       */
+/* INPUTS: parser - a parser within the length octets of a header          */
+/*         octet - the next of them                                        */
+/*                                                                         */
+/***************************************************************************/
+
+static void push_length_octet (struct push_parser *parser, uint8_t octet)
+{
+uint32_t length = 0ul;
+uint8_t  n;
+
+    parser->octets[parser->have++] = octet;
+    if (parser->have < parser->need) return;
+    for (n = 0u; n < parser->need; n++)
+    {
+        length = (length << 8) | parser->octets[n];
+    }
+    if ((parser->state == StateNewLenMore) && (parser->need == 1u))
+    {
+        length += ((uint32_t)(parser->lead - (PKT_LEN_ONE_MAX + 1u)) << 8) +
+                  PKT_LEN_ONE_MAX + 1u;
+    }
+    parser->need = 0u;
+    push_length (parser, length, FALSE);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* push_body                                                               */
+/* INPUTS: parser - a parser within a body                                 */
+/*         data - the rest of the caller's piece                           */
+/*         avail - octets in it                                            */
+/* RETURN: the number of octets taken                                      */
+/*                                                                         */
+/* A body wholly within the piece is handed on where it lies. Otherwise it */
+/* is gathered, the buffer being grown once to the size the header states, */
+/* and handed on when complete. Bulk data is handed on as it comes.        */
+/*                                                                         */
+/***************************************************************************/
+
+static size_t push_body (struct push_parser *parser, const uint8_t *data, size_t avail)
+{
+uint32_t n;
+uint32_t want;
+uint8_t  done;
+uint8_t *grown;
+
+    if (avail > MAXIMUM_BODY) avail = MAXIMUM_BODY;
+    n    = (parser->to_end || (avail < parser->left)) ? (uint32_t)avail : parser->left;
+    done = !parser->to_end && (n == parser->left);
+    if (!n && !done) return 0u;
+    parser->left -= parser->to_end ? 0ul : n;
+
+    if (parser->bulk)
+    {
+        if (n || (done && !parser->partial))
+        {
+            push_deliver (parser, data, n, done && !parser->partial);
+        }
+    }
+    else if (done && !parser->partial && !parser->held)
+    {
+        push_deliver (parser, data, n, TRUE);
+    }
+    else
+    {
+        if (n > MAXIMUM_BODY - parser->held)
+        {
+            parser->state = StateFailed;
+            return n;
+        }
+        if (parser->held + n > parser->buf.size)
+        {
+            want = parser->held + n + parser->left;
+            if (parser->to_end || parser->partial)
+            {
+                want = (want < 2u * parser->buf.size) ? 2u * parser->buf.size : want;
+                want = (want > MAXIMUM_BODY) ? MAXIMUM_BODY : want;
+            }
+            grown = realloc (parser->buf.data, want);
+            if (grown == NULL)
+            {
+                parser->state = StateFailed;
+                return n;
+            }
+            parser->buf.data = grown;
+            parser->buf.size = want;
+        }
+        memcpy (parser->buf.data + parser->held, data, n);
+        parser->held += n;
+        if (done && !parser->partial)
+        {
+            push_deliver (parser, parser->buf.data, parser->held, TRUE);
+        }
+    }
+    if (done && (parser->state == StateBody))
+    {
+        parser->state = parser->partial ? StateNewLen : StateTag;
+    }
+    return n;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* push_feed                                                               */
+/* INPUTS: parser - the parser                                             */
+/*         data - the next piece of input                                  */
+/*         len - octets in it, which may be any number                     */
+/* RETURN: PushOK once the piece is all taken, PushStopped if the callback */
+/*         stopped the parser, PushFailed on a malformed header, a body    */
+/*         over 64 MiB or running out of memory                            */
+/*                                                                         */
+/* Nothing of the piece is kept after the return beyond a body being       */
+/* gathered, so the caller may reuse its buffer straight away.             */
+/*                                                                         */
+/***************************************************************************/
+
+extern enum push_status push_feed (struct push_parser *parser, const uint8_t *data,
+                                   size_t len)
+{
+size_t pos = 0u;
+size_t taken;
+
+    while ((parser->state != StateStopped) && (parser->state != StateFailed))
+    {
+        if (parser->state == StateBody)
+        {
+            taken = push_body (parser, data + pos, len - pos);
+            pos            += taken;
+            parser->offset += taken;
+            if ((parser->state == StateBody) && (pos == len)) break;
+            continue;
+        }
+        if (pos == len) break;
+        switch (parser->state)
+        {
+            case StateTag:
+                push_tag (parser, data[pos]);
+                break;
+            case StateNewLen:
+                push_new_length (parser, data[pos]);
+                break;
+            default:
+                push_length_octet (parser, data[pos]);
+                break;
+        }
+        pos++;
+        parser->offset++;
+    }
+    if (parser->state == StateStopped) return PushStopped;
+    if (parser->state == StateFailed) return PushFailed;
+    return PushOK;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* push_finish                                                             */
+/* INPUTS: parser - the parser, at the end of its input                    */
+/* RETURN: PushOK if the input ended on a packet boundary, or ended a body */
+/*         that runs to the end of the input, PushStopped if the callback */
+/*         stopped the parser, or PushFailed if a packet was cut short     */
+/*                                                                         */
+/***************************************************************************/
+
+extern enum push_status push_finish (struct push_parser *parser)
+{
+    if ((parser->state == StateBody) && parser->to_end)
+    {
+        parser->state = StateTag;
+        if (parser->bulk)
+        {
+            push_deliver (parser, NULL, 0ul, TRUE);
+        }
+        else
+        {
+            push_deliver (parser, parser->buf.data, parser->held, TRUE);
+        }
+    }
+    if (parser->state == StateStopped) return PushStopped;
+    if (parser->state == StateTag) return PushOK;
+    parser->state = StateFailed;
+    return PushFailed;
+}
+
+/* Octets of input taken so far */
+
+extern off_t push_offset (const struct push_parser *parser)
+{
+    return parser->offset;
+}
+
+extern void push_free (struct push_parser *parser)
+{
+    if (parser == NULL) return;
+    grab_release (&parser->buf);
+    free (parser);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PUSH_H
+#define PUSH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "2440.h"
+
+/***************************************************************************/
+/* Push parser                                                             */
+/*                                                                         */
+/* The caller hands over input in whatever pieces it arrives in, and the   */
+/* parser keeps its place between them, down to a single octet of a        */
+/* length. A packet body is handed on as a pointer into the caller's       */
+/* piece when it lies wholly inside it; only a body split across pieces,   */
+/* or one sent in partial chunks, is gathered into a buffer of the         */
+/* parser's own. Bulk data packets are never gathered: their bodies are    */
+/* handed on piece by piece as they arrive.                                */
+/***************************************************************************/
+
+struct push_packet
+{
+    enum packet_tags tag;
+    off_t           offset;     /* of the packet header in the input */
+    const uint8_t  *data;       /* the body, or this piece of a bulk body */
+    uint32_t        len;
+    uint32_t        length;     /* stated length of the first chunk */
+    uint8_t         partial;    /* whether the first chunk was partial */
+    uint8_t         first;      /* for bulk data, the first piece */
+    uint8_t         last;       /* and the last */
+};
+
+/* returns FALSE to stop the parser */
+typedef uint8_t (*push_fn) (void *ctx, const struct push_packet *pkt);
+
+enum push_status
+{
+    PushOK,                     /* all taken, or ended cleanly */
+    PushStopped,                /* the callback returned FALSE */
+    PushFailed                  /* malformed input or out of memory */
+};
+
+struct push_parser;
+
+extern struct push_parser *push_new (push_fn fn, void *ctx);
+extern enum push_status push_feed (struct push_parser *parser, const uint8_t *data,
+                                   size_t len);
+extern enum push_status push_finish (struct push_parser *parser);
+extern off_t push_offset (const struct push_parser *parser);
+extern void  push_free (struct push_parser *parser);
+
+#endif
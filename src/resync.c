@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "resync.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+#define MAXIMUM_BODY    (1ul << 26)
+#define MIN_PARTIAL     (512u)
+
+/***************************************************************************/
+/*                                                                         */
+/* plausible_tag                                                           */
+/* INPUTS: val - first octet of a supposed packet header                   */
+/* RETURN: TRUE if it names a packet type defined by RFC 9580              */
+/*                                                                         */
+/* Old format headers of indeterminate length are refused: they would run  */
+/* to end of file, so nothing after them could confirm them.              */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t plausible_tag (uint8_t val)
+{
+uint8_t tag;
+
+    if (!(val & PKT_INDICATED)) return FALSE;
+    if (val & PKT_FORMAT_NEW)
+    {
+        tag = val & PKT_NEW_PACKET;
+        return (((tag >= PktPKESKP) && (tag <= PktPublicSubkey)) ||
+                ((tag >= PktUserAttribute) && (tag <= PktPadding)));
+    }
+    tag = (val & PKT_OLD_PACKET) >> PKT_OLD_PKT_SHF;
+    return ((tag >= PktPKESKP) && (tag <= PktPublicSubkey) &&
+            ((val & PKT_OLD_LENGTH) != OldPartial));
+}
+
+/* The algorithm and signature type numbers RFC 9580 and its predecessors */
+/* give a meaning to, and the private and experimental range 100 to 110   */
+
+static uint8_t known_pk_alg (uint8_t alg)
+{
+    return (((alg >= 1u) && (alg <= 3u)) || ((alg >= 16u) && (alg <= 20u)) ||
+            ((alg >= 22u) && (alg <= 28u) && (alg != 23u) && (alg != 24u)) ||
+            ((alg >= 100u) && (alg <= 110u)));
+}
+
+static uint8_t known_hash (uint8_t hash)
+{
+    return (((hash >= 1u) && (hash <= 3u)) || ((hash >= 8u) && (hash <= 12u)) ||
+            (hash == 14u) || ((hash >= 100u) && (hash <= 110u)));
+}
+
+static uint8_t known_sig_type (uint8_t type)
+{
+    switch (type)
+    {
+        case 0x00: case 0x01: case 0x02:
+        case 0x10: case 0x11: case 0x12: case 0x13:
+        case 0x18: case 0x19: case 0x1f: case 0x20:
+        case 0x28: case 0x30: case 0x40: case 0x50:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* plausible_body                                                          */
+/* INPUTS: tag - the packet type                                           */
+/*         len - the length its header gives                               */
+/*         body - the start of its body                                    */
+/*         seen - how much of the body is available                        */
+/*         strict - also judge the packets any octets could start          */
+/* RETURN: TRUE if a packet of this type could start that way              */
+/*                                                                         */
+/* Most packets open with a version octet and algorithm numbers with only  */
+/* a few legal values, which throws out nearly every accidental header in  */
+/* random data. User IDs, trust and the like could hold anything, so when  */
+/* searching they are held to what real ones look like.                    */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t plausible_body (uint8_t tag, uint32_t len, const uint8_t *body,
+                               uint32_t seen, uint8_t strict)
+{
+uint32_t i;
+
+    if (seen == 0u) return TRUE;
+    switch (tag)
+    {
+        case PktPKESKP:
+            return ((body[0] == 3u) || (body[0] == 6u));
+        case PktOnePassSignature:
+            if ((body[0] != 3u) && (body[0] != 6u)) return FALSE;
+            return ((seen < 4u) ||
+                    (known_sig_type (body[1]) && known_hash (body[2]) &&
+                     known_pk_alg (body[3])));
+        case PktSignature:
+            if ((body[0] < 3u) || (body[0] > 6u)) return FALSE;
+            if (body[0] == 3u)
+            {
+                return ((seen < 3u) || ((body[1] == 5u) && known_sig_type (body[2])));
+            }
+            return ((seen < 4u) ||
+                    (known_sig_type (body[1]) && known_pk_alg (body[2]) &&
+                     known_hash (body[3])));
+        case PktSKESKP:
+            return ((body[0] >= 4u) && (body[0] <= 6u));
+        case PktSecretKey:
+        case PktPublicKey:
+        case PktSecretSubkey:
+        case PktPublicSubkey:
+            if ((body[0] < 2u) || (body[0] > 6u)) return FALSE;
+            i = (body[0] < 4u) ? 7u : 5u;
+            return ((seen <= i) || known_pk_alg (body[i]));
+        case PktCompressedData:
+            return (body[0] <= 3u);
+        case PktMarker:
+            return ((len == 3u) && (body[0] == 'P'));
+        case PktLiteral:
+            return ((body[0] == 'b') || (body[0] == 't') || (body[0] == 'u') ||
+                    (body[0] == 'l') || (body[0] == '1') || (body[0] == 'm'));
+        case PktSymEncIntegrityProtData:
+            return ((body[0] == 1u) || (body[0] == 2u));
+        case PktMDC:
+            return (len == 20u);
+        case PktAEADEncData:
+            return (body[0] == 1u);
+        case PktUserID:
+            if (!strict) return TRUE;
+            for (i = 0u; i < seen; i++)
+            {
+                if ((body[i] < 0x20u) || (body[i] == 0x7fu)) return FALSE;
+            }
+            return TRUE;
+        case PktTrust:
+            return (!strict || (len <= 2u));
+        case PktUserAttribute:
+            /* an image subpacket, with a one or two octet length */
+            if (!strict) return TRUE;
+            if (body[0] < 192u) return ((seen < 2u) || (body[1] == 1u));
+            if (body[0] < 224u) return ((seen < 3u) || (body[2] == 1u));
+            return (body[0] == 255u);
+        case PktSymmetricEncData:
+        case PktPadding:
+            return !strict;
+        default:
+            return FALSE;
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* resync_parse                                                            */
+/* INPUTS: p - supposed packet header in memory                            */
+/*         avail - bytes available from p                                  */
+/*         strict - TRUE when searching rather than checking the next      */
+/*                  packet of a stream already in sync                     */
+/* RETURN: HeadGood, HeadBad, or HeadShort if avail cuts it off            */
+/* OUTPUT: head - the packet type, header and (first chunk) body length    */
+/*                                                                         */
+/* Partial lengths are only legal on the bulk data packets, and their      */
+/* first chunk must be at least 512 octets.                                */
+/*                                                                         */
+/***************************************************************************/
+
+extern enum head_check resync_parse (const uint8_t *p, size_t avail, uint8_t strict,
+                                     struct resync_head *head)
+{
+size_t  seen;
+uint8_t val;
+
+    if (avail < 1u) return HeadShort;
+    if (!plausible_tag (p[0])) return HeadBad;
+    head->partial = FALSE;
+    if (p[0] & PKT_FORMAT_NEW)
+    {
+        head->tag = p[0] & PKT_NEW_PACKET;
+        if (avail < 2u) return HeadShort;
+        val = p[1];
+        if (val <= PKT_LEN_ONE_MAX)
+        {
+            head->head = 2u;
+            head->len  = val;
+        }
+        else if (val < PKT_LEN_PT)
+        {
+            if (avail < 3u) return HeadShort;
+            head->head = 3u;
+            head->len  = ((uint32_t)(val - (PKT_LEN_ONE_MAX + 1u)) << 8) + p[2] +
+                         PKT_LEN_ONE_MAX + 1u;
+        }
+        else if (val == PKT_LEN_LEADING)
+        {
+            if (avail < 6u) return HeadShort;
+            head->head = 6u;
+            head->len  = ((uint32_t)p[2] << 24) | ((uint32_t)p[3] << 16) |
+                         ((uint32_t)p[4] << 8) | p[5];
+        }
+        else
+        {
+            if (!is_stream (head->tag)) return HeadBad;
+            head->head    = 2u;
+            head->len     = PKT_LEN_PT_CONVERT (val);
+            head->partial = TRUE;
+            if (head->len < MIN_PARTIAL) return HeadBad;
+        }
+    }
+    else
+    {
+        head->tag = (p[0] & PKT_OLD_PACKET) >> PKT_OLD_PKT_SHF;
+        switch (p[0] & PKT_OLD_LENGTH)
+        {
+            case OldOneOctet:
+                if (avail < 2u) return HeadShort;
+                head->head = 2u;
+                head->len  = p[1];
+                break;
+            case OldTwoOctet:
+                if (avail < 3u) return HeadShort;
+                head->head = 3u;
+                head->len  = ((uint32_t)p[1] << 8) | p[2];
+                break;
+            default:
+                if (avail < 5u) return HeadShort;
+                head->head = 5u;
+                head->len  = ((uint32_t)p[1] << 24) | ((uint32_t)p[2] << 16) |
+                             ((uint32_t)p[3] << 8) | p[4];
+                break;
+        }
+    }
+    if (head->len > MAXIMUM_BODY) return HeadBad;
+    if ((head->len == 0u) && (head->tag != PktUserID)) return HeadBad;
+    seen = avail - head->head;
+    if (seen > head->len) seen = head->len;
+    if (!plausible_body (head->tag, head->len, p + head->head, (uint32_t)seen, strict))
+    {
+        return HeadBad;
+    }
+    return HeadGood;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* resync_body_end                                                         */
+/* INPUTS: p - packet header already parsed                                */
+/*         avail - bytes available from p                                  */
+/*         head - what resync_parse made of it                             */
+/* RETURN: TRUE if the whole packet lies within avail                      */
+/* OUTPUT: pEnd - offset from p of the octet after the packet              */
+/*                                                                         */
+/* Partial body chunks are stepped through to the last of them.            */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t resync_body_end (const uint8_t *p, size_t avail,
+                                const struct resync_head *head, size_t *pEnd)
+{
+size_t  pos;
+uint8_t partial;
+uint8_t val;
+
+    pos     = (size_t)head->head + head->len;
+    partial = head->partial;
+    while (partial)
+    {
+        if (pos >= avail) return FALSE;
+        val = p[pos];
+        if (val <= PKT_LEN_ONE_MAX)
+        {
+            pos    += 1u + val;
+            partial = FALSE;
+        }
+        else if (val < PKT_LEN_PT)
+        {
+            if (pos + 1u >= avail) return FALSE;
+            pos    += 2u + ((uint32_t)(val - (PKT_LEN_ONE_MAX + 1u)) << 8) +
+                      p[pos + 1u] + PKT_LEN_ONE_MAX + 1u;
+            partial = FALSE;
+        }
+        else if (val == PKT_LEN_LEADING)
+        {
+            if (pos + 5u >= avail) return FALSE;
+            pos    += 5u + (((uint32_t)p[pos + 1u] << 24) |
+                            ((uint32_t)p[pos + 2u] << 16) |
+                            ((uint32_t)p[pos + 3u] << 8) | p[pos + 4u]);
+            partial = FALSE;
+        }
+        else
+        {
+            pos += 1u + PKT_LEN_PT_CONVERT (val);
+        }
+    }
+    if (pos > avail) return FALSE;
+    *pEnd = pos;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* chain                                                                   */
+/* INPUTS: p - supposed start of a packet                                  */
+/*         avail - bytes available from p                                  */
+/*         at_end - TRUE if the input ends after them                      */
+/*         want - headers that must chain on to confirm p                  */
+/*         strict - as for resync_parse                                    */
+/*         blind - headers enough to confirm p when the chain runs past   */
+/*                 what is available, and so cannot be followed further    */
+/* RETURN: TRUE if p is confirmed as a packet start                        */
+/*                                                                         */
+/* A chain which ends exactly at the end of the input is confirmed however */
+/* short it is; one which overruns it is a truncated packet.               */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t chain (const uint8_t *p, size_t avail, uint8_t at_end, uint32_t want,
+                      uint8_t strict, uint32_t blind)
+{
+struct resync_head head;
+enum head_check check;
+uint32_t count = 0u;
+size_t   end;
+size_t   pos = 0u;
+
+    while (count < want)
+    {
+        if ((pos == avail) && at_end) return (count > 0u);
+        check = resync_parse (p + pos, avail - pos, strict, &head);
+        if (check == HeadBad) return FALSE;
+        if (check == HeadShort) return (!at_end && (count >= blind));
+        count++;
+        if (!resync_body_end (p + pos, avail - pos, &head, &end))
+        {
+            return (!at_end && (count >= blind));
+        }
+        pos += end;
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* resync_plausible                                                        */
+/* INPUTS: src - pgp input positioned at the next packet header            */
+/*         growing - TRUE if the input may still be being written          */
+/* RETURN: TRUE if the header and what can be seen of the body are         */
+/*         believable and the packet ends within the input                 */
+/*                                                                         */
+/* Checked before each packet when recovering. The header after it is not */
+/* looked at here but on the next call, so an intact packet just before   */
+/* damage is kept and the skipped range starts at the first bad header.    */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t resync_plausible (struct source *src, uint8_t growing)
+{
+struct resync_head head;
+const uint8_t *p;
+size_t avail;
+size_t wanted;
+
+    p = source_peek (src, PKT_MAX_HEADER, &avail);
+    if (avail == 0u) return TRUE;
+    if ((p[0] & PKT_INDICATED) && !(p[0] & PKT_FORMAT_NEW) &&
+            ((p[0] & PKT_OLD_LENGTH) == OldPartial))
+    {
+        return ((p[0] & PKT_OLD_PACKET) != 0u);
+    }
+    if (resync_parse (p, avail, FALSE, &head) == HeadBad) return FALSE;
+    /* a peek is capped at the buffer size, which is not the end of input */
+    wanted = (size_t)head.head + head.len + PKT_MAX_HEADER;
+    if (wanted > SOURCE_BUFFER) wanted = SOURCE_BUFFER;
+    p = source_peek (src, wanted, &avail);
+    return chain (p, avail, !growing && (avail < wanted), 1u, FALSE, 1u);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* next_tag                                                                */
+/* INPUTS: p - where to start looking                                      */
+/*         end - end of the buffered input                                 */
+/* RETURN: the first octet at or after p that could start a header, or end */
+/*                                                                         */
+/* Every header octet has its top bit set, which SSE2 picks out of 16      */
+/* octets at once; only those are looked at one by one.                    */
+/*                                                                         */
+/***************************************************************************/
+
+static const uint8_t *next_tag (const uint8_t *p, const uint8_t *end)
+{
+#ifdef __SSE2__
+uint32_t mask;
+
+    while (end - p >= 16)
+    {
+        mask = (uint32_t)_mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *)p));
+        while (mask)
+        {
+            if (plausible_tag (p[__builtin_ctz (mask)]))
+            {
+                return p + __builtin_ctz (mask);
+            }
+            mask &= mask - 1u;
+        }
+        p += 16;
+    }
+#endif
+    while ((p < end) && !plausible_tag (*p)) p++;
+    return p;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* resync_find                                                             */
+/* INPUTS: src - pgp input positioned at a damaged packet                  */
+/* RETURN: TRUE if positioned at a confirmed packet start, FALSE if the    */
+/*         rest of the input had to be given up                            */
+/* OUTPUT: pSkipped - number of octets passed over                         */
+/*                                                                         */
+/* Candidates are tried in order, so a damaged packet costs little more    */
+/* than its own length. Only the first half of the buffer is searched      */
+/* before it slides on, so every candidate has at least half a buffer of   */
+/* input after it to chain through.                                        */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t resync_find (struct source *src, off_t *pSkipped)
+{
+const uint8_t *p;
+const uint8_t *hit;
+size_t  avail;
+size_t  limit;
+size_t  from = 1u;
+uint8_t at_end;
+
+    *pSkipped = 0;
+    for (;;)
+    {
+        p = source_peek (src, SOURCE_BUFFER, &avail);
+        if (avail <= from)
+        {
+            source_skip (src, avail);
+            *pSkipped += (off_t)avail;
+            return FALSE;
+        }
+        at_end = (avail < SOURCE_BUFFER);
+        limit  = at_end ? avail : (avail / 2u);
+        for (hit = next_tag (p + from, p + limit); hit < p + limit;
+                 hit = next_tag (hit + 1, p + limit))
+        {
+            if (chain (hit, avail - (size_t)(hit - p), at_end, RESYNC_CHAIN, TRUE, 2u))
+            {
+                source_skip (src, (uint64_t)(hit - p));
+                *pSkipped += hit - p;
+                return TRUE;
+            }
+        }
+        source_skip (src, limit);
+        *pSkipped += (off_t)limit;
+        if (at_end) return FALSE;
+        from = 0u;
+    }
+}
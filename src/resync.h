@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESYNC_H
+#define RESYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "source.h"
+
+/***************************************************************************/
+/* Recovery from damaged packets                                           */
+/*                                                                         */
+/* A packet start is only believed once the headers after it chain on      */
+/* consistently, each one landing exactly where the one before it ended.   */
+/***************************************************************************/
+
+#define RESYNC_CHAIN    (4u)
+
+enum head_check
+{
+    HeadBad,
+    HeadShort,
+    HeadGood
+};
+
+/* A packet header parsed in memory; len is the first chunk if partial */
+
+struct resync_head
+{
+    uint8_t         tag;
+    uint8_t         partial;
+    uint32_t        head;
+    uint32_t        len;
+};
+
+extern enum head_check resync_parse (const uint8_t *p, size_t avail, uint8_t strict,
+                                     struct resync_head *head);
+extern uint8_t resync_body_end (const uint8_t *p, size_t avail,
+                                const struct resync_head *head, size_t *pEnd);
+extern uint8_t resync_plausible (struct source *src, uint8_t growing);
+extern uint8_t resync_find (struct source *src, off_t *pSkipped);
+
+#endif
@@ -17,10 +17,27 @@
 
 
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
 #include <byteswap.h>
+#include <sys/types.h>
 
 #include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "export.h"
+#include "resync.h"
+#include "keybox.h"
+#include "filter.h"
+#include "push.h"
+#include "digest.h"
 
 extern uint16_t buf_read (uint8_t index, uint8_t * buf, uint16_t size);
 extern uint16_t buf_write (uint8_t index, const uint8_t * buf, uint16_t size);
@@ -29,12 +46,40 @@ extern uint8_t  mark_end (uint8_t flag);
 extern uint8_t  mark_buffer (uint8_t flag, uint8_t *pMark);
 extern uint8_t *pop_marker (uint8_t *flag);
 extern uint8_t *last_marker (uint8_t *flag);
+extern int      follow_open (const char *filename);
+extern uint8_t  follow_complete (struct source *src, uint32_t length);
+extern uint8_t  follow_wait (int notify, struct source *src, off_t position);
+extern void     follow_close (int notify);
+extern int      diff_keyrings (const char *old_name, const char *new_name, size_t memory);
+extern int      merge_keyrings (const char *out_name, char **names, uint32_t count,
+                                size_t memory);
+extern int      verify_keyring (const char *name, uint32_t threads);
+extern int      weak_rsa_keys (const char *name, uint32_t threads);
+extern int      match_keyrings (const char *pattern_file, const char *name,
+                                const char *out_name);
+extern int      columns_export (const char *name, const char *out_name);
+extern int      carve_image (const char *name, uint32_t threads);
+extern int      mail_archives (char **names, uint32_t count, uint32_t threads);
+extern int      wot_keyring (const char *name, char **keys, uint32_t key_count,
+                             const char *out_name, uint32_t threads);
+extern int      store_write (const char *name, const char *out_name);
+extern int      store_show (const char *snapshot, char **keys, uint32_t key_count);
+extern int      summary_keyring (const char *name, uint32_t threads,
+                                 const char *sample);
+extern int      time_index_build (const char *name, const char *out_name,
+                                  size_t memory);
+extern int      time_index_query (const char *index_name, const char *field,
+                                  const char *after, const char *before);
 
 #define FALSE           (0u)
 #define TRUE            (!FALSE)
 #define MAXIMUM_GRAB    (1024u)
+#define STREAM_SHOWN    (256u)
+#define STREAM_LEAD     (36u + STREAM_SHOWN)
+#define DEFAULT_MEMORY  ((size_t)256u << 20)
 
-static uint8_t grabbing[MAXIMUM_GRAB];
+static uint8_t  grabbing[MAXIMUM_GRAB];
+static struct grab_buffer body;
 static  int8_t sub_pkt_tag_txt [][17] =
 {
     "XXX             ",
@@ -69,12 +114,18 @@ static  int8_t sub_pkt_tag_txt [][17] =
     "RevokeReason    ",
     "Features        ",
     "SigTarget       ",
-    "SigEmbedded     "
+    "SigEmbedded     ",
+    "IssuerFpr       ",
+    "PrefAEAD        ",
+    "IntendedRecip   ",
+    "XXX             ",
+    "AttestedCerts   ",
+    "KeyBlock        ",
+    "PrefCipherSuite "
 };
 
-#define SUB_PKT_NUM_TAGS (32u)
 /* 1 - UINT32_T_MAX only */
-static void display_hex (int8_t *disp_str, uint8_t *buf, uint32_t size)
+static void display_hex (const char *disp_str, const uint8_t *buf, uint32_t size)
 {
 uint8_t mod_remain;
 uint32_t i, j;
@@ -108,489 +159,1061 @@ uint32_t i, j;
 
 /********************************************************************************/
 /*                                                                              */
-/* grab_new_s_pkt_head                                                          */
-/* INPUTS: fp - open pgp file containing packets                                */
-/*         mainPkt - whether this is a packet or a sub-packet                   */
-/* RETURN: number of bytes to transferred                                       */
-/* OUTPUT: pPartial - whether this a partial packet or not                      */
-/*         pLength - the length of the packet                                   */
-/*                                                                              */
-/* Grab the new packet header or sub-packet header, and the return the length   */
-/* of the the rest of the packet to be expected.                                */
+/* display_subpackets                                                           */
+/* INPUTS: area - signature subpacket area                                      */
+/*         len - length of the area                                             */
+/*         prefix - "h " for the hashed area, "uh" for the unhashed             */
+/* RETURN: none                                                                 */
 /*                                                                              */
 /********************************************************************************/
-  
-static uint8_t grab_new_s_pkt_head (FILE *fp, uint8_t mainPkt, uint8_t *pPartial, uint32_t *pLength)
+
+static void display_subpackets (const uint8_t *area, uint32_t len, const char *prefix)
 {
-uint8_t val;
-uint8_t transferred;
-uint32_t length;
-
-    *pPartial   = FALSE;
-    transferred = fread (&val, 1u, sizeof(uint8_t), fp);
-    if (transferred != sizeof(uint8_t)) return transferred;
-    length = val;
-    if ((val > PKT_LEN_ONE_MAX) &&
-             (val < (mainPkt ? PKT_LEN_PT : PKT_LEN_LEADING)))
-    {
-        transferred += fread (&val, 1u, sizeof(uint8_t), fp);
-        if (transferred != sizeof(uint8_t)*2) return transferred;
-        length =   val - (PKT_LEN_ONE_MAX + 1);
-        length <<= 8;
-        length +=  val;
-        length +=  PKT_LEN_ONE_MAX + 1;
-    }
-    else if (val == PKT_LEN_LEADING)
-    {
-        transferred += fread (&length, 1u, sizeof(uint32_t), fp);
-        if (transferred != sizeof(uint8_t)+sizeof(uint32_t))
+struct pgp_subpacket sub;
+uint32_t offset = 0ul;
+char     label[4];
+
+    label[0] = prefix[0];
+    label[1] = prefix[1];
+    label[2] = '0';
+    label[3] = '\0';
+    while (next_subpacket (area, len, &offset, &sub))
+    {
+        if (sub.type < SUB_PKT_NUM_TAGS)
+        {
+            fputs ((const char *)sub_pkt_tag_txt[sub.type], stdout);
+        }
+        if (sub.type == SubPktPrefKeyServer)
         {
-            return transferred;
+            printf ("KEY:= %.*s\n", (int)sub.len, sub.data);
         }
-//        bswap_32 (length);
-        length = __bswap_constant_32 (length);
+        display_hex (label, sub.data - 1, sub.len + 1u);
+        label[2]++;
+    }
+}
+
+static void display_fields (const struct pgp_field *field, uint8_t count)
+{
+uint8_t i;
+
+    for (i = 0u; i < count; i++)
+    {
+        printf ("%dth MPI total bits:- %d\n", i, field[i].bits);
+        display_hex ("--- MPI ", field[i].data, field[i].len);
+    }
+}
+
+static void display_key (const char *kind, const uint8_t *buf, uint32_t len)
+{
+struct pgp_key   key;
+struct pgp_field field[PKT_MAX_FIELDS];
+uint8_t          count;
+
+    if (!decode_public_key (buf, len, &key))
+    {
+        printf ("%s Version %d not understood\n", kind, buf[0]);
+        return;
+    }
+    display_hex ("Time: ", buf + 1, 4u);
+    printf ("%s Version %d\n", kind, key.version);
+    if (key.version < 4u)
+    {
+        display_hex ("Days valid: ", buf + 5, 2u);
+    }
+    display_hex ("Alg: ", &key.algorithm, 1u);
+    if (key.version >= 5u)
+    {
+        printf ("Key material length: %u\n", key.material_len);
+    }
+    if (key.curve)
+    {
+        printf ("Curve: %s\n", key.curve->name);
+    }
+    else if (key.oid)
+    {
+        display_hex ("OID: ", key.oid, key.oid_len);
+    }
+    if (key.bits)
+    {
+        printf ("Bits: %u\n", key.bits);
     }
-    else if ((val >= PKT_LEN_PT) && mainPkt) 
+    if (key_fields (&key, field, &count))
     {
-        /* this could be replaced with the macro */
-        length    = (1ul << (val & PKT_LEN_PT_MASK));
-        *pPartial = TRUE;
+        display_fields (field, count);
     }
-    *pLength = length;
 }
 
-static uint8_t grab_sub_pkt_head (FILE *fp, uint32_t *pLength)
+static void display_signature (const uint8_t *buf, uint32_t len)
 {
-uint8_t dummy;
+struct pgp_sig   sig;
+struct pgp_field field[PKT_MAX_FIELDS];
+uint8_t          count;
 
-    return grab_new_s_pkt_head (fp, FALSE, &dummy, pLength);
+    if (!decode_signature (buf, len, &sig))
+    {
+        printf ("Signature Version %d not understood\n", buf[0]);
+        return;
+    }
+    printf ("Signature Version %d\n", sig.version);
+    printf ("type: %02x\n",        sig.type);
+    printf ("pub-key alg: %02x\n", sig.pk_alg);
+    printf ("hash: %02x\n",        sig.hash_alg);
+    if (sig.version < 4u)
+    {
+        display_hex ("Time: ", buf + 3, 4u);
+        display_hex ("ID: ", sig.issuer, PKT_KEYID_LEN);
+    }
+    display_subpackets (sig.hashed, sig.hashed_len, "h ");
+    display_subpackets (sig.unhashed, sig.unhashed_len, "uh");
+    display_hex ("Hash prefix: ", sig.left16, sizeof(uint16_t));
+    display_hex ("Salt: ", sig.salt, sig.salt_len);
+    printf ("Block remaining:- %d\n", sig.material_len);
+    if (sig_fields (&sig, field, &count))
+    {
+        display_fields (field, count);
+    }
+}
+
+static void display_pkesk (const uint8_t *buf, uint32_t len)
+{
+struct pgp_pkesk pkesk;
+
+    if (!decode_pkesk (buf, len, &pkesk))
+    {
+        printf ("PUBLIC Encrypted Symmetric Key Packet Version %d not understood\n", buf[0]);
+        return;
+    }
+    printf ("PUBLIC Encrypted Symmetric Key Packet Version %d\n", pkesk.version);
+    if (pkesk.version == 3u)
+    {
+        display_hex ("ID: ", pkesk.recipient, pkesk.recipient_len);
+    }
+    else if (pkesk.recipient)
+    {
+        printf ("Key version: %d\n", pkesk.key_version);
+        display_hex ("Fingerprint: ", pkesk.recipient, pkesk.recipient_len);
+    }
+    printf ("Public Key Algorithm used: %d\n", pkesk.pk_alg);
+    display_hex ("ESKP: ", pkesk.material, pkesk.material_len);
+}
+
+static void display_skesk (const uint8_t *buf, uint32_t len)
+{
+struct pgp_skesk skesk;
+
+    if (!decode_skesk (buf, len, &skesk))
+    {
+        printf ("SYMMETRIC Encrypted Symmetric Key Packet Version %d not understood\n", buf[0]);
+        return;
+    }
+    printf ("SYMMETRIC Encrypted Symmetric Key Packet Version %d\n", skesk.version);
+    printf ("Symmetric Key Algorithm used: %d\n", skesk.sym_alg);
+    if (skesk.version >= 5u)
+    {
+        printf ("AEAD Algorithm used: %d\n", skesk.aead_alg);
+    }
+    printf ("S2K type: %d\n", skesk.s2k.type);
+    if (skesk.s2k.type == Argon2S2K)
+    {
+        printf ("Passes: %d\n", skesk.s2k.passes);
+        printf ("Parallelism: %d\n", skesk.s2k.parallelism);
+        printf ("Memory: %d\n", skesk.s2k.memory);
+    }
+    else
+    {
+        printf ("Hash alg: %d\n", skesk.s2k.hash_alg);
+    }
+    display_hex ("Salt: ", skesk.s2k.salt, skesk.s2k.salt_len);
+    if (skesk.s2k.type == IteratedSaltedS2K)
+    {
+        printf ("Count: %d\n", skesk.s2k.count);
+    }
+    display_hex ("ESKP: ", skesk.rest, skesk.rest_len);
+}
+
+static void display_one_pass (const uint8_t *buf, uint32_t len)
+{
+struct pgp_one_pass ops;
+
+    if (!decode_one_pass (buf, len, &ops))
+    {
+        printf ("One-Pass Signature Version %d not understood\n", buf[0]);
+        return;
+    }
+    printf ("One-Pass Signature Version %d\n", ops.version);
+    printf ("type: %02x\n",        ops.type);
+    printf ("pub-key alg: %02x\n", ops.pk_alg);
+    printf ("hash: %02x\n",        ops.hash_alg);
+    display_hex ("ID: ", ops.issuer, ops.issuer_len);
 }
 
 /********************************************************************************/
 /*                                                                              */
-/* grab_packet_head                                                             */
-/* INPUTS: fp - open pgp file containing packets                                */
-/* RETURN: number of bytes to transferred                                       */
-/* OUTPUT: pTag - the tag of the packet                                         */
-/*         pPartial - whether this packet is incomplete/partial                 */
-/*         pLength - the length of the packet (NB may be partial)               */
-/*                                                                              */
-/* Grab the packet header and return the tag, partial indicator and length of   */
-/* the remaining packet                                                         */
+/* stream_lead                                                                  */
+/* INPUTS: tagged - the bulk data packet type                                   */
+/*         length - length of the body, or of its first partial chunk           */
+/* RETURN: how many octets from the start of the body are shown                 */
 /*                                                                              */
 /********************************************************************************/
 
-static uint8_t grab_packet_head (FILE *fp, uint8_t *pTag, uint8_t *pPartial, uint32_t *pLength)
+static uint32_t stream_lead (enum packet_tags tagged, uint32_t length)
 {
-uint8_t val;
-uint8_t transferred = 0u;
-uint16_t old_length;
-uint32_t length;
-enum old_packet_len op_len;
-
-    *pTag     = 0u;
-    *pPartial = FALSE;
-    *pLength  = (0ul);
-    transferred += fread (pTag, 1u, sizeof(uint8_t), fp);
-    if (transferred != sizeof(uint8_t)) return transferred;
-    if (!(*pTag & PKT_INDICATED))
+    switch (tagged)
     {
-        return (sizeof(uint8_t));
+        case PktSymEncIntegrityProtData:
+        case PktAEADEncData:
+        case PktSymmetricEncData:
+            return (length > STREAM_LEAD) ? STREAM_LEAD : length;
+        default:
+            return 0ul;
     }
-    if (*pTag & PKT_FORMAT_NEW)
+}
+
+/********************************************************************************/
+/*                                                                              */
+/* display_stream_lead                                                          */
+/* INPUTS: tagged - the bulk data packet type                                   */
+/*         lead - the start of the body                                         */
+/*         have - octets of it held, as many as stream_lead asks for unless     */
+/*                the body was cut short                                        */
+/*         length - length of the body, or of its first partial chunk           */
+/*         partial - whether further partial body chunks follow                 */
+/* RETURN: FALSE if the body is too short for its header                        */
+/*                                                                              */
+/* Show the fixed header of an encrypted data packet and the start of the data. */
+/*                                                                              */
+/********************************************************************************/
+
+static uint8_t display_stream_lead (enum packet_tags tagged, const uint8_t *lead,
+                                    uint32_t have, uint32_t length, uint8_t partial)
+{
+uint32_t shown;
+
+    switch (tagged)
     {
-        transferred  = grab_new_s_pkt_head (fp, TRUE, pPartial, pLength) + 1; 
-        *pTag       &= PKT_NEW_PACKET;
+        case PktSymEncIntegrityProtData:
+            if ((length < 1u) || (have < 1u)) return FALSE;
+            printf ("Packet Sym Enc Integrity Prot Data - Version %d\n", lead[0]);
+            length--;
+            have--;
+            if ((lead[0] == 2u) && (length >= 35u))
+            {
+                if (have < 35u) return FALSE;
+                printf ("Symmetric Key Algorithm used: %d\n", lead[1]);
+                printf ("AEAD Algorithm used: %d\n", lead[2]);
+                printf ("Chunk size: %d\n", lead[3]);
+                display_hex ("Salt: ", lead + 4, 32u);
+                length -= 35u;
+                have   -= 35u;
+                lead   += 35u;
+            }
+            lead++;
+            break;
+        case PktAEADEncData:
+            if ((length < 4u) || (have < 4u)) return FALSE;
+            printf ("Packet AEAD Encrypted Data - Version %d\n", lead[0]);
+            printf ("Symmetric Key Algorithm used: %d\n", lead[1]);
+            printf ("AEAD Algorithm used: %d\n", lead[2]);
+            printf ("Chunk size: %d\n", lead[3]);
+            length -= 4u;
+            have   -= 4u;
+            lead   += 4u;
+            break;
+        case PktSymmetricEncData:
+            break;
+        default:
+            return TRUE;
     }
-    else
+    printf ("LENGTH: %u%s\n", length, partial ? " (partial)" : "");
+    shown = (length > STREAM_SHOWN) ? STREAM_SHOWN : length;
+    if (have < shown) return FALSE;
+    display_hex ("Sym Enc DATA: ", lead, shown);
+    return TRUE;
+}
+
+/********************************************************************************/
+/*                                                                              */
+/* display_stream                                                               */
+/* INPUTS: src - pgp input positioned after the packet header                  */
+/*         tagged - the bulk data packet type                                   */
+/*         length - length of the body, or of its first partial chunk           */
+/*         partial - whether further partial body chunks follow                 */
+/* RETURN: TRUE if the whole packet was passed over                             */
+/*                                                                              */
+/* Show the fixed header of an encrypted data packet and skip the rest.         */
+/*                                                                              */
+/********************************************************************************/
+
+static uint8_t display_stream (struct source *src, enum packet_tags tagged, uint32_t length,
+                               uint8_t partial)
+{
+uint32_t want;
+uint32_t have;
+
+    want = stream_lead (tagged, length);
+    if (want)
     {
-        op_len = (*pTag & PKT_OLD_LENGTH);
-        switch (op_len)
+        have = source_read (src, grabbing, want);
+        if (!display_stream_lead (tagged, grabbing, have, length, partial) ||
+                (have != want))
         {
-            case OldOneOctet:
-                transferred += fread (&val, 1u, sizeof(uint8_t), fp);
-                if (transferred != sizeof(uint8_t)*2) return transferred;
-                length = val;
-                break;
-            case OldTwoOctet:
-                transferred += fread (&old_length, 1u, sizeof(uint16_t), fp);
-                if (transferred != sizeof(uint8_t)+sizeof(uint16_t))
-                {
-                    return transferred;
-                }
-//                bswap_16 (old_length);
-                old_length = __bswap_constant_16 (old_length);
-                length = old_length;
-                break;
-            case OldFourOctet:
-                transferred += fread (&length, 1u, sizeof(uint32_t), fp);
-                if (transferred != sizeof(uint8_t)+sizeof(uint32_t))
-                {
-                    return transferred;
-                }
-//                bswap_32 (length);
-                length = __bswap_constant_32 (length);
-                break;
-            case OldPartial:
-                *pPartial = TRUE;
-                break;
-            default:
-                break;
+            return FALSE;
         }
-        *pTag &=  PKT_OLD_PACKET;
-        *pTag >>= PKT_OLD_PKT_SHF;
-        *pLength = length;
-    }    
-    return transferred;
+    }
+    if (length == PKT_LEN_INDETERMINATE) return skip_body (src, length, partial);
+    return skip_body (src, length - want, partial);
 }
 
-static uint16_t grab_hashed (FILE *fp)
-{
-uint16_t sz_hashed;
-uint8_t  val;
-uint8_t  transferred = 0u;
-uint32_t packet_offset;
-uint32_t subpacket_size;
-uint8_t  h_index=48u;
-int8_t   h[4]="h  ";
-
-     transferred += fread (&val, 1u, sizeof(uint8_t), fp);
-     sz_hashed    = val;
-     sz_hashed  <<= 8u;
-     transferred += fread (&val, 1u, sizeof(uint8_t), fp);
-     sz_hashed   += val;
-     if (transferred != sizeof(uint16_t))
-     {
-         return ;
-     }
-     packet_offset  = 0ul;
-     while (packet_offset < (uint32_t)sz_hashed)
-     {
-//          grab_sub_pkt_head (fp, &subpacket_size);          
-          fread (&val, 1u, sizeof(uint8_t), fp);
-          subpacket_size =  val;
-          if (fread (grabbing, 1u, subpacket_size, fp) == subpacket_size)
-          {
-              if (*grabbing < 32)
-              {
-                  printf (sub_pkt_tag_txt[*grabbing]);
-              }
-              if (*grabbing == 24)
-              {
-                  grabbing[subpacket_size]='\0';
-                  printf ("KEY:= %s\n", grabbing+1);
-              }
-              h[2] = h_index++;
-              display_hex (h, grabbing, subpacket_size); 
-              packet_offset += subpacket_size + 1;
-          }
-     }
-     return sz_hashed + 2;
-}
+/********************************************************************************/
+/*                                                                              */
+/* display_packet                                                               */
+/* INPUTS: tagged - the packet type                                             */
+/*         buf - the packet body                                                */
+/*         len - length of the body                                             */
+/* RETURN: FALSE if the packet type cannot occur in a valid stream              */
+/*                                                                              */
+/********************************************************************************/
 
-static uint16_t grab_unhashed (FILE *fp)
+static uint8_t display_packet (enum packet_tags tagged, const uint8_t *buf, uint32_t len)
 {
-uint16_t sz_unhashed;
-uint8_t  val;
-uint8_t  transferred = 0u;
-uint32_t packet_offset;
-uint32_t subpacket_size;
-uint8_t  uh_index=48u;
-int8_t   uh[4]="uh ";
-
-     transferred += fread (&val, 1u, sizeof(uint8_t), fp);
-     sz_unhashed    = val;
-     sz_unhashed  <<= 8u;
-     transferred += fread (&val, 1u, sizeof(uint8_t), fp);
-     sz_unhashed   += val;
-     if (transferred != sizeof(uint16_t))
-     {
-         return ;
-     }
-     packet_offset  = 0ul;
-     while (packet_offset < (uint32_t)sz_unhashed)
-     {
-//          grab_sub_pkt_head (fp, &subpacket_size);          
-          fread (&val, 1u, sizeof(uint8_t), fp);
-          subpacket_size =  val;
-          if (fread (grabbing, 1u, subpacket_size, fp) == subpacket_size)
-          {
-              if (*grabbing < 32)
-              {
-                  printf (sub_pkt_tag_txt[*grabbing]);
-              }
-              uh[2] = uh_index++;
-              display_hex (uh, grabbing, subpacket_size); 
-              packet_offset += subpacket_size + 1;
-          }
-     }
-     return sz_unhashed + 2;
+    if (len == 0u)
+    {
+        return (tagged != PktReserved);
+    }
+    switch (tagged)
+    {
+        case PktReserved:
+            return FALSE;
+        case PktSignature:
+            display_signature (buf, len);
+            break;
+        case PktPublicKey:
+            display_key ("Public Key", buf, len);
+            break;
+        case PktPublicSubkey:
+            display_key ("Public Subkey", buf, len);
+            break;
+        case PktSecretKey:
+            display_key ("Secret Key", buf, len);
+            break;
+        case PktSecretSubkey:
+            display_key ("Secret Subkey", buf, len);
+            break;
+        case PktPKESKP:
+            display_pkesk (buf, len);
+            break;
+        case PktSKESKP:
+            display_skesk (buf, len);
+            break;
+        case PktOnePassSignature:
+            display_one_pass (buf, len);
+            break;
+        case PktUserID:
+            printf ("NAME:= %.*s\n", (int)len, buf);
+            break;
+        case PktUserAttribute:
+            printf ("User Attribute: %u bytes\n", len);
+            break;
+        default:
+            break;
+    }
+    return TRUE;
 }
 
-static void scan_open_pgp_file (int8_t *filename)
+/********************************************************************************/
+/*                                                                              */
+/* scan_open_pgp_file                                                           */
+/* INPUTS: filename - the pgp file to be scanned, or "-" for standard input     */
+/*         follow - keep waiting for packets appended to the file               */
+/*         recover - skip over damaged packets rather than stopping at them     */
+/* RETURN: 0, or 1 if damaged data was skipped                                  */
+/*                                                                              */
+/* Walk the packets of the file, displaying each one. When following, a packet  */
+/* which is not yet wholly on disk is held back, and we sleep on inotify until  */
+/* the writer appends the rest of it. A pipe already blocks until the writer   */
+/* catches up, so following only changes anything for a regular file.          */
+/*                                                                              */
+/* When recovering, each header must chain on to the next before its packet is  */
+/* believed. A damaged one is searched past for the next confirmed packet      */
+/* start, and the range skipped is reported in line.                            */
+/*                                                                              */
+/********************************************************************************/
+
+static int scan_open_pgp_file (int8_t *filename, uint8_t follow, uint8_t recover)
 {
-FILE *openPGPFile;
+struct source *openPGPFile;
+int notify = -1;
+off_t pkt_start;
+off_t skipped;
+off_t skipped_total = 0;
+uint32_t ranges = 0u;
 uint8_t good_read;
 uint8_t pkt_tag;
 uint8_t incomplete;
+uint8_t transferred;
 uint32_t expected_len;
+uint32_t body_len;
 enum packet_tags tagged;
 
-uint8_t key_index=48u;
-uint8_t sign_index=48u;
-int8_t key[5]="key ";
-int8_t sign[8]="sign ~ ";
-int8_t keyname[8];
-uint8_t algorithm=0u;
-uint8_t val, i, n;
-uint32_t len;
-
     good_read   = TRUE;
-    openPGPFile = fopen (filename, "r+b");
-    if (openPGPFile == 0L) return;
+    openPGPFile = source_open ((const char *)filename);
+    if (openPGPFile == 0L)
+    {
+        fprintf (stderr, "%s: cannot open\n", (const char *)filename);
+        return (2u);
+    }
+    if (!openPGPFile->seekable) follow = FALSE;
+    if (follow)
+    {
+        notify = follow_open ((const char *)filename);
+        if (notify < 0)
+        {
+            source_close (openPGPFile);
+            return (2u);
+        }
+    }
 
     mark_start (FALSE);
-    while (!feof (openPGPFile) && good_read)
+    while ((follow || !openPGPFile->eof) && good_read)
     {
-        grab_packet_head (openPGPFile,
-               &pkt_tag, &incomplete, &expected_len); 
-
-        tagged = pkt_tag;
-        if (tagged == PktSignature)
+        pkt_start = source_tell (openPGPFile);
+        if (recover && !resync_plausible (openPGPFile, follow))
         {
             good_read = FALSE;
-            algorithm = 0u;
-            if (fread (grabbing, 1u, 1u, openPGPFile) == 1u)
+        }
+        else
+        {
+            transferred = grab_packet_head (openPGPFile,
+                              &pkt_tag, &incomplete, &expected_len);
+            if (follow && !follow_complete (openPGPFile, expected_len))
             {
-                if (grabbing[0] == 3u)
-                {
-                    if (fread (grabbing, 1u, 16u, openPGPFile) == 16u)
-                    {
-                        printf ("Signature Version 3\n");
-                        printf ("type: %02x\n",        grabbing[1]); 
-                        printf ("pub-key alg: %02x\n", grabbing[14]);
-                        printf ("hash: %02x\n",        grabbing[15]);
-                        algorithm = grabbing[14];
-                        expected_len--;
-                        expected_len -= 16u;
-                        printf ("Block remaining:- %d\n", expected_len);
-//                        if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-//                                expected_len) good_read = TRUE;
-                        fread (grabbing, 1u, sizeof(uint16_t), openPGPFile);
-                        good_read = TRUE;
-                    }
-                }
-                else if (grabbing[0] == 4u)
-                {
-                    if (fread (grabbing, 1u, 3u, openPGPFile) == 3u)
-                    {
-                        printf ("Signature Version 4\n");
-                        printf ("type: %02x\n",        grabbing[0]);
-                        printf ("pub-key alg: %02x\n", grabbing[1]);
-                        printf ("hash: %02x\n",        grabbing[2]);
-                        algorithm = grabbing[1];
-                        expected_len--;
-                        expected_len -= 3u;
-                        expected_len -= grab_hashed (openPGPFile);
-                        expected_len -= grab_unhashed (openPGPFile);
-                        printf ("Block remaining:- %d\n", expected_len);
-//                        if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-//                                expected_len) good_read = TRUE;
-                        fread (grabbing, 1u, sizeof(uint16_t), openPGPFile);
-                        good_read = TRUE;
-                    }
-                }
-                else if (grabbing[0] == 2u)
-                {
-                    expected_len--;
-                    printf ("Block remaining: %d\n", expected_len);
-                    if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-                            expected_len) good_read = TRUE;
-                }
-                if ((algorithm ==  1u) || (algorithm == 17u))
-                {
-                    fread (&val, 1u, 1u, openPGPFile);
-                    expected_len   = (uint32_t)val;
-                    expected_len <<= 8;
-                    fread (&val, 1u, 1u, openPGPFile);
-                    expected_len  += (uint32_t)val;
-                    printf ("First MPI total bits:- %d\n", expected_len);
-                    if (expected_len % 8) expected_len +=8;
-                    expected_len /= 8;
-                    if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-                            expected_len) good_read = TRUE;
-                    display_hex ("first MPI ", grabbing, expected_len);
-                }
-                if (algorithm == 17u)
-                {
-                    fread (&val, 1u, 1u, openPGPFile);
-                    expected_len   = (uint32_t)val;
-                    expected_len <<= 8;
-                    fread (&val, 1u, 1u, openPGPFile);
-                    expected_len  += (uint32_t)val;
-                    printf ("Second MPI total bits:- %d\n", expected_len);
-                    if (expected_len % 8) expected_len +=8;
-                    expected_len /= 8;
-                    if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-                            expected_len) good_read = TRUE;
-                    display_hex ("second MPI ", grabbing, expected_len);
-                }
-                    
+                fflush (stdout);
+                if (!follow_wait (notify, openPGPFile, pkt_start)) break;
+                continue;
+            }
+            if (!transferred || openPGPFile->eof) break;
+
+            tagged = pkt_tag;
+            if (is_stream (tagged))
+            {
+                good_read = display_stream (openPGPFile, tagged, expected_len, incomplete);
+            }
+            else if (grab_body (openPGPFile, expected_len, incomplete, &body, &body_len))
+            {
+                good_read = display_packet (tagged, body.data, body_len);
+            }
+            else
+            {
+                good_read = FALSE;
+            }
+            if (!good_read && follow && openPGPFile->eof)
+            {
+                /* a later partial body chunk has not been written yet */
+                fflush (stdout);
+                if (!follow_wait (notify, openPGPFile, pkt_start)) break;
+                good_read = TRUE;
             }
         }
-        else
+        if (!good_read && recover)
+        {
+            /* a pipe can only go back if the packet is still buffered */
+            source_seek (openPGPFile, pkt_start);
+            pkt_start = source_tell (openPGPFile);
+            good_read = resync_find (openPGPFile, &skipped) || follow;
+            printf ("Damaged data skipped: %" PRIdMAX " bytes at offset %" PRIdMAX "\n",
+                    (intmax_t)skipped, (intmax_t)pkt_start);
+            skipped_total += skipped;
+            ranges++;
+        }
+    }
+    if (ranges)
+    {
+        fprintf (stderr, "%s: skipped %" PRIdMAX " damaged bytes in %u ranges\n",
+                 (const char *)filename, (intmax_t)skipped_total, ranges);
+    }
+    follow_close (notify);
+    source_close (openPGPFile);
+    return (ranges ? 1u : 0u);
+}
+
+/* Where the push dump has got to within a bulk data packet */
+
+struct push_display
+{
+    off_t    offset;
+    uint32_t want;
+    uint32_t have;
+    uint8_t  shown;
+};
+
+/********************************************************************************/
+/*                                                                              */
+/* display_pushed                                                               */
+/* INPUTS: ctx - the push_display                                               */
+/*         pkt - a packet from the push parser, or a piece of a bulk one        */
+/* RETURN: FALSE if the packet is damaged                                       */
+/*                                                                              */
+/* The start of a bulk data packet is collected over however many pieces it     */
+/* comes in, and shown once there is enough of it.                              */
+/*                                                                              */
+/********************************************************************************/
+
+static uint8_t display_pushed (void *ctx, const struct push_packet *pkt)
+{
+struct push_display *shown = ctx;
+uint32_t n;
+
+    shown->offset = pkt->offset;
+    if (!is_stream (pkt->tag))
+    {
+        return display_packet (pkt->tag, pkt->data, pkt->len);
+    }
+    if (pkt->first)
+    {
+        shown->want  = stream_lead (pkt->tag, pkt->length);
+        shown->have  = 0ul;
+        shown->shown = FALSE;
+    }
+    if (shown->shown) return TRUE;
+    n = shown->want - shown->have;
+    n = (pkt->len < n) ? pkt->len : n;
+    memcpy (grabbing + shown->have, pkt->data, n);
+    shown->have += n;
+    if ((shown->have < shown->want) && !pkt->last) return TRUE;
+    shown->shown = TRUE;
+    if (!shown->want) return TRUE;
+    return display_stream_lead (pkt->tag, grabbing, shown->have, pkt->length,
+                                pkt->partial) && (shown->have == shown->want);
+}
+
+/********************************************************************************/
+/*                                                                              */
+/* scan_push_file                                                               */
+/* INPUTS: filename - the pgp file to be scanned, or "-" for standard input     */
+/*         size - octets read at a time                                         */
+/* RETURN: 0, 1 if a packet was damaged or cut short, 2 if the file could not   */
+/*         be read                                                              */
+/*                                                                              */
+/* Dump the packets as scan_open_pgp_file does, but read the file in pieces of  */
+/* the given size and hand each to the push parser, as a program taking        */
+/* messages off the network would.                                              */
+/*                                                                              */
+/********************************************************************************/
+
+static int scan_push_file (const char *filename, size_t size)
+{
+struct push_parser *parser = NULL;
+struct push_display shown;
+enum push_status status = PushOK;
+uint8_t *piece = NULL;
+ssize_t got;
+int fd;
+int rc = 2;
+
+    fd = strcmp (filename, "-") ? open (filename, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0)
+    {
+        fprintf (stderr, "%s: cannot open\n", filename);
+        return (2u);
+    }
+    memset (&shown, 0, sizeof(shown));
+    piece  = malloc (size);
+    parser = push_new (display_pushed, &shown);
+    if ((piece == NULL) || (parser == NULL)) goto done;
+
+    while (status == PushOK)
+    {
+        got = read (fd, piece, size);
+        if ((got < 0) && (errno == EINTR)) continue;
+        if (got < 0)
+        {
+            fprintf (stderr, "%s: read failed\n", filename);
+            goto done;
+        }
+        if (got == 0)
+        {
+            status = push_finish (parser);
+            break;
+        }
+        status = push_feed (parser, piece, (size_t)got);
+    }
+    rc = 0;
+    if (status == PushStopped)
+    {
+        fprintf (stderr, "%s: damaged packet at offset %" PRIdMAX "\n", filename,
+                 (intmax_t)shown.offset);
+        rc = 1;
+    }
+    else if (status == PushFailed)
+    {
+        fprintf (stderr, "%s: damaged or truncated packet before offset %" PRIdMAX "\n",
+                 filename, (intmax_t)push_offset (parser));
+        rc = 1;
+    }
+
+done:
+    push_free (parser);
+    free (piece);
+    if (fd != STDIN_FILENO) close (fd);
+    return rc;
+}
+
+/********************************************************************************/
+/*                                                                              */
+/* display_keyblock                                                             */
+/* INPUTS: src - the keybox file                                                */
+/*         blob - an OpenPGP blob                                               */
+/* RETURN: FALSE if the key block in it is damaged                              */
+/*                                                                              */
+/* Hand the key block held in a keybox blob to the packet display, as if it    */
+/* had been read from a keyring. gpg stores its trust packets alongside.       */
+/*                                                                              */
+/********************************************************************************/
+
+static uint8_t display_keyblock (struct source *src, const struct keybox_blob *blob)
+{
+off_t    end = (off_t)(blob->keyblock + blob->keyblock_len);
+uint8_t  pkt_tag;
+uint8_t  incomplete;
+uint32_t expected_len;
+uint32_t body_len;
+
+    if (!source_seek (src, (off_t)blob->keyblock)) return FALSE;
+    while (source_tell (src) < end)
+    {
+        if (!grab_packet_head (src, &pkt_tag, &incomplete, &expected_len) ||
+                src->eof || is_stream (pkt_tag) ||
+                !grab_body (src, expected_len, incomplete, &body, &body_len) ||
+                (source_tell (src) > end) ||
+                !display_packet (pkt_tag, body.data, body_len))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/********************************************************************************/
+/*                                                                              */
+/* scan_keybox                                                                  */
+/* INPUTS: kbx - the keybox, already opened                                     */
+/*         name - its file name                                                 */
+/*         keys - key IDs or fingerprints in hex, any of which will do          */
+/*         key_count - how many, zero for any key                               */
+/*         uid - text a user ID must contain, or NULL                           */
+/*         detail - dump the key blocks rather than list them                   */
+/* RETURN: 0, 1 if no blob was selected, 2 on a damaged keybox                  */
+/*                                                                              */
+/* Blobs are selected and listed from the fingerprint and user ID tables gpg    */
+/* keeps in each; their key blocks are only parsed when dumped.                 */
+/*                                                                              */
+/********************************************************************************/
+
+static int scan_keybox (struct keybox *kbx, const char *name, char **keys,
+                        uint32_t key_count, const char *uid, uint8_t detail)
+{
+struct keybox_blob blob;
+struct source *src = NULL;
+const uint8_t *text;
+uint8_t  (*id)[PKT_MAX_FPR];
+uint8_t  *id_len;
+uint8_t  fpr[PKT_MAX_FPR];
+uint8_t  fpr_len;
+uint8_t  keyid[PKT_KEYID_LEN];
+uint8_t  wanted;
+size_t   offset = 0u;
+uint32_t found = 0u;
+uint32_t len;
+uint32_t i;
+uint16_t n;
+int      rc = 2;
+
+    id     = calloc (key_count + 1u, sizeof(*id));
+    id_len = calloc (key_count + 1u, sizeof(*id_len));
+    if ((id == NULL) || (id_len == NULL)) goto done;
+    for (i = 0u; i < key_count; i++)
+    {
+        if (!parse_key_id (keys[i], id[i], &id_len[i]))
+        {
+            fprintf (stderr, "%s: not a key ID or fingerprint\n", keys[i]);
+            goto done;
+        }
+    }
+    if (detail)
+    {
+        src = source_open (name);
+        if (src == NULL) goto done;
+    }
+
+    while (keybox_next (kbx, &offset, &blob))
+    {
+        if (blob.type != KEYBOX_OPENPGP) continue;
+        wanted = !key_count;
+        for (i = 0u; (i < key_count) && !wanted; i++)
+        {
+            wanted = keybox_has_key (kbx, &blob, id[i], id_len[i]);
+        }
+        if (!wanted || (uid && !keybox_has_uid (kbx, &blob, uid))) continue;
+        found++;
+
+        if (detail)
+        {
+            if (!display_keyblock (src, &blob))
+            {
+                fprintf (stderr, "%s: damaged key block at offset %zu\n", name,
+                         blob.offset);
+                goto done;
+            }
+            continue;
+        }
+        for (n = 0u; keybox_key (kbx, &blob, n, fpr, &fpr_len, keyid); n++)
         {
-            switch (tagged)
+            printf ("%s ", n ? "sub" : ((blob.flags & KEYBOX_SECRET) ? "sec" : "pub"));
+            for (i = 0u; i < fpr_len; i++)
             {
-               case PktPublicKey:
-                    good_read = FALSE;
-                    if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-                            expected_len)
-                    {
-                        if (buf_write (0u, grabbing, expected_len) ==
-                                expected_len)
-                        {
-                            mark_end (FALSE);
-                            good_read = TRUE;
-                            key[3]=key_index++;
-                            sign_index = 48u;
-//                            display_hex (key, grabbing, expected_len);
-                            display_hex ("Time: ", grabbing + 1, 4u);
-                            if ((grabbing[0] == 3u) || (grabbing[0] == 2u))
-                            {
-                                printf ("Public Key Version %c\n", '0'+grabbing[0]);
-                                display_hex ("Days valid: ", grabbing + 5, 2u);
-                                display_hex ("Alg: ", grabbing + 7, 1u);
-                                algorithm = grabbing[7];
-                                val = 8;
-                            }
-                            else if (grabbing[0] == 4u)
-                            {
-                                printf ("Public Key Version 4\n");
-                                display_hex ("Alg: ", grabbing + 5, 1u);
-                                algorithm = grabbing[5];
-                                val = 6;
-                            }
-                            len = (uint32_t)val;
-                            switch (algorithm)
-                            {
-                                case 1u:
-                                    n = 2;
-                                    break;
-                                case 17u:
-                                    n = 4;
-                                    break;
-                                default:
-                                    n = 0;
-                                    break;
-                            }
-
-                            for (i = 0; i < n; i++)
-                            {
-                                expected_len = (grabbing[len]<<8) + grabbing[len+1];
-                                printf ("%dth MPI total bits:- %d\n", i, expected_len);
-                                if (expected_len % 8) expected_len +=8;
-                                expected_len /= 8;
-                                len += expected_len + 2;
-                                display_hex ("--- MPI ", grabbing, expected_len);
-                            }
-                        }
-                    }
-                    break;
-                case PktPKESKP:
-                    if (fread (grabbing, 1u, 10u, openPGPFile) == 10u)
-                    {
-                        printf ("PUBLIC Encrypted Symmetric Key Packet Version %d\n", grabbing[0]);
-                        display_hex ("ID: ", grabbing+1, 8u);
-                        printf ("Symmetric Key Algorithm used: %d\n", grabbing[9]);
-                        expected_len -= 10u;
-                        if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-                                expected_len) good_read = TRUE;
-                        display_hex ("ESKP: ", grabbing, expected_len);
-                    }
-                    break;
-                case PktSKESKP:
-                    if (fread (grabbing, 1u, 2u, openPGPFile) == 2u)
-                    {
-                        printf ("SYMMETRIC Encrypted Symmetric Key Packet Version %d\n", grabbing[0]);
-                        printf ("Symmetric Key Algorithm used: %d\n", grabbing[1]);
-                        expected_len -= 3u;
-                        switch (grabbing[2])
-                        {
-                            case SimpleS2K:
-                                if (fread (grabbing+1, 1u, 2u, openPGPFile) == 2u)
-                                {
-                                    printf ("Hash alg: %d\n", ((struct salted_s2k *)grabbing)->hash_algorithm);
-                                    expected_len -= 2u;
-                                }
-                                break;
-                            case SaltedS2K:
-                                if (fread (grabbing+1, 1u, 10u, openPGPFile) == 10u)
-                                {
-                                    printf ("Hash alg: %d\n", ((struct salted_s2k *)grabbing)->hash_algorithm);
-                                    display_hex ("Salt: ", ((struct salted_s2k *)grabbing)->salt, 8u);
-                                    expected_len -= 10u;
-                                }
-                                break;
-                            case IteratedSaltedS2K:
-                                if (fread (grabbing+1, 1u, 11u, openPGPFile) == 11u)
-                                {
-                                    printf ("Hash alg: %d\n", ((struct salted_s2k *)grabbing)->hash_algorithm);
-                                    display_hex ("Salt: ", ((struct salted_s2k *)grabbing)->salt, 8u);
-                                    printf ("Count: %d\n", ((struct salted_s2k *)grabbing)->count);
-                                    expected_len -= 11u;
-                                }
-                                break;
-                            default:
-                                break;
-                        }                        
-                        if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-                                expected_len) good_read = TRUE;
-                        display_hex ("ESKP: ", grabbing, expected_len);
-                    }
-                    break;
-                case PktSymEncIntegrityProtData:
-                    printf ("Packet Sym Enc Integrity Prot Data - position 00\n");
-                    fread (grabbing, 1u, 1u, openPGPFile);
-                    expected_len--;
-                case PktSymmetricEncData:
-                    printf ("LENGTH: %ld\n", expected_len);
-                    if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-                            expected_len) good_read = TRUE;
-                    display_hex ("Sym Enc DATA: ", grabbing, expected_len);
-                    break;
-                case PktUserID:
-                    good_read = FALSE;
-                    if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-                            expected_len)
-                    {
-                        grabbing[expected_len] = '\0';
-                        printf ("NAME:= %s\n", grabbing);
-                        good_read = TRUE;
-                    }
-                    break;
-                default:
-                    good_read = FALSE;
-                    if (fread (grabbing, 1u, expected_len, openPGPFile) ==
-                            expected_len)
-                    {
-                        good_read = TRUE;
-                    }
-                    break;
+                printf ("%02X", fpr[i]);
             }
+            printf ("\n");
+        }
+        for (n = 0u; keybox_uid (kbx, &blob, n, &text, &len); n++)
+        {
+            printf ("uid %.*s\n", (int)len, text);
         }
     }
-    fclose (openPGPFile);
+    if (offset != kbx->size)
+    {
+        fprintf (stderr, "%s: damaged blob at offset %zu\n", name, offset);
+        goto done;
+    }
+    rc = found ? 0 : 1;
+
+done:
+    source_close (src);
+    free (id);
+    free (id_len);
+    return rc;
+}
+
+enum scan_mode
+{
+    ModeDump,
+    ModeDiff,
+    ModeMerge,
+    ModeVerify,
+    ModeWeakRSA,
+    ModeMatch,
+    ModeExport,
+    ModeColumns,
+    ModeCarve,
+    ModeSummary,
+    ModeTimeIndex,
+    ModeTimeQuery,
+    ModeKeybox,
+    ModeFilter,
+    ModeFilterCheck,
+    ModePush,
+    ModeMail,
+    ModeWot,
+    ModeStore,
+    ModeStoreShow
+};
+
+static const struct option scan_options[] =
+{
+    { "follow", no_argument,       NULL, 'f' },
+    { "recover", no_argument,      NULL, 'r' },
+    { "diff",   no_argument,       NULL, 'd' },
+    { "merge",  no_argument,       NULL, 'M' },
+    { "verify", no_argument,       NULL, 'V' },
+    { "weak-rsa", no_argument,     NULL, 'W' },
+    { "match-file", required_argument, NULL, 'p' },
+    { "export", no_argument,       NULL, 'x' },
+    { "no-attributes", no_argument, NULL, 'A' },
+    { "no-third-party", no_argument, NULL, 'T' },
+    { "key",    required_argument, NULL, 'k' },
+    { "columns", required_argument, NULL, 'c' },
+    { "carve",  no_argument,       NULL, 'C' },
+    { "summary", no_argument,      NULL, 's' },
+    { "sample", required_argument, NULL, 'S' },
+    { "time-index", required_argument, NULL, 'i' },
+    { "time-query", required_argument, NULL, 'q' },
+    { "after",  required_argument, NULL, 'a' },
+    { "before", required_argument, NULL, 'b' },
+    { "keybox", no_argument,       NULL, 'K' },
+    { "uid",    required_argument, NULL, 'u' },
+    { "detail", no_argument,       NULL, 'D' },
+    { "filter", required_argument, NULL, 'F' },
+    { "fp-rate", required_argument, NULL, 'R' },
+    { "filter-check", required_argument, NULL, 'Q' },
+    { "push",   required_argument, NULL, 'P' },
+    { "mail",   no_argument,       NULL, 'E' },
+    { "wot",    no_argument,       NULL, 'G' },
+    { "store",  required_argument, NULL, 'B' },
+    { "store-show", no_argument,   NULL, 'L' },
+    { "output", required_argument, NULL, 'o' },
+    { "memory", required_argument, NULL, 'm' },
+    { "threads", required_argument, NULL, 't' },
+    { NULL,     0,                 NULL,  0  }
+};
+
+static void usage (const char *name)
+{
+    fprintf (stderr, "usage: %s [--follow] [--recover] FILE|-\n", name);
+    fprintf (stderr, "       %s --diff [--memory=MB] OLD NEW\n", name);
+    fprintf (stderr, "       %s --merge [--memory=MB] [--output=OUT] FILE...\n", name);
+    fprintf (stderr, "       %s --verify [--threads=N] FILE\n", name);
+    fprintf (stderr, "       %s --weak-rsa [--threads=N] FILE|-\n", name);
+    fprintf (stderr, "       %s --match-file=PATTERNS [--output=OUT] FILE\n", name);
+    fprintf (stderr, "       %s --export [--no-attributes] [--no-third-party] [--key=ID]...\n"
+                     "              [--output=OUT] FILE\n", name);
+    fprintf (stderr, "       %s --columns=OUT FILE|-\n", name);
+    fprintf (stderr, "       %s --carve [--threads=N] IMAGE\n", name);
+    fprintf (stderr, "       %s --summary [--threads=N] [--sample=SHARE] FILE|-\n", name);
+    fprintf (stderr, "       %s --time-index=OUT [--memory=MB] FILE|-\n", name);
+    fprintf (stderr, "       %s --time-query=FIELD [--after=WHEN] [--before=WHEN] INDEX\n",
+             name);
+    fprintf (stderr, "       %s --keybox [--key=ID]... [--uid=TEXT] [--detail] KEYBOX\n",
+             name);
+    fprintf (stderr, "       %s --filter=OUT [--fp-rate=RATE] FILE|-\n", name);
+    fprintf (stderr, "       %s --filter-check=FILTER ID...\n", name);
+    fprintf (stderr, "       %s --push=SIZE FILE|-\n", name);
+    fprintf (stderr, "       %s --mail [--threads=N] MBOX|MAILDIR...\n", name);
+    fprintf (stderr, "       %s --wot [--threads=N] [--key=FROM [--key=TO]...] [--output=OUT]\n"
+                     "              FILE|-\n", name);
+    fprintf (stderr, "       %s --store=OUT FILE\n", name);
+    fprintf (stderr, "       %s --store-show [--key=ID]... SNAPSHOT\n", name);
 }
- 
-extern int32_t main (uint8_t argc, int8_t *argv[])
+
+extern int32_t main (int argc, char *argv[])
 {
-    if (argc == 2)
+enum scan_mode mode = ModeDump;
+uint8_t follow = FALSE;
+uint8_t recover = FALSE;
+size_t memory = DEFAULT_MEMORY;
+const char *output = NULL;
+const char *patterns = NULL;
+const char *field = NULL;
+const char *after = NULL;
+const char *before = NULL;
+const char *uid = NULL;
+uint8_t detail = FALSE;
+const char *rate = NULL;
+const char *sample = NULL;
+size_t piece = 0u;
+struct keybox *kbx;
+char **keys;
+uint32_t key_count = 0u;
+uint8_t export_flags = 0u;
+uint32_t threads;
+long online;
+int opt;
+
+    online  = sysconf (_SC_NPROCESSORS_ONLN);
+    threads = (online > 0) ? (uint32_t)online : 1u;
+    keys    = calloc ((size_t)argc, sizeof(*keys));
+    if (keys == NULL) return (2u);
+    while ((opt = getopt_long (argc, argv, "frdMVWp:xATk:c:CsS:i:q:a:b:Ku:DF:R:Q:P:EGB:Lo:m:t:", scan_options, NULL)) != -1)
     {
-        scan_open_pgp_file (argv[1]);
+        switch (opt)
+        {
+            case 'f':
+                follow = TRUE;
+                break;
+            case 'r':
+                recover = TRUE;
+                break;
+            case 'd':
+                mode = ModeDiff;
+                break;
+            case 'M':
+                mode = ModeMerge;
+                break;
+            case 'V':
+                mode = ModeVerify;
+                break;
+            case 'W':
+                mode = ModeWeakRSA;
+                break;
+            case 'p':
+                mode     = ModeMatch;
+                patterns = optarg;
+                break;
+            case 'x':
+                mode = ModeExport;
+                break;
+            case 'A':
+                export_flags |= EXPORT_NO_ATTRIBUTES;
+                break;
+            case 'T':
+                export_flags |= EXPORT_NO_THIRD_PARTY;
+                break;
+            case 'k':
+                keys[key_count++] = optarg;
+                break;
+            case 'c':
+                mode   = ModeColumns;
+                output = optarg;
+                break;
+            case 'C':
+                mode = ModeCarve;
+                break;
+            case 's':
+                mode = ModeSummary;
+                break;
+            case 'i':
+                mode   = ModeTimeIndex;
+                output = optarg;
+                break;
+            case 'q':
+                mode  = ModeTimeQuery;
+                field = optarg;
+                break;
+            case 'a':
+                after = optarg;
+                break;
+            case 'b':
+                before = optarg;
+                break;
+            case 'K':
+                mode = ModeKeybox;
+                break;
+            case 'u':
+                uid = optarg;
+                break;
+            case 'D':
+                detail = TRUE;
+                break;
+            case 'S':
+                sample = optarg;
+                break;
+            case 'F':
+                mode   = ModeFilter;
+                output = optarg;
+                break;
+            case 'R':
+                rate = optarg;
+                break;
+            case 'Q':
+                mode   = ModeFilterCheck;
+                output = optarg;
+                break;
+            case 'P':
+                mode  = ModePush;
+                piece = (size_t)strtoul (optarg, NULL, 10);
+                break;
+            case 'E':
+                mode = ModeMail;
+                break;
+            case 'G':
+                mode = ModeWot;
+                break;
+            case 'B':
+                mode   = ModeStore;
+                output = optarg;
+                break;
+            case 'L':
+                mode = ModeStoreShow;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'm':
+                memory = (size_t)strtoul (optarg, NULL, 10) << 20;
+                break;
+            case 't':
+                threads = (uint32_t)strtoul (optarg, NULL, 10);
+                break;
+            default:
+                usage (argv[0]);
+                return (1u);
+        }
     }
-    else
+    if (!digest_init ())
+    {
+        fprintf (stderr, "%s: libgcrypt could not be initialised\n", argv[0]);
+        return (2u);
+    }
+
+    switch (mode)
     {
-        return (1u);
+        case ModeDiff:
+            if (optind + 2 != argc) break;
+            return diff_keyrings (argv[optind], argv[optind + 1], memory / 2u);
+        case ModeMerge:
+            if (optind >= argc) break;
+            return merge_keyrings (output, argv + optind, (uint32_t)(argc - optind),
+                                   memory);
+        case ModeVerify:
+            if (optind + 1 != argc) break;
+            return verify_keyring (argv[optind], threads);
+        case ModeWeakRSA:
+            if (optind + 1 != argc) break;
+            return weak_rsa_keys (argv[optind], threads);
+        case ModeMatch:
+            if (optind + 1 != argc) break;
+            return match_keyrings (patterns, argv[optind], output);
+        case ModeExport:
+            if (optind + 1 != argc) break;
+            return export_keyring (argv[optind], output, export_flags, keys, key_count);
+        case ModeColumns:
+            if (optind + 1 != argc) break;
+            return columns_export (argv[optind], output);
+        case ModeCarve:
+            if (optind + 1 != argc) break;
+            return carve_image (argv[optind], threads);
+        case ModeSummary:
+            if (optind + 1 != argc) break;
+            return summary_keyring (argv[optind], threads, sample);
+        case ModeTimeIndex:
+            if (optind + 1 != argc) break;
+            return time_index_build (argv[optind], output, memory);
+        case ModeTimeQuery:
+            if (optind + 1 != argc) break;
+            return time_index_query (argv[optind], field, after, before);
+        case ModeFilter:
+            if (optind + 1 != argc) break;
+            return filter_build (argv[optind], output, rate);
+        case ModeFilterCheck:
+            if (optind >= argc) break;
+            return filter_query (output, argv + optind, (uint32_t)(argc - optind));
+        case ModePush:
+            if ((optind + 1 != argc) || !piece) break;
+            return scan_push_file (argv[optind], piece);
+        case ModeMail:
+            if (optind >= argc) break;
+            return mail_archives (argv + optind, (uint32_t)(argc - optind), threads);
+        case ModeWot:
+            if (optind + 1 != argc) break;
+            return wot_keyring (argv[optind], keys, key_count, output, threads);
+        case ModeStore:
+            if (optind + 1 != argc) break;
+            return store_write (argv[optind], output);
+        case ModeStoreShow:
+            if (optind + 1 != argc) break;
+            return store_show (argv[optind], keys, key_count);
+        case ModeKeybox:
+            if (optind + 1 != argc) break;
+            kbx = keybox_open (argv[optind]);
+            if (kbx == NULL)
+            {
+                fprintf (stderr, "%s: not a keybox\n", argv[optind]);
+                return (2u);
+            }
+            opt = scan_keybox (kbx, argv[optind], keys, key_count, uid, detail);
+            keybox_close (kbx);
+            return opt;
+        default:
+            if (optind + 1 != argc) break;
+            /* gpg's pubring.kbx is dumped key block by key block */
+            kbx = follow ? NULL : keybox_open (argv[optind]);
+            if (kbx != NULL)
+            {
+                opt = scan_keybox (kbx, argv[optind], NULL, 0u, NULL, TRUE);
+                keybox_close (kbx);
+                return (opt == 2) ? 2 : 0;
+            }
+            return scan_open_pgp_file ((int8_t *)argv[optind], follow, recover);
     }
+    usage (argv[0]);
+    return (1u);
 }
@@ -0,0 +1,791 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/***************************************************************************/
+/*                                                                         */
+/* scand keeps keyrings mapped, with every primary key and subkey sorted   */
+/* by key ID and every user ID held in memory, and answers requests over   */
+/* a Unix domain socket. Integers on the wire are big endian.              */
+/*                                                                         */
+/*   request   u8 op, u8 zero, u16 payload length, payload                 */
+/*   response  u8 status, 3 zero octets, u32 payload length, payload       */
+/*                                                                         */
+/*   op 1 lookup   payload a key ID or a v4 or v6 fingerprint; the answer  */
+/*                 is the key block holding that key or subkey, as stored  */
+/*   op 2 search   payload text; the answer is u8 length and fingerprint   */
+/*                 of each primary key with a user ID containing the text, */
+/*                 ASCII case ignored, at most SCAND_HITS of them          */
+/*   op 3 summary  no payload; the answer is u32 keyrings, then for each   */
+/*                 u64 size, keys, subkeys, user IDs, signatures and loads */
+/*                                                                         */
+/*   status 0 found, 1 nothing found, 2 bad request                        */
+/*                                                                         */
+/* A client may send any number of requests on one connection, and each   */
+/* connection has a thread of its own. A keyring whose file changes is     */
+/* loaded again in the background and swapped in once it has been read    */
+/* in full; requests already running finish on the copy they started on.  */
+/* The swap is only atomic if the file is replaced by rename rather than   */
+/* rewritten in place.                                                     */
+/*                                                                         */
+/***************************************************************************/
+
+#define SCAND_LOOKUP    (1u)
+#define SCAND_SEARCH    (2u)
+#define SCAND_SUMMARY   (3u)
+
+#define SCAND_FOUND     (0u)
+#define SCAND_NONE      (1u)
+#define SCAND_BAD       (2u)
+
+#define SCAND_HITS      (1000u)
+#define SCAND_POLL      (1u)
+#define SCAND_BACKLOG   (64)
+
+struct scand_key
+{
+    uint8_t         keyid[PKT_KEYID_LEN];
+    uint8_t         fpr[PKT_MAX_FPR];
+    uint8_t         fpr_len;
+    uint32_t        block;
+};
+
+struct scand_block
+{
+    off_t           offset;
+    off_t           end;
+    uint8_t         fpr[PKT_MAX_FPR];
+    uint8_t         fpr_len;
+    uint32_t        uid_first;
+    uint32_t        uids;
+};
+
+struct scand_uid
+{
+    uint64_t        offset;
+    uint32_t        len;
+};
+
+/* One load of one keyring; freed when the last request using it is done */
+
+struct scand_ring
+{
+    uint32_t        refs;
+    int             fd;
+    uint8_t        *map;
+    size_t          size;
+    struct scand_block *block;
+    uint32_t        blocks;
+    uint32_t        block_size;
+    struct scand_key *key;
+    uint32_t        keys;
+    uint32_t        key_size;
+    struct scand_uid *uid;
+    uint32_t        uids;
+    uint32_t        uid_size;
+    uint8_t        *text;
+    uint64_t        text_len;
+    uint64_t        text_size;
+    uint64_t        subkeys;
+    uint64_t        sigs;
+    uint64_t        loads;
+    uint8_t         failed;
+};
+
+struct scand_slot
+{
+    const char     *name;
+    struct scand_ring *ring;
+    struct stat     seen;
+};
+
+struct scand_state
+{
+    pthread_mutex_t lock;
+    struct scand_slot *slot;
+    uint32_t        slots;
+};
+
+static struct scand_state state = { PTHREAD_MUTEX_INITIALIZER, NULL, 0u };
+static volatile sig_atomic_t stopping = 0;
+
+static void ring_free (struct scand_ring *ring)
+{
+    if (ring == NULL) return;
+    if (ring->map != NULL) munmap (ring->map, ring->size);
+    if (ring->fd >= 0) close (ring->fd);
+    free (ring->block);
+    free (ring->key);
+    free (ring->uid);
+    free (ring->text);
+    free (ring);
+}
+
+static struct scand_ring *ring_get (uint32_t i)
+{
+struct scand_ring *ring;
+
+    pthread_mutex_lock (&state.lock);
+    ring = state.slot[i].ring;
+    if (ring != NULL) ring->refs++;
+    pthread_mutex_unlock (&state.lock);
+    return ring;
+}
+
+static void ring_put (struct scand_ring *ring)
+{
+uint32_t refs;
+
+    if (ring == NULL) return;
+    pthread_mutex_lock (&state.lock);
+    refs = --ring->refs;
+    pthread_mutex_unlock (&state.lock);
+    if (!refs) ring_free (ring);
+}
+
+/* Grow an array by doubling, keeping count and size in step */
+
+static uint8_t grow (void **array, uint32_t count, uint32_t *pSize, size_t each)
+{
+void *grown;
+
+    if (count < *pSize) return TRUE;
+    grown = realloc (*array, (size_t)(*pSize ? *pSize * 2u : 256u) * each);
+    if (grown == NULL) return FALSE;
+    *array = grown;
+    *pSize = *pSize ? *pSize * 2u : 256u;
+    return TRUE;
+}
+
+static uint8_t add_key (struct scand_ring *ring, const uint8_t *keyid, const uint8_t *fpr,
+                        uint8_t fpr_len)
+{
+struct scand_key *key;
+
+    if (!grow ((void **)&ring->key, ring->keys, &ring->key_size, sizeof(*key))) return FALSE;
+    key = &ring->key[ring->keys++];
+    memcpy (key->keyid, keyid, PKT_KEYID_LEN);
+    memset (key->fpr, 0, PKT_MAX_FPR);
+    memcpy (key->fpr, fpr, fpr_len);
+    key->fpr_len = fpr_len;
+    key->block   = ring->blocks - 1u;
+    return TRUE;
+}
+
+static uint8_t add_uid (struct scand_ring *ring, const uint8_t *text, uint32_t len)
+{
+uint8_t *grown;
+uint64_t size;
+
+    if (!grow ((void **)&ring->uid, ring->uids, &ring->uid_size, sizeof(*ring->uid)))
+    {
+        return FALSE;
+    }
+    if (ring->text_len + len > ring->text_size)
+    {
+        size = ring->text_size ? ring->text_size : 65536u;
+        while (ring->text_len + len > size) size *= 2u;
+        grown = realloc (ring->text, size);
+        if (grown == NULL) return FALSE;
+        ring->text      = grown;
+        ring->text_size = size;
+    }
+    memcpy (ring->text + ring->text_len, text, len);
+    ring->uid[ring->uids].offset = ring->text_len;
+    ring->uid[ring->uids].len    = len;
+    ring->uids++;
+    ring->text_len += len;
+    ring->block[ring->blocks - 1u].uids++;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* load_collect                                                            */
+/* INPUTS: ctx - the keyring being loaded                                  */
+/*         block - the key block being walked                              */
+/*         pkt - the packet                                                */
+/* RETURN: FALSE if out of memory                                          */
+/*                                                                         */
+/* Anything before the first primary key belongs to no block and is only  */
+/* stepped over.                                                           */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t load_collect (void *ctx, const struct keyring_block *block,
+                             const struct keyring_packet *pkt)
+{
+struct scand_ring  *ring = ctx;
+struct scand_block *current;
+uint8_t fpr[PKT_MAX_FPR];
+uint8_t fpr_len;
+uint8_t keyid[PKT_KEYID_LEN];
+
+    if ((pkt->tag == PktPublicKey) || (pkt->tag == PktSecretKey))
+    {
+        if (!grow ((void **)&ring->block, ring->blocks, &ring->block_size,
+                   sizeof(*current)))
+        {
+            goto fail;
+        }
+        current = &ring->block[ring->blocks++];
+        memset (current, 0, sizeof(*current));
+        current->offset    = pkt->offset;
+        current->uid_first = ring->uids;
+        if (block->valid)
+        {
+            memcpy (current->fpr, block->fpr, block->fpr_len);
+            current->fpr_len = block->fpr_len;
+            if (!add_key (ring, block->keyid, block->fpr, block->fpr_len)) goto fail;
+        }
+    }
+    if (!ring->blocks) return TRUE;
+    ring->block[ring->blocks - 1u].end = pkt->end;
+
+    switch (pkt->tag)
+    {
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            ring->subkeys++;
+            if (key_fingerprint (pkt->body, pkt->len, fpr, &fpr_len, keyid) &&
+                    !add_key (ring, keyid, fpr, fpr_len))
+            {
+                goto fail;
+            }
+            break;
+        case PktUserID:
+            if (!add_uid (ring, pkt->body, pkt->len)) goto fail;
+            break;
+        case PktSignature:
+            ring->sigs++;
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+
+fail:
+    ring->failed = TRUE;
+    return FALSE;
+}
+
+static int by_keyid (const void *a, const void *b)
+{
+    return memcmp (a, b, PKT_KEYID_LEN);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* ring_load                                                               */
+/* INPUTS: name - keyring file                                             */
+/*         loads - how many times it has been loaded before                */
+/* RETURN: the loaded keyring, or NULL if it could not be read in full     */
+/* OUTPUT: pSt - the file's status when it was opened                      */
+/*                                                                         */
+/***************************************************************************/
+
+static struct scand_ring *ring_load (const char *name, uint64_t loads, struct stat *pSt)
+{
+struct scand_ring *ring;
+struct source     *src;
+int                fd;
+
+    ring = calloc (1u, sizeof(*ring));
+    if (ring == NULL) return NULL;
+    ring->refs  = 1u;
+    ring->loads = loads + 1u;
+    ring->fd    = open (name, O_RDONLY | O_CLOEXEC);
+    if ((ring->fd < 0) || fstat (ring->fd, pSt) || !S_ISREG (pSt->st_mode) ||
+            !pSt->st_size)
+    {
+        goto fail;
+    }
+    ring->size = (size_t)pSt->st_size;
+    ring->map  = mmap (NULL, ring->size, PROT_READ, MAP_SHARED, ring->fd, 0);
+    if (ring->map == MAP_FAILED)
+    {
+        ring->map = NULL;
+        goto fail;
+    }
+
+    fd  = dup (ring->fd);
+    src = source_fdopen (fd);
+    if (src == NULL)
+    {
+        if (fd >= 0) close (fd);
+        goto fail;
+    }
+    if (!keyring_walk (src, KEYRING_SKIP_ATTRIBUTES, load_collect, ring) ||
+            ring->failed || (source_tell (src) != pSt->st_size))
+    {
+        source_close (src);
+        goto fail;
+    }
+    source_close (src);
+    qsort (ring->key, ring->keys, sizeof(*ring->key), by_keyid);
+    return ring;
+
+fail:
+    ring_free (ring);
+    return NULL;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* reload_thread                                                           */
+/* INPUTS: arg - unused                                                    */
+/* RETURN: never                                                           */
+/*                                                                         */
+/* Every keyring's file is looked at once a second. When it has changed    */
+/* it is loaded afresh; a load that fails, say on a file caught half       */
+/* written, leaves the old one in service until the file changes again.    */
+/*                                                                         */
+/***************************************************************************/
+
+static void *reload_thread (void *arg)
+{
+struct scand_slot *slot;
+struct scand_ring *ring;
+struct scand_ring *old;
+struct stat        st;
+uint32_t           i;
+
+    (void)arg;
+    for (;;)
+    {
+        sleep (SCAND_POLL);
+        for (i = 0u; i < state.slots; i++)
+        {
+            slot = &state.slot[i];
+            if (stat (slot->name, &st)) continue;
+            if ((st.st_dev == slot->seen.st_dev) && (st.st_ino == slot->seen.st_ino) &&
+                    (st.st_size == slot->seen.st_size) &&
+                    (st.st_mtim.tv_sec == slot->seen.st_mtim.tv_sec) &&
+                    (st.st_mtim.tv_nsec == slot->seen.st_mtim.tv_nsec))
+            {
+                continue;
+            }
+            old  = ring_get (i);
+            ring = ring_load (slot->name, old ? old->loads : 0u, &slot->seen);
+            ring_put (old);
+            if (ring == NULL)
+            {
+                slot->seen = st;
+                fprintf (stderr, "%s: changed but could not be loaded\n", slot->name);
+                continue;
+            }
+            pthread_mutex_lock (&state.lock);
+            old        = slot->ring;
+            slot->ring = ring;
+            pthread_mutex_unlock (&state.lock);
+            ring_put (old);
+            fprintf (stderr, "%s: reloaded, %u keys\n", slot->name, ring->blocks);
+        }
+    }
+    return NULL;
+}
+
+/* Send all of a buffer, or give up on the client */
+
+static uint8_t send_all (int fd, const void *data, size_t len)
+{
+const uint8_t *p = data;
+ssize_t        sent;
+
+    while (len)
+    {
+        sent = send (fd, p, len, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        p   += sent;
+        len -= (size_t)sent;
+    }
+    return TRUE;
+}
+
+static uint8_t recv_all (int fd, void *data, size_t len)
+{
+uint8_t *p = data;
+ssize_t  got;
+
+    while (len)
+    {
+        got = recv (fd, p, len, 0);
+        if (got < 0)
+        {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        if (!got) return FALSE;
+        p   += got;
+        len -= (size_t)got;
+    }
+    return TRUE;
+}
+
+static void be (uint8_t *p, uint64_t value, uint32_t len)
+{
+    while (len--)
+    {
+        p[len] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+static uint8_t send_head (int fd, uint8_t status, uint32_t len)
+{
+uint8_t head[8];
+
+    memset (head, 0, sizeof(head));
+    head[0] = status;
+    be (head + 4, len, 4u);
+    return send_all (fd, head, sizeof(head));
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* lookup                                                                  */
+/* INPUTS: ring - the keyring                                              */
+/*         want - key ID, or fingerprint                                   */
+/*         len - PKT_KEYID_LEN, 20 for v4 or 32 for v5 and v6              */
+/* RETURN: the block holding the key, or NULL                              */
+/*                                                                         */
+/* The key ID is the tail of a v4 fingerprint and the head of a v5 or v6   */
+/* one, so every lookup is a binary search on the key ID.                  */
+/*                                                                         */
+/***************************************************************************/
+
+static const struct scand_block *lookup (const struct scand_ring *ring,
+                                         const uint8_t *want, uint32_t len)
+{
+const uint8_t *keyid = want;
+uint32_t low = 0u;
+uint32_t high = ring->keys;
+uint32_t middle;
+
+    if (len == 20u) keyid = want + 20u - PKT_KEYID_LEN;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2u;
+        if (memcmp (ring->key[middle].keyid, keyid, PKT_KEYID_LEN) < 0)
+        {
+            low = middle + 1u;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    for (; (low < ring->keys) && !memcmp (ring->key[low].keyid, keyid, PKT_KEYID_LEN);
+           low++)
+    {
+        if ((len == PKT_KEYID_LEN) ||
+                ((ring->key[low].fpr_len == len) && !memcmp (ring->key[low].fpr, want, len)))
+        {
+            return &ring->block[ring->key[low].block];
+        }
+    }
+    return NULL;
+}
+
+static uint8_t lower (uint8_t c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+/* Whether text holds want, ASCII case ignored */
+
+static uint8_t contains (const uint8_t *text, uint32_t len, const uint8_t *want,
+                         uint32_t want_len)
+{
+uint32_t i;
+uint32_t j;
+
+    if (want_len > len) return FALSE;
+    for (i = 0u; i + want_len <= len; i++)
+    {
+        for (j = 0u; j < want_len; j++)
+        {
+            if (lower (text[i + j]) != lower (want[j])) break;
+        }
+        if (j == want_len) return TRUE;
+    }
+    return FALSE;
+}
+
+static uint8_t serve_lookup (int fd, const uint8_t *want, uint32_t len)
+{
+const struct scand_block *block = NULL;
+struct scand_ring *ring = NULL;
+uint8_t ok;
+uint32_t i;
+
+    if ((len != PKT_KEYID_LEN) && (len != 20u) && (len != 32u))
+    {
+        return send_head (fd, SCAND_BAD, 0u);
+    }
+    for (i = 0u; (i < state.slots) && (block == NULL); i++)
+    {
+        ring_put (ring);
+        ring = ring_get (i);
+        if (ring != NULL) block = lookup (ring, want, len);
+    }
+    if (block == NULL)
+    {
+        ok = send_head (fd, SCAND_NONE, 0u);
+    }
+    else
+    {
+        ok = send_head (fd, SCAND_FOUND, (uint32_t)(block->end - block->offset)) &&
+             send_all (fd, ring->map + block->offset, (size_t)(block->end - block->offset));
+    }
+    ring_put (ring);
+    return ok;
+}
+
+static uint8_t serve_search (int fd, const uint8_t *want, uint32_t len)
+{
+struct scand_ring *ring;
+const struct scand_block *block;
+const struct scand_uid   *uid;
+uint8_t  *answer;
+uint32_t  answer_len = 0u;
+uint32_t  hits = 0u;
+uint32_t  i;
+uint32_t  b;
+uint32_t  u;
+uint8_t   ok;
+
+    if (!len) return send_head (fd, SCAND_BAD, 0u);
+    answer = malloc (SCAND_HITS * (1u + PKT_MAX_FPR));
+    if (answer == NULL) return FALSE;
+    for (i = 0u; (i < state.slots) && (hits < SCAND_HITS); i++)
+    {
+        ring = ring_get (i);
+        if (ring == NULL) continue;
+        for (b = 0u; (b < ring->blocks) && (hits < SCAND_HITS); b++)
+        {
+            block = &ring->block[b];
+            for (u = 0u; u < block->uids; u++)
+            {
+                uid = &ring->uid[block->uid_first + u];
+                if (!contains (ring->text + uid->offset, uid->len, want, len)) continue;
+                answer[answer_len++] = block->fpr_len;
+                memcpy (answer + answer_len, block->fpr, block->fpr_len);
+                answer_len += block->fpr_len;
+                hits++;
+                break;
+            }
+        }
+        ring_put (ring);
+    }
+    ok = send_head (fd, hits ? SCAND_FOUND : SCAND_NONE, answer_len) &&
+         send_all (fd, answer, answer_len);
+    free (answer);
+    return ok;
+}
+
+static uint8_t serve_summary (int fd)
+{
+struct scand_ring *ring;
+uint8_t  *answer;
+uint8_t  *p;
+uint32_t  len = 4u + state.slots * 48u;
+uint32_t  i;
+uint8_t   ok;
+
+    answer = calloc (1u, len);
+    if (answer == NULL) return FALSE;
+    be (answer, state.slots, 4u);
+    for (i = 0u; i < state.slots; i++)
+    {
+        p    = answer + 4u + i * 48u;
+        ring = ring_get (i);
+        if (ring == NULL) continue;
+        be (p, ring->size, 8u);
+        be (p + 8, ring->blocks, 8u);
+        be (p + 16, ring->subkeys, 8u);
+        be (p + 24, ring->uids, 8u);
+        be (p + 32, ring->sigs, 8u);
+        be (p + 40, ring->loads, 8u);
+        ring_put (ring);
+    }
+    ok = send_head (fd, SCAND_FOUND, len) && send_all (fd, answer, len);
+    free (answer);
+    return ok;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* client_thread                                                           */
+/* INPUTS: arg - the connected socket                                      */
+/* RETURN: NULL                                                            */
+/*                                                                         */
+/* Answers requests until the client hangs up or sends something that is   */
+/* not a request at all.                                                   */
+/*                                                                         */
+/***************************************************************************/
+
+static void *client_thread (void *arg)
+{
+int      fd = (int)(intptr_t)arg;
+uint8_t  head[4];
+uint8_t  payload[65536];
+uint32_t len;
+uint8_t  ok = TRUE;
+
+    while (ok && recv_all (fd, head, sizeof(head)))
+    {
+        len = ((uint32_t)head[2] << 8) | head[3];
+        if (head[1] || !recv_all (fd, payload, len)) break;
+        switch (head[0])
+        {
+            case SCAND_LOOKUP:
+                ok = serve_lookup (fd, payload, len);
+                break;
+            case SCAND_SEARCH:
+                ok = serve_search (fd, payload, len);
+                break;
+            case SCAND_SUMMARY:
+                ok = len ? send_head (fd, SCAND_BAD, 0u) : serve_summary (fd);
+                break;
+            default:
+                ok = send_head (fd, SCAND_BAD, 0u);
+                break;
+        }
+    }
+    close (fd);
+    return NULL;
+}
+
+static void stop (int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+extern int32_t main (int argc, char *argv[])
+{
+struct sockaddr_un addr;
+struct sigaction   act;
+pthread_attr_t     attr;
+pthread_t          thread;
+struct stat        st;
+uint32_t i;
+int      listener;
+int      fd;
+
+    if (argc < 3)
+    {
+        fprintf (stderr, "usage: %s SOCKET KEYRING...\n", argv[0]);
+        return (1u);
+    }
+    if (strlen (argv[1]) >= sizeof(addr.sun_path))
+    {
+        fprintf (stderr, "%s: socket path too long\n", argv[1]);
+        return (1u);
+    }
+    if (!digest_init ())
+    {
+        fprintf (stderr, "%s: libgcrypt could not be initialised\n", argv[0]);
+        return (2u);
+    }
+
+    state.slots = (uint32_t)(argc - 2);
+    state.slot  = calloc (state.slots, sizeof(*state.slot));
+    if (state.slot == NULL) return (2u);
+    for (i = 0u; i < state.slots; i++)
+    {
+        state.slot[i].name = argv[i + 2];
+        state.slot[i].ring = ring_load (argv[i + 2], 0u, &state.slot[i].seen);
+        if (state.slot[i].ring == NULL)
+        {
+            fprintf (stderr, "%s: cannot load\n", argv[i + 2]);
+            return (2u);
+        }
+        fprintf (stderr, "%s: %u keys, %u user IDs\n", argv[i + 2],
+                 state.slot[i].ring->blocks, state.slot[i].ring->uids);
+    }
+
+    memset (&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, argv[1]);
+    if (!lstat (argv[1], &st) && S_ISSOCK (st.st_mode)) unlink (argv[1]);
+    listener = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ((listener < 0) || bind (listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+            listen (listener, SCAND_BACKLOG))
+    {
+        fprintf (stderr, "%s: cannot listen\n", argv[1]);
+        return (2u);
+    }
+
+    /* no SA_RESTART, so accept returns to let the socket be removed */
+    memset (&act, 0, sizeof(act));
+    act.sa_handler = stop;
+    sigemptyset (&act.sa_mask);
+    sigaction (SIGINT, &act, NULL);
+    sigaction (SIGTERM, &act, NULL);
+
+    pthread_attr_init (&attr);
+    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create (&thread, &attr, reload_thread, NULL))
+    {
+        fprintf (stderr, "%s: keyrings will not be reloaded\n", argv[0]);
+    }
+    while (!stopping)
+    {
+        fd = accept (listener, NULL, NULL);
+        if (fd < 0) continue;
+        if (pthread_create (&thread, &attr, client_thread, (void *)(intptr_t)fd))
+        {
+            close (fd);
+        }
+    }
+    pthread_attr_destroy (&attr);
+    close (listener);
+    unlink (argv[1]);
+    return (0u);
+}
@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "source.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+#define SOURCE_ALIGN    (4096u)
+
+/***************************************************************************/
+/*                                                                         */
+/* source_fdopen                                                           */
+/* INPUTS: fd - open descriptor, which becomes owned by the source         */
+/* RETURN: the new source, or NULL if failed                               */
+/*                                                                         */
+/* Regular files are read ahead sequentially. For a pipe we ask for a      */
+/* bigger pipe buffer so the writer can run further ahead of us and each   */
+/* read() hands over more data.                                            */
+/*                                                                         */
+/***************************************************************************/
+
+extern struct source *source_fdopen (int fd)
+{
+struct source *src;
+struct stat    st;
+void          *buffer;
+
+    if ((fd < 0) || fstat (fd, &st)) return NULL;
+    src = calloc (1u, sizeof(*src));
+    if (src == NULL) return NULL;
+    if (posix_memalign (&buffer, SOURCE_ALIGN, SOURCE_BUFFER))
+    {
+        free (src);
+        return NULL;
+    }
+    src->fd       = fd;
+    src->buffer   = buffer;
+    src->window   = SOURCE_BUFFER;
+    src->seekable = S_ISREG (st.st_mode) ? TRUE : FALSE;
+    if (src->seekable)
+    {
+        src->offset = lseek (fd, 0, SEEK_CUR);
+        posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#ifdef F_SETPIPE_SZ
+    else if (S_ISFIFO (st.st_mode))
+    {
+        fcntl (fd, F_SETPIPE_SZ, (int)SOURCE_BUFFER);
+    }
+#endif
+    return src;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* source_open                                                             */
+/* INPUTS: name - path to open read only, or "-" for standard input        */
+/* RETURN: the new source, or NULL if failed                               */
+/*                                                                         */
+/* Any other inherited descriptor can be named as /dev/fd/N.               */
+/*                                                                         */
+/***************************************************************************/
+
+extern struct source *source_open (const char *name)
+{
+struct source *src;
+int fd;
+
+    if (!strcmp (name, "-"))
+    {
+        fd = dup (STDIN_FILENO);
+    }
+    else
+    {
+        fd = open (name, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) return NULL;
+    src = source_fdopen (fd);
+    if (src == NULL) close (fd);
+    return src;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* fill                                                                    */
+/* INPUTS: src - the source                                                */
+/* RETURN: number of new bytes in the buffer, zero at end of input         */
+/*                                                                         */
+/* Move whatever is left to the front and top the buffer up with one read. */
+/* After a random seek only a small window is read, doubling with each    */
+/* fill, so that reading back one packet does not read a whole buffer.    */
+/*                                                                         */
+/***************************************************************************/
+
+static size_t fill (struct source *src)
+{
+ssize_t got;
+size_t  want;
+
+    if (src->start)
+    {
+        memmove (src->buffer, src->buffer + src->start, src->end - src->start);
+        src->offset += src->start;
+        src->end    -= src->start;
+        src->start   = 0u;
+    }
+    want = SOURCE_BUFFER - src->end;
+    if (want > src->window) want = src->window;
+    if (src->window < SOURCE_BUFFER) src->window *= 2u;
+    do
+    {
+        got = read (src->fd, src->buffer + src->end, want);
+    } while ((got < 0) && (errno == EINTR));
+    if (got <= 0)
+    {
+        if (got < 0) src->error = TRUE;
+        src->eof = TRUE;
+        return 0u;
+    }
+    src->end += (size_t)got;
+    return (size_t)got;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* source_read                                                             */
+/* INPUTS: src - the source                                                */
+/*         dst - where to put the bytes                                    */
+/*         size - number of bytes wanted                                   */
+/* RETURN: number of bytes read, short only at end of input or on error    */
+/*                                                                         */
+/* Large reads with the buffer drained go straight into dst.               */
+/*                                                                         */
+/***************************************************************************/
+
+extern size_t source_read (struct source *src, void *dst, size_t size)
+{
+uint8_t *out = dst;
+size_t   done = 0u;
+size_t   avail;
+ssize_t  got;
+
+    while (done < size)
+    {
+        avail = src->end - src->start;
+        if (avail)
+        {
+            if (avail > size - done) avail = size - done;
+            memcpy (out + done, src->buffer + src->start, avail);
+            src->start += avail;
+            done       += avail;
+            continue;
+        }
+        if (src->eof) break;
+        if (size - done >= SOURCE_BUFFER)
+        {
+            src->offset += src->end;
+            src->start   = src->end = 0u;
+            do
+            {
+                got = read (src->fd, out + done, size - done);
+            } while ((got < 0) && (errno == EINTR));
+            if (got <= 0)
+            {
+                if (got < 0) src->error = TRUE;
+                src->eof = TRUE;
+                break;
+            }
+            src->offset += got;
+            done        += (size_t)got;
+            continue;
+        }
+        if (!fill (src)) break;
+    }
+    return done;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* source_peek                                                             */
+/* INPUTS: src - the source                                                */
+/*         size - number of bytes wanted, at most SOURCE_BUFFER            */
+/* RETURN: the buffered bytes at the current position, left unconsumed     */
+/* OUTPUT: pAvail - how many there are, fewer than size only at the end    */
+/*                                                                         */
+/* End of input found while topping up is not reported while bytes are    */
+/* still buffered; the next read past them finds it again.                 */
+/*                                                                         */
+/***************************************************************************/
+
+extern const uint8_t *source_peek (struct source *src, size_t size, size_t *pAvail)
+{
+    if (size > SOURCE_BUFFER) size = SOURCE_BUFFER;
+    while ((src->end - src->start < size) && !src->eof)
+    {
+        if (!fill (src)) break;
+    }
+    if (src->eof && !src->error && (src->end > src->start)) src->eof = FALSE;
+    *pAvail = src->end - src->start;
+    return src->buffer + src->start;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* source_skip                                                             */
+/* INPUTS: src - the source                                                */
+/*         size - number of bytes to pass over                             */
+/* RETURN: TRUE if all of them were passed over                            */
+/*                                                                         */
+/* Regular files seek past anything beyond the buffer; a seek past the end */
+/* of a file is caught by checking its size. Pipes read and discard.       */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t source_skip (struct source *src, uint64_t size)
+{
+struct stat st;
+size_t avail;
+off_t  target;
+
+    avail = src->end - src->start;
+    if (size <= avail)
+    {
+        src->start += (size_t)size;
+        return TRUE;
+    }
+    if (src->seekable)
+    {
+        target = source_tell (src) + (off_t)size;
+        if (fstat (src->fd, &st) || (target > st.st_size))
+        {
+            src->eof = TRUE;
+            return FALSE;
+        }
+        if (!source_seek (src, target)) return FALSE;
+        src->window = SOURCE_BUFFER;
+        return TRUE;
+    }
+    size      -= avail;
+    src->start = src->end;
+    while (size)
+    {
+        if (!fill (src)) return FALSE;
+        avail = src->end - src->start;
+        if (avail > size) avail = (size_t)size;
+        src->start += avail;
+        size       -= avail;
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* source_skip_rest                                                        */
+/* INPUTS: src - the source                                                */
+/* RETURN: TRUE unless reading failed                                      */
+/*                                                                         */
+/* Pass over everything up to the end of input, as for a packet of         */
+/* indeterminate length. A regular file seeks to its current size.         */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t source_skip_rest (struct source *src)
+{
+struct stat st;
+
+    if (src->seekable)
+    {
+        if (fstat (src->fd, &st)) return FALSE;
+        if (st.st_size > source_tell (src))
+        {
+            if (!source_seek (src, st.st_size)) return FALSE;
+        }
+        src->start = src->end;
+        src->eof   = TRUE;
+        return TRUE;
+    }
+    src->start = src->end;
+    while (fill (src))
+    {
+        src->start = src->end;
+    }
+    return !src->error;
+}
+
+extern off_t source_tell (const struct source *src)
+{
+    return src->offset + (off_t)src->start;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* source_seek                                                             */
+/* INPUTS: src - the source, which must be a regular file                  */
+/*         position - absolute offset to continue reading from             */
+/* RETURN: TRUE if the source is now positioned there                      */
+/*                                                                         */
+/* Positions inside the buffer are reached without a system call. Either   */
+/* way the end of input indication is cleared, as the file may have grown. */
+/* Reading on from a position outside the buffer starts with a small       */
+/* window (see fill).                                                      */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t source_seek (struct source *src, off_t position)
+{
+    src->eof   = FALSE;
+    src->error = FALSE;
+    if ((position >= src->offset) &&
+            (position <= src->offset + (off_t)src->end))
+    {
+        src->start = (size_t)(position - src->offset);
+        return TRUE;
+    }
+    if (!src->seekable || (lseek (src->fd, position, SEEK_SET) != position))
+    {
+        return FALSE;
+    }
+    src->offset = position;
+    src->start  = src->end = 0u;
+    src->window = SOURCE_WINDOW;
+    return TRUE;
+}
+
+extern void source_close (struct source *src)
+{
+    if (src == NULL) return;
+    close (src->fd);
+    free (src->buffer);
+    free (src);
+}
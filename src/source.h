@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/***************************************************************************/
+/* Packet input                                                            */
+/*                                                                         */
+/* A file, pipe or terminal read through one large page aligned buffer.    */
+/* Nothing here needs to seek: skipping on a pipe reads and discards.      */
+/* Only random access (source_seek) needs a regular file.                  */
+/***************************************************************************/
+
+#define SOURCE_BUFFER   ((size_t)1u << 20)
+#define SOURCE_WINDOW   ((size_t)1u << 12)
+
+struct source
+{
+    int             fd;
+    uint8_t         seekable;
+    uint8_t         eof;
+    uint8_t         error;
+    uint8_t        *buffer;
+    size_t          start;
+    size_t          end;
+    size_t          window;
+    off_t           offset;
+};
+
+extern struct source *source_open (const char *name);
+extern struct source *source_fdopen (int fd);
+extern size_t  source_read (struct source *src, void *dst, size_t size);
+extern const uint8_t *source_peek (struct source *src, size_t size, size_t *pAvail);
+extern uint8_t source_skip (struct source *src, uint64_t size);
+extern uint8_t source_skip_rest (struct source *src);
+extern off_t   source_tell (const struct source *src);
+extern uint8_t source_seek (struct source *src, off_t position);
+extern void    source_close (struct source *src);
+
+#endif
@@ -0,0 +1,1014 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+#include "resync.h"
+#include "store.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/***************************************************************************/
+/*                                                                         */
+/* Snapshot file, all integers little endian:                              */
+/*                                                                         */
+/*   header     "PGPSTOR" 0x00, u32 version (1), u32 columns, u64 size of  */
+/*              the keyring, u32 length of its path, u32 zero              */
+/*   directory  per column u32 table, u32 column, u32 width, u32 zero,     */
+/*              u64 rows, u64 offset                                       */
+/*   path       the keyring's path as given when the store was built       */
+/*   columns    each at its offset, a multiple of 64, rows * width octets  */
+/*                                                                         */
+/* The columns are those of struct store in the order of store_layout, so  */
+/* column n of the directory is layout entry n. Loading maps the file and  */
+/* points each column of the store at its data, which is only possible on */
+/* a little endian machine.                                                */
+/*                                                                         */
+/***************************************************************************/
+
+#define STORE_MAGIC     "PGPSTOR"
+#define STORE_VERSION   (1u)
+#define STORE_HEAD      (32u)
+#define STORE_ENTRY     (32u)
+#define STORE_ALIGN     (64u)
+#define STORE_BATCH     (4096u)
+
+/* What store_row returns when memory runs out; a StoreText offset is 64  */
+/* bits wide and may well be STORE_NONE                                    */
+
+#define STORE_NO_ROW    (UINT64_MAX)
+
+struct store_layout
+{
+    uint8_t         table;
+    uint8_t         width;
+    size_t          field;
+};
+
+#define COLUMN(table, field) \
+    { table, sizeof(*((struct store *)0)->field), offsetof (struct store, field) }
+
+static const struct store_layout store_layout[] =
+{
+    COLUMN (StoreKeys, key_id),
+    COLUMN (StoreKeys, key_offset),
+    COLUMN (StoreKeys, key_created),
+    COLUMN (StoreKeys, key_version),
+    COLUMN (StoreKeys, key_algorithm),
+    COLUMN (StoreKeys, key_bits),
+    COLUMN (StoreKeys, key_secret),
+    COLUMN (StoreKeys, key_first_subkey),
+    COLUMN (StoreKeys, key_first_uid),
+    COLUMN (StoreKeys, key_first_sig),
+    COLUMN (StoreSubkeys, sub_id),
+    COLUMN (StoreSubkeys, sub_offset),
+    COLUMN (StoreSubkeys, sub_created),
+    COLUMN (StoreSubkeys, sub_version),
+    COLUMN (StoreSubkeys, sub_algorithm),
+    COLUMN (StoreSubkeys, sub_bits),
+    COLUMN (StoreSubkeys, sub_key),
+    COLUMN (StoreUserIDs, uid_offset),
+    COLUMN (StoreUserIDs, uid_text),
+    COLUMN (StoreUserIDs, uid_key),
+    COLUMN (StoreSignatures, sig_issuer),
+    COLUMN (StoreSignatures, sig_offset),
+    COLUMN (StoreSignatures, sig_created),
+    COLUMN (StoreSignatures, sig_expires),
+    COLUMN (StoreSignatures, sig_key_expires),
+    COLUMN (StoreSignatures, sig_type),
+    COLUMN (StoreSignatures, sig_version),
+    COLUMN (StoreSignatures, sig_algorithm),
+    COLUMN (StoreSignatures, sig_hash),
+    COLUMN (StoreSignatures, sig_over),
+    COLUMN (StoreSignatures, sig_target),
+    COLUMN (StoreSignatures, sig_keyserver),
+    COLUMN (StoreSignatures, sig_policy),
+    COLUMN (StoreStrings, string_end),
+    COLUMN (StoreText, string_text)
+};
+
+#define STORE_COLUMNS   (sizeof(store_layout) / sizeof(store_layout[0]))
+
+/* Open addressed hash of the strings stored so far */
+
+struct intern_slot
+{
+    uint32_t        id;
+    uint32_t        hash;
+};
+
+struct store_ctx
+{
+    struct store   *store;
+    uint32_t        current;
+    uint8_t         over;
+    uint32_t        target;
+    struct intern_slot *slot;
+    uint32_t        slots;
+    uint8_t         failed;
+};
+
+static void **column_of (struct store *store, uint32_t n)
+{
+    return (void **)((uint8_t *)store + store_layout[n].field);
+}
+
+static void le (uint8_t *p, uint64_t value, uint32_t len)
+{
+uint32_t i;
+
+    for (i = 0u; i < len; i++)
+    {
+        p[i] = (uint8_t)(value >> (8u * i));
+    }
+}
+
+static uint64_t get_le (const uint8_t *p, uint32_t len)
+{
+uint64_t value = 0u;
+
+    while (len--)
+    {
+        value = (value << 8) | p[len];
+    }
+    return value;
+}
+
+static uint64_t get_be64 (const uint8_t *p)
+{
+uint64_t val = 0u;
+uint8_t  i;
+
+    for (i = 0u; i < 8u; i++)
+    {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* store_row                                                               */
+/* INPUTS: store - a store being built                                     */
+/*         table - the table to add to                                     */
+/*         count - how many rows                                           */
+/* RETURN: the first row added, or STORE_NO_ROW if memory ran out          */
+/*                                                                         */
+/* Every column of the table is grown together, doubling each time.        */
+/*                                                                         */
+/***************************************************************************/
+
+static uint64_t store_row (struct store *store, enum store_table table, uint64_t count)
+{
+uint64_t capacity;
+uint64_t row;
+uint32_t n;
+void    *grown;
+
+    if (store->rows[table] + count > store->capacity[table])
+    {
+        capacity = store->capacity[table] ? store->capacity[table] : STORE_BATCH;
+        while (capacity < store->rows[table] + count) capacity *= 2u;
+        for (n = 0u; n < STORE_COLUMNS; n++)
+        {
+            if (store_layout[n].table != table) continue;
+            grown = realloc (*column_of (store, n), (size_t)capacity * store_layout[n].width);
+            if (grown == NULL) return STORE_NO_ROW;
+            *column_of (store, n) = grown;
+        }
+        store->capacity[table] = capacity;
+    }
+    row = store->rows[table];
+    store->rows[table] += count;
+    return row;
+}
+
+static uint64_t string_start (const struct store *store, uint32_t id)
+{
+    return id ? store->string_end[id - 1u] : 0u;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* intern                                                                  */
+/* INPUTS: ctx - the store being built                                     */
+/*         text - a user ID, URL or other string                           */
+/*         len - its length                                                */
+/* RETURN: its string number, the same for the same text, or STORE_NONE    */
+/*         if memory ran out                                               */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t intern (struct store_ctx *ctx, const uint8_t *text, uint32_t len)
+{
+struct store   *store = ctx->store;
+struct intern_slot *slot;
+uint64_t start;
+uint64_t row;
+uint32_t hash = 2166136261u;
+uint32_t slots;
+uint32_t i;
+uint32_t j;
+
+    if ((store->rows[StoreStrings] + 1u) * 2u > ctx->slots)
+    {
+        slots = ctx->slots ? ctx->slots * 2u : 65536u;
+        slot  = malloc (slots * sizeof(*slot));
+        if (slot == NULL) return STORE_NONE;
+        for (i = 0u; i < slots; i++)
+        {
+            slot[i].id = STORE_NONE;
+        }
+        for (i = 0u; i < ctx->slots; i++)
+        {
+            if (ctx->slot[i].id == STORE_NONE) continue;
+            for (j = ctx->slot[i].hash & (slots - 1u); slot[j].id != STORE_NONE;
+                     j = (j + 1u) & (slots - 1u));
+            slot[j] = ctx->slot[i];
+        }
+        free (ctx->slot);
+        ctx->slot  = slot;
+        ctx->slots = slots;
+    }
+    for (i = 0u; i < len; i++)
+    {
+        hash = (hash ^ text[i]) * 16777619u;
+    }
+    for (j = hash & (ctx->slots - 1u); ctx->slot[j].id != STORE_NONE;
+             j = (j + 1u) & (ctx->slots - 1u))
+    {
+        if (ctx->slot[j].hash != hash) continue;
+        start = string_start (store, ctx->slot[j].id);
+        if ((store->string_end[ctx->slot[j].id] - start == len) &&
+                !memcmp (store->string_text + start, text, len))
+        {
+            return ctx->slot[j].id;
+        }
+    }
+
+    start = store_row (store, StoreText, len);
+    row   = store_row (store, StoreStrings, 1u);
+    if ((start == STORE_NO_ROW) || (row == STORE_NO_ROW)) return STORE_NONE;
+    memcpy (store->string_text + start, text, len);
+    store->string_end[row] = start + len;
+    ctx->slot[j].id   = (uint32_t)row;
+    ctx->slot[j].hash = hash;
+    return (uint32_t)row;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* store_sig                                                               */
+/* INPUTS: ctx - the store being built                                     */
+/*         pkt - a signature packet                                        */
+/* RETURN: FALSE if memory ran out                                         */
+/*                                                                         */
+/* A signature that does not decode is left out.                           */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t store_sig (struct store_ctx *ctx, const struct keyring_packet *pkt)
+{
+struct store        *store = ctx->store;
+struct pgp_sig       sig;
+struct pgp_subpacket sub;
+uint32_t offset = 0ul;
+uint64_t row;
+
+    if (!decode_signature (pkt->body, pkt->len, &sig)) return TRUE;
+    row = store_row (store, StoreSignatures, 1u);
+    if (row == STORE_NO_ROW) return FALSE;
+    store->sig_issuer[row]      = sig.has_issuer ? get_be64 (sig.issuer) : 0u;
+    store->sig_offset[row]      = (uint64_t)pkt->offset;
+    store->sig_created[row]     = sig.created;
+    store->sig_expires[row]     = sig.expires;
+    store->sig_key_expires[row] = sig.key_expires;
+    store->sig_type[row]        = sig.type;
+    store->sig_version[row]     = sig.version;
+    store->sig_algorithm[row]   = sig.pk_alg;
+    store->sig_hash[row]        = sig.hash_alg;
+    store->sig_over[row]        = ctx->over;
+    store->sig_target[row]      = ctx->target;
+    store->sig_keyserver[row]   = STORE_NONE;
+    store->sig_policy[row]      = STORE_NONE;
+    while (next_subpacket (sig.hashed, sig.hashed_len, &offset, &sub))
+    {
+        if (sub.type == SubPktPrefKeyServer)
+        {
+            store->sig_keyserver[row] = intern (ctx, sub.data, sub.len);
+            if (store->sig_keyserver[row] == STORE_NONE) return FALSE;
+        }
+        else if (sub.type == SubPktPolicyURI)
+        {
+            store->sig_policy[row] = intern (ctx, sub.data, sub.len);
+            if (store->sig_policy[row] == STORE_NONE) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* store_collect                                                           */
+/* INPUTS: ctx - the store being built                                     */
+/*         block - the key block being walked                              */
+/*         pkt - one of its packets                                        */
+/* RETURN: FALSE if memory ran out                                         */
+/*                                                                         */
+/* Key blocks whose primary key cannot be read are left out whole.         */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t store_collect (void *ctx_in, const struct keyring_block *block,
+                              const struct keyring_packet *pkt)
+{
+struct store_ctx *ctx = ctx_in;
+struct store     *store = ctx->store;
+struct pgp_key    key;
+uint8_t  fpr[PKT_MAX_FPR];
+uint8_t  keyid[PKT_KEYID_LEN];
+uint8_t  fpr_len;
+uint64_t row;
+
+    memset (&key, 0, sizeof(key));
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            ctx->current = STORE_NONE;
+            if (!block->valid) break;
+            decode_public_key (pkt->body, pkt->len, &key);
+            row = store_row (store, StoreKeys, 1u);
+            if (row == STORE_NO_ROW) goto fail;
+            store->key_id[row]           = get_be64 (block->keyid);
+            store->key_offset[row]       = (uint64_t)pkt->offset;
+            store->key_created[row]      = key.created;
+            store->key_version[row]      = key.version;
+            store->key_algorithm[row]    = key.algorithm;
+            store->key_bits[row]         = key.bits;
+            store->key_secret[row]       = (pkt->tag == PktSecretKey);
+            store->key_first_subkey[row] = (uint32_t)store->rows[StoreSubkeys];
+            store->key_first_uid[row]    = (uint32_t)store->rows[StoreUserIDs];
+            store->key_first_sig[row]    = (uint32_t)store->rows[StoreSignatures];
+            ctx->current = (uint32_t)row;
+            ctx->over    = OverKey;
+            ctx->target  = (uint32_t)row;
+            break;
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            if (ctx->current == STORE_NONE) break;
+            if (!key_fingerprint (pkt->body, pkt->len, fpr, &fpr_len, keyid)) break;
+            decode_public_key (pkt->body, pkt->len, &key);
+            row = store_row (store, StoreSubkeys, 1u);
+            if (row == STORE_NO_ROW) goto fail;
+            store->sub_id[row]        = get_be64 (keyid);
+            store->sub_offset[row]    = (uint64_t)pkt->offset;
+            store->sub_created[row]   = key.created;
+            store->sub_version[row]   = key.version;
+            store->sub_algorithm[row] = key.algorithm;
+            store->sub_bits[row]      = key.bits;
+            store->sub_key[row]       = ctx->current;
+            ctx->over   = OverSubkey;
+            ctx->target = (uint32_t)row;
+            break;
+        case PktUserID:
+        case PktUserAttribute:
+            if (ctx->current == STORE_NONE) break;
+            row = store_row (store, StoreUserIDs, 1u);
+            if (row == STORE_NO_ROW) goto fail;
+            store->uid_offset[row] = (uint64_t)pkt->offset;
+            store->uid_key[row]    = ctx->current;
+            store->uid_text[row]   = STORE_NONE;
+            if (pkt->tag == PktUserID)
+            {
+                store->uid_text[row] = intern (ctx, pkt->body, pkt->len);
+                if (store->uid_text[row] == STORE_NONE) goto fail;
+            }
+            ctx->over   = OverUserID;
+            ctx->target = (uint32_t)row;
+            break;
+        case PktSignature:
+            if (ctx->current == STORE_NONE) break;
+            if (!store_sig (ctx, pkt)) goto fail;
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+
+fail:
+    ctx->failed = TRUE;
+    return FALSE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* store_build                                                             */
+/* INPUTS: name - the keyring                                              */
+/* RETURN: a store of its key blocks, or NULL                              */
+/*                                                                         */
+/* The keyring must be a file, which is kept by its absolute path so that  */
+/* its packets can be found again from anywhere.                           */
+/*                                                                         */
+/***************************************************************************/
+
+extern struct store *store_build (const char *name)
+{
+struct store_ctx ctx;
+struct source   *src;
+struct stat      st;
+uint8_t ok;
+
+    if (!strcmp (name, "-") || stat (name, &st) || !S_ISREG (st.st_mode))
+    {
+        fprintf (stderr, "%s: not a regular file, which the store reads packets back "
+                 "from\n", name);
+        return NULL;
+    }
+    memset (&ctx, 0, sizeof(ctx));
+    ctx.current = STORE_NONE;
+    ctx.store   = calloc (1u, sizeof(*ctx.store));
+    src         = source_open (name);
+    if ((ctx.store == NULL) || (src == NULL))
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        if (src != NULL) source_close (src);
+        free (ctx.store);
+        return NULL;
+    }
+    ok = keyring_walk (src, KEYRING_SKIP_ATTRIBUTES, store_collect, &ctx) && !ctx.failed;
+    source_close (src);
+    free (ctx.slot);
+    if (!ok)
+    {
+        fprintf (stderr, "%s: %s\n", name, ctx.failed ? "out of memory" : "damaged packet");
+        store_free (ctx.store);
+        return NULL;
+    }
+    ctx.store->keyring      = realpath (name, NULL);
+    ctx.store->keyring_size = stat (name, &st) ? 0u : (uint64_t)st.st_size;
+    if (ctx.store->keyring == NULL)
+    {
+        fprintf (stderr, "%s: cannot find its absolute path\n", name);
+        store_free (ctx.store);
+        return NULL;
+    }
+    return ctx.store;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* store_save                                                              */
+/* INPUTS: store - the store                                               */
+/*         out_name - the snapshot to write                                */
+/* RETURN: TRUE if written                                                 */
+/*                                                                         */
+/***************************************************************************/
+
+extern uint8_t store_save (const struct store *store, const char *out_name)
+{
+static const uint8_t zero[STORE_ALIGN];
+uint8_t  head[STORE_HEAD];
+uint8_t  entry[STORE_ENTRY];
+uint64_t offset;
+uint64_t len;
+uint32_t path_len;
+uint32_t n;
+uint8_t  ok = TRUE;
+FILE    *out;
+
+    out = fopen (out_name, "wb");
+    if (out == NULL)
+    {
+        fprintf (stderr, "%s: cannot create\n", out_name);
+        return FALSE;
+    }
+    path_len = (uint32_t)strlen (store->keyring);
+    memset (head, 0, sizeof(head));
+    memcpy (head, STORE_MAGIC, 8u);
+    le (head + 8, STORE_VERSION, 4u);
+    le (head + 12, STORE_COLUMNS, 4u);
+    le (head + 16, store->keyring_size, 8u);
+    le (head + 24, path_len, 4u);
+    ok = (fwrite (head, 1u, sizeof(head), out) == sizeof(head));
+
+    offset = STORE_HEAD + STORE_COLUMNS * STORE_ENTRY + path_len;
+    for (n = 0u; ok && (n < STORE_COLUMNS); n++)
+    {
+        offset = (offset + STORE_ALIGN - 1u) & ~(uint64_t)(STORE_ALIGN - 1u);
+        memset (entry, 0, sizeof(entry));
+        le (entry, store_layout[n].table, 4u);
+        le (entry + 4, n, 4u);
+        le (entry + 8, store_layout[n].width, 4u);
+        le (entry + 16, store->rows[store_layout[n].table], 8u);
+        le (entry + 24, offset, 8u);
+        ok = (fwrite (entry, 1u, sizeof(entry), out) == sizeof(entry));
+        offset += store->rows[store_layout[n].table] * store_layout[n].width;
+    }
+    if (ok) ok = (fwrite (store->keyring, 1u, path_len, out) == path_len);
+
+    offset = STORE_HEAD + STORE_COLUMNS * STORE_ENTRY + path_len;
+    for (n = 0u; ok && (n < STORE_COLUMNS); n++)
+    {
+        len = (STORE_ALIGN - (offset & (STORE_ALIGN - 1u))) & (STORE_ALIGN - 1u);
+        ok  = (fwrite (zero, 1u, (size_t)len, out) == len);
+        offset += len;
+        len = store->rows[store_layout[n].table] * store_layout[n].width;
+        if (ok && len)
+        {
+            ok = (fwrite (*column_of ((struct store *)store, n), 1u, (size_t)len, out) == len);
+        }
+        offset += len;
+    }
+    if (fclose (out) || !ok)
+    {
+        fprintf (stderr, "%s: write failed\n", out_name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* store_load                                                              */
+/* INPUTS: name - a snapshot from store_save                               */
+/* RETURN: the store, with every column pointing into the mapped file, or  */
+/*         NULL                                                            */
+/*                                                                         */
+/* The keyring is mapped too if it is still where it was and the same      */
+/* size, so that packets can be read back; otherwise that is warned of and */
+/* store_packet gives NULL.                                                */
+/*                                                                         */
+/***************************************************************************/
+
+extern struct store *store_load (const char *name)
+{
+const uint16_t probe = 1u;
+struct store *store;
+struct stat   st;
+const uint8_t *map;
+const uint8_t *entry;
+uint64_t rows;
+uint64_t offset;
+uint32_t path_len;
+uint32_t n;
+uint8_t  seen[StoreTables];
+void    *keyring;
+int      fd;
+
+    if (*(const uint8_t *)&probe != 1u)
+    {
+        fprintf (stderr, "%s: snapshots can only be loaded on little endian machines\n",
+                 name);
+        return NULL;
+    }
+    store = calloc (1u, sizeof(*store));
+    if (store == NULL) return NULL;
+    fd = open (name, O_RDONLY | O_CLOEXEC);
+    if ((fd < 0) || fstat (fd, &st))
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        goto fail;
+    }
+    if (st.st_size < STORE_HEAD)
+    {
+        fprintf (stderr, "%s: not a keyring store snapshot\n", name);
+        goto fail;
+    }
+    store->map_size = (size_t)st.st_size;
+    store->map      = mmap (NULL, store->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    fd = -1;
+    if (store->map == MAP_FAILED)
+    {
+        store->map = NULL;
+        fprintf (stderr, "%s: cannot be mapped\n", name);
+        goto fail;
+    }
+    map      = store->map;
+    path_len = (uint32_t)get_le (map + 24, 4u);
+    if (memcmp (map, STORE_MAGIC, 8u) || (get_le (map + 8, 4u) != STORE_VERSION) ||
+            (get_le (map + 12, 4u) != STORE_COLUMNS) ||
+            (STORE_HEAD + STORE_COLUMNS * STORE_ENTRY + (uint64_t)path_len >
+             store->map_size))
+    {
+        fprintf (stderr, "%s: not a keyring store snapshot\n", name);
+        goto fail;
+    }
+
+    memset (seen, 0, sizeof(seen));
+    for (n = 0u; n < STORE_COLUMNS; n++)
+    {
+        entry  = map + STORE_HEAD + n * STORE_ENTRY;
+        rows   = get_le (entry + 16, 8u);
+        offset = get_le (entry + 24, 8u);
+        if ((get_le (entry, 4u) != store_layout[n].table) || (get_le (entry + 4, 4u) != n) ||
+                (get_le (entry + 8, 4u) != store_layout[n].width) ||
+                (offset & (STORE_ALIGN - 1u)) || (offset > store->map_size) ||
+                (rows > (store->map_size - offset) / store_layout[n].width) ||
+                (seen[store_layout[n].table] &&
+                 (rows != store->rows[store_layout[n].table])))
+        {
+            fprintf (stderr, "%s: damaged snapshot\n", name);
+            goto fail;
+        }
+        seen[store_layout[n].table]       = TRUE;
+        store->rows[store_layout[n].table] = rows;
+        *column_of (store, n) = (void *)(map + offset);
+    }
+
+    store->keyring = strndup ((const char *)map + STORE_HEAD + STORE_COLUMNS * STORE_ENTRY,
+                              path_len);
+    if (store->keyring == NULL) goto fail;
+    store->keyring_size = get_le (map + 16, 8u);
+    fd = open (store->keyring, O_RDONLY | O_CLOEXEC);
+    if ((fd < 0) || fstat (fd, &st))
+    {
+        fprintf (stderr, "%s: keyring %s cannot be opened, its packets are unavailable\n",
+                 name, store->keyring);
+    }
+    else if ((uint64_t)st.st_size != store->keyring_size)
+    {
+        fprintf (stderr, "%s: keyring %s has changed size since the snapshot, its packets "
+                 "are unavailable\n", name, store->keyring);
+    }
+    else if (store->keyring_size)
+    {
+        keyring = mmap (NULL, (size_t)store->keyring_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (keyring != MAP_FAILED)
+        {
+            store->keyring_map = keyring;
+        }
+        else
+        {
+            fprintf (stderr, "%s: keyring %s cannot be mapped, its packets are "
+                     "unavailable\n", name, store->keyring);
+        }
+    }
+    if (fd >= 0) close (fd);
+    return store;
+
+fail:
+    if (fd >= 0) close (fd);
+    store_free (store);
+    return NULL;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* store_packet                                                            */
+/* INPUTS: store - a loaded store                                           */
+/*         offset - a packet offset from one of its columns                */
+/* RETURN: the packet's body in the mapped keyring, or NULL if the keyring */
+/*         is not mapped or the body is sent in partial chunks            */
+/* OUTPUT: pLen - its length                                               */
+/*                                                                         */
+/***************************************************************************/
+
+extern const uint8_t *store_packet (const struct store *store, uint64_t offset,
+                                    uint32_t *pLen)
+{
+struct resync_head head;
+size_t avail;
+
+    if ((store->keyring_map == NULL) || (offset >= store->keyring_size)) return NULL;
+    avail = (size_t)(store->keyring_size - offset);
+    if ((resync_parse (store->keyring_map + offset, avail, FALSE, &head) != HeadGood) ||
+            head.partial || (head.len > avail - head.head))
+    {
+        return NULL;
+    }
+    *pLen = head.len;
+    return store->keyring_map + offset + head.head;
+}
+
+extern const uint8_t *store_string (const struct store *store, uint32_t id, uint32_t *pLen)
+{
+uint64_t start;
+
+    if (id >= store->rows[StoreStrings]) return NULL;
+    start = string_start (store, id);
+    if ((store->string_end[id] < start) ||
+            (store->string_end[id] > store->rows[StoreText]))
+    {
+        return NULL;
+    }
+    *pLen = (uint32_t)(store->string_end[id] - start);
+    return store->string_text + start;
+}
+
+/* Octets held in the columns */
+
+extern uint64_t store_memory (const struct store *store)
+{
+uint64_t total = 0u;
+uint32_t n;
+
+    for (n = 0u; n < STORE_COLUMNS; n++)
+    {
+        total += store->rows[store_layout[n].table] * store_layout[n].width;
+    }
+    return total;
+}
+
+extern void store_free (struct store *store)
+{
+uint32_t n;
+
+    if (store == NULL) return;
+    if (store->map != NULL)
+    {
+        munmap (store->map, store->map_size);
+    }
+    else
+    {
+        for (n = 0u; n < STORE_COLUMNS; n++)
+        {
+            free (*column_of (store, n));
+        }
+    }
+    if (store->keyring_map != NULL)
+    {
+        munmap ((void *)store->keyring_map, (size_t)store->keyring_size);
+    }
+    free (store->keyring);
+    free (store);
+}
+
+static double seconds_since (const struct timespec *start)
+{
+struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) +
+           (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void show_counts (const struct store *store)
+{
+    printf ("%llu keys, %llu subkeys, %llu user IDs, %llu signatures, "
+            "%llu distinct strings in %llu octets\n",
+            (unsigned long long)store->rows[StoreKeys],
+            (unsigned long long)store->rows[StoreSubkeys],
+            (unsigned long long)store->rows[StoreUserIDs],
+            (unsigned long long)store->rows[StoreSignatures],
+            (unsigned long long)store->rows[StoreStrings],
+            (unsigned long long)store->rows[StoreText]);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* store_write                                                             */
+/* INPUTS: name - the keyring                                              */
+/*         out_name - the snapshot to write                                */
+/* RETURN: exit status, 0 if written                                       */
+/*                                                                         */
+/***************************************************************************/
+
+extern int store_write (const char *name, const char *out_name)
+{
+struct timespec start;
+struct store   *store;
+uint64_t memory;
+double   took;
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    store = store_build (name);
+    if (store == NULL) return (2u);
+    took = seconds_since (&start);
+    if (!store_save (store, out_name))
+    {
+        store_free (store);
+        return (2u);
+    }
+    memory = store_memory (store);
+    show_counts (store);
+    printf ("%llu octets in columns", (unsigned long long)memory);
+    if (store->keyring_size)
+    {
+        printf (", %.1f%% of the keyring's %llu",
+                100.0 * (double)memory / (double)store->keyring_size,
+                (unsigned long long)store->keyring_size);
+    }
+    printf ("; read in %.2fs\n", took);
+    store_free (store);
+    return (0u);
+}
+
+static void show_date (const char *label, uint32_t when)
+{
+struct tm tm;
+time_t    t = when;
+char      date[16];
+
+    gmtime_r (&t, &tm);
+    strftime (date, sizeof(date), "%Y-%m-%d", &tm);
+    printf (" %s %s", label, date);
+}
+
+static void show_string (const struct store *store, const char *label, uint32_t id)
+{
+const uint8_t *text;
+uint32_t len;
+uint32_t i;
+
+    text = store_string (store, id, &len);
+    if (text == NULL) return;
+    printf ("  %s ", label);
+    for (i = 0u; i < len; i++)
+    {
+        putchar (((text[i] < 0x20u) || (text[i] == 0x7fu)) ? '.' : text[i]);
+    }
+    putchar ('\n');
+}
+
+/* First row of the next key's span in a table, bounded by the table */
+
+static uint32_t span_end (const struct store *store, const uint32_t *first, uint32_t key,
+                          enum store_table table)
+{
+uint64_t end;
+
+    end = (key + 1u < store->rows[StoreKeys]) ? first[key + 1u] : store->rows[table];
+    return (uint32_t)((end > store->rows[table]) ? store->rows[table] : end);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* show_key                                                                */
+/* INPUTS: store - a loaded store                                          */
+/*         key - a primary key's row                                       */
+/*                                                                         */
+/* The fingerprint is worked out afresh from the key packet, if the        */
+/* keyring could be mapped; everything else comes from the columns. Each   */
+/* keyserver and policy is listed once however many signatures name it.   */
+/*                                                                         */
+/***************************************************************************/
+
+static void show_key (const struct store *store, uint32_t key)
+{
+const uint8_t *body;
+uint8_t  fpr[PKT_MAX_FPR];
+uint8_t  keyid[PKT_KEYID_LEN];
+uint8_t  fpr_len;
+uint32_t len;
+uint32_t end;
+uint32_t sig_end;
+uint32_t third = 0u;
+uint32_t i;
+uint32_t j;
+
+    printf ("%s %016llX v%u algorithm %u", store->key_secret[key] ? "sec" : "pub",
+            (unsigned long long)store->key_id[key], store->key_version[key],
+            store->key_algorithm[key]);
+    if (store->key_bits[key]) printf (" %u bits", store->key_bits[key]);
+    show_date ("created", store->key_created[key]);
+    printf (" at %llu\n", (unsigned long long)store->key_offset[key]);
+
+    body = store_packet (store, store->key_offset[key], &len);
+    if ((body != NULL) && key_fingerprint (body, len, fpr, &fpr_len, keyid))
+    {
+        printf ("  fingerprint ");
+        for (i = 0u; i < fpr_len; i++)
+        {
+            printf ("%02X", fpr[i]);
+        }
+        putchar ('\n');
+    }
+
+    end = span_end (store, store->key_first_uid, key, StoreUserIDs);
+    for (i = store->key_first_uid[key]; i < end; i++)
+    {
+        if (store->uid_text[i] == STORE_NONE)
+        {
+            printf ("  attribute\n");
+        }
+        else
+        {
+            show_string (store, "uid", store->uid_text[i]);
+        }
+    }
+    end = span_end (store, store->key_first_subkey, key, StoreSubkeys);
+    for (i = store->key_first_subkey[key]; i < end; i++)
+    {
+        printf ("  sub %016llX v%u algorithm %u", (unsigned long long)store->sub_id[i],
+                store->sub_version[i], store->sub_algorithm[i]);
+        if (store->sub_bits[i]) printf (" %u bits", store->sub_bits[i]);
+        show_date ("created", store->sub_created[i]);
+        putchar ('\n');
+    }
+
+    sig_end = span_end (store, store->key_first_sig, key, StoreSignatures);
+    for (i = store->key_first_sig[key]; i < sig_end; i++)
+    {
+        if (store->sig_issuer[i] != store->key_id[key]) third++;
+    }
+    printf ("  %u signatures, %u by other keys\n",
+            (sig_end > store->key_first_sig[key]) ? sig_end - store->key_first_sig[key] : 0u,
+            third);
+    for (i = store->key_first_sig[key]; i < sig_end; i++)
+    {
+        for (j = store->key_first_sig[key]; (j < i) &&
+                 (store->sig_keyserver[j] != store->sig_keyserver[i]); j++);
+        if (j == i) show_string (store, "keyserver", store->sig_keyserver[i]);
+    }
+    for (i = store->key_first_sig[key]; i < sig_end; i++)
+    {
+        for (j = store->key_first_sig[key]; (j < i) &&
+                 (store->sig_policy[j] != store->sig_policy[i]); j++);
+        if (j == i) show_string (store, "policy", store->sig_policy[i]);
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* store_show                                                              */
+/* INPUTS: snapshot - a snapshot from --store                              */
+/*         keys - key IDs or fingerprints to show                          */
+/*         key_count - how many                                            */
+/* RETURN: exit status: 0, 1 if a key was not in the store, 2 on error     */
+/*                                                                         */
+/* A key is found by a pass down the key ID column, or failing that the    */
+/* subkey ID column, which shows its primary key.                          */
+/*                                                                         */
+/***************************************************************************/
+
+extern int store_show (const char *snapshot, char **keys, uint32_t key_count)
+{
+struct timespec start;
+struct store   *store;
+uint8_t  id[PKT_MAX_FPR];
+uint8_t  id_len;
+uint64_t want;
+uint64_t row;
+uint32_t i;
+int      status = 0;
+double   took;
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    store = store_load (snapshot);
+    if (store == NULL) return (2u);
+    took = seconds_since (&start);
+    show_counts (store);
+    printf ("%llu octets in columns, loaded in %.3fs\n",
+            (unsigned long long)store_memory (store), took);
+
+    for (i = 0u; i < key_count; i++)
+    {
+        if (!parse_key_id (keys[i], id, &id_len))
+        {
+            fprintf (stderr, "%s: not a key ID or fingerprint\n", keys[i]);
+            store_free (store);
+            return (2u);
+        }
+        /* v4 key IDs are the tail of the fingerprint, v6 the head */
+        want = get_be64 ((id_len == 20u) ? id + 12 : id);
+        for (row = 0u; (row < store->rows[StoreKeys]) && (store->key_id[row] != want); row++);
+        if (row == store->rows[StoreKeys])
+        {
+            for (row = 0u; (row < store->rows[StoreSubkeys]) &&
+                     (store->sub_id[row] != want); row++);
+            row = (row < store->rows[StoreSubkeys]) ? store->sub_key[row] : STORE_NONE;
+        }
+        if ((row == STORE_NONE) || (row >= store->rows[StoreKeys]))
+        {
+            printf ("%s: not in the store\n", keys[i]);
+            status = 1;
+            continue;
+        }
+        show_key (store, (uint32_t)row);
+    }
+    store_free (store);
+    return status;
+}
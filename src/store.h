@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/***************************************************************************/
+/* Keyring store                                                           */
+/*                                                                         */
+/* A keyring held in memory as columns, one array per field, with rows     */
+/* numbered from 0 in each table and rows of other tables referred to by   */
+/* number. Subkeys, user IDs and signatures come in file order, so those   */
+/* of key k run from its first_ column up to that of key k + 1. Texts (user */
+/* IDs, preferred keyservers, policy URIs) are stored once each, as a      */
+/* string number; key and signature material stays in the keyring, found  */
+/* from the offset of its packet. A store is saved as a snapshot which     */
+/* maps straight back into memory.                                         */
+/***************************************************************************/
+
+#define STORE_NONE      (UINT32_MAX)
+
+enum store_table
+{
+    StoreKeys,
+    StoreSubkeys,
+    StoreUserIDs,
+    StoreSignatures,
+    StoreStrings,
+    StoreText,
+    StoreTables
+};
+
+/* What a signature is over */
+
+enum store_over
+{
+    OverKey,
+    OverUserID,
+    OverSubkey
+};
+
+struct store
+{
+    uint64_t        rows[StoreTables];
+
+    /* keys: primary keys */
+    uint64_t       *key_id;
+    uint64_t       *key_offset;
+    uint32_t       *key_created;
+    uint8_t        *key_version;
+    uint8_t        *key_algorithm;
+    uint16_t       *key_bits;
+    uint8_t        *key_secret;
+    uint32_t       *key_first_subkey;
+    uint32_t       *key_first_uid;
+    uint32_t       *key_first_sig;
+
+    /* subkeys */
+    uint64_t       *sub_id;
+    uint64_t       *sub_offset;
+    uint32_t       *sub_created;
+    uint8_t        *sub_version;
+    uint8_t        *sub_algorithm;
+    uint16_t       *sub_bits;
+    uint32_t       *sub_key;
+
+    /* user IDs and attributes, which have no text */
+    uint64_t       *uid_offset;
+    uint32_t       *uid_text;
+    uint32_t       *uid_key;
+
+    /* signatures */
+    uint64_t       *sig_issuer;
+    uint64_t       *sig_offset;
+    uint32_t       *sig_created;
+    uint32_t       *sig_expires;
+    uint32_t       *sig_key_expires;
+    uint8_t        *sig_type;
+    uint8_t        *sig_version;
+    uint8_t        *sig_algorithm;
+    uint8_t        *sig_hash;
+    uint8_t        *sig_over;
+    uint32_t       *sig_target;
+    uint32_t       *sig_keyserver;
+    uint32_t       *sig_policy;
+
+    /* strings: end offset of each in text */
+    uint64_t       *string_end;
+    uint8_t        *string_text;
+
+    /* the keyring, mapped for the packets, and the snapshot if loaded */
+    char           *keyring;
+    uint64_t        keyring_size;
+    const uint8_t  *keyring_map;
+    void           *map;
+    size_t          map_size;
+    uint64_t        capacity[StoreTables];
+};
+
+extern struct store  *store_build (const char *name);
+extern uint8_t        store_save (const struct store *store, const char *out_name);
+extern struct store  *store_load (const char *name);
+extern const uint8_t *store_packet (const struct store *store, uint64_t offset,
+                                    uint32_t *pLen);
+extern const uint8_t *store_string (const struct store *store, uint32_t id,
+                                    uint32_t *pLen);
+extern uint64_t       store_memory (const struct store *store);
+extern void           store_free (struct store *store);
+
+extern int store_write (const char *name, const char *out_name);
+extern int store_show (const char *snapshot, char **keys, uint32_t key_count);
+
+#endif
@@ -0,0 +1,950 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "keyring.h"
+#include "resync.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/* Key blocks are handed out in ranges of about this many octets */
+
+#define SUMMARY_RANGE   ((off_t)1 << 23)
+#define SUMMARY_SIZES   (1024u)
+#define SUMMARY_TAGS    (64u)
+#define SUMMARY_VERSIONS (8u)
+
+/* Sampling reads windows of up to 256 KiB, at least this many of them */
+
+#define SAMPLE_WINDOW   ((off_t)1 << 18)
+#define SAMPLE_MINIMUM_WINDOW ((off_t)1 << 14)
+#define SAMPLE_MINIMUM  (64u)
+#define SAMPLE_Z        (1.96)
+
+/***************************************************************************/
+/*                                                                         */
+/* The main thread only frames the packets, reading their headers and      */
+/* stepping over their bodies, and cuts the file into ranges of whole key  */
+/* blocks. Each worker walks the ranges it takes with a source of its own, */
+/* decoding every key and signature into counts of its own, so the         */
+/* threads share nothing but the list of ranges. The counts are added up   */
+/* once every worker has finished. Input that cannot be read twice is      */
+/* walked once on the main thread.                                         */
+/*                                                                         */
+/* A sample instead reads windows at random offsets, one in each of as     */
+/* many equal slices of the file. Each starts at the first primary key     */
+/* after a packet start confirmed by resync_find, and takes whole key      */
+/* blocks until the window is used up. Totals are estimated as the counts  */
+/* per octet of the windows times the size of the file, and the 95%        */
+/* confidence interval from the variance of that ratio between windows.   */
+/*                                                                         */
+/***************************************************************************/
+
+/* Keys counted by kind, algorithm and size, in an open addressed table */
+
+struct summary_size
+{
+    uint32_t        kind;
+    uint64_t        count;
+};
+
+struct summary_counts
+{
+    uint64_t        packets[SUMMARY_TAGS];
+    uint64_t        keys;
+    uint64_t        subkeys;
+    uint64_t        key_versions[SUMMARY_VERSIONS];
+    uint64_t        expired;
+    uint64_t        revoked;
+    uint64_t        subkeys_revoked;
+    uint64_t        sigs;
+    uint64_t        sig_versions[SUMMARY_VERSIONS];
+    uint64_t        hashes[256];
+    uint64_t        skesks;
+    uint64_t        s2k[256];
+    uint64_t        undecoded;
+    struct summary_size size[SUMMARY_SIZES];
+    uint32_t        sizes;
+};
+
+/* The counts above from packets to undecoded, taken as one array */
+
+#define SUMMARY_FLAT    (offsetof (struct summary_counts, size) / sizeof(uint64_t))
+
+/* Sums over the sample windows of each count squared and of each count   */
+/* times the window's length; sizes go by their slot in the running total */
+
+struct summary_moments
+{
+    double          sq[SUMMARY_FLAT];
+    double          cb[SUMMARY_FLAT];
+    double          size_sq[SUMMARY_SIZES];
+    double          size_cb[SUMMARY_SIZES];
+    double          b;
+    double          b2;
+    uint32_t        n;
+};
+
+struct summary_ctx
+{
+    struct summary_counts counts;
+    off_t           end;
+    uint32_t        now;
+    uint8_t         in_block;
+    uint8_t         revoked;
+    uint32_t        created;
+    uint32_t        expires;
+    uint32_t        expiry_from;
+    off_t           stopped;
+    uint8_t         failed;
+};
+
+struct summary_range
+{
+    off_t           start;
+    off_t           end;
+};
+
+struct summary_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    const char     *name;
+    uint32_t        now;
+    struct summary_range *range;
+    size_t          ranges;
+    size_t          range_size;
+    size_t          taken;
+    uint8_t         closing;
+};
+
+struct summary_worker
+{
+    struct summary_pool *pool;
+    struct summary_ctx   ctx;
+    pthread_t            thread;
+    uint8_t              started;
+};
+
+/***************************************************************************/
+/*                                                                         */
+/* count_size                                                              */
+/* INPUTS: counts - the counts to add to                                   */
+/*         kind - primary key flag, algorithm and size packed together     */
+/*         count - how many to add                                         */
+/* RETURN: the slot counted in                                             */
+/*                                                                         */
+/* The table holds far more kinds than real keyrings have; should it ever  */
+/* fill, the rest are counted under a kind of zero.                        */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t count_size (struct summary_counts *counts, uint32_t kind, uint64_t count)
+{
+uint32_t slot;
+uint32_t probe;
+
+    slot = (kind * 2654435761u) & (SUMMARY_SIZES - 1u);
+    for (probe = 0u; probe < SUMMARY_SIZES; probe++)
+    {
+        if (counts->size[slot].kind == kind) break;
+        if (counts->size[slot].count == 0u)
+        {
+            if (counts->sizes + 1u >= SUMMARY_SIZES)
+            {
+                kind = 0u;
+                probe = 0u;
+                slot  = 0u;
+                continue;
+            }
+            counts->size[slot].kind = kind;
+            counts->sizes++;
+            break;
+        }
+        slot = (slot + 1u) & (SUMMARY_SIZES - 1u);
+    }
+    counts->size[slot].count += count;
+    return slot;
+}
+
+static uint32_t size_kind (uint8_t primary, const struct pgp_key *key)
+{
+    return ((uint32_t)(primary ? 2u : 1u) << 24) | ((uint32_t)key->algorithm << 16) |
+           key->bits;
+}
+
+/* Once a block is over, see whether its primary key has expired or been */
+/* revoked                                                                */
+
+static void finish_block (struct summary_ctx *ctx)
+{
+    if (!ctx->in_block) return;
+    if (ctx->revoked)
+    {
+        ctx->counts.revoked++;
+    }
+    else if (ctx->expires && (ctx->expires < ctx->now))
+    {
+        ctx->counts.expired++;
+    }
+    ctx->in_block = FALSE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* count_signature                                                         */
+/* INPUTS: ctx - the worker's counts and current block                     */
+/*         block - the key block being walked                              */
+/*         sig - the decoded signature                                     */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* Only the key's own signatures count towards its expiry and revocation;  */
+/* the latest self signature over the key or a user ID sets the expiry.    */
+/*                                                                         */
+/***************************************************************************/
+
+static void count_signature (struct summary_ctx *ctx, const struct keyring_block *block,
+                             const struct pgp_sig *sig)
+{
+    ctx->counts.sigs++;
+    ctx->counts.sig_versions[sig->version & (SUMMARY_VERSIONS - 1u)]++;
+    ctx->counts.hashes[sig->hash_alg]++;
+    if (!ctx->in_block) return;
+    if (sig->has_issuer && memcmp (sig->issuer, block->keyid, PKT_KEYID_LEN)) return;
+    switch (sig->type)
+    {
+        case SIG_REVOKE_KEY:
+            ctx->revoked = TRUE;
+            break;
+        case SIG_REVOKE_SUBKEY:
+            ctx->counts.subkeys_revoked++;
+            break;
+        case SIG_CERT_GENERIC:
+        case SIG_CERT_PERSONA:
+        case SIG_CERT_CASUAL:
+        case SIG_CERT_POSITIVE:
+        case SIG_DIRECT:
+            if ((block->component != PktPublicKey) &&
+                    (block->component != PktUserID)) break;
+            self_sig_expiry (sig, ctx->created, &ctx->expiry_from, &ctx->expires);
+            break;
+        default:
+            break;
+    }
+}
+
+static uint8_t summary_collect (void *ctx_in, const struct keyring_block *block,
+                                const struct keyring_packet *pkt)
+{
+struct summary_ctx *ctx = ctx_in;
+struct pgp_key   key;
+struct pgp_sig   sig;
+struct pgp_skesk skesk;
+
+    if ((pkt->offset >= ctx->end) &&
+            ((pkt->tag == PktPublicKey) || (pkt->tag == PktSecretKey)))
+    {
+        ctx->stopped = pkt->offset;
+        return FALSE;
+    }
+    ctx->counts.packets[pkt->tag & (SUMMARY_TAGS - 1u)]++;
+    if (pkt->body == NULL) return TRUE;
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            finish_block (ctx);
+            if (!decode_public_key (pkt->body, pkt->len, &key))
+            {
+                ctx->counts.undecoded++;
+                break;
+            }
+            ctx->counts.keys++;
+            ctx->counts.key_versions[key.version & (SUMMARY_VERSIONS - 1u)]++;
+            count_size (&ctx->counts, size_kind (TRUE, &key), 1u);
+            ctx->in_block    = TRUE;
+            ctx->revoked     = FALSE;
+            ctx->created     = key.created;
+            ctx->expiry_from = 0u;
+            ctx->expires     = key_own_expiry (&key);
+            break;
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            if (!decode_public_key (pkt->body, pkt->len, &key))
+            {
+                ctx->counts.undecoded++;
+                break;
+            }
+            ctx->counts.subkeys++;
+            count_size (&ctx->counts, size_kind (FALSE, &key), 1u);
+            break;
+        case PktSignature:
+            if (!decode_signature (pkt->body, pkt->len, &sig))
+            {
+                ctx->counts.undecoded++;
+                break;
+            }
+            count_signature (ctx, block, &sig);
+            break;
+        case PktSKESKP:
+            if (!decode_skesk (pkt->body, pkt->len, &skesk))
+            {
+                ctx->counts.undecoded++;
+                break;
+            }
+            ctx->counts.skesks++;
+            ctx->counts.s2k[skesk.s2k.type]++;
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* summary_walk                                                            */
+/* INPUTS: src - the input, positioned at the start of a key block         */
+/*         ctx - counts to add to, and where to stop                       */
+/* RETURN: none                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+static void summary_walk (struct source *src, struct summary_ctx *ctx)
+{
+    ctx->in_block = FALSE;
+    if (!keyring_walk (src, KEYRING_SKIP_ATTRIBUTES, summary_collect, ctx))
+    {
+        ctx->failed = TRUE;
+    }
+    finish_block (ctx);
+}
+
+static void *summary_worker (void *arg)
+{
+struct summary_worker *worker = arg;
+struct summary_pool   *pool = worker->pool;
+struct summary_range   range;
+struct source         *src;
+
+    src = source_open (pool->name);
+    if (src == NULL)
+    {
+        worker->ctx.failed = TRUE;
+        return NULL;
+    }
+    pthread_mutex_lock (&pool->lock);
+    for (;;)
+    {
+        while ((pool->taken == pool->ranges) && !pool->closing)
+        {
+            pthread_cond_wait (&pool->work, &pool->lock);
+        }
+        if (pool->taken == pool->ranges) break;
+        range = pool->range[pool->taken++];
+        pthread_mutex_unlock (&pool->lock);
+
+        worker->ctx.end = range.end;
+        if (source_seek (src, range.start))
+        {
+            summary_walk (src, &worker->ctx);
+        }
+        else
+        {
+            worker->ctx.failed = TRUE;
+        }
+
+        pthread_mutex_lock (&pool->lock);
+    }
+    pthread_mutex_unlock (&pool->lock);
+    source_close (src);
+    return NULL;
+}
+
+static uint8_t add_range (struct summary_pool *pool, off_t start, off_t end)
+{
+struct summary_range *grown;
+uint8_t ok = TRUE;
+
+    if (end <= start) return TRUE;
+    pthread_mutex_lock (&pool->lock);
+    if (pool->ranges == pool->range_size)
+    {
+        pool->range_size = pool->range_size ? pool->range_size * 2u : 64u;
+        grown = realloc (pool->range, pool->range_size * sizeof(*grown));
+        if (grown == NULL)
+        {
+            ok = FALSE;
+        }
+        else
+        {
+            pool->range = grown;
+        }
+    }
+    if (ok)
+    {
+        pool->range[pool->ranges].start = start;
+        pool->range[pool->ranges].end   = end;
+        pool->ranges++;
+        pthread_cond_signal (&pool->work);
+    }
+    pthread_mutex_unlock (&pool->lock);
+    return ok;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* cut_ranges                                                              */
+/* INPUTS: src - the input                                                 */
+/*         pool - where the ranges go                                      */
+/* RETURN: FALSE if the framing hit a damaged packet or ran out of memory  */
+/*                                                                         */
+/* A range is closed at the first primary key after it has grown big      */
+/* enough. Whatever follows a damaged packet is not handed out.            */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t cut_ranges (struct source *src, struct summary_pool *pool)
+{
+off_t    start = 0;
+off_t    at;
+uint8_t  tag;
+uint8_t  partial;
+uint8_t  transferred;
+uint32_t length;
+
+    for (;;)
+    {
+        at          = source_tell (src);
+        transferred = grab_packet_head (src, &tag, &partial, &length);
+        if (!transferred && src->eof) break;
+        if (src->eof || (tag == PktReserved))
+        {
+            add_range (pool, start, at);
+            return FALSE;
+        }
+        if (((tag == PktPublicKey) || (tag == PktSecretKey)) &&
+                (at - start >= SUMMARY_RANGE))
+        {
+            if (!add_range (pool, start, at)) return FALSE;
+            start = at;
+        }
+        if (!skip_body (src, length, partial))
+        {
+            add_range (pool, start, at);
+            return FALSE;
+        }
+    }
+    return add_range (pool, start, source_tell (src));
+}
+
+/* Add one worker's counts into the total */
+
+static void merge_counts (struct summary_counts *total, const struct summary_counts *part)
+{
+uint32_t i;
+
+    for (i = 0u; i < SUMMARY_TAGS; i++) total->packets[i] += part->packets[i];
+    for (i = 0u; i < SUMMARY_VERSIONS; i++)
+    {
+        total->key_versions[i] += part->key_versions[i];
+        total->sig_versions[i] += part->sig_versions[i];
+    }
+    for (i = 0u; i < 256u; i++)
+    {
+        total->hashes[i] += part->hashes[i];
+        total->s2k[i]    += part->s2k[i];
+    }
+    for (i = 0u; i < SUMMARY_SIZES; i++)
+    {
+        if (part->size[i].count) count_size (total, part->size[i].kind, part->size[i].count);
+    }
+    total->keys            += part->keys;
+    total->subkeys         += part->subkeys;
+    total->expired         += part->expired;
+    total->revoked         += part->revoked;
+    total->subkeys_revoked += part->subkeys_revoked;
+    total->sigs            += part->sigs;
+    total->skesks          += part->skesks;
+    total->undecoded       += part->undecoded;
+}
+
+static int by_kind (const void *a, const void *b)
+{
+const struct summary_size *x = a;
+const struct summary_size *y = b;
+
+    if (x->kind == y->kind) return 0;
+    return (x->kind > y->kind) ? -1 : 1;
+}
+
+/* Print a count, and when estimated the half width of its interval */
+
+static void show (const struct summary_counts *counts, const struct summary_counts *half,
+                  const uint64_t *value)
+{
+    printf ("%" PRIu64, *value);
+    if (half != NULL)
+    {
+        printf (" +/- %" PRIu64,
+                ((const uint64_t *)half)[value - (const uint64_t *)counts]);
+    }
+}
+
+static void print_spread (const struct summary_counts *counts,
+                          const struct summary_counts *half, const char *title,
+                          const uint64_t *count, uint32_t n, const char *prefix)
+{
+uint32_t i;
+
+    printf ("%s", title);
+    for (i = 0u; i < n; i++)
+    {
+        if (!count[i]) continue;
+        printf (" %s%u: ", prefix, i);
+        show (counts, half, &count[i]);
+    }
+    printf ("\n");
+}
+
+static uint64_t half_size (const struct summary_counts *half, uint32_t kind)
+{
+uint32_t i;
+
+    for (i = 0u; i < SUMMARY_SIZES; i++)
+    {
+        if (half->size[i].count && (half->size[i].kind == kind)) return half->size[i].count;
+    }
+    return 0u;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* print_summary                                                           */
+/* INPUTS: counts - the totals                                             */
+/*         half - half widths of the 95% intervals if the totals were      */
+/*                estimated from a sample, else NULL                       */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* Sizes are listed primary keys first, then subkeys, each by algorithm    */
+/* and then by size, largest first.                                        */
+/*                                                                         */
+/***************************************************************************/
+
+static void print_summary (struct summary_counts *counts, const struct summary_counts *half)
+{
+uint32_t i;
+
+    print_spread (counts, half, "packets by tag:", counts->packets, SUMMARY_TAGS, "");
+    printf ("keys: ");
+    show (counts, half, &counts->keys);
+    printf (" primary, ");
+    show (counts, half, &counts->subkeys);
+    printf (" subkeys\n");
+    print_spread (counts, half, "key versions:", counts->key_versions, SUMMARY_VERSIONS,
+                  "v");
+    qsort (counts->size, SUMMARY_SIZES, sizeof(counts->size[0]), by_kind);
+    for (i = 0u; (i < SUMMARY_SIZES) && counts->size[i].count; i++)
+    {
+        if (counts->size[i].kind == 0u)
+        {
+            printf ("  other keys: %" PRIu64, counts->size[i].count);
+        }
+        else
+        {
+            printf ("  %s alg %u, %u bits: %" PRIu64,
+                    ((counts->size[i].kind >> 24) == 2u) ? "primary" : "subkey",
+                    (counts->size[i].kind >> 16) & 0xffu, counts->size[i].kind & 0xffffu,
+                    counts->size[i].count);
+        }
+        if (half != NULL)
+        {
+            printf (" +/- %" PRIu64, half_size (half, counts->size[i].kind));
+        }
+        printf ("\n");
+    }
+    printf ("primary keys revoked: ");
+    show (counts, half, &counts->revoked);
+    printf (", expired: ");
+    show (counts, half, &counts->expired);
+    printf ("; subkeys revoked: ");
+    show (counts, half, &counts->subkeys_revoked);
+    printf ("\nsignatures: ");
+    show (counts, half, &counts->sigs);
+    printf ("\n");
+    print_spread (counts, half, "signature versions:", counts->sig_versions,
+                  SUMMARY_VERSIONS, "v");
+    print_spread (counts, half, "signature hash algorithms:", counts->hashes, 256u, "");
+    printf ("symmetric key encrypted session keys: ");
+    show (counts, half, &counts->skesks);
+    printf ("\n");
+    if (counts->skesks)
+    {
+        print_spread (counts, half, "S2K types:", counts->s2k, 256u, "");
+    }
+    if (counts->undecoded)
+    {
+        printf ("packets not understood: ");
+        show (counts, half, &counts->undecoded);
+        printf ("\n");
+    }
+}
+
+static uint64_t next_random (uint64_t *pState)
+{
+    *pState ^= *pState << 13;
+    *pState ^= *pState >> 7;
+    *pState ^= *pState << 17;
+    return *pState;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* sample_window                                                           */
+/* INPUTS: src - the input, a regular file                                 */
+/*         from - where to start looking for a packet                      */
+/*         limit - where to give up looking for a primary key              */
+/*         window - octets of key blocks wanted                            */
+/*         ctx - counts for this window alone                              */
+/* RETURN: TRUE if whole key blocks were read undamaged                    */
+/* OUTPUT: pLen - the octets they took                                     */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t sample_window (struct source *src, off_t from, off_t limit, off_t window,
+                              struct summary_ctx *ctx, off_t *pLen)
+{
+off_t    skipped;
+off_t    at;
+uint8_t  tag;
+uint8_t  partial;
+uint32_t length;
+
+    if (!source_seek (src, from) || !resync_find (src, &skipped)) return FALSE;
+    for (;;)
+    {
+        at = source_tell (src);
+        if (at >= limit) return FALSE;
+        if (!grab_packet_head (src, &tag, &partial, &length) || src->eof ||
+                (tag == PktReserved))
+        {
+            return FALSE;
+        }
+        if ((tag == PktPublicKey) || (tag == PktSecretKey)) break;
+        if (!skip_body (src, length, partial)) return FALSE;
+    }
+    if (!source_seek (src, at)) return FALSE;
+
+    memset (&ctx->counts, 0, sizeof(ctx->counts));
+    ctx->end     = at + window;
+    ctx->stopped = -1;
+    ctx->failed  = FALSE;
+    summary_walk (src, ctx);
+    if (ctx->failed) return FALSE;
+    *pLen = ((ctx->stopped >= 0) ? ctx->stopped : source_tell (src)) - at;
+    return (*pLen > 0);
+}
+
+static void add_sample (struct summary_counts *total, struct summary_moments *m,
+                        const struct summary_counts *part, off_t len)
+{
+uint64_t       *sum = (uint64_t *)total;
+const uint64_t *x = (const uint64_t *)part;
+double          b = (double)len;
+uint32_t        slot;
+uint32_t        i;
+
+    for (i = 0u; i < SUMMARY_FLAT; i++)
+    {
+        sum[i]   += x[i];
+        m->sq[i] += (double)x[i] * (double)x[i];
+        m->cb[i] += (double)x[i] * b;
+    }
+    for (i = 0u; i < SUMMARY_SIZES; i++)
+    {
+        if (!part->size[i].count) continue;
+        slot = count_size (total, part->size[i].kind, part->size[i].count);
+        m->size_sq[slot] += (double)part->size[i].count * (double)part->size[i].count;
+        m->size_cb[slot] += (double)part->size[i].count * b;
+    }
+    m->b  += b;
+    m->b2 += b * b;
+    m->n++;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* estimate                                                                */
+/* INPUTS: sum - a count summed over the windows                           */
+/*         sq - the sum of its squares                                     */
+/*         cb - the sum of it times each window's length                   */
+/*         m - the windows' lengths                                        */
+/*         size - the file's length                                        */
+/* RETURN: the estimated total for the file                                */
+/* OUTPUT: pHalf - half the width of its 95% confidence interval           */
+/*                                                                         */
+/* The ratio estimator: r is the sum over the total window length, and     */
+/* its variance about the sum over windows of (c - r b) squared, over      */
+/* n (n - 1) times the mean window length squared.                         */
+/*                                                                         */
+/***************************************************************************/
+
+static uint64_t estimate (double sum, double sq, double cb, const struct summary_moments *m,
+                          double size, uint64_t *pHalf)
+{
+double r = sum / m->b;
+double mean = m->b / m->n;
+double var;
+
+    var = (sq - 2.0 * r * cb + r * r * m->b2) / ((double)m->n * (m->n - 1u) * mean * mean);
+    if (!(var > 0.0)) var = 0.0;
+    *pHalf = (uint64_t)(SAMPLE_Z * size * sqrt (var) + 0.5);
+    return (uint64_t)(r * size + 0.5);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* summary_sample                                                          */
+/* INPUTS: src - the input, a regular file                                 */
+/*         fraction - share of the file to read                            */
+/*         total - where the estimates go                                  */
+/*         half - where the interval half widths go                        */
+/* RETURN: FALSE if the file is too small for a sample to save anything,   */
+/*         or too few windows held whole key blocks                        */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t summary_sample (struct source *src, double fraction,
+                               struct summary_ctx *total, struct summary_counts *half)
+{
+struct summary_moments *m;
+struct summary_ctx     *ctx;
+struct stat st;
+uint64_t   *value = (uint64_t *)&total->counts;
+uint64_t   *width = (uint64_t *)half;
+uint64_t    state;
+uint64_t    hw;
+off_t       window = SAMPLE_WINDOW;
+off_t       slice;
+off_t       from;
+off_t       len;
+off_t       decoded = 0;
+uint32_t    windows;
+uint32_t    i;
+uint8_t     ok = FALSE;
+
+    if (fstat (src->fd, &st)) return FALSE;
+    windows = (uint32_t)((double)st.st_size * fraction / (double)window);
+    if (windows < SAMPLE_MINIMUM)
+    {
+        windows = SAMPLE_MINIMUM;
+        window  = (off_t)((double)st.st_size * fraction / windows);
+        if (window < SAMPLE_MINIMUM_WINDOW) window = SAMPLE_MINIMUM_WINDOW;
+    }
+    if ((off_t)windows * window * 2 > st.st_size) return FALSE;
+
+    m   = calloc (1u, sizeof(*m));
+    ctx = calloc (1u, sizeof(*ctx));
+    if ((m == NULL) || (ctx == NULL)) goto done;
+    ctx->now = total->now;
+    state    = ((uint64_t)time (NULL) << 20) ^ (uint64_t)getpid () ^ 0x9e3779b97f4a7c15ull;
+    slice    = st.st_size / windows;
+    for (i = 0u; i < windows; i++)
+    {
+        from = (off_t)i * slice + (off_t)(next_random (&state) % (uint64_t)(slice - window));
+        if (!sample_window (src, from, (off_t)(i + 1u) * slice, window, ctx, &len)) continue;
+        add_sample (&total->counts, m, &ctx->counts, len);
+        decoded += len;
+    }
+    if (m->n < 2u)
+    {
+        fprintf (stderr, "too few key blocks in the sample, so reading it all\n");
+        goto done;
+    }
+
+    for (i = 0u; i < SUMMARY_FLAT; i++)
+    {
+        value[i] = estimate ((double)value[i], m->sq[i], m->cb[i], m, (double)st.st_size,
+                             &width[i]);
+    }
+    for (i = 0u; i < SUMMARY_SIZES; i++)
+    {
+        if (!total->counts.size[i].count) continue;
+        total->counts.size[i].count = estimate ((double)total->counts.size[i].count,
+                                                m->size_sq[i], m->size_cb[i], m,
+                                                (double)st.st_size, &hw);
+        if (hw) count_size (half, total->counts.size[i].kind, hw);
+    }
+    fprintf (stderr, "estimated from %u windows, %" PRIdMAX " of %" PRIdMAX
+             " octets decoded; +/- gives 95%% intervals\n",
+             m->n, (intmax_t)decoded, (intmax_t)st.st_size);
+    ok = TRUE;
+
+done:
+    free (m);
+    free (ctx);
+    return ok;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* summary_keyring                                                         */
+/* INPUTS: name - keyring or other packet stream to summarise              */
+/*         threads - worker threads, used if the input is a regular file   */
+/*         sample - share of the file to estimate from, as 1% or 0.01, or  */
+/*                  NULL to read it all                                    */
+/* RETURN: 0, or 2 if the input could not be read or was damaged           */
+/*                                                                         */
+/***************************************************************************/
+
+extern int summary_keyring (const char *name, uint32_t threads, const char *sample)
+{
+struct summary_pool    pool;
+struct summary_worker *worker = NULL;
+struct summary_ctx    *total;
+struct summary_counts *half = NULL;
+struct source *src;
+double   fraction = 1.0;
+char    *end;
+uint32_t i;
+uint8_t  ok = TRUE;
+
+    if (sample != NULL)
+    {
+        fraction = strtod (sample, &end);
+        if (*end == '%')
+        {
+            fraction /= 100.0;
+            end++;
+        }
+        if (*end || !(fraction > 0.0) || (fraction > 1.0))
+        {
+            fprintf (stderr, "%s: not a share of the file to sample\n", sample);
+            return 2;
+        }
+    }
+
+    src = source_open (name);
+    if (src == NULL)
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        return 2;
+    }
+    total = calloc (1u, sizeof(*total));
+    if (total == NULL)
+    {
+        source_close (src);
+        return 2;
+    }
+    total->now = (uint32_t)time (NULL);
+    total->end = (off_t)INT64_MAX;
+    if ((fraction < 1.0) && !src->seekable)
+    {
+        fprintf (stderr, "%s: sampling needs a regular file\n", name);
+        free (total);
+        source_close (src);
+        return 2;
+    }
+    if (fraction < 1.0)
+    {
+        half = calloc (1u, sizeof(*half));
+        if ((half != NULL) && !summary_sample (src, fraction, total, half))
+        {
+            /* too small to be worth sampling, so read it all */
+            free (half);
+            half = NULL;
+            memset (&total->counts, 0, sizeof(total->counts));
+            source_seek (src, 0);
+        }
+    }
+    if ((half == NULL) && src->seekable && (threads > 1u))
+    {
+        worker = calloc (threads, sizeof(*worker));
+    }
+    if (half != NULL)
+    {
+        /* estimated already */
+    }
+    else if (worker == NULL)
+    {
+        summary_walk (src, total);
+        ok = !total->failed;
+    }
+    else
+    {
+        memset (&pool, 0, sizeof(pool));
+        pthread_mutex_init (&pool.lock, NULL);
+        pthread_cond_init (&pool.work, NULL);
+        pool.name = name;
+        for (i = 0u; i < threads; i++)
+        {
+            worker[i].pool    = &pool;
+            worker[i].ctx.now = total->now;
+            worker[i].started = !pthread_create (&worker[i].thread, NULL,
+                                                 summary_worker, &worker[i]);
+        }
+        ok = cut_ranges (src, &pool);
+        pthread_mutex_lock (&pool.lock);
+        pool.closing = TRUE;
+        pthread_cond_broadcast (&pool.work);
+        pthread_mutex_unlock (&pool.lock);
+        for (i = 0u; i < threads; i++)
+        {
+            if (worker[i].started) pthread_join (worker[i].thread, NULL);
+        }
+        if (!worker[0].started && (pool.taken < pool.ranges))
+        {
+            /* no thread could be started, so do it all here */
+            worker[0].started = TRUE;
+            summary_worker (&worker[0]);
+        }
+        for (i = 0u; i < threads; i++)
+        {
+            if (!worker[i].started) continue;
+            if (worker[i].ctx.failed) ok = FALSE;
+            merge_counts (&total->counts, &worker[i].ctx.counts);
+        }
+        pthread_cond_destroy (&pool.work);
+        pthread_mutex_destroy (&pool.lock);
+        free (pool.range);
+        free (worker);
+    }
+    print_summary (&total->counts, half);
+    if (!ok) fprintf (stderr, "%s: stopped at a damaged packet\n", name);
+    free (half);
+    free (total);
+    source_close (src);
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,526 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "keyring.h"
+#include "extsort.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+/***************************************************************************/
+/*                                                                         */
+/* Time index file, all integers little endian:                            */
+/*                                                                         */
+/*   header  "PGPTIME" 0x00, u32 version (1), u32 number of arrays (4)     */
+/*   arrays  per array u64 offset of its first entry, u64 entries          */
+/*   entries u32 time, u32 packet type, u64 packet offset in the keyring,  */
+/*           8 octets key ID of the block's primary key                    */
+/*                                                                         */
+/* Each array is sorted by time, then by packet offset, so a range of      */
+/* times is found by binary search over the mapped file. The arrays are,   */
+/* in order, key creation, key expiry, signature creation and signature    */
+/* expiry. Expiry times are absolute; a key's comes from self_sig_expiry   */
+/* over its self signatures, and keys or signatures that do not expire     */
+/* are left out.                                                           */
+/*                                                                         */
+/***************************************************************************/
+
+#define TIME_MAGIC      "PGPTIME"
+#define TIME_VERSION    (1u)
+#define TIME_HEAD       (16u)
+#define TIME_ENTRY      (24u)
+
+enum time_field
+{
+    FieldKeyCreated,
+    FieldKeyExpires,
+    FieldSigCreated,
+    FieldSigExpires,
+    TIME_FIELDS
+};
+
+static const char *const field_name[TIME_FIELDS] =
+{
+    "key-created", "key-expires", "sig-created", "sig-expires"
+};
+
+/* Sort record, ordered by array, time and then packet offset */
+
+struct time_record
+{
+    uint32_t        field;
+    uint32_t        when;
+    uint64_t        offset;
+    uint32_t        tag;
+    uint8_t         keyid[PKT_KEYID_LEN];
+};
+
+/* A key whose expiry is settled once its block ends */
+
+struct time_key
+{
+    off_t           offset;
+    uint32_t        tag;
+    uint32_t        created;
+    uint32_t        expires;
+    uint32_t        expiry_from;
+};
+
+struct time_ctx
+{
+    struct extsort *sort;
+    uint64_t        count[TIME_FIELDS];
+    uint8_t         keyid[PKT_KEYID_LEN];
+    struct time_key *key;
+    uint32_t        keys;
+    uint32_t        key_size;
+    uint8_t         failed;
+};
+
+static int compare_records (const void *a, const void *b)
+{
+const struct time_record *x = a;
+const struct time_record *y = b;
+
+    if (x->field != y->field) return (x->field < y->field) ? -1 : 1;
+    if (x->when != y->when) return (x->when < y->when) ? -1 : 1;
+    if (x->offset != y->offset) return (x->offset < y->offset) ? -1 : 1;
+    return 0;
+}
+
+static void le (uint8_t *p, uint64_t value, uint32_t len)
+{
+uint32_t i;
+
+    for (i = 0u; i < len; i++)
+    {
+        p[i] = (uint8_t)(value >> (8u * i));
+    }
+}
+
+static uint64_t get_le (const uint8_t *p, uint32_t len)
+{
+uint64_t value = 0u;
+
+    while (len--)
+    {
+        value = (value << 8) | p[len];
+    }
+    return value;
+}
+
+static uint8_t add_record (struct time_ctx *ctx, enum time_field field, uint32_t when,
+                           off_t offset, uint32_t tag)
+{
+struct time_record record;
+
+    memset (&record, 0, sizeof(record));
+    record.field  = field;
+    record.when   = when;
+    record.offset = (uint64_t)offset;
+    record.tag    = tag;
+    memcpy (record.keyid, ctx->keyid, PKT_KEYID_LEN);
+    if (!extsort_add (ctx->sort, &record)) return FALSE;
+    ctx->count[field]++;
+    return TRUE;
+}
+
+/* The block is over, so the expiry of each of its keys is known */
+
+static uint8_t flush_keys (struct time_ctx *ctx)
+{
+uint32_t i;
+
+    for (i = 0u; i < ctx->keys; i++)
+    {
+        if (!ctx->key[i].expires) continue;
+        if (!add_record (ctx, FieldKeyExpires, ctx->key[i].expires, ctx->key[i].offset,
+                         ctx->key[i].tag))
+        {
+            return FALSE;
+        }
+    }
+    ctx->keys = 0u;
+    return TRUE;
+}
+
+static uint8_t hold_key (struct time_ctx *ctx, const struct keyring_packet *pkt)
+{
+struct time_key *key;
+struct pgp_key   decoded;
+
+    if (!decode_public_key (pkt->body, pkt->len, &decoded)) return TRUE;
+    if (ctx->keys == ctx->key_size)
+    {
+        ctx->key_size = ctx->key_size ? ctx->key_size * 2u : 16u;
+        key = realloc (ctx->key, ctx->key_size * sizeof(*key));
+        if (key == NULL) return FALSE;
+        ctx->key = key;
+    }
+    key = &ctx->key[ctx->keys++];
+    memset (key, 0, sizeof(*key));
+    key->offset  = pkt->offset;
+    key->tag     = pkt->tag;
+    key->created = decoded.created;
+    key->expires = key_own_expiry (&decoded);
+    return add_record (ctx, FieldKeyCreated, decoded.created, pkt->offset, pkt->tag);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* add_signature                                                           */
+/* INPUTS: ctx - the index being built                                     */
+/*         block - the key block being walked                              */
+/*         pkt - the signature packet                                      */
+/* RETURN: FALSE if the records could not be stored                        */
+/*                                                                         */
+/* A self signature over the key or a user ID sets the primary key's       */
+/* expiry, a binding signature the subkey's; the latest such one wins.     */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t add_signature (struct time_ctx *ctx, const struct keyring_block *block,
+                              const struct keyring_packet *pkt)
+{
+struct pgp_sig   sig;
+struct time_key *key = NULL;
+
+    if (!decode_signature (pkt->body, pkt->len, &sig)) return TRUE;
+    if (ctx->keys && sig.has_issuer && !memcmp (sig.issuer, block->keyid, PKT_KEYID_LEN))
+    {
+        if (((block->component == PktPublicKey) || (block->component == PktUserID)) &&
+                (sig.type != SIG_REVOKE_KEY) && (sig.type != SIG_REVOKE_CERT))
+        {
+            key = &ctx->key[0];
+        }
+        else if (((block->component == PktPublicSubkey) ||
+                  (block->component == PktSecretSubkey)) && (sig.type == SIG_SUBKEY_BIND))
+        {
+            key = &ctx->key[ctx->keys - 1u];
+        }
+    }
+    if (key != NULL)
+    {
+        self_sig_expiry (&sig, key->created, &key->expiry_from, &key->expires);
+    }
+
+    if (sig.created &&
+            !add_record (ctx, FieldSigCreated, sig.created, pkt->offset, pkt->tag))
+    {
+        return FALSE;
+    }
+    if (sig.expires &&
+            !add_record (ctx, FieldSigExpires, sig.created + sig.expires, pkt->offset,
+                         pkt->tag))
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static uint8_t time_collect (void *ctx_in, const struct keyring_block *block,
+                             const struct keyring_packet *pkt)
+{
+struct time_ctx *ctx = ctx_in;
+
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            if (!flush_keys (ctx)) goto fail;
+            memcpy (ctx->keyid, block->keyid, PKT_KEYID_LEN);
+            if (!hold_key (ctx, pkt)) goto fail;
+            break;
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            if (!ctx->keys) break;
+            if (!hold_key (ctx, pkt)) goto fail;
+            break;
+        case PktSignature:
+            if (!add_signature (ctx, block, pkt)) goto fail;
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+
+fail:
+    ctx->failed = TRUE;
+    return FALSE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* time_index_build                                                        */
+/* INPUTS: name - keyring to index, or "-" for standard input              */
+/*         out_name - index file to write                                  */
+/*         memory - octets of records sorted in memory before spilling     */
+/* RETURN: 0 on success, 1 on failure                                      */
+/*                                                                         */
+/***************************************************************************/
+
+extern int time_index_build (const char *name, const char *out_name, size_t memory)
+{
+struct time_ctx    ctx;
+struct time_record record;
+struct source     *src;
+FILE              *out = NULL;
+uint8_t            head[TIME_HEAD + TIME_FIELDS * 16u];
+uint8_t            entry[TIME_ENTRY];
+uint64_t           at;
+uint32_t           i;
+uint8_t            ok = FALSE;
+
+    memset (&ctx, 0, sizeof(ctx));
+    src = source_open (name);
+    if (src == NULL)
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        return 1;
+    }
+    ctx.sort = extsort_open (sizeof(record), memory, compare_records);
+    if (ctx.sort == NULL) goto done;
+
+    if (!keyring_walk (src, KEYRING_SKIP_ATTRIBUTES, time_collect, &ctx) && !ctx.failed)
+    {
+        fprintf (stderr, "%s: malformed packet, rest of file ignored\n", name);
+    }
+    if (ctx.failed || !flush_keys (&ctx) || !extsort_finish (ctx.sort)) goto done;
+
+    out = fopen (out_name, "wb");
+    if (out == NULL)
+    {
+        fprintf (stderr, "%s: cannot open\n", out_name);
+        goto done;
+    }
+    memcpy (head, TIME_MAGIC, 8u);
+    le (head + 8, TIME_VERSION, 4u);
+    le (head + 12, TIME_FIELDS, 4u);
+    at = sizeof(head);
+    for (i = 0u; i < TIME_FIELDS; i++)
+    {
+        le (head + TIME_HEAD + i * 16u, at, 8u);
+        le (head + TIME_HEAD + i * 16u + 8u, ctx.count[i], 8u);
+        at += ctx.count[i] * TIME_ENTRY;
+    }
+    if (fwrite (head, 1u, sizeof(head), out) != sizeof(head)) goto done;
+    while (extsort_next (ctx.sort, &record))
+    {
+        le (entry, record.when, 4u);
+        le (entry + 4, record.tag, 4u);
+        le (entry + 8, record.offset, 8u);
+        memcpy (entry + 16, record.keyid, PKT_KEYID_LEN);
+        if (fwrite (entry, 1u, TIME_ENTRY, out) != TIME_ENTRY) goto done;
+    }
+    ok = !fflush (out);
+    if (ok)
+    {
+        fprintf (stderr, "%llu key creation, %llu key expiry, %llu signature creation and "
+                 "%llu signature expiry times\n",
+                 (unsigned long long)ctx.count[FieldKeyCreated],
+                 (unsigned long long)ctx.count[FieldKeyExpires],
+                 (unsigned long long)ctx.count[FieldSigCreated],
+                 (unsigned long long)ctx.count[FieldSigExpires]);
+    }
+
+done:
+    if (out && fclose (out)) ok = FALSE;
+    extsort_close (ctx.sort);
+    source_close (src);
+    free (ctx.key);
+    return ok ? 0 : 1;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* parse_when                                                              */
+/* INPUTS: text - YYYY-MM-DD (midnight UTC), @SECONDS since the epoch, or  */
+/*                now, optionally followed by +N or -N days as in now+30   */
+/*         now - the current time                                          */
+/* RETURN: TRUE if the time was understood                                 */
+/* OUTPUT: pWhen - the time, as seconds since the epoch                    */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t parse_when (const char *text, time_t now, int64_t *pWhen)
+{
+struct tm tm;
+char     *end;
+long long value;
+int       year;
+int       month;
+int       day;
+char      extra;
+
+    if (text[0] == '@')
+    {
+        value = strtoll (text + 1, &end, 10);
+        if ((end == text + 1) || *end) return FALSE;
+        *pWhen = value;
+        return TRUE;
+    }
+    if (!strncmp (text, "now", 3u))
+    {
+        *pWhen = (int64_t)now;
+        if (!text[3]) return TRUE;
+        if ((text[3] != '+') && (text[3] != '-')) return FALSE;
+        value = strtoll (text + 3, &end, 10);
+        if ((end == text + 4) || *end) return FALSE;
+        *pWhen += value * 86400;
+        return TRUE;
+    }
+    if (sscanf (text, "%4d-%2d-%2d%c", &year, &month, &day, &extra) != 3) return FALSE;
+    memset (&tm, 0, sizeof(tm));
+    tm.tm_year = year - 1900;
+    tm.tm_mon  = month - 1;
+    tm.tm_mday = day;
+    *pWhen = (int64_t)timegm (&tm);
+    return TRUE;
+}
+
+/* First entry of a sorted array whose time is not before when */
+
+static uint64_t lower_bound (const uint8_t *array, uint64_t count, int64_t when)
+{
+uint64_t low = 0u;
+uint64_t high = count;
+uint64_t middle;
+
+    if (when <= 0) return 0u;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2u;
+        if ((int64_t)get_le (array + middle * TIME_ENTRY, 4u) < when)
+        {
+            low = middle + 1u;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* time_index_query                                                        */
+/* INPUTS: index_name - file written by time_index_build                   */
+/*         field - key-created, key-expires, sig-created or sig-expires    */
+/*         after - earliest time wanted, or NULL for no limit              */
+/*         before - first time no longer wanted, or NULL for no limit      */
+/* RETURN: 0 if any entry fell in the range, 1 if none, 2 on trouble       */
+/*                                                                         */
+/* Lists the packet offset, time, packet type and primary key ID of every  */
+/* entry from after up to but not including before, in time order.         */
+/*                                                                         */
+/***************************************************************************/
+
+extern int time_index_query (const char *index_name, const char *field,
+                             const char *after, const char *before)
+{
+const uint8_t *map = MAP_FAILED;
+const uint8_t *entry;
+struct stat    st;
+struct tm      tm;
+time_t         now;
+time_t         t;
+int64_t        from = INT64_MIN;
+int64_t        to = INT64_MAX;
+uint64_t       offset;
+uint64_t       count;
+uint64_t       first;
+uint64_t       last;
+uint32_t       which;
+uint32_t       i;
+char           date[32];
+int            fd;
+int            rc = 2;
+
+    for (which = 0u; which < TIME_FIELDS; which++)
+    {
+        if (!strcmp (field, field_name[which])) break;
+    }
+    now = time (NULL);
+    if ((which == TIME_FIELDS) || (after && !parse_when (after, now, &from)) ||
+            (before && !parse_when (before, now, &to)))
+    {
+        fprintf (stderr, "unknown field or time; fields are key-created, key-expires, "
+                 "sig-created and sig-expires, times YYYY-MM-DD, @SECONDS or now[+-DAYS]\n");
+        return 2;
+    }
+
+    fd = open (index_name, O_RDONLY);
+    if ((fd < 0) || fstat (fd, &st) || (st.st_size < TIME_HEAD + TIME_FIELDS * 16))
+    {
+        fprintf (stderr, "%s: cannot open\n", index_name);
+        goto done;
+    }
+    map = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) goto done;
+    offset = get_le (map + TIME_HEAD + which * 16u, 8u);
+    count  = get_le (map + TIME_HEAD + which * 16u + 8u, 8u);
+    if (memcmp (map, TIME_MAGIC, 8u) || (get_le (map + 8, 4u) != TIME_VERSION) ||
+            (get_le (map + 12, 4u) != TIME_FIELDS) || (offset > (uint64_t)st.st_size) ||
+            (count > ((uint64_t)st.st_size - offset) / TIME_ENTRY))
+    {
+        fprintf (stderr, "%s: not a time index\n", index_name);
+        goto done;
+    }
+
+    first = lower_bound (map + offset, count, from);
+    last  = (to == INT64_MAX) ? count : lower_bound (map + offset, count, to);
+    rc    = (first < last) ? 0 : 1;
+    for (; first < last; first++)
+    {
+        entry = map + offset + first * TIME_ENTRY;
+        t     = (time_t)get_le (entry, 4u);
+        gmtime_r (&t, &tm);
+        strftime (date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+        printf ("%llu %s %s ", (unsigned long long)get_le (entry + 8, 8u), date,
+                (get_le (entry + 4, 4u) == PktSignature) ? "signature" :
+                (get_le (entry + 4, 4u) == PktPublicKey) ||
+                (get_le (entry + 4, 4u) == PktSecretKey) ? "key" : "subkey");
+        for (i = 0u; i < PKT_KEYID_LEN; i++)
+        {
+            printf ("%02X", entry[16 + i]);
+        }
+        printf ("\n");
+    }
+
+done:
+    if (map != MAP_FAILED) munmap ((void *)map, (size_t)st.st_size);
+    if (fd >= 0) close (fd);
+    return rc;
+}
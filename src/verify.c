@@ -0,0 +1,908 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <gcrypt.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+#define VERIFY_OK       (0)
+#define VERIFY_FAILED   (1)
+#define VERIFY_TROUBLE  (2)
+
+#define VERIFY_BATCH    (256u)
+#define MAX_DIGEST      (64u)
+#define NO_ARENA        (UINT32_MAX)
+
+/***************************************************************************/
+/*                                                                         */
+/* Every signature over a key, user ID, attribute or subkey becomes a job. */
+/* The walking thread links it to its issuer, hashes what it covers and    */
+/* checks the left 16 bits of the digest; only the jobs that survive are   */
+/* left for the worker threads, which do the public key operation. Jobs    */
+/* are handed over in batches that are reported in the order they were    */
+/* filled, so the output does not depend on the number of threads.         */
+/*                                                                         */
+/***************************************************************************/
+
+enum verify_result
+{
+    VerifyPending,
+    VerifyGood,
+    VerifyBad,
+    VerifyPrefix,
+    VerifyNoKey,
+    VerifyUnsupported,
+    VerifyError,
+    VerifyResults
+};
+
+struct verify_job
+{
+    uint8_t         primary[PKT_MAX_FPR];
+    uint8_t         fpr_len;
+    uint8_t         sig_type;
+    uint8_t         issuer[PKT_KEYID_LEN];
+    uint8_t         result;
+    uint8_t         hash_alg;
+    uint8_t         digest[MAX_DIGEST];
+    uint8_t         digest_len;
+    uint32_t        key_at;
+    uint32_t        key_len;
+    uint32_t        sig_at;
+    uint32_t        sig_len;
+};
+
+/* Issuer keys and signatures of a batch are copied into its arena */
+
+struct verify_batch
+{
+    struct verify_job job[VERIFY_BATCH];
+    uint32_t        count;
+    uint8_t         done;
+    uint8_t        *arena;
+    uint32_t        arena_len;
+    uint32_t        arena_size;
+};
+
+struct verify_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_cond_t  finished;
+    struct verify_batch *slot;
+    uint32_t        slots;
+    uint64_t        submitted;
+    uint64_t        taken;
+    uint64_t        reported;
+    uint8_t         closing;
+    pthread_t      *thread;
+    uint32_t        threads;
+    uint64_t        tally[VerifyResults];
+};
+
+/* Every key and subkey in the file, sorted by key ID */
+
+struct verify_entry
+{
+    uint8_t         keyid[PKT_KEYID_LEN];
+    uint64_t        offset;
+};
+
+/* Public part of a key, or the body of a user ID or attribute */
+
+struct verify_held
+{
+    uint8_t         keyid[PKT_KEYID_LEN];
+    uint8_t         valid;
+    uint8_t        *body;
+    uint32_t        len;
+    uint32_t        size;
+};
+
+struct verify_ctx
+{
+    struct verify_entry *index;
+    uint32_t        index_count;
+    uint32_t        index_size;
+    struct source  *lookup;
+    struct grab_buffer lookup_buf;
+    enum packet_tags component_tag;
+    struct verify_held primary;
+    struct verify_held component;
+    struct verify_held cached;
+    struct verify_pool *pool;
+};
+
+static int hash_algo (uint8_t hash_alg)
+{
+    switch (hash_alg)
+    {
+        case HashAlgMD5:        return GCRY_MD_MD5;
+        case HashAlgSHA1:       return GCRY_MD_SHA1;
+        case HashAlgRIPEMD160:  return GCRY_MD_RMD160;
+        case HashAlgSHA256:     return GCRY_MD_SHA256;
+        case HashAlgSHA384:     return GCRY_MD_SHA384;
+        case HashAlgSHA512:     return GCRY_MD_SHA512;
+        case HashAlgSHA224:     return GCRY_MD_SHA224;
+        case HashAlgSHA3_256:   return GCRY_MD_SHA3_256;
+        case HashAlgSHA3_512:   return GCRY_MD_SHA3_512;
+        default:                return GCRY_MD_NONE;
+    }
+}
+
+static int compare_entries (const void *a, const void *b)
+{
+    return memcmp (a, b, PKT_KEYID_LEN);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* index_collect                                                           */
+/* INPUTS: ctx - the verify context                                        */
+/*         block - the key block being walked                              */
+/*         pkt - the packet                                                */
+/* RETURN: FALSE if the index could not be grown                           */
+/*                                                                         */
+/* First pass: note where every key and subkey lives, by key ID.           */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t index_collect (void *ctx, const struct keyring_block *block,
+                              const struct keyring_packet *pkt)
+{
+struct verify_ctx   *verify = ctx;
+struct verify_entry *grown;
+uint8_t fpr[PKT_MAX_FPR];
+uint8_t fpr_len;
+
+    (void)block;
+    if ((pkt->tag != PktPublicKey) && (pkt->tag != PktSecretKey) &&
+            (pkt->tag != PktPublicSubkey) && (pkt->tag != PktSecretSubkey))
+    {
+        return TRUE;
+    }
+    if (verify->index_count == verify->index_size)
+    {
+        verify->index_size = verify->index_size ? verify->index_size * 2u : 1024u;
+        grown = realloc (verify->index, verify->index_size * sizeof(*grown));
+        if (grown == NULL) return FALSE;
+        verify->index = grown;
+    }
+    if (key_fingerprint (pkt->body, pkt->len, fpr, &fpr_len,
+                         verify->index[verify->index_count].keyid))
+    {
+        verify->index[verify->index_count++].offset = (uint64_t)pkt->offset;
+    }
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* hold                                                                    */
+/* INPUTS: held - where to keep the copy                                   */
+/*         body - packet body                                              */
+/*         len - length of the body                                        */
+/*         key - whether this is a key, cut down to its public part        */
+/* RETURN: FALSE if out of memory                                          */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t hold (struct verify_held *held, const uint8_t *body, uint32_t len,
+                     uint8_t key)
+{
+struct pgp_key pgp_key;
+uint8_t  fpr[PKT_MAX_FPR];
+uint8_t  fpr_len;
+uint8_t *grown;
+
+    held->valid = FALSE;
+    if (key)
+    {
+        if (!decode_public_key (body, len, &pgp_key) ||
+                !key_fingerprint (body, len, fpr, &fpr_len, held->keyid))
+        {
+            return TRUE;
+        }
+        len = key_public_len (body, &pgp_key);
+        if (!len) return TRUE;
+    }
+    if (len > held->size)
+    {
+        grown = realloc (held->body, len);
+        if (grown == NULL) return FALSE;
+        held->body = grown;
+        held->size = len;
+    }
+    memcpy (held->body, body, len);
+    held->len   = len;
+    held->valid = TRUE;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* find_issuer                                                             */
+/* INPUTS: verify - the verify context                                     */
+/*         sig - the signature                                             */
+/* RETURN: the issuer's public key, or NULL if it is not in the file       */
+/*                                                                         */
+/* Self signatures are by far the most common, so the primary key and the  */
+/* current subkey are tried first; anything else is read back through the  */
+/* index, keeping the last one in case it signs again.                     */
+/*                                                                         */
+/***************************************************************************/
+
+static const struct verify_held *find_issuer (struct verify_ctx *verify,
+                                              const struct pgp_sig *sig)
+{
+const struct verify_entry *entry;
+enum packet_tags tag;
+uint32_t len;
+
+    if (sig->type == SIG_PRIMARY_BIND)
+    {
+        return verify->component.valid ? &verify->component : NULL;
+    }
+    if (!sig->has_issuer ||
+            !memcmp (sig->issuer, verify->primary.keyid, PKT_KEYID_LEN))
+    {
+        return verify->primary.valid ? &verify->primary : NULL;
+    }
+    if (verify->cached.valid &&
+            !memcmp (sig->issuer, verify->cached.keyid, PKT_KEYID_LEN))
+    {
+        return &verify->cached;
+    }
+    entry = bsearch (sig->issuer, verify->index, verify->index_count,
+                     sizeof(*entry), compare_entries);
+    if (entry == NULL) return NULL;
+    if (!keyring_read_at (verify->lookup, (off_t)entry->offset,
+                          &verify->lookup_buf, &tag, &len))
+    {
+        return NULL;
+    }
+    if (!hold (&verify->cached, verify->lookup_buf.data, len, TRUE)) return NULL;
+    return verify->cached.valid ? &verify->cached : NULL;
+}
+
+static void hash_key (gcry_md_hd_t md, const struct verify_held *key)
+{
+uint8_t head[5];
+
+    if (key->body[0] >= 5u)
+    {
+        head[0] = (key->body[0] == 5u) ? 0x9a : 0x9b;
+        head[1] = (uint8_t)(key->len >> 24);
+        head[2] = (uint8_t)(key->len >> 16);
+        head[3] = (uint8_t)(key->len >> 8);
+        head[4] = (uint8_t)key->len;
+        gcry_md_write (md, head, 5u);
+    }
+    else
+    {
+        head[0] = 0x99;
+        head[1] = (uint8_t)(key->len >> 8);
+        head[2] = (uint8_t)key->len;
+        gcry_md_write (md, head, 3u);
+    }
+    gcry_md_write (md, key->body, key->len);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* hash_signed                                                             */
+/* INPUTS: verify - the verify context, holding the primary key and the    */
+/*                  component the signature follows                        */
+/*         body - the signature body                                       */
+/*         sig - the signature decoded from body                           */
+/*         job - job to receive the digest                                 */
+/* RETURN: the job's result so far                                         */
+/*                                                                         */
+/* Hash the salt (v6), the primary key, the user ID, attribute or subkey   */
+/* for the types that cover one, then the hashed part of the signature     */
+/* and its trailer. v3 signatures hash only their type and creation time,  */
+/* and the user ID without a header.                                       */
+/*                                                                         */
+/***************************************************************************/
+
+static enum verify_result hash_signed (const struct verify_ctx *verify,
+                                       const uint8_t *body, const struct pgp_sig *sig,
+                                       struct verify_job *job)
+{
+gcry_md_hd_t md;
+uint8_t  trailer[10];
+uint32_t prefix_len;
+uint8_t  uid_head;
+int      algo;
+
+    algo = hash_algo (sig->hash_alg);
+    if ((algo == GCRY_MD_NONE) || !verify->primary.valid) return VerifyUnsupported;
+    if (gcry_md_open (&md, algo, 0)) return VerifyUnsupported;
+
+    if (sig->salt_len) gcry_md_write (md, sig->salt, sig->salt_len);
+    hash_key (md, &verify->primary);
+    switch (sig->type)
+    {
+        case SIG_CERT_GENERIC:
+        case SIG_CERT_PERSONA:
+        case SIG_CERT_CASUAL:
+        case SIG_CERT_POSITIVE:
+        case SIG_REVOKE_CERT:
+            if (sig->version >= 4u)
+            {
+                uid_head   = (verify->component_tag == PktUserID) ? 0xb4 : 0xd1;
+                trailer[0] = uid_head;
+                trailer[1] = (uint8_t)(verify->component.len >> 24);
+                trailer[2] = (uint8_t)(verify->component.len >> 16);
+                trailer[3] = (uint8_t)(verify->component.len >> 8);
+                trailer[4] = (uint8_t)verify->component.len;
+                gcry_md_write (md, trailer, 5u);
+            }
+            gcry_md_write (md, verify->component.body, verify->component.len);
+            break;
+        case SIG_SUBKEY_BIND:
+        case SIG_PRIMARY_BIND:
+        case SIG_REVOKE_SUBKEY:
+            hash_key (md, &verify->component);
+            break;
+        default:
+            break;
+    }
+
+    if (sig->version < 4u)
+    {
+        gcry_md_write (md, body + 2, 5u);
+    }
+    else
+    {
+        prefix_len = (uint32_t)(sig->hashed - body) + sig->hashed_len;
+        gcry_md_write (md, body, prefix_len);
+        trailer[0] = sig->version;
+        trailer[1] = 0xff;
+        if (sig->version == 5u)
+        {
+            memset (trailer + 2, 0, 4u);
+            trailer[6] = (uint8_t)(prefix_len >> 24);
+            trailer[7] = (uint8_t)(prefix_len >> 16);
+            trailer[8] = (uint8_t)(prefix_len >> 8);
+            trailer[9] = (uint8_t)prefix_len;
+            gcry_md_write (md, trailer, 10u);
+        }
+        else
+        {
+            trailer[2] = (uint8_t)(prefix_len >> 24);
+            trailer[3] = (uint8_t)(prefix_len >> 16);
+            trailer[4] = (uint8_t)(prefix_len >> 8);
+            trailer[5] = (uint8_t)prefix_len;
+            gcry_md_write (md, trailer, 6u);
+        }
+    }
+
+    job->digest_len = (uint8_t)gcry_md_get_algo_dlen (algo);
+    memcpy (job->digest, gcry_md_read (md, algo), job->digest_len);
+    gcry_md_close (md);
+    return memcmp (job->digest, sig->left16, 2u) ? VerifyPrefix : VerifyPending;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* check_job                                                               */
+/* INPUTS: batch - the batch holding the job's key and signature           */
+/*         job - a job that passed the quick reject                        */
+/* RETURN: the result of the public key verification                       */
+/*                                                                         */
+/* RSA takes the PKCS#1 encoded digest, DSA and ECDSA the digest cut to    */
+/* the size of the group order, EdDSA the digest as the message.           */
+/*                                                                         */
+/***************************************************************************/
+
+static enum verify_result check_job (const struct verify_batch *batch,
+                                     const struct verify_job *job)
+{
+struct pgp_key   key;
+struct pgp_sig   sig;
+struct pgp_field kf[PKT_MAX_FIELDS];
+struct pgp_field sf[PKT_MAX_FIELDS];
+uint8_t          kcount, scount;
+uint8_t          r[57], s[57];
+uint32_t         half;
+uint32_t         dlen;
+const char      *curve;
+gcry_sexp_t      s_pub = NULL, s_data = NULL, s_sig = NULL;
+gcry_error_t     err;
+enum verify_result result;
+
+    if (!decode_public_key (batch->arena + job->key_at, job->key_len, &key) ||
+            !key_fields (&key, kf, &kcount) ||
+            !decode_signature (batch->arena + job->sig_at, job->sig_len, &sig) ||
+            !sig_fields (&sig, sf, &scount))
+    {
+        return VerifyError;
+    }
+    dlen = job->digest_len;
+    switch (key.algorithm)
+    {
+        case PKAlgEncryptAndSign:
+        case PKAlgSignOnly:
+            if ((sig.pk_alg != PKAlgEncryptAndSign) && (sig.pk_alg != PKAlgSignOnly))
+            {
+                return VerifyError;
+            }
+            err = gcry_sexp_build (&s_pub, NULL, "(public-key(rsa(n%b)(e%b)))",
+                                   (int)kf[0].len, kf[0].data, (int)kf[1].len, kf[1].data);
+            if (!err) err = gcry_sexp_build (&s_data, NULL, "(data(flags pkcs1)(hash %s %b))",
+                                             gcry_md_algo_name (hash_algo (job->hash_alg)),
+                                             (int)dlen, job->digest);
+            if (!err) err = gcry_sexp_build (&s_sig, NULL, "(sig-val(rsa(s%b)))",
+                                             (int)sf[0].len, sf[0].data);
+            break;
+        case PKAlgDSA:
+            if (sig.pk_alg != PKAlgDSA) return VerifyError;
+            if (dlen > kf[1].len) dlen = kf[1].len;
+            err = gcry_sexp_build (&s_pub, NULL, "(public-key(dsa(p%b)(q%b)(g%b)(y%b)))",
+                                   (int)kf[0].len, kf[0].data, (int)kf[1].len, kf[1].data,
+                                   (int)kf[2].len, kf[2].data, (int)kf[3].len, kf[3].data);
+            if (!err) err = gcry_sexp_build (&s_data, NULL, "(data(flags raw)(value %b))",
+                                             (int)dlen, job->digest);
+            if (!err) err = gcry_sexp_build (&s_sig, NULL, "(sig-val(dsa(r%b)(s%b)))",
+                                             (int)sf[0].len, sf[0].data,
+                                             (int)sf[1].len, sf[1].data);
+            break;
+        case PKAlgECDSA:
+            if ((sig.pk_alg != PKAlgECDSA) || (key.curve == NULL)) return VerifyUnsupported;
+            if (dlen > (key.curve->bits + 7u) / 8u) dlen = (key.curve->bits + 7u) / 8u;
+            err = gcry_sexp_build (&s_pub, NULL, "(public-key(ecc(curve %s)(q%b)))",
+                                   key.curve->name, (int)kf[0].len, kf[0].data);
+            if (!err) err = gcry_sexp_build (&s_data, NULL, "(data(flags raw)(value %b))",
+                                             (int)dlen, job->digest);
+            if (!err) err = gcry_sexp_build (&s_sig, NULL, "(sig-val(ecdsa(r%b)(s%b)))",
+                                             (int)sf[0].len, sf[0].data,
+                                             (int)sf[1].len, sf[1].data);
+            break;
+        case PKAlgEdDSALegacy:
+        case PKAlgEd25519:
+        case PKAlgEd448:
+            if (sig.pk_alg != key.algorithm) return VerifyError;
+            if (key.algorithm == PKAlgEdDSALegacy)
+            {
+                if ((key.curve == NULL) || strcmp (key.curve->name, "ed25519"))
+                {
+                    return VerifyUnsupported;
+                }
+                half = 32u;
+                if ((sf[0].len > half) || (sf[1].len > half)) return VerifyError;
+                memset (r, 0, sizeof(r));
+                memset (s, 0, sizeof(s));
+                memcpy (r + half - sf[0].len, sf[0].data, sf[0].len);
+                memcpy (s + half - sf[1].len, sf[1].data, sf[1].len);
+            }
+            else
+            {
+                half = sf[0].len / 2u;
+                memcpy (r, sf[0].data, half);
+                memcpy (s, sf[0].data + half, half);
+            }
+            curve = (key.algorithm == PKAlgEd448) ? "Ed448" : "Ed25519";
+            err = gcry_sexp_build (&s_pub, NULL, "(public-key(ecc(curve %s)(flags eddsa)(q%b)))",
+                                   curve, (int)kf[0].len, kf[0].data);
+            if (!err && (key.algorithm == PKAlgEd448))
+            {
+                err = gcry_sexp_build (&s_data, NULL, "(data(flags eddsa)(value %b))",
+                                       (int)dlen, job->digest);
+            }
+            else if (!err)
+            {
+                err = gcry_sexp_build (&s_data, NULL,
+                                       "(data(flags eddsa)(hash-algo sha512)(value %b))",
+                                       (int)dlen, job->digest);
+            }
+            if (!err) err = gcry_sexp_build (&s_sig, NULL, "(sig-val(eddsa(r%b)(s%b)))",
+                                             (int)half, r, (int)half, s);
+            break;
+        default:
+            return VerifyUnsupported;
+    }
+
+    if (!err) err = gcry_pk_verify (s_sig, s_data, s_pub);
+    if (!err)                                            result = VerifyGood;
+    else if (gcry_err_code (err) == GPG_ERR_BAD_SIGNATURE) result = VerifyBad;
+    else                                                 result = VerifyError;
+    gcry_sexp_release (s_pub);
+    gcry_sexp_release (s_data);
+    gcry_sexp_release (s_sig);
+    return result;
+}
+
+static void *verify_worker (void *arg)
+{
+struct verify_pool  *pool = arg;
+struct verify_batch *batch;
+uint32_t i;
+
+    pthread_mutex_lock (&pool->lock);
+    for (;;)
+    {
+        while ((pool->taken == pool->submitted) && !pool->closing)
+        {
+            pthread_cond_wait (&pool->work, &pool->lock);
+        }
+        if (pool->taken == pool->submitted) break;
+        batch = &pool->slot[pool->taken++ % pool->slots];
+        pthread_mutex_unlock (&pool->lock);
+
+        for (i = 0u; i < batch->count; i++)
+        {
+            if (batch->job[i].result == VerifyPending)
+            {
+                batch->job[i].result = check_job (batch, &batch->job[i]);
+            }
+        }
+
+        pthread_mutex_lock (&pool->lock);
+        batch->done = TRUE;
+        pthread_cond_broadcast (&pool->finished);
+    }
+    pthread_mutex_unlock (&pool->lock);
+    return NULL;
+}
+
+static void print_hex (const uint8_t *buf, uint32_t len)
+{
+uint32_t i;
+
+    for (i = 0ul; i < len; i++)
+    {
+        printf ("%02X", buf[i]);
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* report_batch                                                            */
+/* INPUTS: pool - the worker pool                                          */
+/*         batch - a finished batch                                        */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* Count every result, and print a line for each signature that failed.    */
+/* Signatures by keys missing from the file are only counted; in a dump   */
+/* most third party certifications are.                                    */
+/*                                                                         */
+/***************************************************************************/
+
+static void report_batch (struct verify_pool *pool, const struct verify_batch *batch)
+{
+const struct verify_job *job;
+const char *what;
+uint32_t i;
+
+    for (i = 0u; i < batch->count; i++)
+    {
+        job = &batch->job[i];
+        pool->tally[job->result]++;
+        switch (job->result)
+        {
+            case VerifyBad:     what = "bad sig";   break;
+            case VerifyPrefix:  what = "bad sig";   break;
+            case VerifyError:   what = "error sig"; break;
+            default:            continue;
+        }
+        printf ("%s ", what);
+        print_hex (job->primary, job->fpr_len);
+        printf (" type %02x by ", job->sig_type);
+        print_hex (job->issuer, PKT_KEYID_LEN);
+        printf ("%s\n", (job->result == VerifyPrefix) ? " (hash prefix)" : "");
+    }
+}
+
+static struct verify_batch *filling (struct verify_pool *pool)
+{
+    return &pool->slot[pool->submitted % pool->slots];
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* submit                                                                  */
+/* INPUTS: pool - the worker pool                                          */
+/*         drain - wait for and report every batch, not just enough to     */
+/*                 free the next slot                                      */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* Hand the batch being filled to the workers and start on the next slot, */
+/* reporting the batch that last used it first.                            */
+/*                                                                         */
+/***************************************************************************/
+
+static void submit (struct verify_pool *pool, uint8_t drain)
+{
+struct verify_batch *batch;
+
+    pthread_mutex_lock (&pool->lock);
+    if (filling (pool)->count)
+    {
+        filling (pool)->done = FALSE;
+        pool->submitted++;
+        pthread_cond_signal (&pool->work);
+    }
+    while ((pool->reported < pool->submitted) &&
+               (drain || (pool->submitted - pool->reported >= pool->slots)))
+    {
+        batch = &pool->slot[pool->reported % pool->slots];
+        while (!batch->done) pthread_cond_wait (&pool->finished, &pool->lock);
+        pthread_mutex_unlock (&pool->lock);
+        report_batch (pool, batch);
+        pthread_mutex_lock (&pool->lock);
+        pool->reported++;
+    }
+    pthread_mutex_unlock (&pool->lock);
+    batch = filling (pool);
+    batch->count     = 0u;
+    batch->arena_len = 0ul;
+}
+
+static uint32_t arena_add (struct verify_batch *batch, const uint8_t *data, uint32_t len)
+{
+uint8_t *grown;
+uint32_t at;
+
+    if (batch->arena_len + len > batch->arena_size)
+    {
+        grown = realloc (batch->arena, (batch->arena_len + len) * 2u);
+        if (grown == NULL) return NO_ARENA;
+        batch->arena      = grown;
+        batch->arena_size = (batch->arena_len + len) * 2u;
+    }
+    at = batch->arena_len;
+    memcpy (batch->arena + at, data, len);
+    batch->arena_len += len;
+    return at;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* verify_collect                                                          */
+/* INPUTS: ctx - the verify context                                        */
+/*         block - the key block being walked                              */
+/*         pkt - the packet                                                */
+/* RETURN: FALSE if out of memory                                          */
+/*                                                                         */
+/* Second pass: keep the primary key and the current component, and turn  */
+/* each signature over them into a job.                                    */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t verify_collect (void *ctx, const struct keyring_block *block,
+                               const struct keyring_packet *pkt)
+{
+struct verify_ctx   *verify = ctx;
+struct verify_batch *batch;
+struct verify_job   *job;
+const struct verify_held *issuer;
+struct pgp_sig       sig;
+uint8_t              covered;
+
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            verify->component_tag   = PktPublicKey;
+            verify->component.valid = FALSE;
+            return hold (&verify->primary, pkt->body, pkt->len, TRUE);
+        case PktUserID:
+        case PktUserAttribute:
+            verify->component_tag = pkt->tag;
+            return hold (&verify->component, pkt->body, pkt->len, FALSE);
+        case PktPublicSubkey:
+        case PktSecretSubkey:
+            verify->component_tag = PktPublicSubkey;
+            return hold (&verify->component, pkt->body, pkt->len, TRUE);
+        case PktSignature:
+            break;
+        default:
+            return TRUE;
+    }
+    if (!decode_signature (pkt->body, pkt->len, &sig)) return TRUE;
+
+    switch (sig.type)
+    {
+        case SIG_CERT_GENERIC:
+        case SIG_CERT_PERSONA:
+        case SIG_CERT_CASUAL:
+        case SIG_CERT_POSITIVE:
+        case SIG_REVOKE_CERT:
+            covered = ((verify->component_tag == PktUserID) ||
+                       (verify->component_tag == PktUserAttribute)) &&
+                      verify->component.valid;
+            break;
+        case SIG_SUBKEY_BIND:
+        case SIG_PRIMARY_BIND:
+        case SIG_REVOKE_SUBKEY:
+            covered = (verify->component_tag == PktPublicSubkey) &&
+                      verify->component.valid;
+            break;
+        case SIG_DIRECT:
+        case SIG_REVOKE_KEY:
+            covered = TRUE;
+            break;
+        default:
+            covered = FALSE;
+            break;
+    }
+
+    batch = filling (verify->pool);
+    if (batch->count == VERIFY_BATCH)
+    {
+        submit (verify->pool, FALSE);
+        batch = filling (verify->pool);
+    }
+    job = &batch->job[batch->count++];
+    memset (job, 0, sizeof(*job));
+    memcpy (job->primary, block->fpr, block->fpr_len);
+    job->fpr_len  = block->fpr_len;
+    job->sig_type = sig.type;
+    job->hash_alg = sig.hash_alg;
+    if (sig.has_issuer) memcpy (job->issuer, sig.issuer, PKT_KEYID_LEN);
+
+    if (!covered)
+    {
+        job->result = VerifyUnsupported;
+        return TRUE;
+    }
+    issuer = find_issuer (verify, &sig);
+    if (issuer == NULL)
+    {
+        job->result = VerifyNoKey;
+        return TRUE;
+    }
+    if (!sig.has_issuer) memcpy (job->issuer, issuer->keyid, PKT_KEYID_LEN);
+    job->result = hash_signed (verify, pkt->body, &sig, job);
+    if (job->result != VerifyPending) return TRUE;
+
+    job->key_len = issuer->len;
+    job->key_at  = arena_add (batch, issuer->body, issuer->len);
+    job->sig_len = pkt->len;
+    job->sig_at  = arena_add (batch, pkt->body, pkt->len);
+    if ((job->key_at == NO_ARENA) || (job->sig_at == NO_ARENA)) return FALSE;
+    return TRUE;
+}
+
+static void release_held (struct verify_held *held)
+{
+    free (held->body);
+    memset (held, 0, sizeof(*held));
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* verify_keyring                                                          */
+/* INPUTS: name - the keyring to audit                                     */
+/*         threads - number of worker threads                              */
+/* RETURN: 0 if every signature checked was good, 1 if some were not,     */
+/*         2 if the keyring could not be read                              */
+/*                                                                         */
+/* Two passes over the file: the first indexes every key by key ID so     */
+/* third party certifications can find their issuer, the second checks    */
+/* the signatures. A summary of all the results is printed at the end.     */
+/*                                                                         */
+/***************************************************************************/
+
+extern int verify_keyring (const char *name, uint32_t threads)
+{
+struct verify_ctx   verify;
+struct verify_pool  pool;
+struct source      *walk;
+uint32_t            started = 0u;
+uint32_t            i;
+uint8_t             ok = FALSE;
+int                 status = VERIFY_TROUBLE;
+
+    memset (&verify, 0, sizeof(verify));
+    memset (&pool, 0, sizeof(pool));
+    verify.pool = &pool;
+    if (threads < 1u) threads = 1u;
+
+    walk          = source_open (name);
+    verify.lookup = source_open (name);
+    if ((walk == NULL) || (verify.lookup == NULL)) goto done;
+    if (!walk->seekable)
+    {
+        fprintf (stderr, "--verify reads issuer keys back, so needs a regular file\n");
+        goto done;
+    }
+
+    if (!keyring_walk (walk, 0u, index_collect, &verify))
+    {
+        fprintf (stderr, "%s: malformed packet, rest of file ignored\n", name);
+    }
+    qsort (verify.index, verify.index_count, sizeof(*verify.index), compare_entries);
+    if (!source_seek (walk, 0)) goto done;
+
+    pthread_mutex_init (&pool.lock, NULL);
+    pthread_cond_init (&pool.work, NULL);
+    pthread_cond_init (&pool.finished, NULL);
+    pool.slots  = threads * 2u;
+    pool.slot   = calloc (pool.slots, sizeof(*pool.slot));
+    pool.thread = calloc (threads, sizeof(*pool.thread));
+    if ((pool.slot == NULL) || (pool.thread == NULL)) goto stop;
+    for (started = 0u; started < threads; started++)
+    {
+        if (pthread_create (&pool.thread[started], NULL, verify_worker, &pool)) break;
+    }
+    if (!started) goto stop;
+
+    ok = keyring_walk (walk, 0u, verify_collect, &verify);
+    submit (&pool, TRUE);
+    if (!ok) fprintf (stderr, "%s: malformed packet, rest of file ignored\n", name);
+
+    printf ("%llu good, %llu bad, %llu rejected on hash prefix, %llu in error, "
+            "%llu without issuer key, %llu unsupported\n",
+            (unsigned long long)pool.tally[VerifyGood],
+            (unsigned long long)pool.tally[VerifyBad],
+            (unsigned long long)pool.tally[VerifyPrefix],
+            (unsigned long long)pool.tally[VerifyError],
+            (unsigned long long)pool.tally[VerifyNoKey],
+            (unsigned long long)pool.tally[VerifyUnsupported]);
+    status = (pool.tally[VerifyBad] || pool.tally[VerifyPrefix] ||
+              pool.tally[VerifyError]) ? VERIFY_FAILED : VERIFY_OK;
+
+stop:
+    pthread_mutex_lock (&pool.lock);
+    pool.closing = TRUE;
+    pthread_cond_broadcast (&pool.work);
+    pthread_mutex_unlock (&pool.lock);
+    for (i = 0u; i < started; i++)
+    {
+        pthread_join (pool.thread[i], NULL);
+    }
+    if (pool.slot != NULL)
+    {
+        for (i = 0u; i < pool.slots; i++)
+        {
+            free (pool.slot[i].arena);
+        }
+    }
+    free (pool.slot);
+    free (pool.thread);
+    pthread_cond_destroy (&pool.finished);
+    pthread_cond_destroy (&pool.work);
+    pthread_mutex_destroy (&pool.lock);
+
+done:
+    release_held (&verify.primary);
+    release_held (&verify.component);
+    release_held (&verify.cached);
+    grab_release (&verify.lookup_buf);
+    free (verify.index);
+    source_close (walk);
+    source_close (verify.lookup);
+    return status;
+}
@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <gmp.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+#define WEAK_NONE       (0)
+#define WEAK_FOUND      (1)
+#define WEAK_TROUBLE    (2)
+
+/* Above this many weak moduli the pairs are not worked out */
+
+#define WEAK_PAIRS      (1024u)
+
+/***************************************************************************/
+/*                                                                         */
+/* Bernstein's batch GCD. The moduli are multiplied up a product tree to   */
+/* P; the product is then reduced back down, each node taking the          */
+/* remainder of its parent modulo its own square, so leaf i holds          */
+/* P mod n_i^2. gcd(n_i, (P mod n_i^2) / n_i) is 1 unless n_i shares a     */
+/* factor with some other modulus. Every node of a level is independent,   */
+/* so each level is shared out among the worker threads.                   */
+/*                                                                         */
+/***************************************************************************/
+
+struct weak_key
+{
+    uint8_t         fpr[PKT_MAX_FPR];
+    uint8_t         fpr_len;
+    uint8_t         keyid[PKT_KEYID_LEN];
+    mpz_t           n;
+    mpz_t           gcd;
+};
+
+struct weak_set
+{
+    struct weak_key *key;
+    size_t          count;
+    size_t          size;
+};
+
+enum tree_op
+{
+    TreeProduct,
+    TreeRemainder,
+    TreeGcd
+};
+
+struct tree_level
+{
+    enum tree_op    op;
+    mpz_t          *dst;
+    mpz_t          *src;
+    mpz_t          *parent;
+    struct weak_key *keys;
+    size_t          count;
+    size_t          src_count;
+    uint32_t        stripes;
+};
+
+struct tree_stripe
+{
+    struct tree_level *level;
+    uint32_t        stripe;
+};
+
+/***************************************************************************/
+/*                                                                         */
+/* weak_collect                                                            */
+/* INPUTS: ctx - the set of RSA keys                                       */
+/*         block - the key block being walked                              */
+/*         pkt - the packet                                                */
+/* RETURN: FALSE if out of memory                                          */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t weak_collect (void *ctx, const struct keyring_block *block,
+                             const struct keyring_packet *pkt)
+{
+struct weak_set  *set = ctx;
+struct weak_key  *key;
+struct pgp_key    pgp_key;
+struct pgp_field  field[PKT_MAX_FIELDS];
+uint8_t           count;
+
+    (void)block;
+    if ((pkt->tag != PktPublicKey) && (pkt->tag != PktSecretKey) &&
+            (pkt->tag != PktPublicSubkey) && (pkt->tag != PktSecretSubkey))
+    {
+        return TRUE;
+    }
+    if (!decode_public_key (pkt->body, pkt->len, &pgp_key)) return TRUE;
+    if ((pgp_key.algorithm != PKAlgEncryptAndSign) &&
+            (pgp_key.algorithm != PKAlgEncryptOnly) &&
+            (pgp_key.algorithm != PKAlgSignOnly))
+    {
+        return TRUE;
+    }
+    if (!key_fields (&pgp_key, field, &count) || !field[0].len) return TRUE;
+
+    if (set->count == set->size)
+    {
+        set->size = set->size ? set->size * 2u : 1024u;
+        key = realloc (set->key, set->size * sizeof(*key));
+        if (key == NULL) return FALSE;
+        set->key = key;
+    }
+    key = &set->key[set->count];
+    if (!key_fingerprint (pkt->body, pkt->len, key->fpr, &key->fpr_len, key->keyid))
+    {
+        return TRUE;
+    }
+    mpz_init (key->n);
+    mpz_init (key->gcd);
+    mpz_import (key->n, field[0].len, 1, 1, 1, 0, field[0].data);
+    set->count++;
+    return TRUE;
+}
+
+static int compare_keys (const void *a, const void *b)
+{
+const struct weak_key *ka = a;
+const struct weak_key *kb = b;
+
+    if (ka->fpr_len != kb->fpr_len) return (int)ka->fpr_len - (int)kb->fpr_len;
+    return memcmp (ka->fpr, kb->fpr, ka->fpr_len);
+}
+
+static void *tree_worker (void *arg)
+{
+struct tree_stripe *stripe = arg;
+struct tree_level  *level  = stripe->level;
+mpz_t  work;
+size_t i;
+
+    mpz_init (work);
+    for (i = stripe->stripe; i < level->count; i += level->stripes)
+    {
+        switch (level->op)
+        {
+            case TreeProduct:
+                if (2u * i + 1u < level->src_count)
+                {
+                    mpz_mul (level->dst[i], level->src[2u * i], level->src[2u * i + 1u]);
+                }
+                else
+                {
+                    mpz_set (level->dst[i], level->src[2u * i]);
+                }
+                break;
+            case TreeRemainder:
+                /* in place: the node's product is replaced by its remainder */
+                mpz_mul (work, level->dst[i], level->dst[i]);
+                mpz_mod (level->dst[i], level->parent[i / 2u], work);
+                break;
+            case TreeGcd:
+                mpz_divexact (work, level->parent[i], level->keys[i].n);
+                mpz_gcd (level->keys[i].gcd, work, level->keys[i].n);
+                break;
+        }
+    }
+    mpz_clear (work);
+    return NULL;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* run_level                                                               */
+/* INPUTS: level - one level of the product or remainder tree              */
+/*         threads - most threads to use                                   */
+/* RETURN: none                                                            */
+/*                                                                         */
+/* Node i goes to thread i mod stripes. If a thread cannot be started its */
+/* stripe is done here instead.                                            */
+/*                                                                         */
+/***************************************************************************/
+
+static void run_level (struct tree_level *level, uint32_t threads)
+{
+struct tree_stripe *stripe;
+struct tree_stripe  only;
+pthread_t          *thread;
+uint8_t            *started;
+uint32_t            i;
+
+    level->stripes = (level->count < threads) ? (uint32_t)level->count : threads;
+    if (level->stripes < 1u) level->stripes = 1u;
+    stripe  = calloc (level->stripes, sizeof(*stripe));
+    thread  = calloc (level->stripes, sizeof(*thread));
+    started = calloc (level->stripes, sizeof(*started));
+    if ((stripe == NULL) || (thread == NULL) || (started == NULL))
+    {
+        only.level     = level;
+        only.stripe    = 0u;
+        level->stripes = 1u;
+        tree_worker (&only);
+    }
+    else
+    {
+        for (i = 0u; i < level->stripes; i++)
+        {
+            stripe[i].level  = level;
+            stripe[i].stripe = i;
+            if (i) started[i] = !pthread_create (&thread[i], NULL, tree_worker, &stripe[i]);
+        }
+        for (i = 0u; i < level->stripes; i++)
+        {
+            if (!started[i]) tree_worker (&stripe[i]);
+        }
+        for (i = 1u; i < level->stripes; i++)
+        {
+            if (started[i]) pthread_join (thread[i], NULL);
+        }
+    }
+    free (stripe);
+    free (thread);
+    free (started);
+}
+
+static void free_level (mpz_t *level, size_t count)
+{
+size_t i;
+
+    if (level == NULL) return;
+    for (i = 0u; i < count; i++)
+    {
+        mpz_clear (level[i]);
+    }
+    free (level);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* batch_gcd                                                               */
+/* INPUTS: set - the moduli                                                */
+/*         threads - worker threads                                        */
+/* RETURN: FALSE if out of memory                                          */
+/* OUTPUT: the gcd of every key in the set                                 */
+/*                                                                         */
+/* Every level of the product tree is kept; going back down, each level's  */
+/* products become its remainders and the level above is freed.            */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t batch_gcd (struct weak_set *set, uint32_t threads)
+{
+struct tree_level level;
+mpz_t   **tree;
+size_t   *count;
+size_t    depth = 1u;
+size_t    n, i, k;
+uint8_t   ok = FALSE;
+
+    for (n = set->count; n > 1u; n = (n + 1u) / 2u) depth++;
+    tree  = calloc (depth, sizeof(*tree));
+    count = calloc (depth, sizeof(*count));
+    if ((tree == NULL) || (count == NULL)) goto done;
+
+    count[0] = set->count;
+    tree[0]  = malloc (set->count * sizeof(mpz_t));
+    if (tree[0] == NULL) goto done;
+    for (i = 0u; i < set->count; i++)
+    {
+        mpz_init_set (tree[0][i], set->key[i].n);
+    }
+
+    memset (&level, 0, sizeof(level));
+    for (k = 1u; k < depth; k++)
+    {
+        count[k] = (count[k - 1u] + 1u) / 2u;
+        tree[k]  = malloc (count[k] * sizeof(mpz_t));
+        if (tree[k] == NULL) goto done;
+        for (i = 0u; i < count[k]; i++)
+        {
+            mpz_init (tree[k][i]);
+        }
+        level.op        = TreeProduct;
+        level.dst       = tree[k];
+        level.src       = tree[k - 1u];
+        level.count     = count[k];
+        level.src_count = count[k - 1u];
+        run_level (&level, threads);
+    }
+
+    /* the root is its own remainder: P mod P^2 = P */
+    for (k = depth - 1u; k > 0u; k--)
+    {
+        level.op     = TreeRemainder;
+        level.dst    = tree[k - 1u];
+        level.parent = tree[k];
+        level.count  = count[k - 1u];
+        run_level (&level, threads);
+        free_level (tree[k], count[k]);
+        tree[k] = NULL;
+    }
+
+    level.op     = TreeGcd;
+    level.parent = tree[0];
+    level.keys   = set->key;
+    level.count  = set->count;
+    run_level (&level, threads);
+    ok = TRUE;
+
+done:
+    if (tree != NULL)
+    {
+        for (k = 0u; k < depth; k++)
+        {
+            free_level (tree[k], count[k]);
+        }
+    }
+    free (tree);
+    free (count);
+    return ok;
+}
+
+static void print_hex (const uint8_t *buf, uint32_t len)
+{
+uint32_t i;
+
+    for (i = 0ul; i < len; i++)
+    {
+        printf ("%02X", buf[i]);
+    }
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* weak_rsa_keys                                                           */
+/* INPUTS: name - the keyring to audit                                     */
+/*         threads - worker threads                                        */
+/* RETURN: 0 if no RSA moduli share a factor, 1 if some do, 2 if the      */
+/*         keyring could not be read                                       */
+/*                                                                         */
+/* Keys seen more than once (same fingerprint) are counted once. Moduli   */
+/* below 2 or even are reported as bad and kept out of the GCD. Each      */
+/* weak key is printed with the size of the factor it shares; the few     */
+/* weak keys are then compared pairwise to say which share with which.    */
+/*                                                                         */
+/***************************************************************************/
+
+extern int weak_rsa_keys (const char *name, uint32_t threads)
+{
+struct weak_set  set;
+struct source   *src;
+size_t           i, j, kept, weak = 0u, bad = 0u;
+size_t          *flagged = NULL;
+mpz_t            common;
+int              status = WEAK_TROUBLE;
+
+    memset (&set, 0, sizeof(set));
+    mpz_init (common);
+    if (threads < 1u) threads = 1u;
+    src = source_open (name);
+    if (src == NULL) goto done;
+    if (!keyring_walk (src, 0u, weak_collect, &set))
+    {
+        fprintf (stderr, "%s: malformed packet, rest of file ignored\n", name);
+    }
+
+    qsort (set.key, set.count, sizeof(*set.key), compare_keys);
+    for (i = 0u, kept = 0u; i < set.count; i++)
+    {
+        if (kept && !compare_keys (&set.key[kept - 1u], &set.key[i]))
+        {
+            mpz_clear (set.key[i].n);
+            mpz_clear (set.key[i].gcd);
+            continue;
+        }
+        set.key[kept++] = set.key[i];
+    }
+    set.count = kept;
+
+    /* a modulus below 2 would divide by zero in the trees; an even one
+       shares the factor 2 with every other and would flag them all */
+    for (i = 0u, kept = 0u; i < set.count; i++)
+    {
+        if ((mpz_cmp_ui (set.key[i].n, 1ul) > 0) && mpz_odd_p (set.key[i].n))
+        {
+            set.key[kept++] = set.key[i];
+            continue;
+        }
+        bad++;
+        printf ("bad ");
+        print_hex (set.key[i].keyid, PKT_KEYID_LEN);
+        printf (" ");
+        print_hex (set.key[i].fpr, set.key[i].fpr_len);
+        if (mpz_cmp_ui (set.key[i].n, 1ul) <= 0)
+        {
+            printf (" modulus is %lu\n", mpz_get_ui (set.key[i].n));
+        }
+        else
+        {
+            printf (" %lu bits, even modulus\n",
+                    (unsigned long)mpz_sizeinbase (set.key[i].n, 2));
+        }
+        mpz_clear (set.key[i].n);
+        mpz_clear (set.key[i].gcd);
+    }
+    set.count = kept;
+    if (!batch_gcd (&set, threads)) goto done;
+
+    flagged = calloc (set.count + 1u, sizeof(*flagged));
+    if (flagged == NULL) goto done;
+    for (i = 0u; i < set.count; i++)
+    {
+        if (!mpz_cmp_ui (set.key[i].gcd, 1ul)) continue;
+        flagged[weak++] = i;
+        printf ("weak ");
+        print_hex (set.key[i].keyid, PKT_KEYID_LEN);
+        printf (" ");
+        print_hex (set.key[i].fpr, set.key[i].fpr_len);
+        if (!mpz_cmp (set.key[i].gcd, set.key[i].n))
+        {
+            printf (" %lu bits, shares its whole modulus\n",
+                    (unsigned long)mpz_sizeinbase (set.key[i].n, 2));
+        }
+        else
+        {
+            printf (" %lu bits, shares a %lu bit factor\n",
+                    (unsigned long)mpz_sizeinbase (set.key[i].n, 2),
+                    (unsigned long)mpz_sizeinbase (set.key[i].gcd, 2));
+        }
+    }
+    if (weak <= WEAK_PAIRS)
+    {
+        for (i = 0u; i < weak; i++)
+        {
+            for (j = i + 1u; j < weak; j++)
+            {
+                mpz_gcd (common, set.key[flagged[i]].n, set.key[flagged[j]].n);
+                if (!mpz_cmp_ui (common, 1ul)) continue;
+                printf ("pair ");
+                print_hex (set.key[flagged[i]].keyid, PKT_KEYID_LEN);
+                printf (" ");
+                print_hex (set.key[flagged[j]].keyid, PKT_KEYID_LEN);
+                printf ("\n");
+            }
+        }
+    }
+    printf ("%lu RSA moduli, %lu weak", (unsigned long)(set.count + bad),
+            (unsigned long)weak);
+    if (bad) printf (", %lu zero, one or even", (unsigned long)bad);
+    printf ("\n");
+    status = (weak || bad) ? WEAK_FOUND : WEAK_NONE;
+
+done:
+    for (i = 0u; i < set.count; i++)
+    {
+        mpz_clear (set.key[i].n);
+        mpz_clear (set.key[i].gcd);
+    }
+    free (set.key);
+    free (flagged);
+    mpz_clear (common);
+    source_close (src);
+    return status;
+}
@@ -0,0 +1,886 @@
+/*
+ * Copyright (c) 2020 Felicity Janet Meadows
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "2440.h"
+#include "packet.h"
+#include "grab.h"
+#include "source.h"
+#include "digest.h"
+#include "keyring.h"
+
+#define FALSE           (0u)
+#define TRUE            (!FALSE)
+
+#define WOT_NONE        (UINT32_MAX)
+#define WOT_CHUNK       (1024u)
+#define WOT_SHOWN       (10u)
+#define WOT_MIX         (0x9e3779b97f4a7c15ull)
+
+/***************************************************************************/
+/*                                                                         */
+/* Every primary key is a node, numbered in the order first met through a  */
+/* hash index on its key ID. A certification (types 0x10 to 0x13) over a   */
+/* user ID or attribute by another key is an edge from the signer to the   */
+/* key it follows; edges by keys not in the file are dropped, as are      */
+/* repeats, and revocations of certifications are not taken into account. */
+/* The edges are held in compressed sparse row form both ways round: the  */
+/* out edges of node n are out[out_start[n]] up to out[out_start[n + 1]], */
+/* and likewise the in edges.                                              */
+/*                                                                         */
+/* Strongly connected components are found as by Hong et al.: a key that  */
+/* certifies nothing, or that nothing certifies, is a component of its     */
+/* own; the component of the key with most edges, which in any web of     */
+/* trust is the strong set, is what both a forward and a backward search  */
+/* from it reach; and Tarjan's algorithm sorts out whatever is left, which */
+/* is small. Each search goes a level at a time, each level's frontier     */
+/* being shared out between the threads, which claim nodes with a compare  */
+/* and swap.                                                               */
+/*                                                                         */
+/***************************************************************************/
+
+struct wot_graph
+{
+    uint64_t       *keyid;
+    uint32_t        nodes;
+    uint32_t        node_size;
+    uint32_t       *slot;
+    uint32_t        slot_bits;
+    uint64_t       *pair;
+    uint64_t        pairs;
+    uint64_t        pair_size;
+    uint64_t        certifications;
+    uint64_t        unknown;
+    uint64_t        edges;
+    uint64_t       *out_start;
+    uint32_t       *out;
+    uint64_t       *in_start;
+    uint32_t       *in;
+    uint32_t        current;
+    uint8_t         failed;
+};
+
+/* One breadth first search, a level at a time */
+
+struct wot_bfs
+{
+    const uint64_t *start;
+    const uint32_t *adj;
+    const uint32_t *comp;
+    uint32_t       *level;
+    uint32_t       *parent;
+    uint32_t       *frontier;
+    uint32_t        frontier_len;
+    uint32_t       *next;
+    uint32_t        next_len;
+    uint32_t        depth;
+    uint32_t        taken;
+    pthread_mutex_t lock;
+};
+
+static uint64_t get_be64 (const uint8_t *p)
+{
+uint64_t val = 0u;
+uint8_t  i;
+
+    for (i = 0u; i < 8u; i++)
+    {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+static uint32_t slot_of (const struct wot_graph *graph, uint64_t keyid)
+{
+    return (uint32_t)((keyid * WOT_MIX) >> (64u - graph->slot_bits));
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* wot_find                                                                */
+/* INPUTS: graph - the graph                                               */
+/*         keyid - a key ID, as a big endian number                        */
+/* RETURN: the node of that key, or WOT_NONE                               */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t wot_find (const struct wot_graph *graph, uint64_t keyid)
+{
+uint32_t mask = (1u << graph->slot_bits) - 1u;
+uint32_t i;
+
+    if (graph->slot == NULL) return WOT_NONE;
+    for (i = slot_of (graph, keyid); graph->slot[i]; i = (i + 1u) & mask)
+    {
+        if (graph->keyid[graph->slot[i] - 1u] == keyid) return graph->slot[i] - 1u;
+    }
+    return WOT_NONE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* wot_node                                                                */
+/* INPUTS: graph - the graph                                               */
+/*         keyid - a primary key's ID                                      */
+/* RETURN: its node, added if it is new, or WOT_NONE if memory ran out     */
+/*                                                                         */
+/* The index is kept at most half full, so a probe seldom goes far.        */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t wot_node (struct wot_graph *graph, uint64_t keyid)
+{
+uint64_t *grown;
+uint32_t *slot;
+uint32_t  mask;
+uint32_t  node;
+uint32_t  i;
+uint32_t  n;
+
+    node = wot_find (graph, keyid);
+    if (node != WOT_NONE) return node;
+    if ((graph->slot == NULL) || (2u * (graph->nodes + 1u) > (1u << graph->slot_bits)))
+    {
+        slot = calloc ((size_t)1u << (graph->slot_bits + 1u), sizeof(*slot));
+        if (slot == NULL) return WOT_NONE;
+        free (graph->slot);
+        graph->slot = slot;
+        graph->slot_bits++;
+        mask = (1u << graph->slot_bits) - 1u;
+        for (n = 0u; n < graph->nodes; n++)
+        {
+            for (i = slot_of (graph, graph->keyid[n]); slot[i]; i = (i + 1u) & mask);
+            slot[i] = n + 1u;
+        }
+    }
+    if (graph->nodes == graph->node_size)
+    {
+        n     = graph->node_size ? (graph->node_size * 2u) : 4096u;
+        grown = realloc (graph->keyid, (size_t)n * sizeof(*grown));
+        if (grown == NULL) return WOT_NONE;
+        graph->keyid     = grown;
+        graph->node_size = n;
+    }
+    mask = (1u << graph->slot_bits) - 1u;
+    for (i = slot_of (graph, keyid); graph->slot[i]; i = (i + 1u) & mask);
+    node = graph->nodes++;
+    graph->keyid[node] = keyid;
+    graph->slot[i]     = node + 1u;
+    return node;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* wot_collect                                                             */
+/* INPUTS: ctx - the graph                                                 */
+/*         block - the key block being walked                              */
+/*         pkt - one of its packets                                        */
+/* RETURN: FALSE if memory ran out                                         */
+/*                                                                         */
+/* Signers are held as key IDs, as they may come later in the file, and    */
+/* only put to nodes once the whole file has been read.                    */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t wot_collect (void *ctx, const struct keyring_block *block,
+                            const struct keyring_packet *pkt)
+{
+struct wot_graph *graph = ctx;
+struct pgp_sig    sig;
+uint64_t *grown;
+uint64_t  size;
+
+    switch (pkt->tag)
+    {
+        case PktPublicKey:
+        case PktSecretKey:
+            graph->current = WOT_NONE;
+            if (!block->valid) break;
+            graph->current = wot_node (graph, get_be64 (block->keyid));
+            if (graph->current == WOT_NONE) graph->failed = TRUE;
+            break;
+        case PktSignature:
+            if ((graph->current == WOT_NONE) ||
+                    ((block->component != PktUserID) &&
+                     (block->component != PktUserAttribute)) ||
+                    !decode_signature (pkt->body, pkt->len, &sig) ||
+                    (sig.type < SIG_CERT_GENERIC) || (sig.type > SIG_CERT_POSITIVE) ||
+                    !sig.has_issuer ||
+                    !memcmp (sig.issuer, block->keyid, PKT_KEYID_LEN))
+            {
+                break;
+            }
+            if (graph->pairs == graph->pair_size)
+            {
+                size  = graph->pair_size ? (graph->pair_size * 2u) : 65536u;
+                grown = realloc (graph->pair, (size_t)size * sizeof(*grown));
+                if (grown == NULL)
+                {
+                    graph->failed = TRUE;
+                    break;
+                }
+                graph->pair      = grown;
+                graph->pair_size = size;
+            }
+            /* the signer's key ID, then the signee's node */
+            graph->pair[graph->pairs++] = get_be64 (sig.issuer);
+            graph->pair[graph->pairs++] = graph->current;
+            graph->certifications++;
+            break;
+        default:
+            break;
+    }
+    return !graph->failed;
+}
+
+static int compare_u64 (const void *a, const void *b)
+{
+uint64_t x = *(const uint64_t *)a;
+uint64_t y = *(const uint64_t *)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* wot_build                                                               */
+/* INPUTS: graph - the graph with its signer and signee pairs collected    */
+/* RETURN: FALSE if memory ran out                                         */
+/*                                                                         */
+/* Each pair becomes signer << 32 | signee, sorted and stripped of         */
+/* repeats, which is the out rows in order; the in rows are then filled    */
+/* by counting.                                                            */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t wot_build (struct wot_graph *graph)
+{
+uint64_t *edge = graph->pair;
+uint64_t  count = 0u;
+uint64_t  i;
+uint64_t *fill;
+uint32_t  signer;
+uint32_t  signee;
+uint32_t  n;
+
+    for (i = 0u; i < graph->pairs; i += 2u)
+    {
+        signer = wot_find (graph, graph->pair[i]);
+        if (signer == WOT_NONE)
+        {
+            graph->unknown++;
+            continue;
+        }
+        edge[count++] = ((uint64_t)signer << 32) | graph->pair[i + 1u];
+    }
+    if (count) qsort (edge, (size_t)count, sizeof(*edge), compare_u64);
+    graph->edges = 0u;
+    for (i = 0u; i < count; i++)
+    {
+        if (graph->edges && (edge[graph->edges - 1u] == edge[i])) continue;
+        edge[graph->edges++] = edge[i];
+    }
+
+    graph->out_start = calloc ((size_t)graph->nodes + 1u, sizeof(*graph->out_start));
+    graph->in_start  = calloc ((size_t)graph->nodes + 1u, sizeof(*graph->in_start));
+    graph->out       = malloc ((size_t)(graph->edges ? graph->edges : 1u) * sizeof(uint32_t));
+    graph->in        = malloc ((size_t)(graph->edges ? graph->edges : 1u) * sizeof(uint32_t));
+    fill             = calloc ((size_t)graph->nodes + 1u, sizeof(*fill));
+    if ((graph->out_start == NULL) || (graph->in_start == NULL) ||
+            (graph->out == NULL) || (graph->in == NULL) || (fill == NULL))
+    {
+        free (fill);
+        return FALSE;
+    }
+    for (i = 0u; i < graph->edges; i++)
+    {
+        signer = (uint32_t)(edge[i] >> 32);
+        signee = (uint32_t)edge[i];
+        graph->out[i] = signee;
+        graph->out_start[signer + 1u]++;
+        graph->in_start[signee + 1u]++;
+    }
+    for (n = 0u; n < graph->nodes; n++)
+    {
+        graph->out_start[n + 1u] += graph->out_start[n];
+        graph->in_start[n + 1u]  += graph->in_start[n];
+        fill[n] = graph->in_start[n];
+    }
+    for (i = 0u; i < graph->edges; i++)
+    {
+        signee = (uint32_t)edge[i];
+        graph->in[fill[signee]++] = (uint32_t)(edge[i] >> 32);
+    }
+    free (fill);
+    free (graph->pair);
+    graph->pair = NULL;
+    return TRUE;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* bfs_worker                                                              */
+/* INPUTS: arg - the search                                                */
+/* RETURN: NULL                                                            */
+/*                                                                         */
+/* Takes the frontier a chunk at a time. A node is put on the next         */
+/* frontier by whichever thread first swaps its level in; the thread       */
+/* gathers those it won and adds them to the next frontier in one go.      */
+/*                                                                         */
+/***************************************************************************/
+
+static void *bfs_worker (void *arg)
+{
+struct wot_bfs *bfs = arg;
+uint32_t found[WOT_CHUNK];
+uint32_t count = 0u;
+uint32_t first;
+uint32_t last;
+uint32_t expected;
+uint32_t pos;
+uint32_t u;
+uint32_t v;
+uint64_t e;
+
+    for (;;)
+    {
+        pthread_mutex_lock (&bfs->lock);
+        first       = bfs->taken;
+        bfs->taken += (first < bfs->frontier_len) ? WOT_CHUNK : 0u;
+        pthread_mutex_unlock (&bfs->lock);
+        if (first >= bfs->frontier_len) break;
+        last = (bfs->frontier_len - first > WOT_CHUNK) ? first + WOT_CHUNK :
+                                                         bfs->frontier_len;
+        for (; first < last; first++)
+        {
+            u = bfs->frontier[first];
+            for (e = bfs->start[u]; e < bfs->start[u + 1u]; e++)
+            {
+                v = bfs->adj[e];
+                if ((bfs->comp != NULL) && (bfs->comp[v] != WOT_NONE)) continue;
+                if (__atomic_load_n (&bfs->level[v], __ATOMIC_RELAXED) != WOT_NONE) continue;
+                expected = WOT_NONE;
+                if (!__atomic_compare_exchange_n (&bfs->level[v], &expected, bfs->depth + 1u,
+                                                  FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                {
+                    continue;
+                }
+                if (bfs->parent != NULL) bfs->parent[v] = u;
+                found[count++] = v;
+                if (count < WOT_CHUNK) continue;
+                pos = __atomic_fetch_add (&bfs->next_len, count, __ATOMIC_RELAXED);
+                memcpy (bfs->next + pos, found, count * sizeof(*found));
+                count = 0u;
+            }
+        }
+    }
+    if (count)
+    {
+        pos = __atomic_fetch_add (&bfs->next_len, count, __ATOMIC_RELAXED);
+        memcpy (bfs->next + pos, found, count * sizeof(*found));
+    }
+    return NULL;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* wot_bfs                                                                 */
+/* INPUTS: bfs - the search, with start, adj, comp and parent set and      */
+/*               level, frontier and next allocated for every node         */
+/*         source - where to search from                                   */
+/*         threads - most threads to use                                   */
+/* RETURN: the number of nodes reached, source included                    */
+/* OUTPUT: bfs->level - the distance of each node reached, WOT_NONE for    */
+/*                      the rest                                           */
+/*                                                                         */
+/* A level with a small frontier is done here; a thread that cannot be     */
+/* started leaves its share to the others.                                 */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t wot_bfs (struct wot_bfs *bfs, uint32_t nodes, uint32_t source,
+                         uint32_t threads)
+{
+pthread_t *thread;
+uint32_t  *swap;
+uint32_t   reached = 1u;
+uint32_t   wanted;
+uint32_t   started;
+uint32_t   i;
+
+    memset (bfs->level, 0xff, (size_t)nodes * sizeof(*bfs->level));
+    bfs->level[source] = 0u;
+    if (bfs->parent != NULL) bfs->parent[source] = WOT_NONE;
+    bfs->frontier[0]  = source;
+    bfs->frontier_len = 1u;
+    bfs->depth        = 0u;
+    thread = calloc (threads ? threads : 1u, sizeof(*thread));
+    while (bfs->frontier_len)
+    {
+        bfs->taken    = 0u;
+        bfs->next_len = 0u;
+        wanted  = (bfs->frontier_len + WOT_CHUNK - 1u) / WOT_CHUNK;
+        wanted  = (wanted < threads) ? wanted : threads;
+        started = 0u;
+        for (i = 1u; (thread != NULL) && (i < wanted); i++)
+        {
+            if (pthread_create (&thread[started], NULL, bfs_worker, bfs)) break;
+            started++;
+        }
+        bfs_worker (bfs);
+        for (i = 0u; i < started; i++)
+        {
+            pthread_join (thread[i], NULL);
+        }
+        reached          += bfs->next_len;
+        swap              = bfs->frontier;
+        bfs->frontier     = bfs->next;
+        bfs->next         = swap;
+        bfs->frontier_len = bfs->next_len;
+        bfs->depth++;
+    }
+    free (thread);
+    return reached;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* wot_tarjan                                                              */
+/* INPUTS: graph - the graph                                               */
+/*         comp - component of each node, WOT_NONE where not yet known     */
+/*         next_comp - the first free component number                     */
+/* RETURN: the next free component number, or WOT_NONE if memory ran out  */
+/*                                                                         */
+/* Tarjan's algorithm, with its own stack in place of recursion. Nodes     */
+/* already in a component are left out, which is safe as each of those    */
+/* components is whole.                                                    */
+/*                                                                         */
+/***************************************************************************/
+
+static uint32_t wot_tarjan (const struct wot_graph *graph, uint32_t *comp,
+                            uint32_t next_comp)
+{
+uint32_t *index = malloc ((size_t)graph->nodes * sizeof(uint32_t));
+uint32_t *low   = malloc ((size_t)graph->nodes * sizeof(uint32_t));
+uint32_t *stack = malloc ((size_t)graph->nodes * sizeof(uint32_t));
+uint32_t *call  = malloc ((size_t)graph->nodes * sizeof(uint32_t));
+uint64_t *at    = malloc ((size_t)graph->nodes * sizeof(uint64_t));
+uint32_t  counter = 0u;
+uint32_t  depth = 0u;
+uint32_t  top = 0u;
+uint32_t  root;
+uint32_t  v;
+uint32_t  w;
+
+    if ((index == NULL) || (low == NULL) || (stack == NULL) || (call == NULL) ||
+            (at == NULL))
+    {
+        next_comp = WOT_NONE;
+        goto done;
+    }
+    memset (index, 0xff, (size_t)graph->nodes * sizeof(uint32_t));
+    for (root = 0u; root < graph->nodes; root++)
+    {
+        if ((comp[root] != WOT_NONE) || (index[root] != WOT_NONE)) continue;
+        index[root]   = low[root] = counter++;
+        at[root]      = graph->out_start[root];
+        stack[top++]  = root;
+        call[depth++] = root;
+        while (depth)
+        {
+            v = call[depth - 1u];
+            if (at[v] < graph->out_start[v + 1u])
+            {
+                w = graph->out[at[v]++];
+                if (comp[w] != WOT_NONE) continue;
+                if (index[w] == WOT_NONE)
+                {
+                    index[w]      = low[w] = counter++;
+                    at[w]         = graph->out_start[w];
+                    stack[top++]  = w;
+                    call[depth++] = w;
+                }
+                else if (index[w] < low[v])
+                {
+                    /* w is still on the stack, as it has no component yet */
+                    low[v] = index[w];
+                }
+                continue;
+            }
+            depth--;
+            if (depth && (low[v] < low[call[depth - 1u]])) low[call[depth - 1u]] = low[v];
+            if (low[v] != index[v]) continue;
+            do
+            {
+                w       = stack[--top];
+                comp[w] = next_comp;
+            } while (w != v);
+            next_comp++;
+        }
+    }
+
+done:
+    free (index);
+    free (low);
+    free (stack);
+    free (call);
+    free (at);
+    return next_comp;
+}
+
+static void print_keyid (FILE *out, uint64_t keyid)
+{
+    fprintf (out, "%016llX", (unsigned long long)keyid);
+}
+
+static int by_size (const void *a, const void *b)
+{
+uint32_t x = *(const uint32_t *)a;
+uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) ? -1 : (x < y);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* wot_components                                                          */
+/* INPUTS: graph - the graph                                               */
+/*         bfs - buffers for a search                                      */
+/*         threads - most threads to use                                   */
+/*         comp - for the component of each node                           */
+/*         out_name - file for the key IDs of the strong set, or NULL      */
+/* RETURN: FALSE on trouble                                                */
+/*                                                                         */
+/***************************************************************************/
+
+static uint8_t wot_components (const struct wot_graph *graph, struct wot_bfs *bfs,
+                               uint32_t threads, uint32_t *comp, const char *out_name)
+{
+uint32_t *forward = NULL;
+uint32_t *size = NULL;
+uint64_t  best = 0u;
+uint64_t  weight;
+uint32_t  pivot = WOT_NONE;
+uint32_t  comps = 0u;
+uint32_t  alone = 0u;
+uint32_t  giant = 0u;
+uint32_t  n;
+uint8_t   ok = FALSE;
+FILE     *out;
+
+    if (graph->nodes == 0u) return TRUE;
+    memset (comp, 0xff, (size_t)graph->nodes * sizeof(*comp));
+    for (n = 0u; n < graph->nodes; n++)
+    {
+        if ((graph->out_start[n] == graph->out_start[n + 1u]) ||
+                (graph->in_start[n] == graph->in_start[n + 1u]))
+        {
+            comp[n] = comps++;
+            continue;
+        }
+        weight = (graph->out_start[n + 1u] - graph->out_start[n]) *
+                 (graph->in_start[n + 1u] - graph->in_start[n]);
+        if (weight > best)
+        {
+            best  = weight;
+            pivot = n;
+        }
+    }
+
+    if (pivot != WOT_NONE)
+    {
+        /* what both searches reach is the pivot's component */
+        forward = malloc ((size_t)graph->nodes * sizeof(*forward));
+        if (forward == NULL) goto done;
+        bfs->start = graph->out_start;
+        bfs->adj   = graph->out;
+        bfs->comp  = comp;
+        wot_bfs (bfs, graph->nodes, pivot, threads);
+        memcpy (forward, bfs->level, (size_t)graph->nodes * sizeof(*forward));
+        bfs->start = graph->in_start;
+        bfs->adj   = graph->in;
+        wot_bfs (bfs, graph->nodes, pivot, threads);
+        for (n = 0u; n < graph->nodes; n++)
+        {
+            if ((forward[n] != WOT_NONE) && (bfs->level[n] != WOT_NONE)) comp[n] = comps;
+        }
+        giant = comps++;
+        comps = wot_tarjan (graph, comp, comps);
+        if (comps == WOT_NONE) goto done;
+    }
+
+    size = calloc (comps, sizeof(*size));
+    if (size == NULL) goto done;
+    for (n = 0u; n < graph->nodes; n++)
+    {
+        size[comp[n]]++;
+    }
+    for (n = 0u; n < comps; n++)
+    {
+        alone += (size[n] == 1u);
+    }
+    printf ("strongly connected components: %u, of one key: %u\n", comps, alone);
+    if (pivot != WOT_NONE)
+    {
+        printf ("largest strong set: %u keys, including ", size[giant]);
+        print_keyid (stdout, graph->keyid[pivot]);
+        printf ("\n");
+    }
+    if (out_name != NULL)
+    {
+        out = fopen (out_name, "w");
+        if (out == NULL)
+        {
+            fprintf (stderr, "%s: cannot create\n", out_name);
+            goto done;
+        }
+        for (n = 0u; (pivot != WOT_NONE) && (n < graph->nodes); n++)
+        {
+            if (comp[n] != giant) continue;
+            print_keyid (out, graph->keyid[n]);
+            fprintf (out, "\n");
+        }
+        if (fclose (out))
+        {
+            fprintf (stderr, "%s: write failed\n", out_name);
+            goto done;
+        }
+    }
+    qsort (size, comps, sizeof(*size), by_size);
+    printf ("largest components:");
+    for (n = 0u; (n < comps) && (n < WOT_SHOWN); n++)
+    {
+        printf (" %u", size[n]);
+    }
+    printf ("\n");
+    ok = TRUE;
+
+done:
+    free (forward);
+    free (size);
+    return ok;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* wot_paths                                                               */
+/* INPUTS: graph - the graph                                               */
+/*         bfs - buffers for a search                                      */
+/*         threads - most threads to use                                   */
+/*         keys - key IDs or fingerprints: where to start, then where to  */
+/*                go                                                       */
+/*         key_count - how many                                            */
+/* RETURN: 0 if every path was found, 1 if not, 2 on a bad key             */
+/*                                                                         */
+/* A path runs from a key through keys each certified by the one before.   */
+/* With no key to go to, the keys reached at each distance are counted.    */
+/*                                                                         */
+/***************************************************************************/
+
+static int wot_paths (const struct wot_graph *graph, struct wot_bfs *bfs,
+                      uint32_t threads, char **keys, uint32_t key_count)
+{
+uint8_t   id[PKT_MAX_FPR];
+uint8_t   id_len;
+uint32_t *node;
+uint32_t *at_depth;
+uint32_t *path = NULL;
+uint64_t  total = 0u;
+uint32_t  reached;
+uint32_t  deepest = 0u;
+uint32_t  step;
+uint32_t  i;
+uint32_t  v;
+int       rc = 0;
+
+    node = calloc (key_count, sizeof(*node));
+    if (node == NULL) return (2u);
+    for (i = 0u; i < key_count; i++)
+    {
+        if (!parse_key_id (keys[i], id, &id_len))
+        {
+            fprintf (stderr, "%s: not a key ID or fingerprint\n", keys[i]);
+            free (node);
+            return (2u);
+        }
+        /* v4 key IDs are the tail of the fingerprint, v6 the head */
+        node[i] = wot_find (graph, get_be64 ((id_len == 20u) ? id + 12 : id));
+        if (node[i] == WOT_NONE)
+        {
+            fprintf (stderr, "%s: not in the file\n", keys[i]);
+            free (node);
+            return (2u);
+        }
+    }
+
+    bfs->start  = graph->out_start;
+    bfs->adj    = graph->out;
+    bfs->comp   = NULL;
+    reached     = wot_bfs (bfs, graph->nodes, node[0], threads);
+    path        = malloc (((size_t)bfs->depth + 1u) * sizeof(*path));
+    if (path == NULL)
+    {
+        free (node);
+        return (2u);
+    }
+    if (key_count == 1u)
+    {
+        at_depth = calloc ((size_t)bfs->depth + 1u, sizeof(*at_depth));
+        for (v = 0u; (at_depth != NULL) && (v < graph->nodes); v++)
+        {
+            if (bfs->level[v] == WOT_NONE) continue;
+            at_depth[bfs->level[v]]++;
+            total += bfs->level[v];
+            if (bfs->level[v] > deepest) deepest = bfs->level[v];
+        }
+        print_keyid (stdout, graph->keyid[node[0]]);
+        printf (" reaches %u keys, mean distance %.4f\n", reached - 1u,
+                (reached > 1u) ? (double)total / (reached - 1u) : 0.0);
+        for (v = 1u; (at_depth != NULL) && (v <= deepest); v++)
+        {
+            printf ("  distance %u: %u\n", v, at_depth[v]);
+        }
+        free (at_depth);
+    }
+    for (i = 1u; i < key_count; i++)
+    {
+        print_keyid (stdout, graph->keyid[node[0]]);
+        printf (" -> ");
+        print_keyid (stdout, graph->keyid[node[i]]);
+        if (bfs->level[node[i]] == WOT_NONE)
+        {
+            printf (": no path\n");
+            rc = 1;
+            continue;
+        }
+        printf (": %u step%s\n", bfs->level[node[i]],
+                (bfs->level[node[i]] == 1u) ? "" : "s");
+
+        /* the parents lead back from the end */
+        step = node[i];
+        for (v = bfs->level[node[i]] + 1u; v-- > 0u;)
+        {
+            path[v] = step;
+            step    = bfs->parent[step];
+        }
+        for (v = 0u; v <= bfs->level[node[i]]; v++)
+        {
+            printf ("  ");
+            print_keyid (stdout, graph->keyid[path[v]]);
+            printf ("\n");
+        }
+    }
+    free (path);
+    free (node);
+    return rc;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* wot_keyring                                                             */
+/* INPUTS: name - the keyring, or - for standard input                     */
+/*         keys - with one key, count the keys it reaches; with more, the  */
+/*                shortest path from the first to each other              */
+/*         key_count - how many                                            */
+/*         out_name - file for the key IDs of the strong set, or NULL      */
+/*         threads - worker threads                                        */
+/* RETURN: 0, 1 if a path was not found, 2 on trouble                      */
+/*                                                                         */
+/***************************************************************************/
+
+extern int wot_keyring (const char *name, char **keys, uint32_t key_count,
+                        const char *out_name, uint32_t threads)
+{
+struct wot_graph graph;
+struct wot_bfs   bfs;
+struct source   *src;
+uint32_t *comp = NULL;
+uint32_t  signers = 0u;
+uint32_t  n;
+int       rc = 2;
+
+    memset (&graph, 0, sizeof(graph));
+    memset (&bfs, 0, sizeof(bfs));
+    graph.current = WOT_NONE;
+    src = source_open (name);
+    if (src == NULL)
+    {
+        fprintf (stderr, "%s: cannot open\n", name);
+        return (2u);
+    }
+    if (!keyring_walk (src, 0u, wot_collect, &graph) || graph.failed)
+    {
+        fprintf (stderr, "%s: %s\n", name, graph.failed ? "out of memory" :
+                                                        "damaged packet");
+        goto done;
+    }
+    if (!wot_build (&graph))
+    {
+        fprintf (stderr, "%s: out of memory\n", name);
+        goto done;
+    }
+    for (n = 0u; n < graph.nodes; n++)
+    {
+        signers += (graph.out_start[n] != graph.out_start[n + 1u]);
+    }
+    printf ("keys: %u, certifying others: %u\n", graph.nodes, signers);
+    printf ("certifications: %llu, by keys not in the file: %llu, edges: %llu\n",
+            (unsigned long long)graph.certifications, (unsigned long long)graph.unknown,
+            (unsigned long long)graph.edges);
+
+    if (threads < 1u) threads = 1u;
+    pthread_mutex_init (&bfs.lock, NULL);
+    comp         = malloc (((size_t)graph.nodes + 1u) * sizeof(*comp));
+    bfs.level    = malloc (((size_t)graph.nodes + 1u) * sizeof(*bfs.level));
+    bfs.parent   = malloc (((size_t)graph.nodes + 1u) * sizeof(*bfs.parent));
+    bfs.frontier = malloc (((size_t)graph.nodes + 1u) * sizeof(*bfs.frontier));
+    bfs.next     = malloc (((size_t)graph.nodes + 1u) * sizeof(*bfs.next));
+    if ((comp == NULL) || (bfs.level == NULL) || (bfs.parent == NULL) ||
+            (bfs.frontier == NULL) || (bfs.next == NULL))
+    {
+        fprintf (stderr, "%s: out of memory\n", name);
+    }
+    else if (wot_components (&graph, &bfs, threads, comp, out_name))
+    {
+        rc = key_count ? wot_paths (&graph, &bfs, threads, keys, key_count) : 0;
+    }
+    pthread_mutex_destroy (&bfs.lock);
+
+done:
+    fflush (stdout);
+    source_close (src);
+    free (comp);
+    free (bfs.level);
+    free (bfs.parent);
+    free (bfs.frontier);
+    free (bfs.next);
+    free (graph.keyid);
+    free (graph.slot);
+    free (graph.pair);
+    free (graph.out_start);
+    free (graph.out);
+    free (graph.in_start);
+    free (graph.in);
+    return rc;
+}